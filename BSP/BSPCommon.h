@@ -86,6 +86,14 @@ namespace BSP {
     //  into real bsp space from rendering bsp space
     const float REVERSE_SCALE = 1.0 / MAP_SCALE;
 
+    // The TexInfo flags of surfaces that don't hide what is behind them: the
+    //  sky, water and lava, see-through surfaces, and surfaces that aren't drawn
+    const unsigned int SURFACE_SKY = 0x4;
+    const unsigned int SURFACE_WARP = 0x8;
+    const unsigned int SURFACE_TRANS33 = 0x10;
+    const unsigned int SURFACE_TRANS66 = 0x20;
+    const unsigned int SURFACE_NODRAW = 0x80;
+
 
     /**
      * Lump structure:
@@ -230,11 +238,6 @@ namespace BSP {
         unsigned int    type;        // ?
 
     } Plane;
-
-    // These structures make a set of indices into a vertex array for the faces
-    // which are drawn by the BSPMap class.
-    typedef vector< LeafFace > ClusterLeaf;
-    typedef vector< ClusterLeaf > Cluster;
 };
 
 #endif
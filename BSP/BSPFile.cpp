@@ -0,0 +1,118 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "BSPFile.h"
+
+
+/**
+ * Constructor prepares the object so that a file can be opened.
+ */
+BSPFile::BSPFile() {
+    // The VirtualFile prepares itself
+};
+
+/**
+ * Destructor makes sure that the file has been unmapped and closed.
+ */
+BSPFile::~BSPFile() {
+    close();
+};
+
+
+/**
+ * open() maps the .bsp file fileName (e.g. "maps/base1.bsp") into memory
+ * and checks its header.
+ * Returns false if the file could not be found or mapped, or if the
+ * file is not a valid Quake 2 .bsp map.
+ */
+bool BSPFile::open( std::string fileName ) {
+
+    // Only one file can be mapped at a time
+    close();
+
+    // Map the file. A loose file is mapped to be read from front to back.
+    if ( !file.open( fileName ) ) {
+        return false;
+    }
+
+    // A file that is too small to hold a header can't be a map
+    if ( file.getSize() < sizeof( BSP::Header ) ) {
+        close();
+        return false;
+    }
+
+    // Make sure that the file actually is a map before anyone uses it
+    if ( !validateHeader() ) {
+        close();
+        return false;
+    }
+
+    return true;
+};
+
+/**
+ * close() unmaps the file. Any pointers that were handed out by this
+ * object are no longer valid after close() is called.
+ */
+void BSPFile::close() {
+    file.close();
+};
+
+
+/**
+ * Returns a pointer to the first byte of lump #lumpNum, or NULL if
+ * no file is open. The data is read-only - it must never be written to.
+ */
+unsigned char *BSPFile::getLump( int lumpNum ) {
+    if ( !file.isOpen() || lumpNum < 0 || lumpNum >= BSP_NUM_LUMPS ) {
+        return NULL;
+    }
+
+    return file.getData() + getHeader()->lump[ lumpNum ].offset;
+};
+
+/**
+ * Returns the length (in bytes) of lump #lumpNum
+ */
+int BSPFile::getLumpLength( int lumpNum ) {
+    if ( !file.isOpen() || lumpNum < 0 || lumpNum >= BSP_NUM_LUMPS ) {
+        return 0;
+    }
+
+    return getHeader()->lump[ lumpNum ].length;
+};
+
+
+/**
+ * Checks the header to make sure that the mapped file is a Quake 2 map,
+ * and that every lump lies within the file.
+ */
+bool BSPFile::validateHeader() {
+    BSP::Header *header = getHeader();
+    unsigned int fileSize = file.getSize();
+
+    // Check the identifying number and the version of the map
+    if ( header->magic != BSP_MAGIC || header->version != BSP_VERSION ) {
+        return false;
+    }
+
+    // Check that each lump starts and ends inside of the file. The lengths
+    // are compared without adding them to the offsets so they can't overflow.
+    for ( int i = 0; i < BSP_NUM_LUMPS; ++i ) {
+        int offset = header->lump[ i ].offset;
+        int length = header->lump[ i ].length;
+
+        if ( offset < 0 || length < 0 ) {
+            return false;
+        }
+        if ( ( unsigned int ) offset > fileSize || ( unsigned int ) length > fileSize - offset ) {
+            return false;
+        }
+    }
+
+    return true;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
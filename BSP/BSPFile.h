@@ -0,0 +1,118 @@
+//---------------------------------------------------------------------------
+
+#ifndef BSPFileH
+#define BSPFileH
+
+#include <windows.h>
+#include <string>
+
+#include "BSPCommon.h"
+#include "FileSystem.h"
+
+// The identifying number at the start of every Quake 2 .bsp file ("IBSP")
+#define BSP_MAGIC ( ( 'P' << 24 ) + ( 'S' << 16 ) + ( 'B' << 8 ) + 'I' )
+
+// The version number of a Quake 2 .bsp file
+#define BSP_VERSION 38
+
+// The number of lumps in the header of a Quake 2 .bsp file
+#define BSP_NUM_LUMPS 19
+
+/**
+ * The BSPFile class maps an entire .bsp file into memory, instead of reading
+ * each lump with fseek() and fread(). The header is checked once, when the file
+ * is opened, so that every lump lies inside of the file. After that, the lumps
+ * are handed out as pointers straight into the mapped file, so no lump data is
+ * ever copied.
+ *
+ * The mapping is read-only, so its pages come straight out of the system file
+ * cache. Loading the same map twice doesn't touch the disk the second time.
+ * The file is found through the FileSystem, so a map in a .pak file is used
+ * straight out of the .pak file's mapping.
+ *
+ * The BSPFile has to stay open for as long as anything is using its lumps.
+ */
+class BSPFile {
+    public:
+
+        /**
+         * Constructor prepares the object so that a file can be opened.
+         */
+        BSPFile();
+
+        /**
+         * Destructor makes sure that the file has been unmapped and closed.
+         */
+        ~BSPFile();
+
+        /**
+         * open() maps the .bsp file fileName (e.g. "maps/base1.bsp") into memory
+         * and checks its header.
+         * Returns false if the file could not be found or mapped, or if the
+         * file is not a valid Quake 2 .bsp map.
+         */
+        bool open( std::string fileName );
+
+        /**
+         * close() unmaps the file. Any pointers that were handed out by this
+         * object are no longer valid after close() is called.
+         */
+        void close();
+
+        /**
+         * Returns true if a file is currently mapped
+         */
+        bool isOpen() {
+            return file.isOpen();
+        };
+
+        /**
+         * Returns the header at the start of the mapped .bsp file
+         */
+        BSP::Header *getHeader() {
+            return ( BSP::Header * ) file.getData();
+        };
+
+        /**
+         * Returns a pointer to the first byte of lump #lumpNum, or NULL if
+         * no file is open. The data is read-only - it must never be written to.
+         */
+        unsigned char *getLump( int lumpNum );
+
+        /**
+         * Returns the length (in bytes) of lump #lumpNum
+         */
+        int getLumpLength( int lumpNum );
+
+        /**
+         * Return the size of the .bsp file in bytes, and the time that it was
+         * last written to. These tell a map cache whether it was made from
+         * this version of the file.
+         */
+        unsigned int getFileSize() {
+            return file.getSize();
+        };
+        FILETIME getWriteTime() {
+            return file.getWriteTime();
+        };
+
+        /**
+         * touchPages() reads the whole file into the system file cache
+         */
+        void touchPages() {
+            file.touchPages();
+        };
+
+    private:
+
+        // Checks the header to make sure that the mapped file is a Quake 2 map,
+        // and that every lump lies within the file.
+        bool validateHeader();
+
+        // The mapped .bsp file
+        VirtualFile file;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -29,11 +29,25 @@ BSPMap::BSPMap() {
 
     ddsTexture = NULL;
 
+    // Nothing is being loaded yet
+    loading = false;
+    loadConsole = NULL;
+
     // Use lightmaps as default
     lMap = 0;
+
+    // Draw every cluster when the camera is outside of the map
+    outsideUsesNearestCluster = false;
 }
 
 
+// Maps use full vertices unless compact vertices are asked for
+bool BSPMap::useCompactVertices = false;
+
+// The WAL images that every map shares
+TextureCache BSPMap::textureCache;
+
+
 /**
  * Class Destructor makes sure all of the memory allocated by the class
  * is deleted.
@@ -56,6 +70,9 @@ BSPMap::~BSPMap() {
  */
 void BSPMap::unload( D3DContext *d3d, Console *console ) {
 
+    // Stop loading the map, if it is still being loaded
+    cancelLoad();
+
     // Tell the user that we are deleting Textures
     d3d->clearScreen();
     d3d->getDevice()->BeginScene();
@@ -64,6 +81,11 @@ void BSPMap::unload( D3DContext *d3d, Console *console ) {
     d3d->getDevice()->EndScene();
     d3d->updateScreen();
 
+    // The draw list uses the textures, vertices and lightmaps, so it goes first
+    drawList.unload();
+    occlusion.unload();
+    visibleSet.unload();
+
     // Delete the texture information.
     if ( texInfo != NULL ) {
         delete texInfo;
@@ -135,6 +157,9 @@ void BSPMap::unload( D3DContext *d3d, Console *console ) {
         bspTree = NULL;
     }
 
+    // Nothing is using the map's lumps anymore, so the .bsp file can be unmapped
+    mapFile.close();
+
     // delete the skybox object
     if ( skyBox != NULL ) {
         delete skyBox;
@@ -167,6 +192,14 @@ void BSPMap::unload( D3DContext *d3d, Console *console ) {
  *  of the map's information.
  */
 void BSPMap::unload() {
+    // Stop loading the map, if it is still being loaded
+    cancelLoad();
+
+    // The draw list uses the textures, vertices and lightmaps, so it goes first
+    drawList.unload();
+    occlusion.unload();
+    visibleSet.unload();
+
     // Delete the textures
     if ( texInfo != NULL ) {
         delete texInfo;
@@ -197,6 +230,9 @@ void BSPMap::unload() {
         bspTree = NULL;
     }
 
+    // Unmap the .bsp file now that nothing is using its lumps
+    mapFile.close();
+
     // Delete the map's pixel shader
     if ( mapShader != NULL ) {
         delete mapShader;
@@ -216,13 +252,23 @@ void BSPMap::unload() {
 };
 
 
+/**
+ * unloadTextureCache() deletes every image in the shared texture cache.
+ * It is called once every map has been deleted.
+ */
+void BSPMap::unloadTextureCache() {
+    textureCache.unload();
+};
+
+
 /**
  * load() routine:
  *  - fileName: the name of the .bsp file to be loaded, without its
  *      directory or file extension.
  *  - d3d: A pointer to a Direct3D Context object. This is needed in order
  *      to inform the user of the loading process because the console cannot
- *      be drawn without this object.
+ *      be drawn without this object. If it is NULL, the map is loaded
+ *      without Direct3D (see startLoad()), and nothing is drawn.
  *  - camera: A pointer to a camera object. After loading in the map, the
  *      position of the camera is found from a special entity in the map's
  *      entity lump.
@@ -235,20 +281,72 @@ void BSPMap::unload() {
  */
 bool BSPMap::load( std::string fileName, D3DContext *d3d, Camera *camera, Console *console ) {
 
-    // Our base file object
-	FILE *file = NULL;
+    // Start the loading tasks. If the map file can't be opened, return false
+    if ( !startLoad( fileName, d3d, console ) ) {
+        return false;
+    }
+
+    // Tell the user that the map is being loaded
+    if ( d3d != NULL ) {
+        d3d->clearScreen();
+        d3d->getDevice()->BeginScene();
+            console->render();
+        d3d->getDevice()->EndScene();
+        d3d->updateScreen();
+    }
+
+    // Run the render tasks as they become ready, until the map has loaded
+    while ( !updateLoad( INFINITE ) ) {
+        loadGraph.wait();
+    }
+
+    // Set the camera's position to where the player appears in the map
+    placeCamera( camera );
+
+    // Tell the user what was loaded, and how long each part took
+    if ( d3d != NULL ) {
+        d3d->clearScreen();
+        d3d->getDevice()->BeginScene();
+            console->render();
+        d3d->getDevice()->EndScene();
+        d3d->updateScreen();
+    }
+
+    // Loading was successful!
+	return true;
+}
+
+
+/**
+ * startLoad() routine:
+ *  - fileName: the name of the .bsp file to be loaded, without its
+ *      directory or file extension.
+ *  - d3d: A pointer to a Direct3D Context object. The render tasks use its
+ *      device. If it is NULL, the textures, buffers, skybox and shader aren't
+ *      made, but everything that culling and the draw list need is loaded, so
+ *      the map can be drawn into a RecordingRenderDevice.
+ *  - console: A pointer to a Console object, which the map reports to while
+ *      it is loading.
+ *
+ * startLoad() opens the map file and starts loading the map on the worker
+ * threads, then returns straight away. updateLoad() must then be called, on
+ * the same thread, until it returns true.
+ *
+ * startLoad() returns false if the map file was not found.
+ */
+bool BSPMap::startLoad( std::string fileName, D3DContext *d3d, Console *console ) {
 
     // add in the directory and file extension to the map name
-    fileName = string( "Q2/maps/" ) + fileName + string( ".bsp" );
+    fileName = string( "maps/" ) + fileName + string( ".bsp" );
 
     // Tell the user that we are loading that bsp file
     console->printMessage( "Loading " + fileName, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
 
 
-    // open the .bsp file for loading. If opening fails, return false
-	if ( ( file = fopen( fileName.c_str(), "rb" ) ) == NULL ) {
+    // map the .bsp file into memory and check its header. If that fails, return false
+	if ( !mapFile.open( fileName ) ) {
         // Tell the user that the map was not found
-        console->printMessage( "BSP Map file was not found.", D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
+        console->printMessage( "BSP Map file was not found, or is not a Quake 2 map.", D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
 		return false;
 	}
 
@@ -259,131 +357,398 @@ bool BSPMap::load( std::string fileName, D3DContext *d3d, Camera *camera, Consol
     lightMaps = new LightMapInfo();
     bspTree = new BSPTree::Tree();
 
-    // Create the Pixel shader object
+    // Create the Pixel shader object and the skybox
     mapShader = new D3D::Shader();
+    skyBox = new SkyBox();
 
+    // Open the map cache beside the .bsp file. If it is there and up to date,
+    // the faces, lightmaps and BSP tree are copied out of it instead of being
+    // built again.
+    loadCacheName = MapCache::getCacheName( fileName );
+    MapCache *openCache = loadCache.open( loadCacheName, &mapFile ) ? &loadCache : NULL;
+
+    // The state that the loading tasks share
+    loadState.map = this;
+    loadState.device = ( d3d != NULL ) ? d3d->getDevice() : NULL;
+    loadState.cache = openCache;
+    loadState.facesCached = false;
+    loadState.treeCached = false;
+    loadState.nextImage = 0;
+
+    loadConsole = console;
+
+    // The parts of the map are loaded by a graph of tasks, on one worker
+    // thread for each processor. A task only starts once the tasks that it
+    // depends on are done:
+    //  - The faces need the sizes of the textures, and the lightmap lump.
+    //  - The visible sets need the faces and the BSP tree.
+    //  - The skybox needs the name out of the entities.
+    // Everything that uses Direct3D is a render task, which is run on the
+    // thread that calls updateLoad().
+    int numThreads = TaskGraph::getNumProcessors();
+    loadGraph.clear();
+
+    int lightMapsTask = loadGraph.addTask( "Lightmaps", loadLightMapsTask, &loadState, false );
+    int acquireTask = loadGraph.addTask( "Texture names", acquireTexturesTask, &loadState, false );
+
+    // The textures that aren't in the texture cache yet are read in by one
+    // task on each thread
+    vector< int > readTasks;
+    for ( int i = 0; i < numThreads; ++i ) {
+        readTasks.push_back( loadGraph.addTask( "Read textures", readTexturesTask, &loadState, false ) );
+        loadGraph.addDependency( readTasks.back(), acquireTask );
+    }
 
-    // read in the header
-	fread( &header, sizeof( header ), 1, file );
+    int texturesTask = loadGraph.addTask( "Upload textures", createTexturesTask, &loadState, true );
+    int facesTask = loadGraph.addTask( "Faces", loadFacesTask, &loadState, false );
+    loadGraph.addDependency( facesTask, lightMapsTask );
 
-    // Tell the user that we are loading in the lightmaps section
-    d3d->getDevice()->BeginScene();
-        console->printMessage( "Loading Lightmaps... ", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-    d3d->getDevice()->EndScene();
-    d3d->updateScreen();
+    for ( unsigned int i = 0; i < readTasks.size(); ++i ) {
+        loadGraph.addDependency( texturesTask, readTasks[ i ] );
+        loadGraph.addDependency( facesTask, readTasks[ i ] );
+    }
 
-    // Load in the lightmaps
-    lightMaps->load( &header, file );
+    int faceBuffersTask = loadGraph.addTask( "Upload faces", createFaceBuffersTask, &loadState, true );
+    loadGraph.addDependency( faceBuffersTask, facesTask );
 
+    int treeTask = loadGraph.addTask( "BSP tree", loadTreeTask, &loadState, false );
+    int entitiesTask = loadGraph.addTask( "Entities", loadEntitiesTask, &loadState, false );
 
-    // Tell the user that we just loaded in the lightmaps section
-    // Also, tell the user that we are loading in the Textures
-    d3d->clearScreen();
-    d3d->getDevice()->BeginScene();
-        console->printMessage( "Lightmaps Loaded!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
-        console->printMessage( "Loading Textures... ", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-        console->render();
-    d3d->getDevice()->EndScene();
-    d3d->updateScreen();
+    int skyBoxTask = loadGraph.addTask( "Sky box", loadSkyBoxTask, &loadState, true );
+    loadGraph.addDependency( skyBoxTask, entitiesTask );
 
-    // load in the textures
-    texInfo->load( &header, file, d3d->getDevice() );
+    int visibilityTask = loadGraph.addTask( "Visible sets", loadVisibilityTask, &loadState, false );
+    loadGraph.addDependency( visibilityTask, facesTask );
+    loadGraph.addDependency( visibilityTask, treeTask );
 
-    // Tell the user that we just loaded in the textures
-    // Also, tell the user that we are loading in the Vertex Information
-    d3d->clearScreen();
-    d3d->getDevice()->BeginScene();
-        console->printMessage( "Textures Loaded!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
+    int drawListTask = loadGraph.addTask( "Draw list", loadDrawListTask, &loadState, true );
+    loadGraph.addDependency( drawListTask, facesTask );
 
-        console->printMessage( "Loading Vertex Information... ", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-        console->render();
-    d3d->getDevice()->EndScene();
-    d3d->updateScreen();
+    int shaderTask = loadGraph.addTask( "Shader", loadShaderTask, &loadState, true );
+    loadGraph.addDependency( shaderTask, faceBuffersTask );
 
-    // load in the vertex information
-    faceInfo->load( &header, file, texInfo, lightMaps, d3d->getDevice() );
+    // Textures that the last map also used are still in the texture cache,
+    // so they don't have to be loaded again.
+    textureCache.resetCounts();
 
-    // Tell the user that we just loaded in the vertex information
-    // Also, tell the user that we are loading in the BSP tree
-    d3d->clearScreen();
-    d3d->getDevice()->BeginScene();
-        console->printMessage( "Vertex Information Loaded!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
+    loadGraph.start( numThreads );
+    loading = true;
 
-        console->printMessage( "Loading Binary Space Partitioning Tree... ", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-        console->render();
-    d3d->getDevice()->EndScene();
-    d3d->updateScreen();
+    char buf[ 128 ];
+    sprintf( buf, "Loading the map on %d worker threads... ", numThreads );
+    console->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
 
-    // load in the BSP Tree
-    bspTree->load( &header, file );
+    return true;
+}
 
-    // Tell the user that we just loaded in the BSP Tree
-    // Also, tell the user that we are loading in the map Entities
-    d3d->clearScreen();
-    d3d->getDevice()->BeginScene();
-        console->printMessage( "Binary Space Partitioning Tree Loaded!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
 
-        console->printMessage( "Loading Map Entities... ", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-        console->render();
-    d3d->getDevice()->EndScene();
-    d3d->updateScreen();
+/**
+ * updateLoad() runs the render tasks of the map that are ready, for up to
+ * maxMillis (a single task can take longer). Once every task has finished,
+ * the map is finished off and updateLoad() returns true. It keeps returning
+ * true until the next map is loaded.
+ */
+bool BSPMap::updateLoad( unsigned int maxMillis ) {
+    if ( !loading ) {
+        return true;
+    }
 
-    // load in the map entities
-    entities->load( &header, file );
+    if ( !loadGraph.runRenderTasks( maxMillis ) ) {
+        return false;
+    }
 
-    // Tell the user that we just loaded in the map entities
-    // Also, tell the user that we just completed loading the entire .bsp map
-    d3d->clearScreen();
-    d3d->getDevice()->BeginScene();
-        console->printMessage( "Map Entities Loaded!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
-        console->printMessage( "Map Finished Loading!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
-        console->printMessage( "------------------------", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-        console->render();
-    d3d->getDevice()->EndScene();
-    d3d->updateScreen();
+    loading = false;
+    finishLoad();
 
-    // Create the skybox and get the name of the skybox
-    skyBox = new SkyBox();
-    char *skyboxName = entities->getSkyBoxName();
+    return true;
+}
+
+
+/**
+ * cancelLoad() stops loading the map. The tasks that are running are
+ * finished first, so this can take as long as the slowest task. The map must
+ * then be unloaded.
+ */
+void BSPMap::cancelLoad() {
+    if ( !loading ) {
+        return;
+    }
+
+    loadGraph.cancel();
+    loadCache.close();
+    loading = false;
+}
+
+
+/**
+ * placeCamera() sets the camera's position to where the player appears in
+ * the map
+ */
+void BSPMap::placeCamera( Camera *camera ) {
+    entities->setCameraPos( camera );
+}
+
+
+/**
+ * finishLoad() is called once every loading task has finished. It writes
+ * the map cache, and tells the user what was loaded.
+ */
+void BSPMap::finishLoad() {
+
+    // Everything has been copied out of the cache
+    loadCache.close();
+
+    // If the map had to be built, write it out so that the next load is faster.
+    // A cache that only had some good parts is deleted instead, since the
+    // lightmap pixels that came out of it have already gone to Direct3D. It
+    // will be written again on the next load.
+    if ( !loadState.facesCached && !loadState.treeCached ) {
+        MapCacheWriter writer;
+        faceInfo->saveCache( &writer );
+        lightMaps->saveCache( &writer );
+        bspTree->saveCache( &writer );
+
+        if ( writer.write( loadCacheName, &mapFile ) ) {
+            loadConsole->printMessage( "Map cache written to " + loadCacheName, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+        }
+    } else if ( !loadState.facesCached || !loadState.treeCached ) {
+        FileSystem::getGameFiles()->removeFile( loadCacheName );
+    } else {
+        loadConsole->printMessage( "Map loaded from " + loadCacheName, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+    }
+
+    // The lightmap pixels aren't needed now that the pages are in Direct3D
+    lightMaps->releasePixels();
+
+    vsTest = 0.0;
+
+    if ( ddsTexture == NULL && loadState.device != NULL ) {
+        D3DXCreateTextureFromFile( loadState.device, "ATDD/static_objects/machine/elevator.dds", &ddsTexture );
+    }
+
+
+    // Tell the user how many textures were already loaded
+    char buf[ 128 ];
+    sprintf( buf, "%d textures loaded, %d reused", textureCache.getNumLoaded(), textureCache.getNumReused() );
+    loadConsole->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+    // Tell the user how well the lightmaps were packed into pages
+    sprintf( buf, "Lightmaps packed into %d pages ( %.1f%% full )", lightMaps->getNumPages(), 100.0 * lightMaps->getOccupancy() );
+    loadConsole->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+    // Tell the user how far off the compact vertices are, next to the
+    //  most that they could be off by
+    if ( faceInfo->hasCompactVertices() ) {
+        CompactVertexError *error = faceInfo->getCompactError();
+        CompactVertexError *bound = faceInfo->getCompactErrorBound();
+
+        sprintf( buf, "Compact vertices: position %g / %g, normal %.2f / %.2f degrees",
+                 error->position, bound->position, error->normalDegrees, bound->normalDegrees );
+        loadConsole->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+        sprintf( buf, "Compact vertices: texture %g / %g, lightmap %g / %g",
+                 error->texCoord, bound->texCoord, error->lightMapCoord, bound->lightMapCoord );
+        loadConsole->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+    } else if ( useCompactVertices ) {
+        loadConsole->printMessage( "This device can't read compact vertices, so full vertices are used", D3DXCOLOR( 1.0, 1.0, 0.0, 1.0 ) );
+    }
+
+    printLoadTimes( &loadGraph, loadConsole );
+
+    loadConsole->printMessage( "Map Finished Loading!", D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
+    loadConsole->printMessage( "------------------------", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+}
+
+
+/**
+ * The map loading tasks. Each one is given the map's LoadState. The tasks
+ * that use Direct3D are render tasks, which are only run on the thread that
+ * calls updateLoad(). Without a device, they only do the parts that don't
+ * use Direct3D.
+ */
+
+// Points the lightmaps at the lightmap lump
+void BSPMap::loadLightMapsTask( void *state ) {
+    BSPMap *map = ( ( LoadState * ) state )->map;
+
+    map->lightMaps->load( &map->mapFile );
+};
+
+// Acquires the map's textures from the texture cache. The images that
+//  aren't in the cache yet are left for the read tasks.
+void BSPMap::acquireTexturesTask( void *state ) {
+    BSPMap *map = ( ( LoadState * ) state )->map;
+
+    map->texInfo->acquire( &map->mapFile, &map->textureCache );
+};
+
+// Reads in the pending texture images, one at a time, until there are
+//  none left. Every read task runs this at the same time.
+void BSPMap::readTexturesTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    TextureCache *cache = &loadState->map->textureCache;
+
+    // Stop early if the load has been cancelled
+    while ( !loadState->map->loadGraph.isCancelled() ) {
+        int imageNum = InterlockedIncrement( &loadState->nextImage ) - 1;
+        if ( imageNum >= cache->getNumPending() ) {
+            break;
+        }
+
+        cache->readPending( imageNum );
+    }
+};
+
+// Sends the new texture images to Direct3D (render task). The textures that
+//  only the last map used can then be deleted.
+void BSPMap::createTexturesTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
+
+    if ( loadState->device != NULL ) {
+        map->texInfo->createTextures( &map->textureCache, loadState->device );
+    }
+    map->textureCache.purgeUnused();
+};
+
+// Triangulates the faces and packs their lightmaps, or copies them out of
+//  the map cache
+void BSPMap::loadFacesTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
+
+    map->faceInfo->setCompactVertices( useCompactVertices );
+    loadState->facesCached = map->faceInfo->loadFaces( &map->mapFile, map->texInfo, map->lightMaps, loadState->cache );
+};
+
+// Sends the lightmap pages and the vertex buffer to Direct3D (render task)
+void BSPMap::createFaceBuffersTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
+
+    if ( loadState->device != NULL ) {
+        map->faceInfo->createBuffers( map->lightMaps, loadState->device );
+    }
+};
+
+// Loads in the BSP tree, and decodes the PVS
+void BSPMap::loadTreeTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
+
+    loadState->treeCached = map->bspTree->load( &map->mapFile, loadState->cache );
+};
+
+// Parses the map entities
+void BSPMap::loadEntitiesTask( void *state ) {
+    BSPMap *map = ( ( LoadState * ) state )->map;
+
+    map->entities->load( &map->mapFile );
+};
+
+// Loads in the skybox that the entities name (render task)
+void BSPMap::loadSkyBoxTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
+
+    if ( loadState->device == NULL ) {
+        return;
+    }
+
+    char *skyboxName = map->entities->getSkyBoxName();
 
     // See if we could find the skybox's name
     if ( skyboxName != NULL ) {
         // If we could, create the skybox and prepare it for rendering
-        skyBox->load( d3d->getDevice(), string( "Q2/env/" ) + string( entities->getSkyBoxName() ) );
+        map->skyBox->load( loadState->device, string( "env/" ) + string( skyboxName ) );
     } else {
         // If there is no skybox name, then just load in a file that will fail. This means
         // a black texture will be made instead of the normal skybox.
-        skyBox->load( d3d->getDevice(), string( "Q2/env/" ) + string( "" ) );
+        map->skyBox->load( loadState->device, string( "env/" ) + string( "" ) );
     }
+};
 
-    // Set the camera's position to where the player appears in the map
-    entities->setCameraPos( camera );
+// Counts the map's polygons, gets ready to find the visible leaves, and
+//  works out which faces hide what is behind them
+void BSPMap::loadVisibilityTask( void *state ) {
+    BSPMap *map = ( ( LoadState * ) state )->map;
+
+    map->occlusion.load( map->faceInfo, map->texInfo );
+    map->visibleSet.load( map->bspTree, map->faceInfo );
+};
+
+// Works out how each face is to be sorted when it is drawn (render task)
+void BSPMap::loadDrawListTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
+
+    map->drawList.load( map->faceInfo, map->texInfo, map->lightMaps, loadState->device );
+};
 
+// Loads in the Pixel Shader (render task). Compact vertices are expanded by
+//  their own vertex shader.
+void BSPMap::loadShaderTask( void *state ) {
+    LoadState *loadState = ( LoadState * ) state;
+    BSPMap *map = loadState->map;
 
-    // If the file was opened correctly, then close it
-	if ( file != NULL ) {
-        fclose( file );
+    if ( loadState->device == NULL ) {
+        return;
     }
 
-    // Load in the Pixel Shader
-    mapShader->createEffect( d3d->getDevice(), "transform.fx", "MapShader" );
+    map->mapShader->createEffect( loadState->device, "transform.fx",
+                                  map->faceInfo->hasCompactVertices() ? "MapShaderCompact" : "MapShader" );
+};
 
-    vsTest = 0.0;
 
+/**
+ * Tells the user how long each step of loading the map took. The tasks with
+ * the same name are one step, which took from when the first one started to
+ * when the last one finished.
+ */
+void BSPMap::printLoadTimes( TaskGraph *graph, Console *console ) {
+    char buf[ 128 ];
 
-    if ( ddsTexture == NULL ) {
-        D3DXCreateTextureFromFile( d3d->getDevice(), "ATDD/static_objects/machine/elevator.dds", &ddsTexture );
+    for ( int i = 0; i < graph->getNumTasks(); ++i ) {
+
+        // Only print each step once, at its first task
+        bool printed = false;
+        for ( int e = 0; e < i && !printed; ++e ) {
+            printed = strcmp( graph->getTaskName( e ), graph->getTaskName( i ) ) == 0;
+        }
+        if ( printed ) {
+            continue;
+        }
+
+        unsigned int start = graph->getTaskStart( i );
+        unsigned int end = start + graph->getTaskMillis( i );
+        unsigned int work = 0;
+        int numTasks = 0;
+
+        for ( int e = i; e < graph->getNumTasks(); ++e ) {
+            if ( strcmp( graph->getTaskName( e ), graph->getTaskName( i ) ) == 0 ) {
+                start = min( start, graph->getTaskStart( e ) );
+                end = max( end, graph->getTaskStart( e ) + graph->getTaskMillis( e ) );
+                work += graph->getTaskMillis( e );
+                numTasks++;
+            }
+        }
+
+        if ( numTasks > 1 ) {
+            sprintf( buf, "  %s: %u ms ( %d tasks, %u ms of work )", graph->getTaskName( i ), end - start, numTasks, work );
+        } else {
+            sprintf( buf, "  %s: %u ms", graph->getTaskName( i ), end - start );
+        }
+        console->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
     }
 
-
-    // Loading was successful!
-	return true;
-}
+    sprintf( buf, "Map loaded in %u ms", graph->getTotalMillis() );
+    console->printMessage( buf, D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
+};
 
 
 
 // Draws the map
-void BSPMap::draw( LPDIRECT3DDEVICE9 device, Camera *camera, DrawingInfo *drawInfo ) {
+void BSPMap::draw( RenderDevice *device, Camera *camera, DrawingInfo *drawInfo ) {
 
     /**
      * Here's how the data is laid out of rendering:
@@ -397,28 +762,42 @@ void BSPMap::draw( LPDIRECT3DDEVICE9 device, Camera *camera, DrawingInfo *drawIn
      *      Clusters are the final tier of drawing information.
      */
 
-    // The array of clusters
-    vector< BSP::Cluster > *clusters = bspTree->getClusters();
+    // The cluster that the camera is in, found by traversing the BSP Tree
+    //  with the camera's position.
+    int cameraCluster = bspTree->getCameraCluster( camera );
+    bool cameraOutside = cameraCluster < 0;
 
-    // This array is for determining which leaf to use for frustum culling
-    vector< vector< BSP::Leaf * > > *clusterLeaves = bspTree->getClusterLeaves();
+    // Outside of the map, there is no PVS to use. Either use the PVS of the
+    //  nearest cluster, or leave every cluster visible.
+    if ( cameraOutside && outsideUsesNearestCluster ) {
+        cameraCluster = bspTree->findNearestCluster( camera );
+    }
 
-    // The visibility state of each cluster, found by traversing the BSP Tree
-    //  with the camera's position.
-    BitVector *visState = bspTree->getVisState( camera );
+    // Find the leaves that can be seen from the camera's cluster, if the
+    //  camera has moved into a different cluster since the last frame
+    visibleSet.setCluster( cameraCluster );
 
 
-    // Set the Fixed Vertex Format (FVF) to the BSP FVF
-    device->SetFVF( BSP_FVF );    // Set the vertex buffer used by Direct3D to the vertex buffer with all of
+    // Set the Fixed Vertex Format (FVF) to the BSP FVF, or the vertex
+    //  declaration of compact vertices
+    if ( faceInfo->hasCompactVertices() ) {
+        device->setVertexDeclaration( faceInfo->getVertexDeclaration() );
+    } else {
+        device->setFVF( BSP_FVF );
+    }    // Set the vertex buffer used by Direct3D to the vertex buffer with all of
     //  the map vertex information in it.
-    device->SetStreamSource( 0, faceInfo->getVertexBuffer(), 0, sizeof( D3D::Vertex ) );    // Special variables for using the map's pixel shader    UINT Pass, Passes;    // Setup backface culling (so polygons that are facing away from you aren't drawn)    device->SetRenderState( D3DRS_CULLMODE, D3DCULL_CCW );
+    device->setStreamSource( 0, faceInfo->getVertexBuffer(), 0, faceInfo->getVertexSize() );
+
+
+    // Setup backface culling (so polygons that are facing away from you aren't drawn)
+    device->setRenderState( D3DRS_CULLMODE, D3DCULL_CCW );
 
     // Set the useLightMap variable in the Pixel Shader
-    mapShader->getEffect()->SetInt( "useLightMap", lMap );
+    device->setEffectInt( mapShader->getEffect(), "useLightMap", lMap );
 
 
     // The variables for how many polgons were drawn or culled.
-    int totalPolygons = faceInfo->getNumVertices() / 3;
+    int totalPolygons = faceInfo->getNumIndices() / 3;
     int polygonsDrawn = 0;
     int numPVSCulled = 0;
     int numFrustumCulled = 0;
@@ -427,26 +806,38 @@ void BSPMap::draw( LPDIRECT3DDEVICE9 device, Camera *camera, DrawingInfo *drawIn
     D3DXMATRIX view;
     D3DXMATRIX proj;
 
-    device->GetTransform( D3DTS_WORLD, &world );
-    device->GetTransform( D3DTS_VIEW, &view );
-    device->GetTransform( D3DTS_PROJECTION, &proj );
-
-    mapShader->getEffect()->SetMatrix( "worldViewProj", &( world * view * proj ) );
-    mapShader->getEffect()->SetMatrix( "world", &( world ) );
-    mapShader->getEffect()->SetMatrix( "view", &( view ) );
-    mapShader->getEffect()->SetMatrix( "proj", &( proj ) );
-
-    mapShader->getEffect()->SetFloat( "camPosX", -camera->pos->x );
-    mapShader->getEffect()->SetFloat( "camPosY", -camera->pos->y );
-    mapShader->getEffect()->SetFloat( "camPosZ", -camera->pos->z );
+    device->getTransform( D3DTS_WORLD, &world );
+    device->getTransform( D3DTS_VIEW, &view );
+    device->getTransform( D3DTS_PROJECTION, &proj );
+
+    device->setEffectMatrix( mapShader->getEffect(), "worldViewProj", &( world * view * proj ) );
+    device->setEffectMatrix( mapShader->getEffect(), "world", &( world ) );
+    device->setEffectMatrix( mapShader->getEffect(), "view", &( view ) );
+    device->setEffectMatrix( mapShader->getEffect(), "proj", &( proj ) );
+
+    device->setEffectFloat( mapShader->getEffect(), "camPosX", -camera->pos->x );
+    device->setEffectFloat( mapShader->getEffect(), "camPosY", -camera->pos->y );
+    device->setEffectFloat( mapShader->getEffect(), "camPosZ", -camera->pos->z );
+
+    // The box that the compact vertex positions are stored in
+    if ( faceInfo->hasCompactVertices() ) {
+        CompactBounds *bounds = faceInfo->getCompactBounds();
+
+        device->setEffectFloat( mapShader->getEffect(), "compactOriginX", bounds->originX );
+        device->setEffectFloat( mapShader->getEffect(), "compactOriginY", bounds->originY );
+        device->setEffectFloat( mapShader->getEffect(), "compactOriginZ", bounds->originZ );
+        device->setEffectFloat( mapShader->getEffect(), "compactExtentX", bounds->extentX );
+        device->setEffectFloat( mapShader->getEffect(), "compactExtentY", bounds->extentY );
+        device->setEffectFloat( mapShader->getEffect(), "compactExtentZ", bounds->extentZ );
+    }
 
     vsTest += 0.1;
-    mapShader->getEffect()->SetFloat( "vsTest", vsTest );
+    device->setEffectFloat( mapShader->getEffect(), "vsTest", vsTest );
 
 
 
-    mapShader->getEffect()->SetTexture( "modelTexture", ddsTexture );
-    mapShader->getEffect()->SetTexture( "modelTexture", texInfo->getMegaTexture() );    // draw the map with the pixel shader    /*mapShader->getEffect()->Begin( &Passes, 0 );    for ( Pass = 0; Pass < Passes; Pass++ ) {
+    device->setEffectTexture( mapShader->getEffect(), "modelTexture", ddsTexture );
+    device->setEffectTexture( mapShader->getEffect(), "modelTexture", texInfo->getMegaTexture() );    // draw the map with the pixel shader    /*mapShader->getEffect()->Begin( &Passes, 0 );    for ( Pass = 0; Pass < Passes; Pass++ ) {
         mapShader->getEffect()->BeginPass( Pass );
         mapShader->getEffect()->SetInt( "useLightMap", 1 );        device->DrawPrimitive( D3DPT_TRIANGLELIST, 0,                               faceInfo->getNumVertices() / 3 );        mapShader->getEffect()->EndPass();    }
     mapShader->getEffect()->End();
@@ -465,39 +856,76 @@ void BSPMap::draw( LPDIRECT3DDEVICE9 device, Camera *camera, DrawingInfo *drawIn
      * polygons are drawn when they don't need to be drawn.
      */
 
-    // For each cluster,
-
-    for ( unsigned int c = 0; c < clusters->size(); ++c ) {
-        // If the cluster is visible,
-        if ( visState->getData( c ) ) {            // If it is, for each leaf in that cluster,            for ( unsigned int l = 0; l < ( *clusters )[ c ].size(); ++l ) {                // Is that leaf within the viewing frustum?                if ( camera->leafInFrustum( ( *clusterLeaves )[ c ][ l ] ) ) {                    // If it is, then draw the faces in that leaf                    // For each face in that leaf                    for ( unsigned int f = 0; f < ( *clusters )[ c ][ l ].size(); ++f ) {                        int i = ( *clusters )[ c ][ l ][ f ];                        // If it's not a skybox, then draw it.                        if ( !texInfo->getTexture( faceInfo->getTextureNum( i ) )->isSkyBox ) {                            // Setup the lightmap and texture for the pixel shader                            mapShader->getEffect()->SetTexture( "modelTexture", texInfo->getTexture( faceInfo->getTextureNum( i ) )->getTexture() );                            //mapShader->getEffect()->SetTexture( "modelTexture", texInfo->getMegaTexture() );                            //mapShader->getEffect()->SetTexture( "modelTexture", ddsTexture );                            mapShader->getEffect()->SetTexture( "lightMap", lightMaps->getTexture( i ) );                            //mapShader->getEffect()->SetTexture( "normalMap", normalMap );                            // If the texture doesn't use lightmaps (for example, water and lava), then disable lightmaps                            if ( !texInfo->getTexture( faceInfo->getTextureNum( i ) )->usesLightMaps ) {                                mapShader->getEffect()->SetInt( "useLightMap", 0 );                            }                            // draw the face with the pixel shader                            mapShader->getEffect()->Begin( &Passes, 0 );                            for ( Pass = 0; Pass < Passes; Pass++ ) {
-                                mapShader->getEffect()->BeginPass( Pass );
-                                device->DrawPrimitive( D3DPT_TRIANGLELIST,                                                       faceInfo->getFaceStartIndex( i ),                                                       ( faceInfo->getFaceStartIndex( i + 1 ) - faceInfo->getFaceStartIndex( i ) ) / 3 );                                mapShader->getEffect()->EndPass();                            }
-                            mapShader->getEffect()->End();
-
-                            // make sure lightmaps are enabled
-                            mapShader->getEffect()->SetInt( "useLightMap", lMap );
-
-                            // Add in the number of polygons drawn
-                            polygonsDrawn += ( faceInfo->getFaceStartIndex( i + 1 ) - faceInfo->getFaceStartIndex( i ) ) / 3;
-                        }                    }                } else {                    for ( unsigned int f = 0; f < ( *clusters )[ c ][ l ].size(); ++f ) {                        int i = ( *clusters )[ c ][ l ][ f ];                        // Add in the number of polygons frustum-culled                        numFrustumCulled += ( faceInfo->getFaceStartIndex( i + 1 ) - faceInfo->getFaceStartIndex( i ) ) / 3;                    }                }            }        } else {            for ( unsigned int l = 0; l < ( *clusters )[ c ].size(); ++l ) {                // For each face in that leaf                for ( unsigned int f = 0; f < ( *clusters )[ c ][ l ].size(); ++f ) {                    int i = ( *clusters )[ c ][ l ][ f ];                    // Add in the number of polygons Potentially-Visible-Set culled                    numPVSCulled += ( faceInfo->getFaceStartIndex( i + 1 ) - faceInfo->getFaceStartIndex( i ) ) / 3;                }            }        }    }    
-    // Buffer for printing to. This is so the polygon variables can be printed into a string
-    //  using the sprintf() function.
-    char buf[ 128 ];
-
-    // Tell the user about a problem with the percentages (exceed 100%)
-    drawInfo->setLine( DrawingInfo::INFO_NOTE, "Note that some polygons may be drawn multiple times, so percentages may exceed 100%.", D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
-
-    // Print the number and percentage of polygons rendered
-    sprintf( buf, "# of polygons rendered: %d / %d ( %f% )", polygonsDrawn, totalPolygons, 100.0 * float( polygonsDrawn ) / float( totalPolygons ) );
-    drawInfo->setLine( DrawingInfo::INFO_POLYGONS_RENDERED, buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
-
-    // Print the number and percentage of polygons culled by the Potentially-Visible-Set culling method
-    sprintf( buf, "# of polygons PVS culled: %d / %d ( %f% )", numPVSCulled, totalPolygons, 100.0 * float( numPVSCulled ) / float( totalPolygons ) );
-    drawInfo->setLine( DrawingInfo::INFO_NUM_PVS_CULLED, buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+    // Start a new list of faces to draw
+    drawList.clear();
+
+    // Add the faces of each visible leaf to the draw list, once each. The draw
+    //  list leaves out the skybox faces.
+    int polygonsAdded = 0;
+
+    if ( cameraOutside ) {
+        // Outside of the map, walk down the BSP tree from front to back, so
+        //  that leaves hidden behind the leaves in front of them are skipped.
+        //  The faces are scaled into the world by the world matrix, but the
+        //  BSP tree's boxes already are.
+        D3DXMATRIX worldViewProj = world * view * proj;
+        D3DXMATRIX viewProj = view * proj;
+        occlusion.begin( &worldViewProj, &viewProj );
+
+        visibleLeaves.resize( 0 );
+        bspTree->findVisibleLeaves( camera, bspTree->getClusterVisState( cameraCluster ), &visibleLeaves, &occlusion );
+
+        visibleSet.beginFrame();
+        for ( unsigned int l = 0; l < visibleLeaves.size(); ++l ) {
+            polygonsAdded += visibleSet.addLeafFaces( visibleLeaves[ l ], &drawList );
+        }
+    } else {
+        // Inside of the map, the leaves that can be seen from the camera's
+        //  cluster are already known, so they are just frustum culled
+        polygonsAdded = visibleSet.addVisibleFaces( camera, &drawList );
+    }
 
-    // Print the number and percentage of polygons culled by Frustum culling
-    sprintf( buf, "# of polygons frustum culled: %d / %d ( %f% )", numFrustumCulled, totalPolygons, 100.0 * float( numFrustumCulled ) / float( totalPolygons ) );
-    drawInfo->setLine( DrawingInfo::INFO_NUM_FRUSTUM_CULLED, buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+    // The polygons that aren't in the PVS are PVS culled, and the polygons in
+    //  the PVS that weren't added are frustum culled
+    numPVSCulled = visibleSet.getNumLeafPolygons() - visibleSet.getNumPolygons();
+    numFrustumCulled = visibleSet.getNumPolygons() - polygonsAdded;
+
+    // Draw all of the visible faces, with one draw call for each set of
+    //  faces that use the same textures
+    polygonsDrawn = drawList.draw( device, mapShader->getEffect(), lMap );
+
+
+    // Tell the user how drawing the map went, if there is anyone to tell
+    if ( drawInfo != NULL ) {
+        // Buffer for printing to. This is so the polygon variables can be printed into a string
+        //  using the sprintf() function.
+        char buf[ 128 ];
+
+        // Tell the user how polygons that are in more than one leaf are counted
+        drawInfo->setLine( DrawingInfo::INFO_NOTE, "Polygons that are in more than one leaf are only drawn and counted once.", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+        // Print the number and percentage of polygons rendered
+        sprintf( buf, "# of polygons rendered: %d / %d ( %f% )", polygonsDrawn, totalPolygons, 100.0 * float( polygonsDrawn ) / float( totalPolygons ) );
+        drawInfo->setLine( DrawingInfo::INFO_POLYGONS_RENDERED, buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+        // Print the number and percentage of polygons culled by the Potentially-Visible-Set culling method
+        sprintf( buf, "# of polygons PVS culled: %d / %d ( %f% )", numPVSCulled, totalPolygons, 100.0 * float( numPVSCulled ) / float( totalPolygons ) );
+        drawInfo->setLine( DrawingInfo::INFO_NUM_PVS_CULLED, buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+        // Print the number and percentage of polygons culled by Frustum culling
+        sprintf( buf, "# of polygons frustum culled: %d / %d ( %f% )", numFrustumCulled, totalPolygons, 100.0 * float( numFrustumCulled ) / float( totalPolygons ) );
+        drawInfo->setLine( DrawingInfo::INFO_NUM_FRUSTUM_CULLED, buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+        // Tell the user whether the camera is outside of the map, and how much
+        //  occlusion culling did
+        if ( !cameraOutside ) {
+            drawInfo->setLine( DrawingInfo::INFO_CAMERA_MODE, "Camera is inside of the map", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+        } else {
+            sprintf( buf, "Camera is outside of the map ( %s, %d nodes and leaves occluded )",
+                     outsideUsesNearestCluster ? "nearest cluster's PVS" : "no PVS", occlusion.getNumOccluded() );
+            drawInfo->setLine( DrawingInfo::INFO_CAMERA_MODE, buf, D3DXCOLOR( 1.0, 1.0, 0.0, 1.0 ) );
+        }
+    }
 
 
     // Render the map's skybox
@@ -510,15 +938,15 @@ void BSPMap::draw( LPDIRECT3DDEVICE9 device, Camera *camera, DrawingInfo *drawIn
  *
  * drawSkyBox() is called by draw()
  */
-void BSPMap::drawSkyBox( LPDIRECT3DDEVICE9 device, Camera *camera ) {
+void BSPMap::drawSkyBox( RenderDevice *device, Camera *camera ) {
 
     // Start by making the skybox centered on the camera
     D3DXMATRIX trans;
     D3DXMatrixTranslation( &trans, -camera->pos->x, -camera->pos->y, -camera->pos->z );
-    device->SetTransform( D3DTS_WORLD, &( trans ) );
+    device->setTransform( D3DTS_WORLD, &( trans ) );
 
     // Disable culling
-    device->SetRenderState( D3DRS_CULLMODE, D3DCULL_NONE );
+    device->setRenderState( D3DRS_CULLMODE, D3DCULL_NONE );
 
     // call the skybox's drawing method
     skyBox->show( device );
@@ -538,7 +966,7 @@ void BSPMap::drawSkyBox( LPDIRECT3DDEVICE9 device, Camera *camera ) {
  * entity lump of a bsp file. After these lights are enabled, the object
  * that is to be lit will be drawn with correct lighting.
  */
-void BSPMap::enableLights( LPDIRECT3DDEVICE9 device, Point3f pos ) {
+void BSPMap::enableLights( RenderDevice *device, Point3f pos ) {
     entities->enableLights( device, pos );
 };
 
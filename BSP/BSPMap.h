@@ -4,6 +4,7 @@
 
 // Include the standard bsp information
 #include "BSPCommon.h"
+#include "BSPFile.h"
 #include "mapdef.h"
 
 // Include the header files for the parts of the bsp map
@@ -13,9 +14,14 @@
 #include "Entity.h"
 #include "LightMapInfo.h"
 #include "BSPTree.h"
+#include "VisibleSet.h"
+#include "MapCache.h"
+#include "DrawList.h"
+#include "TaskGraph.h"
 
 // Include a number of utilities for use in drawing the map
 #include "D3DContext.h"
+#include "RenderDevice.h"
 #include "Light.h"
 #include "Shader.h"
 #include "SkyBox.h"
@@ -86,7 +92,8 @@ class BSPMap {
          *      directory or file extension.
          *  - d3d: A pointer to a Direct3D Context object. This is needed in order
          *      to inform the user of the loading process because the console cannot
-         *      be drawn without this object.
+         *      be drawn without this object. If it is NULL, the map is loaded
+         *      without Direct3D (see startLoad()), and nothing is drawn.
          *  - camera: A pointer to a camera object. After loading in the map, the
          *      position of the camera is found from a special entity in the map's
          *      entity lump.
@@ -100,6 +107,56 @@ class BSPMap {
 		bool load( std::string fileName, D3DContext *d3d, Camera *camera, Console *console );
 
 
+        /**
+         * startLoad() routine:
+         *  - fileName: the name of the .bsp file to be loaded, without its
+         *      directory or file extension.
+         *  - d3d: A pointer to a Direct3D Context object. The render tasks use
+         *      its device. If it is NULL, the textures, buffers, skybox and
+         *      shader aren't made, but everything that culling and the draw
+         *      list need is loaded, so the map can be drawn into a
+         *      RecordingRenderDevice.
+         *  - console: A pointer to a Console object, which the map reports to
+         *      while it is loading.
+         *
+         * startLoad() opens the map file and starts loading the map on the
+         * worker threads, then returns straight away. updateLoad() must then be
+         * called, on the same thread, until it returns true. Another map can be
+         * drawn in the meantime.
+         *
+         * startLoad() returns false if the map file was not found.
+         */
+        bool startLoad( std::string fileName, D3DContext *d3d, Console *console );
+
+        /**
+         * updateLoad() runs the render tasks of the map that are ready, for up
+         * to maxMillis (a single task can take longer). Once every task has
+         * finished, the map is finished off and updateLoad() returns true.
+         */
+        bool updateLoad( unsigned int maxMillis );
+
+        /**
+         * cancelLoad() stops loading the map. The tasks that are running are
+         * finished first, so this can take as long as the slowest task. The map
+         * must then be unloaded.
+         */
+        void cancelLoad();
+
+        /**
+         * Returns true if the map has been started with startLoad(), and
+         * hasn't finished loading yet
+         */
+        bool isLoading() {
+            return loading;
+        };
+
+        /**
+         * placeCamera() sets the camera's position to where the player appears
+         * in the map
+         */
+        void placeCamera( Camera *camera );
+
+
         /**
          * unload() routine:
          *  - d3d: A pointer to a Direct3D Context object. This is needed to update
@@ -119,9 +176,9 @@ class BSPMap {
 
         /**
          * Draws the entire bsp map to the screen.
-         *  - device: A link to a special DirectX structure for drawing. The map
-         *      uses a specific set of methods in the device for drawing to the
-         *      screen properly.
+         *  - device: The RenderDevice that the map is drawn with. This is usually
+         *      the D3DContext's RenderDevice, which draws to the screen, but it
+         *      can also be a RecordingRenderDevice, which records the drawing calls.
          *  - camera: A pointer to a Camera object. This is needed for Potentially
          *      Visible Set (PVS) culling. The set of visible polygons is determined
          *      based on where the camera is within the bsp map, and from that, frustum
@@ -130,14 +187,25 @@ class BSPMap {
          *  - drawInfo: A pointer to a DrawingInfo object. The map tells the object
          *      a few pieces of information based on how rendering the map went.
          *      The drawInfo object then shows the user the drawing statistics.
+         *      It can be NULL.
          *
          * After calling draw(), the .bsp map has been completely rendered. The
          * application can then render the rest of the objects in the world.
          */
-        void draw( LPDIRECT3DDEVICE9 device, Camera *camera, DrawingInfo *drawInfo );
+        void draw( RenderDevice *device, Camera *camera, DrawingInfo *drawInfo );
 
         int lMap;
 
+        // When the camera is outside of the map, the clusters that can be seen
+        //  from the nearest cluster are drawn if this is true. Otherwise, every
+        //  cluster is drawn, and only frustum and occlusion culling are done.
+        bool outsideUsesNearestCluster;
+
+        // If this is true, the maps that are loaded from now on keep their
+        //  vertices as compact vertices (see CompactVertex.h), if the device
+        //  can read them. It is kept from one map to the next.
+        static bool useCompactVertices;
+
 
         /**
          * enableLights() routine:
@@ -151,13 +219,34 @@ class BSPMap {
          * entity lump of a bsp file. After these lights are enabled, the object
          * that is to be lit will be drawn with correct lighting.
          */
-        void enableLights( LPDIRECT3DDEVICE9 device, Point3f pos );
+        void enableLights( RenderDevice *device, Point3f pos );
 
 
         vector< Entity::Monster * > *getMonsters() {
             return entities->getMonsters();
         }
 
+        /**
+         * Adds the names of the maps that this map's changelevels lead to onto
+         * the end of mapNames
+         */
+        void getChangeLevelMaps( vector< std::string > *mapNames ) {
+            entities->getChangeLevelMaps( mapNames );
+        };
+
+        /**
+         * Returns the texture cache that every map shares
+         */
+        static TextureCache *getTextureCache() {
+            return &textureCache;
+        };
+
+        /**
+         * unloadTextureCache() deletes every image in the shared texture cache.
+         * It is called once every map has been deleted.
+         */
+        static void unloadTextureCache();
+
 
 	private:
 
@@ -168,11 +257,81 @@ class BSPMap {
          *
          * drawSkyBox() is called by draw()
          */
-        void drawSkyBox( LPDIRECT3DDEVICE9 device, Camera *camera );
+        void drawSkyBox( RenderDevice *device, Camera *camera );
+
+        /**
+         * The state that the map loading tasks share. load() adds a task for
+         * each part of the map to a TaskGraph, and each task is given this.
+         */
+        typedef struct {
+            BSPMap *map;
+
+            // The device that the render tasks use, or NULL if the map is
+            //  loaded without Direct3D
+            LPDIRECT3DDEVICE9 device;
+
+            // The open map cache, or NULL if there isn't one
+            MapCache *cache;
+
+            // Whether the faces and the BSP tree came out of the map cache
+            bool facesCached;
+            bool treeCached;
+
+            // The next pending texture image for the read tasks to read
+            volatile LONG nextImage;
+        } LoadState;
+
+        // The map loading tasks (see load()). The render tasks use Direct3D,
+        //  so they are only run on the thread that called load().
+        static void loadLightMapsTask( void *state );
+        static void acquireTexturesTask( void *state );
+        static void readTexturesTask( void *state );
+        static void createTexturesTask( void *state );
+        static void loadFacesTask( void *state );
+        static void createFaceBuffersTask( void *state );
+        static void loadTreeTask( void *state );
+        static void loadEntitiesTask( void *state );
+        static void loadSkyBoxTask( void *state );
+        static void loadVisibilityTask( void *state );
+        static void loadDrawListTask( void *state );
+        static void loadShaderTask( void *state );
+
+        /**
+         * finishLoad() is called once every loading task has finished. It
+         * writes the map cache, and tells the user what was loaded.
+         */
+        void finishLoad();
 
-        // The "header" section of the .bsp map tells specifically where the map's
-        // information is stored in the map file
-        BSP::Header header;
+        /**
+         * printLoadTimes() tells the user how long each step of loading the
+         * map took. The tasks with the same name are one step.
+         */
+        void printLoadTimes( TaskGraph *graph, Console *console );
+
+        // The tasks that load the map, and the state that they share. They are
+        //  kept until the map has finished loading, since the map is loaded
+        //  while another map is being drawn.
+        TaskGraph loadGraph;
+        LoadState loadState;
+
+        // The map cache that the map is being loaded from, and its file name
+        MapCache loadCache;
+        std::string loadCacheName;
+
+        // The console that the map reports to while it is loading
+        Console *loadConsole;
+
+        // Whether the map is being loaded
+        bool loading;
+
+        // The mapped .bsp file. The map's lumps are used straight out of the
+        // mapped file, so it stays open until the map is unloaded.
+        BSPFile mapFile;
+
+        // The WAL images used by the maps. The cache is shared by every map,
+        //  so that the next map can use the same images, including the ones
+        //  that were read in ahead of time.
+        static TextureCache textureCache;
 
         // The Objects for the data in the map
         TextureInfo *texInfo;
@@ -181,6 +340,22 @@ class BSPMap {
         LightMapInfo *lightMaps;
         BSPTree::Tree *bspTree;
 
+        // The leaves that can be seen from the camera's cluster. They are only
+        //  found again when the camera moves into a different cluster.
+        VisibleSet visibleSet;
+
+        // The leaves that are being drawn this frame when the camera is outside
+        //  of the map
+        vector< int > visibleLeaves;
+
+        // The coarse depth buffer that hides leaves behind other leaves when the
+        //  camera is outside of the map
+        CoarseOcclusion occlusion;
+
+        // The list of visible faces, which sorts the faces by texture so they
+        //  can be drawn with as few draw calls as possible
+        DrawList drawList;
+
         // The map's Pixel shader (This is just for combining the base texture
         //  of a face and its lightmap.)
         D3D::Shader *mapShader;
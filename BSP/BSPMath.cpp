@@ -49,12 +49,14 @@ void vertexSubtract( Point3f *a, Point3f *b ) {
 };
 
 /**
- * Copies the vertex location at point to the bspVertex vtx
+ * Copies the vertex location at point to the bspVertex vtx, switching it from
+ * Quake 2 coordinates (z is up-down) to Direct3D coordinates (y is up-down):
+ * quake coords ( x, y, z ) == D3D coords ( y, z, -x )
  */
 void vertexCopy( D3D::Vertex *vtx, Point3f *point ) {
-    vtx->x = point->x;
-    vtx->y = point->y;
-    vtx->z = point->z;
+    vtx->x = point->y;
+    vtx->y = point->z;
+    vtx->z = -point->x;
 };
 
 /**
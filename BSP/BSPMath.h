@@ -11,9 +11,12 @@
 // Fills in the texture coordinate of a bspVertex
 void getTexCoord( D3D::Vertex *vtx, BSP::TexInfo *texInfo, WALImage *texture );
 
-// Copies the vertex location from point to vtx
+// Copies the vertex location from point to vtx, converting it to Direct3D coordinates
 void vertexCopy( D3D::Vertex *vtx, Point3f *point );
 
+// Copies the normal from b to a
+void normalCopy( D3D::Vertex *a, D3D::Vertex *b );
+
 // Computes the normal of an array of three vertices pointed to by triangle.
 void getNormal( D3D::Vertex *triangle );
 
@@ -4,176 +4,451 @@
 
 #include "BSPTree.h"
 
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
 namespace BSPTree {
 
     /**
-     * The Constructor for the Node class has several parts:
-     * - First, it creates itself, just like all other constructors. It stores
-     *      a pointer to the BSP::Node and a pointer to the BSP::Plane for
-     *      BSP tree traversal.
-     * - Afterwards, it instantiates its "children", based on the information
-     *      found in the BSP::Node array at index nodeNum.
-     *      - If that child is a Leaf, then it creates a Leaf object and
-     *          stores it.
-     *      - If that child is another node, this constructor is called
-     *          in a recursive style to instantiate the next node.
-     * Each branch of the BSP Tree ends in a leaf.
-     *
-     * leafArray: the array of BSP Leaves from the BSP Map file
-     * leafFaceArray: the array of BSP leaf faces from the BSP map file
-     * nodeArray: the array of BSP Nodes
-     * clusters: the array of BSP::Clusters that the leaves append their
-     *      face index information to.
-     * planeArray: the array of BSP::Planes that the Nodes use for the
-     *      splitting plane.
-     * nodeNum: the index of the node in the node array to be instantiated
-     * clusterLeaves: the array of BSP::Leaves to add to for frustum culling
-     *      purposes. The array is sorted by clusters, then by leaves (2 dimensions)
+     * Constructor prepares the object for later use.
      */
-    Node::Node( BSP::Leaf *leafArray, BSP::LeafFace *leafFaceArray, BSP::Node *nodeArray, vector< BSP::Cluster > *clusters, BSP::Plane *planeArray, int nodeNum, vector< vector< BSP::Leaf * > > *clusterLeaves ) {
+    Tree::Tree() {
+        // Empty constructor
+    };
 
-        // Set the pointers to the BSP node and BSP plane
-        bspNode = nodeArray + nodeNum;
-        bspPlane = planeArray + bspNode->plane;
 
-        // Instantiate the front branch
-        if ( bspNode->front_child < 0 ) {
-            front = new Leaf( leafArray, leafFaceArray, clusters, -( bspNode->front_child + 1 ), clusterLeaves );
-        } else {
-            front = new Node( leafArray, leafFaceArray, nodeArray, clusters, planeArray, bspNode->front_child, clusterLeaves );
-        }
+    /**
+     * Destructor deletes the memory allocated when loaded, if any remains
+     */
+    Tree::~Tree() {
+        unload();
+    };
+
+
+    /**
+     * load() method loads in and initialises the entire BSP Tree from the
+     * BSP file. If cache isn't NULL, the nodes and the clusters are taken
+     * from the map cache instead of being built, and true is returned. If
+     * the cache can't be used, they are built and false is returned.
+     */
+    bool Tree::load( BSPFile *mapFile, MapCache *cache ) {
+        // The leaves are always used straight out of the BSP file
+        leafLump.load( mapFile );
+        leafFaceLump.load( mapFile );
+
+        // Load in the visibility information
+        visInfo.load( mapFile );
 
-        // Instantiate the back branch
-        if ( bspNode->back_child < 0 ) {
-            back = new Leaf( leafArray, leafFaceArray, clusters, -( bspNode->back_child + 1 ), clusterLeaves );
-        } else {
-            back = new Node( leafArray, leafFaceArray, nodeArray, clusters, planeArray, bspNode->back_child, clusterLeaves );
+        bool cached = cache != NULL && loadCache( cache );
+        if ( !cached ) {
+            build( mapFile );
         }
 
+        buildTreeBoxes( mapFile );
+        return cached;
     };
 
-    /**
-     * Destructor deletes both of the children of this node
-     */
-    Node::~Node() {
-        delete front;
-        delete back;
-    };                           
 
-    
     /**
-     * Returns the leaf that the parameter point is within.
-     * Calls getLeaf() on the node/leaf that contains parameter point
-     * (the containing leaf/node is found by the splitting plane).
+     * Builds the nodes and the clusters out of the BSP file's lumps
      */
-    Leaf *Node::getLeaf( Point3f point ) {
+    void Tree::build( BSPFile *mapFile ) {
+        // The nodes and planes are only needed until the tree has been built.
+        Lump< BSP::Node, BSP_NODE_LUMP > nodeLump;
+        Lump< BSP::Plane, BSP_PLANE_LUMP > planeLump;
+
+        nodeLump.load( mapFile );
+        planeLump.load( mapFile );
+
+        // Build the node array, one node at a time, in the same order as the
+        // node lump.
+        nodes.resize( nodeLump.getSize() );
+
+        for ( int i = 0; i < nodeLump.getSize(); ++i ) {
+            BSP::Node *bspNode = nodeLump.getData( i );
+            BSP::Plane *bspPlane = planeLump.getData( bspNode->plane );
+
+            // Copy the splitting plane into the node. A node without a plane
+            // can't split anything, so everything is in front of it.
+            if ( bspPlane != NULL ) {
+                nodes[ i ].normal = bspPlane->normal;
+                nodes[ i ].distance = bspPlane->distance;
+            } else {
+                nodes[ i ].normal = getPoint( 0.0, 0.0, 0.0 );
+                nodes[ i ].distance = 0.0;
+            }
+
+            nodes[ i ].children[ 0 ] = bspNode->front_child;
+            nodes[ i ].children[ 1 ] = bspNode->back_child;
+
+            // The map compiler writes a node before either of its children, so
+            // a child node always comes after its parent. A child that doesn't
+            // (or a leaf that doesn't exist) is turned into leaf 0, the solid
+            // leaf. This way, walking down the tree can never go in circles.
+            for ( int c = 0; c < 2; ++c ) {
+                int child = nodes[ i ].children[ c ];
+
+                if ( ( child >= 0 && ( child <= i || child >= nodeLump.getSize() ) ) ||
+                     ( child < 0 && -( child + 1 ) >= leafLump.getSize() ) ) {
+                    nodes[ i ].children[ c ] = -1;
+                }
+            }
+        }
+
+        // Visit every node and leaf of the tree, front child first, to find
+        // the order that the leaves go into their clusters. A stack of the
+        // nodes that are still to be visited is used instead of recursion, so
+        // a deep tree can't overflow the call stack.
+        vector< int > treeLeaves;
+        vector< int > stack;
+        stack.push_back( nodes.empty() ? -1 : 0 );
+
+        while ( !stack.empty() ) {
+            int child = stack.back();
+            stack.pop_back();
+
+            if ( child < 0 ) {
+                treeLeaves.push_back( -( child + 1 ) );
+            } else {
+                // The back child is pushed first so that the front child is visited first
+                stack.push_back( nodes[ child ].children[ 1 ] );
+                stack.push_back( nodes[ child ].children[ 0 ] );
+            }
+        }
+
+        // The first pass counts the leaves and faces in each cluster, so that
+        // each cluster's leaves and faces can be given their own part of the
+        // arrays. Cluster #c's counts go into entry #( c + 1 ), so that adding
+        // up the counts gives the start of each cluster.
+        int numClusters = visInfo.getNumClusters();
 
-        // If this value is negative, use back child
-        // If it is positive, use the front child
-        float planeResult = point.x * bspPlane->normal.x + point.y * bspPlane->normal.y + point.z * bspPlane->normal.z - bspPlane->distance;
+        clusterStarts.assign( numClusters + 1, 0 );
+        vector< int > clusterFaceStarts( numClusters + 1, 0 );
 
-        if ( planeResult < 0.0 ) {
-            return back->getLeaf( point );
-        } else {
-            return front->getLeaf( point );
+        for ( unsigned int l = 0; l < treeLeaves.size(); ++l ) {
+            int numFaces;
+            if ( getClusterLeaf( treeLeaves[ l ], &numFaces ) ) {
+                int cluster = leafLump.getData( treeLeaves[ l ] )->cluster;
+
+                ++clusterStarts[ cluster + 1 ];
+                clusterFaceStarts[ cluster + 1 ] += numFaces;
+            }
         }
-    };
 
+        for ( int c = 0; c < numClusters; ++c ) {
+            clusterStarts[ c + 1 ] += clusterStarts[ c ];
+            clusterFaceStarts[ c + 1 ] += clusterFaceStarts[ c ];
+        }
+
+        clusterLeafNums.resize( clusterStarts[ numClusters ] );
+        leafFaceStarts.resize( clusterStarts[ numClusters ] + 1 );
+        clusterFaces.resize( clusterFaceStarts[ numClusters ] );
+
+        // The second pass copies each leaf, and its faces, into the next free
+        // place in its cluster's part of the arrays
+        vector< int > nextLeaf = clusterStarts;
+        vector< int > nextFace = clusterFaceStarts;
+
+        for ( unsigned int l = 0; l < treeLeaves.size(); ++l ) {
+            int numFaces;
+            if ( !getClusterLeaf( treeLeaves[ l ], &numFaces ) ) {
+                continue;
+            }
+
+            BSP::Leaf *bspLeaf = leafLump.getData( treeLeaves[ l ] );
+            int entry = nextLeaf[ bspLeaf->cluster ]++;
+            int face = nextFace[ bspLeaf->cluster ];
+
+            clusterLeafNums[ entry ] = treeLeaves[ l ];
+            leafFaceStarts[ entry ] = face;
+
+            if ( numFaces > 0 ) {
+                memcpy( &clusterFaces[ face ], leafFaceLump.getData( bspLeaf->first_leaf_face ),
+                        numFaces * sizeof( BSP::LeafFace ) );
+            }
+
+            nextFace[ bspLeaf->cluster ] += numFaces;
+        }
+
+        leafFaceStarts[ clusterStarts[ numClusters ] ] = clusterFaces.size();
+    };
 
-    // LEAF METHODS
 
     /**
-     * The Leaf constructor does the following:
-     * - Instantiates this leaf
-     * - Appends a set of indices to faces (a set of polygons) in the clusters
-     *      array, and appends its BSP::Leaf to the appropriate cluster in clusterLeaves
-     *
-     * leafArray: The array of BSP::Leaves from the BSP Map file
-     * leafFaceArray: The array of indices to the faces
-     * clusters: The array of clusters, which contain the leaves' indices
-     *      to the faces
-     * leafNum: The index to the leafArray to use in loading the leaf
-     * clusterLeaves: The array of indices to the BSP::Leaves for the
-     *      purposes of frustum culling
+     * Copies the nodes and the clusters out of a map cache. Returns false
+     * if the cache doesn't match the leaves in the map.
      */
-    Leaf::Leaf( BSP::Leaf *leafArray, BSP::LeafFace *leafFaceArray, vector< BSP::Cluster > *clusters, int leafNum, vector< vector< BSP::Leaf * > > *clusterLeaves ) {
-        // set the pointer to the BSP leaf
-        bspLeaf = leafArray + leafNum;
+    bool Tree::loadCache( MapCache *cache ) {
+        int numNodes = cache->getNumItems( MAP_CACHE_NODES, sizeof( Node ) );
+        int numClusterStarts = cache->getNumItems( MAP_CACHE_CLUSTER_STARTS, sizeof( int ) );
+        int numClusterLeaves = cache->getNumItems( MAP_CACHE_CLUSTER_LEAVES, sizeof( int ) );
+        int numLeafFaceStarts = cache->getNumItems( MAP_CACHE_LEAF_FACE_STARTS, sizeof( int ) );
+        int numLeafFaces = cache->getNumItems( MAP_CACHE_LEAF_FACES, sizeof( BSP::LeafFace ) );
+
+        // There must be a start for each cluster and each cluster leaf, plus the end
+        if ( numNodes < 0 || numClusterLeaves < 0 || numLeafFaces < 0 ||
+             numClusterStarts != visInfo.getNumClusters() + 1 ||
+             numLeafFaceStarts != numClusterLeaves + 1 ) {
+            return false;
+        }
 
-        // If the bspLeaf's cluster member
-        if ( bspLeaf->cluster == -1 ) {
-            // The leaf has no visibility information
-            return;
+        Node *cachedNodes = ( Node * ) cache->getSection( MAP_CACHE_NODES );
+        int *cachedClusterStarts = ( int * ) cache->getSection( MAP_CACHE_CLUSTER_STARTS );
+        int *cachedClusterLeafNums = ( int * ) cache->getSection( MAP_CACHE_CLUSTER_LEAVES );
+        int *cachedLeafFaceStarts = ( int * ) cache->getSection( MAP_CACHE_LEAF_FACE_STARTS );
+        BSP::LeafFace *cachedLeafFaces = ( BSP::LeafFace * ) cache->getSection( MAP_CACHE_LEAF_FACES );
+
+        // Every child must be a later node, or a leaf that exists, so that
+        // walking down the tree can never go in circles or off of the end.
+        for ( int i = 0; i < numNodes; ++i ) {
+            for ( int c = 0; c < 2; ++c ) {
+                int child = cachedNodes[ i ].children[ c ];
+
+                if ( ( child >= 0 && ( child <= i || child >= numNodes ) ) ||
+                     ( child < 0 && -( child + 1 ) >= leafLump.getSize() ) ) {
+                    return false;
+                }
+            }
         }
 
-        // Add this leaf's information to the cluster's data
-        ( *clusters )[ bspLeaf->cluster ].push_back();
-        ( *clusterLeaves )[ bspLeaf->cluster ].push_back( bspLeaf );
+        // The starts must go up, and cover all of the entries after them
+        if ( cachedClusterStarts[ 0 ] != 0 || cachedClusterStarts[ numClusterStarts - 1 ] != numClusterLeaves ||
+             cachedLeafFaceStarts[ 0 ] != 0 || cachedLeafFaceStarts[ numLeafFaceStarts - 1 ] != numLeafFaces ) {
+            return false;
+        }
+        for ( int i = 1; i < numClusterStarts; ++i ) {
+            if ( cachedClusterStarts[ i ] < cachedClusterStarts[ i - 1 ] ) {
+                return false;
+            }
+        }
+        for ( int i = 1; i < numLeafFaceStarts; ++i ) {
+            if ( cachedLeafFaceStarts[ i ] < cachedLeafFaceStarts[ i - 1 ] ) {
+                return false;
+            }
+        }
+        for ( int i = 0; i < numClusterLeaves; ++i ) {
+            if ( cachedClusterLeafNums[ i ] < 0 || cachedClusterLeafNums[ i ] >= leafLump.getSize() ) {
+                return false;
+            }
+        }
 
-        for ( int i = 0; i < bspLeaf->num_leaf_faces; ++i ) {
-            ( *clusters )[ bspLeaf->cluster ][ ( *clusters )[ bspLeaf->cluster ].size() - 1 ].push_back( leafFaceArray[ bspLeaf->first_leaf_face + i ] );
+        // The cache can be used
+        nodes.resize( numNodes );
+        if ( numNodes > 0 ) {
+            memcpy( &nodes[ 0 ], cachedNodes, numNodes * sizeof( Node ) );
         }
+
+        // The cache holds the clusters in the same form as they are kept in
+        // memory, so each array is copied in one go
+        clusterStarts.assign( cachedClusterStarts, cachedClusterStarts + numClusterStarts );
+        clusterLeafNums.assign( cachedClusterLeafNums, cachedClusterLeafNums + numClusterLeaves );
+        leafFaceStarts.assign( cachedLeafFaceStarts, cachedLeafFaceStarts + numLeafFaceStarts );
+        clusterFaces.assign( cachedLeafFaces, cachedLeafFaces + numLeafFaces );
+
+        return true;
     };
 
-    // Empty destructor does nothing
-    Leaf::~Leaf() {};
 
     /**
-     * Purpose: returns a pointer to this when Leaf::getLeaf() is called in
-     *  the BSP array, giving the leaf the camera is in.
-     * Return: Pointer to this
+     * saveCache() gives the nodes and the clusters to a map cache, once
+     * the tree has been loaded.
      */
-    Leaf *Leaf::getLeaf( Point3f point ) {
-        return this;
+    void Tree::saveCache( MapCacheWriter *writer ) {
+        // The clusters are written out just as they are kept in memory
+        writer->setSection( MAP_CACHE_NODES, nodes.empty() ? NULL : &nodes[ 0 ],
+                            nodes.size() * sizeof( Node ) );
+        writer->setSection( MAP_CACHE_CLUSTER_STARTS, &clusterStarts[ 0 ],
+                            clusterStarts.size() * sizeof( int ) );
+        writer->setSection( MAP_CACHE_CLUSTER_LEAVES, clusterLeafNums.empty() ? NULL : &clusterLeafNums[ 0 ],
+                            clusterLeafNums.size() * sizeof( int ) );
+        writer->setSection( MAP_CACHE_LEAF_FACE_STARTS, &leafFaceStarts[ 0 ],
+                            leafFaceStarts.size() * sizeof( int ) );
+        writer->setSection( MAP_CACHE_LEAF_FACES, clusterFaces.empty() ? NULL : &clusterFaces[ 0 ],
+                            clusterFaces.size() * sizeof( BSP::LeafFace ) );
     };
 
-    // TREE METHODS
 
+    /**
+     * Works out the bounding box of each node and leaf. The boxes are turned
+     * into Direct3D coordinates here, so that they can be tested against the
+     * frustum planes without any more work.
+     */
+    void Tree::buildTreeBoxes( BSPFile *mapFile ) {
+        Lump< BSP::Node, BSP_NODE_LUMP > nodeLump;
+        nodeLump.load( mapFile );
+
+        treeBoxes.clear();
+
+        for ( unsigned int i = 0; i < nodes.size(); ++i ) {
+            BSP::Node *bspNode = nodeLump.getData( i );
+
+            // A node that isn't in the node lump can't be culled, so give it
+            // a box as big as the world
+            if ( bspNode != NULL ) {
+                addTreeBox( bspNode->bbox_min, bspNode->bbox_max );
+            } else {
+                Point3s min = { -32768, -32768, -32768 };
+                Point3s max = { 32767, 32767, 32767 };
+                addTreeBox( min, max );
+            }
+        }
+
+        for ( int i = 0; i < leafLump.getSize(); ++i ) {
+            addTreeBox( leafLump.getData( i )->bbox_min, leafLump.getData( i )->bbox_max );
+        }
+    };
 
     /**
-     * Constructor sets all pointers to null, preparing the object for
-     * later use.
+     * Adds a bounding box in Quake coordinates to treeBoxes
      */
-    Tree::Tree() {
-        firstNode = NULL;
+    void Tree::addTreeBox( Point3s min, Point3s max ) {
+        // Quake's x, y, z is Direct3D's -z, x, y
+        treeBoxes.add( ( min.y + max.y ) / 2.0 * BSP::MAP_SCALE,
+                       ( min.z + max.z ) / 2.0 * BSP::MAP_SCALE,
+                       -( min.x + max.x ) / 2.0 * BSP::MAP_SCALE,
+                       ( max.y - min.y ) / 2.0 * BSP::MAP_SCALE,
+                       ( max.z - min.z ) / 2.0 * BSP::MAP_SCALE,
+                       ( max.x - min.x ) / 2.0 * BSP::MAP_SCALE );
     };
 
 
     /**
-     * Destructor deletes the memory allocated when loaded, if any remains
+     * findVisibleLeaves() walks down the BSP tree from front to back
+     * (nearest to the camera first), and adds the index of each leaf
+     * that is in the viewing frustum, and in a cluster that is set in
+     * visState, to "leaves".
      */
-    Tree::~Tree() {
-        if ( firstNode != NULL ) {
-            delete firstNode;
-            firstNode = NULL;
+    void Tree::findVisibleLeaves( Camera *camera, BitVector *visState, vector< int > *leaves,
+                                  CoarseOcclusion *occlusion ) {
+        const Plane *planes = camera->getFrustumPlanes();
+        Point3f point = getCameraPoint( camera );
+        int numNodes = nodes.size();
+
+        // A stack of the nodes and leaves still to be visited is used instead
+        // of recursion, so a deep tree can't overflow the call stack.
+        visitStack.resize( 0 );
+        visitStack.push_back();
+        visitStack.back().child = nodes.empty() ? -1 : 0;
+        visitStack.back().planeMask = BOX_CULL_ALL_PLANES;
+
+        while ( !visitStack.empty() ) {
+            Visit visit = visitStack.back();
+            visitStack.pop_back();
+
+            if ( visit.child >= 0 ) {
+                // Skip the node, and everything below it, if its box is outside
+                // of the frustum
+                int planeMask = cullBox( planes, &treeBoxes, visit.child, visit.planeMask );
+                if ( planeMask < 0 ) {
+                    continue;
+                }
+
+                // Also skip it if it is hidden behind what has been found so far
+                if ( occlusion != NULL && occlusion->isOccluded( &treeBoxes, visit.child ) ) {
+                    continue;
+                }
+
+                // The child on the camera's side of the plane is nearer, so
+                // it is pushed last to be visited first
+                Node *node = &nodes[ visit.child ];
+                float planeResult = point.x * node->normal.x + point.y * node->normal.y + point.z * node->normal.z - node->distance;
+                int nearSide = planeResult < 0.0f;
+
+                visitStack.push_back();
+                visitStack.back().child = node->children[ !nearSide ];
+                visitStack.back().planeMask = planeMask;
+
+                visitStack.push_back();
+                visitStack.back().child = node->children[ nearSide ];
+                visitStack.back().planeMask = planeMask;
+            } else {
+                int leafNum = -( visit.child + 1 );
+                BSP::Leaf *leaf = leafLump.getData( leafNum );
+
+                // The leaf has to be in a cluster that can be seen from the camera
+                if ( leaf == NULL || leaf->cluster < 0 || leaf->cluster >= visInfo.getNumClusters() ||
+                     !visState->getData( leaf->cluster ) ) {
+                    continue;
+                }
+
+                if ( cullBox( planes, &treeBoxes, numNodes + leafNum, visit.planeMask ) < 0 ) {
+                    continue;
+                }
+
+                if ( occlusion != NULL ) {
+                    if ( occlusion->isOccluded( &treeBoxes, numNodes + leafNum ) ) {
+                        continue;
+                    }
+
+                    // The leaf's faces can hide the leaves that are behind it
+                    int numFaces;
+                    BSP::LeafFace *faces = getLeafFaces( leafNum, &numFaces );
+                    occlusion->addFaces( faces, numFaces );
+                }
+
+                leaves->push_back( leafNum );
+            }
         }
     };
 
 
     /**
-     * load() method loads in and initialises the entire BSP Tree from the
-     * BSP file.
+     * Returns the cluster of the leaf whose bounding box is nearest to
+     * the camera, or -1 if the map has no clusters
      */
-    void Tree::load( BSP::Header *header, FILE *mapFile ) {
-        // load each of the lumps associated with the BSP Tree
-        leafLump.load( header, mapFile );
-        leafFaceLump.load( header, mapFile );
+    int Tree::findNearestCluster( Camera *camera ) {
+        // The camera's position in Direct3D coordinates, like the boxes
+        float x = -camera->pos->x;
+        float y = -camera->pos->y;
+        float z = -camera->pos->z;
+
+        int nearestCluster = -1;
+        float nearestDistance = 0.0f;
+        int numNodes = nodes.size();
+
+        for ( int i = 0; i < leafLump.getSize(); ++i ) {
+            BSP::Leaf *leaf = leafLump.getData( i );
+            if ( leaf->cluster < 0 || leaf->cluster >= visInfo.getNumClusters() ) {
+                continue;
+            }
+
+            // How far the camera is outside of the box along each axis
+            int box = numNodes + i;
+            float dX = max( fabs( x - treeBoxes.centerX[ box ] ) - treeBoxes.extentX[ box ], 0.0f );
+            float dY = max( fabs( y - treeBoxes.centerY[ box ] ) - treeBoxes.extentY[ box ], 0.0f );
+            float dZ = max( fabs( z - treeBoxes.centerZ[ box ] ) - treeBoxes.extentZ[ box ], 0.0f );
+            float distance = dX * dX + dY * dY + dZ * dZ;
+
+            if ( nearestCluster < 0 || distance < nearestDistance ) {
+                nearestCluster = leaf->cluster;
+                nearestDistance = distance;
+            }
+        }
 
-        nodeLump.load( header, mapFile );
-        planeLump.load( header, mapFile );
+        return nearestCluster;
+    };
 
-        // Load in the visibility information
-        visInfo.load( header, mapFile );
 
-        // Resize the cluster information to fit the data that is going to be put
-        // into it
-        clusters.resize( visInfo.getNumClusters() );
-        clusterLeaves.resize( visInfo.getNumClusters() );
+    /**
+     * Returns true if leaf #leafNum is in a cluster, and puts the number
+     * of its faces that are in the leaf face lump into numFaces
+     */
+    bool Tree::getClusterLeaf( int leafNum, int *numFaces ) {
+        BSP::Leaf *bspLeaf = leafLump.getData( leafNum );
+        *numFaces = 0;
 
-        // Instantiate the first node, which recursively instantiates the entire
-        // BSP tree
-        firstNode = new Node( leafLump.getData( 0 ), leafFaceLump.getData( 0 ), nodeLump.getData( 0 ), &clusters, planeLump.getData( 0 ), 0, &clusterLeaves );
+        // If the leaf has no visibility information, it doesn't belong to any cluster
+        if ( bspLeaf == NULL || bspLeaf->cluster < 0 || bspLeaf->cluster >= visInfo.getNumClusters() ) {
+            return false;
+        }
 
+        // Only the faces that are actually in the leaf face lump are used
+        if ( bspLeaf->first_leaf_face + bspLeaf->num_leaf_faces <= leafFaceLump.getSize() ) {
+            *numFaces = bspLeaf->num_leaf_faces;
+        }
+
+        return true;
     };
 
 
@@ -181,24 +456,24 @@ namespace BSPTree {
      * unload() method deletes all memory allocated by the load() method
      */
     void Tree::unload() {
-        // delete the first node, which recursively deletes the entire BSP Tree
-        if ( firstNode != NULL ) {
-            delete firstNode;
-            firstNode = NULL;
-        }
+        // delete the nodes of the BSP Tree
+        nodes.resize( 0 );
 
         // unload each of the lumps
         leafLump.unload();
         leafFaceLump.unload();
-        planeLump.unload();
-        nodeLump.unload();
 
         // unload the visibility information
         visInfo.unload();
 
         // unload the cluster information
-        clusters.resize( 0 );
-        clusterLeaves.resize( 0 );
+        clusterStarts.resize( 0 );
+        clusterLeafNums.resize( 0 );
+        leafFaceStarts.resize( 0 );
+        clusterFaces.resize( 0 );
+
+        treeBoxes.clear();
+        visitStack.resize( 0 );
     };
 }
 //---------------------------------------------------------------------------
@@ -8,6 +8,9 @@
 #include "VisibilityInfo.h"
 #include "Lump.h"
 #include "Camera.h"
+#include "MapCache.h"
+#include "BoxCull.h"
+#include "CoarseOcclusion.h"
 
 /**
  * This module loads in and interprets the BSP Tree structure contained within a .BSP map.
@@ -22,184 +25,198 @@
  *       leaf, the visible portions of the BSP map can be determined, thus improving
  *       rendering speed. The details of the Potentially-Visible-Set culling algorithm
  *       are further discussed in the files "VisibilityInfo.h" and "VisibilityInfo.cpp"
+ *     - The tree is stored as a flat array of nodes (see BSPTree::Node), so
+ *       finding a leaf is a simple loop down the array, and building the tree
+ *       never recurses.
+ *     - The leaves of each cluster, and the faces of those leaves, are kept
+ *       one cluster after the other in a few flat arrays, with an array of
+ *       starting positions for each (see getClusterStart()). Going through
+ *       a cluster's leaves and faces only reads straight through memory.
+ *     - Each node also has a bounding box around everything below it. When the
+ *       map is drawn, findVisibleLeaves() walks down the tree from front to
+ *       back, and skips every node whose box is outside of the viewing
+ *       frustum, along with everything below it.
  */
 
 
 /**
  * BSPTree namespace:
  * Contains:
- *     BSPTree::TreeChild: "child" type in BSP Tree
- *     BSPTree::Leaf: represents a BSP::Leaf (BSPCommon.h) in the BSP tree
- *     BSPTree::Node: represents a BSP::Node (BSPCommon.h) in the BSP tree
+ *     BSPTree::Node: a node of the flattened BSP tree
  *     BSPTree::Tree: represents the entire BSP Tree.
  */
 namespace BSPTree {
 
-    // This just tells the TreeChild class that the Leaf class exists
-    class Leaf;
+    /**
+     * A Node in a BSP Tree represents a split in the BSP tree. The node has two
+     * children, which can either be another node, or a leaf.
+     *
+     * The nodes are stored one after the other in a single array, in the same
+     * order as the BSP::Node lump. The splitting plane is copied into the node,
+     * so walking down the tree only ever touches the node array:
+     *     - children[ 0 ] is the front child, children[ 1 ] is the back child
+     *     - A child that is 0 or more is the index of another node
+     *     - A negative child is a leaf. The index into the leaf lump is
+     *       -( child + 1 )
+     */
+    typedef struct {
+        // The splitting plane of the node
+        Point3f normal;
+        float distance;
+
+        // The front and back children of the node
+        int children[ 2 ];
+    } Node;
 
     /**
-     * Base class TreeChild is a class that has only three methods: a constructor,
-     * a destructor, and a getLeaf( Point3f ) routine. This class has two subclasses:
-     * The Node, and the Leaf. The Node and Leaf classes override the destructor and
-     * the getLeaf( Point3f ) routines. The Node class defines its two children as
-     * pointers to this class, then instantiates them as either another node, or a leaf.
+     * The BSPTree::Tree object represents the entire BSP Tree.
      */
-    class TreeChild {
+    class Tree {
         public:
-            // Constructor does nothing
-            TreeChild() {};
+            /**
+             * Constructor prepares the object for later use.
+             */
+            Tree();
 
-            // Overloadable destructor does nothing
-            virtual ~TreeChild() {};
+            /**
+             * Destructor deletes the memory allocated when loaded, if any remains
+             */
+            ~Tree();
 
             /**
-             * getLeaf() method is must be overridden by a base class - see functions
-             * at definitions in Node and Leaf classes.
+             * load() method loads in and initialises the entire BSP Tree from the
+             * BSP file. If cache isn't NULL, the nodes and the clusters are taken
+             * from the map cache instead of being built, and true is returned. If
+             * the cache can't be used, they are built and false is returned.
              */
-            virtual Leaf *getLeaf( Point3f point ) = 0;
+            bool load( BSPFile *mapFile, MapCache *cache );
 
-    };
+            /**
+             * saveCache() gives the nodes and the clusters to a map cache, once
+             * the tree has been loaded.
+             */
+            void saveCache( MapCacheWriter *writer );
 
-    /**
-     * A Node in a BSP Tree represents a split in the BSP tree. The node has two
-     * children, which can either be another node, or a leaf.
-     */
-    class Node : public TreeChild {
-        public:
             /**
-             * The Constructor for the Node class has several parts:
-             * - First, it creates itself, just like all other constructors. It stores
-             *      a pointer to the BSP::Node and a pointer to the BSP::Plane for
-             *      BSP tree traversal.
-             * - Afterwards, it instantiates its "children", based on the information
-             *      found in the BSP::Node array at index nodeNum.
-             *      - If that child is a Leaf, then it creates a Leaf object and
-             *          stores it.
-             *      - If that child is another node, this constructor is called
-             *          in a recursive style to instantiate the next node.
-             * Each branch of the BSP Tree ends in a leaf.
-             *
-             * leafArray: the array of BSP Leaves from the BSP Map file
-             * leafFaceArray: the array of BSP leaf faces from the BSP map file
-             * nodeArray: the array of BSP Nodes
-             * clusters: the array of BSP::Clusters that the leaves append their
-             *      face index information to.
-             * planeArray: the array of BSP::Planes that the Nodes use for the
-             *      splitting plane.
-             * nodeNum: the index of the node in the node array to be instantiated
-             * clusterLeaves: the array of BSP::Leaves to add to for frustum culling
-             *      purposes. The array is sorted by clusters, then by leaves (2 dimensions)
+             * unload() method deletes all memory allocated by the load() method
              */
-            Node( BSP::Leaf *leafArray, BSP::LeafFace *leafFaceArray,
-                    BSP::Node *nodeArray, vector< BSP::Cluster > *clusters,
-                    BSP::Plane *planeArray, int nodeNum,
-                    vector< vector< BSP::Leaf * > > *clusterLeaves );
+            void unload();
 
             /**
-             * Destructor deletes both of the children of this node
+             * Returns the number of clusters in the map
              */
-            ~Node();
+            int getNumClusters() {
+                return visInfo.getNumClusters();
+            };
 
             /**
-             * Returns the leaf that the parameter point is within.
-             * Calls getLeaf() on the node/leaf that contains parameter point
-             * (the containing leaf/node is found by the splitting plane).
+             * Returns the position of the first of cluster #clusterNum's leaves
+             * in the cluster leaf array. The cluster's leaves go up to (but don't
+             * include) the first leaf of cluster #( clusterNum + 1 ).
              */
-            Leaf *getLeaf( Point3f point );
+            int getClusterStart( int clusterNum ) {
+                return clusterStarts[ clusterNum ];
+            };
 
-        private:
-            // The Node's children
-            TreeChild *front, *back;
+            /**
+             * Returns the leaf lump index of entry #clusterLeaf of the cluster
+             * leaf array
+             */
+            int getClusterLeafNum( int clusterLeaf ) {
+                return clusterLeafNums[ clusterLeaf ];
+            };
 
-            // The pointer to the node that this object represents
-            BSP::Node *bspNode;
+            /**
+             * Returns the faces of entry #clusterLeaf of the cluster leaf array,
+             * and puts the number of faces into numFaces
+             */
+            BSP::LeafFace *getClusterLeafFaces( int clusterLeaf, int *numFaces ) {
+                *numFaces = leafFaceStarts[ clusterLeaf + 1 ] - leafFaceStarts[ clusterLeaf ];
 
-            // The pointer to the splitting plane of this node
-            BSP::Plane *bspPlane;
-    };
+                return *numFaces > 0 ? &clusterFaces[ leafFaceStarts[ clusterLeaf ] ] : NULL;
+            };
 
-    /**
-     * The BSPTree::Leaf class represents a leaf in the BSP tree. The BSP leaf is
-     * the final step in traversing the BSP Tree. The leaf contains the cluster
-     * number that it is within, which in turn lets us find which clusters are
-     * visible by the camera. The leaf is treated like any other TreeChild subclass,
-     * with the exception of tree traversal (see getLeaf())
-     */
-    class Leaf : public TreeChild {
-        public:
             /**
-             * The Leaf constructor does the following:
-             * - Instantiates this leaf
-             * - Appends a set of indices to faces (a set of polygons) in the clusters
-             *      array, and appends its BSP::Leaf to the appropriate cluster in clusterLeaves
+             * findVisibleLeaves() walks down the BSP tree from front to back
+             * (nearest to the camera first), and adds the index of each leaf
+             * that is in the viewing frustum, and in a cluster that is set in
+             * visState, to "leaves".
+             *
+             * A node whose bounding box is outside of the frustum is skipped,
+             * along with everything below it. The frustum planes that a node's
+             * box is entirely in front of aren't tested again below that node.
              *
-             * leafArray: The array of BSP::Leaves from the BSP Map file
-             * leafFaceArray: The array of indices to the faces
-             * clusters: The array of clusters, which contain the leaves' indices
-             *      to the faces
-             * leafNum: The index to the leafArray to use in loading the leaf
-             * clusterLeaves: The array of indices to the BSP::Leaves for the
-             *      purposes of frustum culling
+             * If occlusion isn't NULL, nodes and leaves that are hidden behind
+             * the leaves that were found before them are skipped too, and the
+             * faces of each leaf that is found are added to it.
              */
-            Leaf( BSP::Leaf *leafArray, BSP::LeafFace *leafFaceArray,
-                    vector< BSP::Cluster > *clusters, int leafNum,
-                    vector< vector< BSP::Leaf * > > *clusterLeaves );
-            ~Leaf();
+            void findVisibleLeaves( Camera *camera, BitVector *visState, vector< int > *leaves,
+                                    CoarseOcclusion *occlusion );
 
             /**
-             * Traversing the BSP Tree goes by finding on which side of a plane the
-             * parameter point is on, eventually terminating on a leaf. The leaf
-             * is the final step in traversal, so it is the leaf that the point is
-             * within.
-             * Returns a pointer to this leaf.
+             * Returns the cluster that the camera is in, or -1 if the camera is
+             * outside of the map (in a solid leaf, or a leaf without a cluster)
              */
-            Leaf *getLeaf( Point3f point );
+            int getCameraCluster( Camera *camera ) {
+                BSP::Leaf *leaf = getLeaf( getCameraPoint( camera ) );
 
-            // The BSP::Leaf that this object represents
-            BSP::Leaf *bspLeaf;
-    };
+                if ( leaf == NULL || leaf->cluster >= visInfo.getNumClusters() ) {
+                    return -1;
+                }
 
-    /**
-     * The BSPTree::Tree object represents the entire BSP Tree.
-     */
-    class Tree {
-        public:
-            /**
-             * Constructor sets all pointers to null, preparing the object for
-             * later use.
-             */
-            Tree();
+                return leaf->cluster;
+            };
 
             /**
-             * Destructor deletes the memory allocated when loaded, if any remains
+             * Returns the cluster of the leaf whose bounding box is nearest to
+             * the camera, or -1 if the map has no clusters
              */
-            ~Tree();
+            int findNearestCluster( Camera *camera );
 
             /**
-             * load() method loads in and initialises the entire BSP Tree from the
-             * BSP file.
+             * Returns the BitVector (VisibilityInfo.h) of the clusters that can
+             * be seen from cluster #clusterNum. If clusterNum is -1, every
+             * cluster is visible.
              */
-            void load( BSP::Header *header, FILE *mapFile );
+            BitVector *getClusterVisState( int clusterNum ) {
+                return visInfo.getVisState( clusterNum );
+            };
 
             /**
-             * unload() method deletes all memory allocated by the load() method
+             * Returns the faces in leaf #leafNum, and puts the number of faces
+             * into numFaces
              */
-            void unload();
+            BSP::LeafFace *getLeafFaces( int leafNum, int *numFaces ) {
+                BSP::Leaf *leaf = leafLump.getData( leafNum );
+
+                // Leave out faces that aren't in the leaf face lump
+                if ( leaf == NULL || leaf->first_leaf_face + leaf->num_leaf_faces > leafFaceLump.getSize() ) {
+                    *numFaces = 0;
+                    return NULL;
+                }
+
+                *numFaces = leaf->num_leaf_faces;
+                return leafFaceLump.getData( leaf->first_leaf_face );
+            };
 
             /**
-             * Returns an array of all of the map's clusters
+             * Adds the bounding box of leaf #leafNum, in Direct3D coordinates,
+             * to the end of "boxes"
              */
-            vector< BSP::Cluster > *getClusters() {
-                return &clusters;
+            void copyLeafBox( int leafNum, BoxArray *boxes ) {
+                int box = nodes.size() + leafNum;
+
+                boxes->add( treeBoxes.centerX[ box ], treeBoxes.centerY[ box ], treeBoxes.centerZ[ box ],
+                            treeBoxes.extentX[ box ], treeBoxes.extentY[ box ], treeBoxes.extentZ[ box ] );
             };
 
             /**
-             * Returns an array sorted by clusters, then by leaf numbers. The drawing
-             * code in BSPMap.cpp uses this information for frustum culling.
+             * Returns a point in Quake coordinates from the camera's position
              */
-            vector< vector< BSP::Leaf * > > *getClusterLeaves() {
-                return &clusterLeaves;
+            static Point3f getCameraPoint( Camera *camera ) {
+                return getPoint( camera->pos->z * BSP::REVERSE_SCALE,
+                                -camera->pos->x * BSP::REVERSE_SCALE,
+                                -camera->pos->y * BSP::REVERSE_SCALE );
             };
 
 
@@ -211,37 +228,63 @@ namespace BSPTree {
              */
             BitVector *getVisState( Camera *camera ) {
 
-                // Find the leaf by using the camera's position, translated to Quake coordinates
-                Leaf *leaf = getLeaf( getPoint( camera->pos->z * BSP::REVERSE_SCALE,
-                                               -camera->pos->x * BSP::REVERSE_SCALE,
-                                               -camera->pos->y * BSP::REVERSE_SCALE ) );
+                // If the camera was not in any specific cluster, then the BitVector
+                // has the entire map visible.
+                return visInfo.getVisState( getCameraCluster( camera ) );
+            };
+
+
+            /**
+             * Returns the index (in the leaf lump) of the leaf that a point is
+             * within by walking down the BSP Tree. The point is in Quake coordinates.
+             */
+            int getLeafIndex( Point3f point ) {
 
-                // If the camera was not in any specific leaf, then just draw the
-                // entire map.
-                if ( leaf == NULL ) {
-                    return visInfo.getVisState( visInfo.getNumClusters() );
+                // Start at the first node. A map without any nodes is a single leaf.
+                int child = nodes.empty() ? -1 : 0;
+
+                // Keep going down the tree until a leaf is reached. If the point
+                // is behind the splitting plane, use the back child. Otherwise,
+                // use the front child.
+                while ( child >= 0 ) {
+                    Node *node = &nodes[ child ];
+
+                    float planeResult = point.x * node->normal.x + point.y * node->normal.y + point.z * node->normal.z - node->distance;
+
+                    child = node->children[ planeResult < 0.0f ];
                 }
 
-                // Otherwise, return the BitVector for the cluster that the camera is within
-                return visInfo.getVisState( leaf->bspLeaf->cluster );
+                return -( child + 1 );
             };
 
-
             /**
              * Returns the leaf that a point is within by traversing the BSP Tree.
              */
-            Leaf *getLeaf( Point3f point ) {
-                return firstNode->getLeaf( point );
+            BSP::Leaf *getLeaf( Point3f point ) {
+                return leafLump.getData( getLeafIndex( point ) );
             };
 
         private:
 
+            // Builds the nodes and the clusters out of the BSP file's lumps
+            void build( BSPFile *mapFile );
+
+            // Copies the nodes and the clusters out of a map cache. Returns false
+            // if the cache doesn't match the leaves in the map.
+            bool loadCache( MapCache *cache );
 
-            // The topmost and first node of the BSP Tree
-            Node *firstNode;
+            // Works out the bounding box of each node and leaf
+            void buildTreeBoxes( BSPFile *mapFile );
 
-            // The BSP node lump
-            Lump< BSP::Node, BSP_NODE_LUMP > nodeLump;
+            // Adds a bounding box in Quake coordinates to treeBoxes
+            void addTreeBox( Point3s min, Point3s max );
+
+            // Returns true if leaf #leafNum is in a cluster, and puts the
+            // number of its faces that are in the leaf face lump into numFaces
+            bool getClusterLeaf( int leafNum, int *numFaces );
+
+            // The nodes of the BSP Tree. The first node is the top of the tree.
+            vector< Node > nodes;
 
             // The BSP leaf lump
             Lump< BSP::Leaf, BSP_LEAF_LUMP > leafLump;
@@ -249,21 +292,38 @@ namespace BSPTree {
             // The BSP leaf face lump
             Lump< BSP::LeafFace, BSP_LEAF_FACE_LUMP > leafFaceLump;
 
-            // The BSP Plane lump
-            Lump< BSP::Plane, BSP_PLANE_LUMP > planeLump;
-
             // The Visibility states of all of the clusters in the map
             VisibilityInfo visInfo;
 
-            // The array of indices to faces, for drawing
-            vector< BSP::Cluster > clusters;
-
-            // The array of indices to leaves, for frustum culling
-            vector< vector< BSP::Leaf * > > clusterLeaves;
+            // The leaves of every cluster, one cluster after the other, as
+            // indices into the leaf lump. Cluster #c's leaves start at
+            // clusterStarts[ c ], and end at clusterStarts[ c + 1 ].
+            vector< int > clusterStarts;
+            vector< int > clusterLeafNums;
+
+            // The faces of every entry in clusterLeafNums, one entry after the
+            // other. Entry #l's faces start at leafFaceStarts[ l ], and end at
+            // leafFaceStarts[ l + 1 ].
+            vector< int > leafFaceStarts;
+            vector< BSP::LeafFace > clusterFaces;
+
+            // The bounding boxes of the nodes, followed by the bounding boxes of
+            // the leaves, in Direct3D coordinates
+            BoxArray treeBoxes;
+
+            // A node or leaf that findVisibleLeaves() still has to visit, and
+            // the frustum planes that it has to be tested against
+            typedef struct {
+                int child;
+                int planeMask;
+            } Visit;
+
+            // The nodes and leaves that findVisibleLeaves() still has to visit.
+            // It is kept here so that it doesn't have to grow every frame.
+            vector< Visit > visitStack;
     };
 
 };
 
 //---------------------------------------------------------------------------
 #endif
- 
\ No newline at end of file
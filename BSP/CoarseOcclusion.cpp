@@ -0,0 +1,319 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "CoarseOcclusion.h"
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+
+// Anything nearer to the camera than this is counted as reaching behind it
+#define OCCLUSION_NEAR 0.0001f
+
+
+/**
+ * Projects the point ( x, y, z ) onto the depth buffer with the matrix m
+ */
+static ScreenPoint project( const D3DXMATRIX *m, float x, float y, float z ) {
+    float clipX = x * m->_11 + y * m->_21 + z * m->_31 + m->_41;
+    float clipY = x * m->_12 + y * m->_22 + z * m->_32 + m->_42;
+
+    ScreenPoint p;
+    p.w = x * m->_14 + y * m->_24 + z * m->_34 + m->_44;
+
+    if ( p.w > OCCLUSION_NEAR ) {
+        p.x = ( clipX / p.w * 0.5f + 0.5f ) * OCCLUSION_WIDTH;
+        p.y = ( -clipY / p.w * 0.5f + 0.5f ) * OCCLUSION_HEIGHT;
+    } else {
+        p.x = 0.0f;
+        p.y = 0.0f;
+    }
+
+    return p;
+};
+
+
+/**
+ * Constructor prepares the object to be loaded
+ */
+CoarseOcclusion::CoarseOcclusion() {
+    faceInfo = NULL;
+    frame = 0;
+    numTriangles = 0;
+    numOccluded = 0;
+
+    depth.resize( OCCLUSION_WIDTH * OCCLUSION_HEIGHT );
+    D3DXMatrixIdentity( &faceViewProj );
+    D3DXMatrixIdentity( &boxViewProj );
+};
+
+
+/**
+ * load() works out which of the map's faces hide what is behind them.
+ * faceInfo must stay loaded for as long as this object is used.
+ */
+void CoarseOcclusion::load( FaceInfo *faceInfo, TextureInfo *texInfo ) {
+    unload();
+
+    this->faceInfo = faceInfo;
+
+    faceOccludes.resize( faceInfo->getNumFaces() );
+    faceFrame.resize( faceInfo->getNumFaces() );
+
+    for ( int i = 0; i < faceInfo->getNumFaces(); ++i ) {
+        BSP::TexInfo *info = texInfo->getData( faceInfo->getTextureNum( i ) );
+
+        unsigned int seeThrough = BSP::SURFACE_SKY | BSP::SURFACE_WARP | BSP::SURFACE_TRANS33 |
+                                  BSP::SURFACE_TRANS66 | BSP::SURFACE_NODRAW;
+
+        faceOccludes[ i ] = ( info != NULL && !( info->flags & seeThrough ) ) ? 1 : 0;
+        faceFrame[ i ] = 0;
+    }
+};
+
+/**
+ * unload() forgets about the map's faces
+ */
+void CoarseOcclusion::unload() {
+    faceInfo = NULL;
+    faceOccludes.resize( 0 );
+    faceFrame.resize( 0 );
+    frame = 0;
+};
+
+
+/**
+ * begin() empties the depth buffer for a new frame. The faces are in the
+ * map's own units, so they are projected with faceViewProj, which is the
+ * world, view and projection matrices multiplied together. The boxes have
+ * already been scaled into the world, so they are projected with boxViewProj,
+ * which is just the view and projection matrices.
+ */
+void CoarseOcclusion::begin( const D3DXMATRIX *faceViewProj, const D3DXMATRIX *boxViewProj ) {
+    this->faceViewProj = *faceViewProj;
+    this->boxViewProj = *boxViewProj;
+
+    for ( int i = 0; i < OCCLUSION_WIDTH * OCCLUSION_HEIGHT; ++i ) {
+        depth[ i ] = FLT_MAX;
+    }
+
+    // Start a new frame. If the frame number wraps around, the faces' old
+    //  frame numbers could match it again, so they are all cleared.
+    if ( ++frame == 0 ) {
+        for ( unsigned int i = 0; i < faceFrame.size(); ++i ) {
+            faceFrame[ i ] = 0;
+        }
+        frame = 1;
+    }
+
+    numTriangles = 0;
+    numOccluded = 0;
+};
+
+
+/**
+ * isOccluded() returns true if box #index of "boxes" is completely
+ * hidden behind the faces that have been drawn so far this frame
+ */
+bool CoarseOcclusion::isOccluded( BoxArray *boxes, int index ) {
+
+    // Nothing can be hidden until something has been drawn
+    if ( numTriangles == 0 ) {
+        return false;
+    }
+
+    float cX = boxes->centerX[ index ];
+    float cY = boxes->centerY[ index ];
+    float cZ = boxes->centerZ[ index ];
+    float eX = boxes->extentX[ index ];
+    float eY = boxes->extentY[ index ];
+    float eZ = boxes->extentZ[ index ];
+
+    // Find the rectangle of pixels that the box's corners cover, and how near
+    //  the box's nearest corner is
+    float minX = FLT_MAX, minY = FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearest = FLT_MAX;
+
+    for ( int c = 0; c < 8; ++c ) {
+        ScreenPoint p = project( &boxViewProj, cX + ( ( c & 1 ) ? eX : -eX ),
+                                               cY + ( ( c & 2 ) ? eY : -eY ),
+                                               cZ + ( ( c & 4 ) ? eZ : -eZ ) );
+
+        // A box that reaches behind the camera can't be tested
+        if ( p.w <= OCCLUSION_NEAR ) {
+            return false;
+        }
+
+        minX = min( minX, p.x );
+        minY = min( minY, p.y );
+        maxX = max( maxX, p.x );
+        maxY = max( maxY, p.y );
+        nearest = min( nearest, p.w );
+    }
+
+    // Every pixel that the rectangle touches, clipped to the depth buffer
+    int x0 = max( ( int ) floor( minX ), 0 );
+    int y0 = max( ( int ) floor( minY ), 0 );
+    int x1 = min( ( int ) ceil( maxX ), OCCLUSION_WIDTH );
+    int y1 = min( ( int ) ceil( maxY ), OCCLUSION_HEIGHT );
+
+    // A box that is off of the screen is left to frustum culling
+    if ( x0 >= x1 || y0 >= y1 ) {
+        return false;
+    }
+
+    // The box is hidden if every pixel is nearer than the box
+    for ( int y = y0; y < y1; ++y ) {
+        float *row = &depth[ y * OCCLUSION_WIDTH ];
+
+        for ( int x = x0; x < x1; ++x ) {
+            if ( row[ x ] >= nearest ) {
+                return false;
+            }
+        }
+    }
+
+    ++numOccluded;
+    return true;
+};
+
+
+/**
+ * addFaces() draws "numFaces" faces into the depth buffer, until
+ * OCCLUSION_MAX_TRIANGLES triangles have been drawn this frame
+ */
+void CoarseOcclusion::addFaces( BSP::LeafFace *faces, int numFaces ) {
+    if ( faceInfo == NULL ) {
+        return;
+    }
+
+    for ( int f = 0; f < numFaces && numTriangles < OCCLUSION_MAX_TRIANGLES; ++f ) {
+        int faceNum = faces[ f ];
+
+        if ( faceNum >= ( int ) faceOccludes.size() || !faceOccludes[ faceNum ] || faceFrame[ faceNum ] == frame ) {
+            continue;
+        }
+        faceFrame[ faceNum ] = frame;
+
+        drawFace( faceNum );
+    }
+};
+
+
+/**
+ * Returns true if the point ( x, y ) is inside of the triangle a, b, c, which
+ * is clockwise on the screen. A point that is on an edge counts as inside, so
+ * that a point on the edge between two triangles of a face is inside of both.
+ */
+static bool insideTriangle( ScreenPoint *a, ScreenPoint *b, ScreenPoint *c, float x, float y ) {
+    const float onEdge = -0.001f;
+
+    return ( b->x - a->x ) * ( y - a->y ) - ( b->y - a->y ) * ( x - a->x ) >= onEdge &&
+           ( c->x - b->x ) * ( y - b->y ) - ( c->y - b->y ) * ( x - b->x ) >= onEdge &&
+           ( a->x - c->x ) * ( y - c->y ) - ( a->y - c->y ) * ( x - c->x ) >= onEdge;
+};
+
+
+/**
+ * Draws the triangles of face #faceNum into the depth buffer. Only the
+ * pixels that the face covers completely are written to.
+ */
+void CoarseOcclusion::drawFace( int faceNum ) {
+    int firstVertex = faceInfo->getFaceStartVertex( faceNum );
+    int numVertices = faceInfo->getFaceStartVertex( faceNum + 1 ) - firstVertex;
+
+    int start = faceInfo->getFaceStartIndex( faceNum );
+    int end = faceInfo->getFaceStartIndex( faceNum + 1 );
+    if ( end - start < 3 ) {
+        return;
+    }
+
+    // Project every corner of the face
+    facePoints.resize( numVertices );
+    for ( int v = 0; v < numVertices; ++v ) {
+        D3D::Vertex *vertex = faceInfo->getVertex( firstVertex + v );
+        facePoints[ v ] = project( &faceViewProj, vertex->x, vertex->y, vertex->z );
+
+        // A face that reaches behind the camera would have to be clipped, so
+        //  it is left out
+        if ( facePoints[ v ].w <= OCCLUSION_NEAR ) {
+            return;
+        }
+    }
+
+    ScreenPoint *p = &facePoints[ 0 ];
+
+    // The corners of the face's triangles, as positions in facePoints
+    faceCorners.resize( end - start );
+    for ( int n = start; n < end; ++n ) {
+        faceCorners[ n - start ] = faceInfo->getIndex( n ) - firstVertex;
+    }
+
+    int *corner = &faceCorners[ 0 ];
+    int numCorners = end - start;
+
+    // The map is drawn with counter-clockwise triangles culled, so only faces
+    //  that are clockwise on the screen can be seen. A face that is facing away
+    //  from the camera can't hide anything (this is what lets the camera see
+    //  into the map from outside of it).
+    ScreenPoint *a = &p[ corner[ 0 ] ], *b = &p[ corner[ 1 ] ], *c = &p[ corner[ 2 ] ];
+    float area = ( b->x - a->x ) * ( c->y - a->y ) - ( b->y - a->y ) * ( c->x - a->x );
+    if ( area <= 0.0f ) {
+        return;
+    }
+
+    numTriangles += numCorners / 3;
+
+    // The whole face is given the depth of its furthest corner, and the pixels
+    //  that the face could cover completely are inside of its rectangle
+    float furthest = p[ 0 ].w;
+    float minX = p[ 0 ].x, minY = p[ 0 ].y;
+    float maxX = p[ 0 ].x, maxY = p[ 0 ].y;
+
+    for ( int v = 1; v < numVertices; ++v ) {
+        furthest = max( furthest, p[ v ].w );
+        minX = min( minX, p[ v ].x );
+        minY = min( minY, p[ v ].y );
+        maxX = max( maxX, p[ v ].x );
+        maxY = max( maxY, p[ v ].y );
+    }
+
+    int x0 = max( ( int ) ceil( minX ), 0 );
+    int y0 = max( ( int ) ceil( minY ), 0 );
+    int x1 = min( ( int ) floor( maxX ), OCCLUSION_WIDTH );
+    int y1 = min( ( int ) floor( maxY ), OCCLUSION_HEIGHT );
+
+    for ( int y = y0; y < y1; ++y ) {
+        for ( int x = x0; x < x1; ++x ) {
+            float *pixel = &depth[ y * OCCLUSION_WIDTH + x ];
+            if ( *pixel <= furthest ) {
+                continue;
+            }
+
+            // Faces are convex, so the pixel is covered if all four of its
+            //  corners are inside of the face. A corner is inside of the face
+            //  if it is inside of any one of the face's triangles.
+            bool covered = true;
+
+            for ( int c = 0; c < 4 && covered; ++c ) {
+                float cornerX = ( float ) ( x + ( c & 1 ) );
+                float cornerY = ( float ) ( y + ( c >> 1 ) );
+
+                covered = false;
+                for ( int t = 0; t + 2 < numCorners && !covered; t += 3 ) {
+                    covered = insideTriangle( &p[ corner[ t ] ], &p[ corner[ t + 1 ] ], &p[ corner[ t + 2 ] ], cornerX, cornerY );
+                }
+            }
+
+            if ( covered ) {
+                *pixel = furthest;
+            }
+        }
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,133 @@
+//---------------------------------------------------------------------------
+
+#ifndef CoarseOcclusionH
+#define CoarseOcclusionH
+
+#include <vector.h>
+
+#include "BSPCommon.h"
+#include "FaceInfo.h"
+#include "TextureInfo.h"
+#include "BoxCull.h"
+
+using namespace std;
+
+
+// The size of the coarse depth buffer, in pixels
+#define OCCLUSION_WIDTH 128
+#define OCCLUSION_HEIGHT 96
+
+// The most triangles that are drawn into the depth buffer each frame
+#define OCCLUSION_MAX_TRIANGLES 4096
+
+
+/**
+ * A point that has been projected onto the depth buffer
+ */
+typedef struct {
+    float x, y;     // The position in pixels
+    float w;        // The distance in front of the camera
+} ScreenPoint;
+
+/**
+ * CoarseOcclusion keeps a tiny software depth buffer of the screen, so that
+ * parts of the map that are hidden behind walls that have already been found
+ * can be skipped.
+ *
+ * While the BSP tree is walked from front to back, the faces of each visible
+ * leaf are drawn into the depth buffer with addFaces(). Before a node or leaf
+ * is visited, isOccluded() checks whether its bounding box is completely
+ * behind what has been drawn so far.
+ *
+ * The test never hides something that can be seen:
+ *  - A pixel is only written when a face covers all of it, and it is given
+ *    the depth of the face's furthest corner.
+ *  - A box is only occluded if every pixel that it touches is nearer than the
+ *    box's nearest corner.
+ *  - Faces and boxes that reach behind the camera are never used.
+ * Faces that can be seen through (sky, water, glass), and faces that are
+ * facing away from the camera, are never drawn into it.
+ */
+class CoarseOcclusion {
+    public:
+
+        /**
+         * Constructor prepares the object to be loaded
+         */
+        CoarseOcclusion();
+
+        /**
+         * load() works out which of the map's faces hide what is behind them.
+         * faceInfo must stay loaded for as long as this object is used.
+         */
+        void load( FaceInfo *faceInfo, TextureInfo *texInfo );
+
+        /**
+         * unload() forgets about the map's faces
+         */
+        void unload();
+
+        /**
+         * begin() empties the depth buffer for a new frame. The faces are in
+         * the map's own units, so they are projected with faceViewProj, which
+         * is the world, view and projection matrices multiplied together. The
+         * boxes have already been scaled into the world, so they are projected
+         * with boxViewProj, which is just the view and projection matrices.
+         */
+        void begin( const D3DXMATRIX *faceViewProj, const D3DXMATRIX *boxViewProj );
+
+        /**
+         * isOccluded() returns true if box #index of "boxes" is completely
+         * hidden behind the faces that have been drawn so far this frame
+         */
+        bool isOccluded( BoxArray *boxes, int index );
+
+        /**
+         * addFaces() draws "numFaces" faces into the depth buffer, until
+         * OCCLUSION_MAX_TRIANGLES triangles have been drawn this frame
+         */
+        void addFaces( BSP::LeafFace *faces, int numFaces );
+
+        /**
+         * Returns the number of boxes that have been found to be occluded
+         * this frame
+         */
+        int getNumOccluded() {
+            return numOccluded;
+        };
+
+    private:
+
+        // Draws the triangles of face #faceNum into the depth buffer
+        void drawFace( int faceNum );
+
+        // The depth of each pixel, as the distance in front of the camera.
+        //  Pixels that nothing has been drawn to are as far away as possible.
+        vector< float > depth;
+
+        // The matrices that the faces and the boxes are projected with
+        D3DXMATRIX faceViewProj;
+        D3DXMATRIX boxViewProj;
+
+        // The projected corners of the face that is being drawn, and the
+        //  corners of each of its triangles
+        vector< ScreenPoint > facePoints;
+        vector< int > faceCorners;
+
+        // The map's faces, and whether each one hides what is behind it
+        FaceInfo *faceInfo;
+        vector< unsigned char > faceOccludes;
+
+        // The frame that each face was last drawn in, so that a face that is
+        //  in more than one leaf is only drawn once
+        vector< unsigned int > faceFrame;
+        unsigned int frame;
+
+        // The number of triangles drawn, and boxes occluded, this frame
+        int numTriangles;
+        int numOccluded;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
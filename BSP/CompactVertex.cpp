@@ -0,0 +1,460 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "CompactVertex.h"
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector.h>
+
+using namespace std;
+
+
+/**
+ * The Direct3D vertex declaration of a D3D::CompactVertex
+ */
+const D3DVERTEXELEMENT9 COMPACT_VERTEX_ELEMENTS[] = {
+    { 0, 0,  D3DDECLTYPE_SHORT4N,   D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+    { 0, 8,  D3DDECLTYPE_UBYTE4N,   D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL,   0 },
+    { 0, 12, D3DDECLTYPE_FLOAT16_2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
+    { 0, 16, D3DDECLTYPE_FLOAT16_2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+    D3DDECL_END()
+};
+
+// The biggest number that a half float can hold
+#define HALF_MAX 65504.0f
+
+// The fixed point code of 1.0 in a SHORT4N
+#define SHORT_ONE 32767.0f
+
+// The octahedral code of 1.0. Codes 0 to 254 stand for -1 to 1.
+#define OCTAHEDRAL_ONE 127.0f
+
+
+/**
+ * floatToHalf() rounds value to the nearest half float. Values that are too
+ * big for a half float are clamped to the biggest one (65504).
+ */
+unsigned short floatToHalf( float value ) {
+    unsigned int bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    unsigned int sign = ( bits >> 16 ) & 0x8000;
+    int floatExponent = ( bits >> 23 ) & 0xFF;
+    unsigned int mantissa = bits & 0x7FFFFF;
+
+    // Not a number stays not a number. Infinity is clamped like any other
+    //  number that is too big.
+    if ( floatExponent == 0xFF && mantissa != 0 ) {
+        return ( unsigned short ) ( sign | 0x7E00 );
+    }
+
+    int exponent = floatExponent - 127 + 15;
+
+    if ( exponent >= 31 ) {
+        return ( unsigned short ) ( sign | 0x7BFF );
+    }
+
+    // Numbers that are too small for the half float's exponent are stored
+    //  without the hidden 1 bit, or as 0 if they are too small even for that
+    if ( exponent <= 0 ) {
+        if ( exponent < -10 ) {
+            return ( unsigned short ) sign;
+        }
+
+        mantissa |= 0x800000;
+
+        int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rest = mantissa & ( ( 1 << shift ) - 1 );
+        unsigned int halfway = 1 << ( shift - 1 );
+
+        // Round to the nearest, and to the even one when exactly between two
+        if ( rest > halfway || ( rest == halfway && ( half & 1 ) ) ) {
+            ++half;
+        }
+
+        return ( unsigned short ) ( sign | half );
+    }
+
+    unsigned int half = ( exponent << 10 ) | ( mantissa >> 13 );
+    unsigned int rest = mantissa & 0x1FFF;
+
+    // Rounding up can carry into the exponent, which is still the right answer,
+    //  unless it carries all of the way up to infinity
+    if ( rest > 0x1000 || ( rest == 0x1000 && ( half & 1 ) ) ) {
+        ++half;
+    }
+    if ( half >= 0x7C00 ) {
+        half = 0x7BFF;
+    }
+
+    return ( unsigned short ) ( sign | half );
+};
+
+/**
+ * halfToFloat() returns the value of a half float
+ */
+float halfToFloat( unsigned short half ) {
+    unsigned int sign = ( half & 0x8000 ) << 16;
+    int exponent = ( half >> 10 ) & 0x1F;
+    unsigned int mantissa = half & 0x3FF;
+
+    // Numbers without the hidden 1 bit are a multiple of 2^-24
+    if ( exponent == 0 ) {
+        float value = ( float ) ldexp( ( double ) mantissa, -24 );
+        return sign ? -value : value;
+    }
+
+    unsigned int bits;
+    if ( exponent == 31 ) {
+        bits = sign | 0x7F800000 | ( mantissa << 13 );
+    } else {
+        bits = sign | ( ( exponent - 15 + 127 ) << 23 ) | ( mantissa << 13 );
+    }
+
+    float value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+};
+
+/**
+ * Returns the most that a value between -maxValue and maxValue can be off by
+ * after being rounded to a half float
+ */
+float getHalfErrorBound( float maxValue ) {
+    maxValue = fabs( maxValue );
+
+    // Values that are too big are clamped
+    if ( maxValue > HALF_MAX ) {
+        return maxValue - HALF_MAX + 16.0f;
+    }
+
+    // A half float has 10 bits after its hidden bit, so a number between 2^e
+    //  and 2^( e + 1 ) is rounded to a multiple of 2^( e - 10 ). It is off by
+    //  half of that, at most. Numbers below 2^-14 are all multiples of 2^-24.
+    int exponent;
+    frexp( maxValue, &exponent );
+
+    int errorExponent = exponent - 12;
+    if ( errorExponent < -25 ) {
+        errorExponent = -25;
+    }
+
+    return ( float ) ldexp( 1.0, errorExponent );
+};
+
+
+/**
+ * Folds a point on the lower half of the octahedron out over the upper half's
+ * square, or back again. Both ways are the same.
+ */
+static void foldOctahedral( float *u, float *v ) {
+    float foldedU = ( 1.0f - fabs( *v ) ) * ( *u >= 0.0f ? 1.0f : -1.0f );
+    float foldedV = ( 1.0f - fabs( *u ) ) * ( *v >= 0.0f ? 1.0f : -1.0f );
+
+    *u = foldedU;
+    *v = foldedV;
+};
+
+/**
+ * decodeOctahedral() turns the octahedral normal in code[ 0 ] and code[ 1 ]
+ * back into a direction that is one unit long
+ */
+void decodeOctahedral( const unsigned char *code, float *nx, float *ny, float *nz ) {
+    float u = code[ 0 ] / OCTAHEDRAL_ONE - 1.0f;
+    float v = code[ 1 ] / OCTAHEDRAL_ONE - 1.0f;
+    float w = 1.0f - fabs( u ) - fabs( v );
+
+    if ( w < 0.0f ) {
+        foldOctahedral( &u, &v );
+    }
+
+    float length = sqrt( u * u + v * v + w * w );
+
+    *nx = u / length;
+    *ny = v / length;
+    *nz = w / length;
+};
+
+/**
+ * encodeOctahedral() stores the direction ( nx, ny, nz ) as an octahedral
+ * normal in code[ 0 ] and code[ 1 ]. Of the codes next to the direction, the
+ * one that decodes closest to it is used.
+ */
+void encodeOctahedral( float nx, float ny, float nz, unsigned char *code ) {
+    float sum = fabs( nx ) + fabs( ny ) + fabs( nz );
+
+    // A direction without a length is stored as straight up
+    if ( !( sum > 0.0f ) ) {
+        code[ 0 ] = code[ 1 ] = ( unsigned char ) OCTAHEDRAL_ONE;
+        return;
+    }
+
+    // Project the direction onto the octahedron |u| + |v| + |w| = 1, and fold
+    //  the lower half out over the corners of the square
+    float u = nx / sum;
+    float v = ny / sum;
+
+    if ( nz < 0.0f ) {
+        foldOctahedral( &u, &v );
+    }
+
+    // Try the four codes around the direction, and keep the closest one
+    float length = sqrt( nx * nx + ny * ny + nz * nz );
+    int baseU = ( int ) floor( ( u + 1.0f ) * OCTAHEDRAL_ONE );
+    int baseV = ( int ) floor( ( v + 1.0f ) * OCTAHEDRAL_ONE );
+    float bestDot = -2.0f;
+
+    for ( int c = 0; c < 4; ++c ) {
+        int codeU = baseU + ( c & 1 );
+        int codeV = baseV + ( c >> 1 );
+
+        if ( codeU < 0 || codeU > 254 || codeV < 0 || codeV > 254 ) {
+            continue;
+        }
+
+        unsigned char tryCode[ 2 ] = { ( unsigned char ) codeU, ( unsigned char ) codeV };
+        float x, y, z;
+        decodeOctahedral( tryCode, &x, &y, &z );
+
+        float dot = ( x * nx + y * ny + z * nz ) / length;
+        if ( dot > bestDot ) {
+            bestDot = dot;
+            code[ 0 ] = tryCode[ 0 ];
+            code[ 1 ] = tryCode[ 1 ];
+        }
+    }
+};
+
+
+/**
+ * findCompactBounds() works out the box around "numVertices" vertices
+ */
+void findCompactBounds( const D3D::Vertex *vertices, int numVertices, CompactBounds *bounds ) {
+    float minX = 0.0f, minY = 0.0f, minZ = 0.0f;
+    float maxX = 0.0f, maxY = 0.0f, maxZ = 0.0f;
+
+    for ( int i = 0; i < numVertices; ++i ) {
+        const D3D::Vertex *vertex = &vertices[ i ];
+
+        if ( i == 0 || vertex->x < minX ) minX = vertex->x;
+        if ( i == 0 || vertex->y < minY ) minY = vertex->y;
+        if ( i == 0 || vertex->z < minZ ) minZ = vertex->z;
+        if ( i == 0 || vertex->x > maxX ) maxX = vertex->x;
+        if ( i == 0 || vertex->y > maxY ) maxY = vertex->y;
+        if ( i == 0 || vertex->z > maxZ ) maxZ = vertex->z;
+    }
+
+    bounds->originX = ( minX + maxX ) / 2.0f;
+    bounds->originY = ( minY + maxY ) / 2.0f;
+    bounds->originZ = ( minZ + maxZ ) / 2.0f;
+
+    // A flat box still needs a size to divide by
+    bounds->extentX = max( ( maxX - minX ) / 2.0f, FLT_EPSILON );
+    bounds->extentY = max( ( maxY - minY ) / 2.0f, FLT_EPSILON );
+    bounds->extentZ = max( ( maxZ - minZ ) / 2.0f, FLT_EPSILON );
+};
+
+/**
+ * Rounds ( value - origin ) / extent to the nearest SHORT4N code
+ */
+static short compactCoordinate( float value, float origin, float extent ) {
+    float code = floor( ( value - origin ) / extent * SHORT_ONE + 0.5f );
+
+    if ( code > SHORT_ONE ) {
+        code = SHORT_ONE;
+    } else if ( code < -SHORT_ONE ) {
+        code = -SHORT_ONE;
+    }
+
+    return ( short ) code;
+};
+
+/**
+ * compactVertex() turns a vertex into a compact vertex in the box "bounds"
+ */
+void compactVertex( const D3D::Vertex *vertex, const CompactBounds *bounds, D3D::CompactVertex *compact ) {
+    compact->x = compactCoordinate( vertex->x, bounds->originX, bounds->extentX );
+    compact->y = compactCoordinate( vertex->y, bounds->originY, bounds->extentY );
+    compact->z = compactCoordinate( vertex->z, bounds->originZ, bounds->extentZ );
+    compact->w = ( short ) SHORT_ONE;
+
+    encodeOctahedral( vertex->nx, vertex->ny, vertex->nz, compact->normal );
+    compact->normal[ 2 ] = 0;
+    compact->normal[ 3 ] = 0;
+
+    compact->u = floatToHalf( vertex->u );
+    compact->v = floatToHalf( vertex->v );
+    compact->lmu = floatToHalf( vertex->lmu );
+    compact->lmv = floatToHalf( vertex->lmv );
+};
+
+/**
+ * expandVertex() turns a compact vertex in the box "bounds" back into a
+ * full vertex, the same way that the shader does
+ */
+void expandVertex( const D3D::CompactVertex *compact, const CompactBounds *bounds, D3D::Vertex *vertex ) {
+    vertex->x = bounds->originX + compact->x / SHORT_ONE * bounds->extentX;
+    vertex->y = bounds->originY + compact->y / SHORT_ONE * bounds->extentY;
+    vertex->z = bounds->originZ + compact->z / SHORT_ONE * bounds->extentZ;
+
+    decodeOctahedral( compact->normal, &vertex->nx, &vertex->ny, &vertex->nz );
+
+    vertex->u = halfToFloat( compact->u );
+    vertex->v = halfToFloat( compact->v );
+    vertex->lmu = halfToFloat( compact->lmu );
+    vertex->lmv = halfToFloat( compact->lmv );
+};
+
+
+/**
+ * getCompactErrorBounds() works out the most that a compact vertex in the box
+ * "bounds" can be off by, if none of its texture coordinates are further than
+ * maxTexCoord from 0, and none of its lightmap coordinates are further than
+ * maxLightMapCoord from 0
+ */
+void getCompactErrorBounds( const CompactBounds *bounds, float maxTexCoord, float maxLightMapCoord,
+                            CompactVertexError *bound ) {
+    // A position is rounded to the nearest 1 / 32767th of the extent, so it is
+    //  off by half of that at most. Turning it back into a float can be off by
+    //  a few more float roundings of the biggest coordinate.
+    float extent = max( bounds->extentX, max( bounds->extentY, bounds->extentZ ) );
+    float origin = max( fabs( bounds->originX ), max( fabs( bounds->originY ), fabs( bounds->originZ ) ) );
+
+    bound->position = extent / SHORT_ONE / 2.0f + ( origin + extent ) * 4.0f * FLT_EPSILON;
+    bound->normalDegrees = COMPACT_NORMAL_ERROR_DEGREES;
+    bound->texCoord = getHalfErrorBound( maxTexCoord );
+    bound->lightMapCoord = getHalfErrorBound( maxLightMapCoord );
+};
+
+/**
+ * measureCompactVertex() works out how far "compact" is off from "vertex", and
+ * raises each part of maxError that it is further off than
+ */
+void measureCompactVertex( const D3D::Vertex *vertex, const D3D::CompactVertex *compact,
+                           const CompactBounds *bounds, CompactVertexError *maxError ) {
+    D3D::Vertex expanded;
+    expandVertex( compact, bounds, &expanded );
+
+    maxError->position = max( maxError->position, ( float ) fabs( expanded.x - vertex->x ) );
+    maxError->position = max( maxError->position, ( float ) fabs( expanded.y - vertex->y ) );
+    maxError->position = max( maxError->position, ( float ) fabs( expanded.z - vertex->z ) );
+
+    // The angle between the normals. A vertex without a normal can't be off.
+    float length = sqrt( vertex->nx * vertex->nx + vertex->ny * vertex->ny + vertex->nz * vertex->nz );
+    if ( length > 0.0f ) {
+        float dot = ( expanded.nx * vertex->nx + expanded.ny * vertex->ny + expanded.nz * vertex->nz ) / length;
+        dot = min( max( dot, -1.0f ), 1.0f );
+
+        maxError->normalDegrees = max( maxError->normalDegrees, ( float ) ( acos( dot ) * 180.0 / 3.14159265358979 ) );
+    }
+
+    maxError->texCoord = max( maxError->texCoord, ( float ) fabs( expanded.u - vertex->u ) );
+    maxError->texCoord = max( maxError->texCoord, ( float ) fabs( expanded.v - vertex->v ) );
+    maxError->lightMapCoord = max( maxError->lightMapCoord, ( float ) fabs( expanded.lmu - vertex->lmu ) );
+    maxError->lightMapCoord = max( maxError->lightMapCoord, ( float ) fabs( expanded.lmv - vertex->lmv ) );
+};
+
+
+/**
+ * Returns a random number from min to max
+ */
+static float randomFloat( float min, float max ) {
+    return min + ( max - min ) * ( float ) rand() / ( float ) RAND_MAX;
+};
+
+/**
+ * testCompactVertices() makes "numVertices" random vertices (from "seed"),
+ * turns them into compact vertices and back, and checks that no part of any
+ * of them is further off than getCompactErrorBounds() says it can be. It
+ * also checks that the normals along the six axes come back exactly. The
+ * results go into "result".
+ */
+void testCompactVertices( int numVertices, unsigned int seed, CompactVertexTest *result ) {
+    // The largest texture and lightmap coordinates that the vertices have.
+    //  Texture coordinates repeat, so they can be well past 1.
+    const float MAX_TEX_COORD = 64.0f;
+    const float MAX_LIGHTMAP_COORD = 1.0f;
+
+    vector< D3D::Vertex > vertices;
+    vertices.resize( numVertices > 0 ? numVertices : 1 );
+
+    srand( seed );
+
+    // The vertices of a map-sized box that isn't centred on the origin, with
+    //  normals in every direction
+    for ( int i = 0; i < numVertices; ++i ) {
+        D3D::Vertex *vertex = &vertices[ i ];
+
+        vertex->x = randomFloat( -3000.0f, 5000.0f );
+        vertex->y = randomFloat( -500.0f, 1500.0f );
+        vertex->z = randomFloat( -4000.0f, 2000.0f );
+
+        float length;
+        do {
+            vertex->nx = randomFloat( -1.0f, 1.0f );
+            vertex->ny = randomFloat( -1.0f, 1.0f );
+            vertex->nz = randomFloat( -1.0f, 1.0f );
+            length = sqrt( vertex->nx * vertex->nx + vertex->ny * vertex->ny + vertex->nz * vertex->nz );
+        } while ( length < 0.01f || length > 1.0f );
+
+        vertex->nx /= length;
+        vertex->ny /= length;
+        vertex->nz /= length;
+
+        vertex->u = randomFloat( -MAX_TEX_COORD, MAX_TEX_COORD );
+        vertex->v = randomFloat( -MAX_TEX_COORD, MAX_TEX_COORD );
+        vertex->lmu = randomFloat( 0.0f, MAX_LIGHTMAP_COORD );
+        vertex->lmv = randomFloat( 0.0f, MAX_LIGHTMAP_COORD );
+    }
+
+    CompactBounds bounds;
+    findCompactBounds( &vertices[ 0 ], numVertices, &bounds );
+    getCompactErrorBounds( &bounds, MAX_TEX_COORD, MAX_LIGHTMAP_COORD, &result->bound );
+
+    memset( &result->maxError, 0, sizeof( result->maxError ) );
+    result->numOverBound = 0;
+    result->numAxisMismatched = 0;
+
+    for ( int i = 0; i < numVertices; ++i ) {
+        D3D::CompactVertex compact;
+        compactVertex( &vertices[ i ], &bounds, &compact );
+
+        CompactVertexError error;
+        memset( &error, 0, sizeof( error ) );
+        measureCompactVertex( &vertices[ i ], &compact, &bounds, &error );
+
+        if ( error.position > result->bound.position || error.normalDegrees > result->bound.normalDegrees ||
+             error.texCoord > result->bound.texCoord || error.lightMapCoord > result->bound.lightMapCoord ) {
+            ++result->numOverBound;
+        }
+
+        measureCompactVertex( &vertices[ i ], &compact, &bounds, &result->maxError );
+    }
+
+    // The normals of walls, floors and ceilings
+    const float AXES[ 6 ][ 3 ] = {
+        { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+    };
+
+    for ( int a = 0; a < 6; ++a ) {
+        unsigned char code[ 2 ];
+        float nx, ny, nz;
+
+        encodeOctahedral( AXES[ a ][ 0 ], AXES[ a ][ 1 ], AXES[ a ][ 2 ], code );
+        decodeOctahedral( code, &nx, &ny, &nz );
+
+        if ( nx != AXES[ a ][ 0 ] || ny != AXES[ a ][ 1 ] || nz != AXES[ a ][ 2 ] ) {
+            ++result->numAxisMismatched;
+        }
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,183 @@
+//---------------------------------------------------------------------------
+
+#ifndef CompactVertexH
+#define CompactVertexH
+
+#include <DirectX/d3d9.h>
+
+#include "BSPCommon.h"
+
+/**
+ * An explanation on compact vertices:
+ *      A D3D::Vertex is ten floats (40 bytes). Most of those bits are wasted on
+ *  a map: every position is somewhere inside of the map's bounding box, every
+ *  normal is one unit long, and the texture coordinates only need to be as
+ *  precise as a fraction of a texel. A D3D::CompactVertex holds the same
+ *  information in 20 bytes:
+ *   - The position is three 16 bit fixed point numbers (SHORT4N), going from
+ *     -1 at one side of the map's bounding box to 1 at the other side. The
+ *     shader scales them back up with the box's centre and extent.
+ *   - The normal is folded onto an octahedron and then flattened onto a square
+ *     ("octahedral encoding"), which is stored as two bytes (UBYTE4N). Codes
+ *     0 to 254 stand for -1 to 1, so that 0 and 1 are stored exactly, and the
+ *     normals of walls, floors and ceilings come out exactly.
+ *   - The texture and lightmap coordinates are half floats (FLOAT16_2).
+ *
+ *      Each of these is rounded to the nearest value that it can hold, so the
+ *  error of each part has a bound, which getCompactErrorBounds() works out.
+ *  measureCompactVertex() measures the actual error of a vertex, so that the
+ *  two can be compared.
+ */
+
+
+namespace D3D {
+
+    /**
+     * A compact map vertex. The layout matches COMPACT_VERTEX_ELEMENTS.
+     */
+    typedef struct {
+        // The position, as fractions of the map's extent from its centre.
+        //  w is always 32767 (1.0).
+        short x, y, z, w;
+
+        // The octahedral normal, in the first two bytes
+        unsigned char normal[ 4 ];
+
+        // The texture and lightmap coordinates, as half floats
+        unsigned short u, v;
+        unsigned short lmu, lmv;
+    } CompactVertex;
+};
+
+
+/**
+ * The Direct3D vertex declaration of a D3D::CompactVertex
+ */
+extern const D3DVERTEXELEMENT9 COMPACT_VERTEX_ELEMENTS[];
+
+// The vertex declaration types that a device must support to use compact vertices
+#define COMPACT_VERTEX_DECL_TYPES ( D3DDTCAPS_SHORT4N | D3DDTCAPS_UBYTE4N | D3DDTCAPS_FLOAT16_2 )
+
+// The most that an octahedral normal can be off by, in degrees. This was
+//  measured over a fine grid of directions (0.64 degrees), and rounded up.
+#define COMPACT_NORMAL_ERROR_DEGREES 0.7f
+
+
+/**
+ * The box that the compact positions are stored in. Every position is
+ * origin + code / 32767 * extent.
+ */
+typedef struct {
+    float originX, originY, originZ;
+    float extentX, extentY, extentZ;
+} CompactBounds;
+
+/**
+ * How far off compact vertices are from the vertices that they were made from
+ */
+typedef struct {
+    // The furthest that a position is off along any axis, in Direct3D units
+    float position;
+
+    // The largest angle between a normal and its compact normal, in degrees
+    float normalDegrees;
+
+    // The furthest that a texture or lightmap coordinate is off
+    float texCoord;
+    float lightMapCoord;
+} CompactVertexError;
+
+
+/**
+ * floatToHalf() rounds value to the nearest half float. Values that are too
+ * big for a half float are clamped to the biggest one (65504).
+ */
+unsigned short floatToHalf( float value );
+
+/**
+ * halfToFloat() returns the value of a half float
+ */
+float halfToFloat( unsigned short half );
+
+/**
+ * Returns the most that a value between -maxValue and maxValue can be off by
+ * after being rounded to a half float
+ */
+float getHalfErrorBound( float maxValue );
+
+
+/**
+ * encodeOctahedral() stores the direction ( nx, ny, nz ) as an octahedral
+ * normal in code[ 0 ] and code[ 1 ]. Of the codes next to the direction, the
+ * one that decodes closest to it is used.
+ */
+void encodeOctahedral( float nx, float ny, float nz, unsigned char *code );
+
+/**
+ * decodeOctahedral() turns the octahedral normal in code[ 0 ] and code[ 1 ]
+ * back into a direction that is one unit long
+ */
+void decodeOctahedral( const unsigned char *code, float *nx, float *ny, float *nz );
+
+
+/**
+ * findCompactBounds() works out the box around "numVertices" vertices
+ */
+void findCompactBounds( const D3D::Vertex *vertices, int numVertices, CompactBounds *bounds );
+
+/**
+ * compactVertex() turns a vertex into a compact vertex in the box "bounds"
+ */
+void compactVertex( const D3D::Vertex *vertex, const CompactBounds *bounds, D3D::CompactVertex *compact );
+
+/**
+ * expandVertex() turns a compact vertex in the box "bounds" back into a
+ * full vertex, the same way that the shader does
+ */
+void expandVertex( const D3D::CompactVertex *compact, const CompactBounds *bounds, D3D::Vertex *vertex );
+
+
+/**
+ * getCompactErrorBounds() works out the most that a compact vertex in the box
+ * "bounds" can be off by, if none of its texture coordinates are further than
+ * maxTexCoord from 0, and none of its lightmap coordinates are further than
+ * maxLightMapCoord from 0
+ */
+void getCompactErrorBounds( const CompactBounds *bounds, float maxTexCoord, float maxLightMapCoord,
+                            CompactVertexError *bound );
+
+/**
+ * measureCompactVertex() works out how far "compact" is off from "vertex", and
+ * raises each part of maxError that it is further off than
+ */
+void measureCompactVertex( const D3D::Vertex *vertex, const D3D::CompactVertex *compact,
+                           const CompactBounds *bounds, CompactVertexError *maxError );
+
+
+/**
+ * The results of testCompactVertices()
+ */
+typedef struct {
+    // The most that the vertices could be off by, and the most that they were
+    CompactVertexError bound;
+    CompactVertexError maxError;
+
+    // The number of vertices that were further off than the bound in any
+    //  part, and the number of the six axis-aligned normals that didn't come
+    //  back exactly. Both should always be 0.
+    int numOverBound;
+    int numAxisMismatched;
+} CompactVertexTest;
+
+/**
+ * testCompactVertices() makes "numVertices" random vertices (from "seed"),
+ * turns them into compact vertices and back, and checks that no part of any
+ * of them is further off than getCompactErrorBounds() says it can be. It
+ * also checks that the normals along the six axes come back exactly. The
+ * results go into "result".
+ */
+void testCompactVertices( int numVertices, unsigned int seed, CompactVertexTest *result );
+
+
+//---------------------------------------------------------------------------
+#endif
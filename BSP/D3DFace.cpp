@@ -7,16 +7,30 @@
 namespace D3D {
     /**
      * Appends the vertex information of this face to the end of the vector
-     * pointed to by vertexBuffer.
+     * pointed to by vertexBuffer, and the indices of its triangles to the end
+     * of the vector pointed to by indexBuffer.
      */
-    void Face::appendTo( vector< D3D::Vertex > *vertexBuffer ) {
-        // Add the number of vertices needed
-        int startIndex = vertexBuffer->size();
-        vertexBuffer->resize( vertexBuffer->size() + vertices.size() );
-
-        // Copy the vertex information
-        for ( unsigned int i = startIndex; i < vertexBuffer->size(); ++i ) {
-            ( *vertexBuffer )[ i ] = vertices[ i - startIndex ];
+    void Face::appendTo( vector< D3D::Vertex > *vertexBuffer, vector< unsigned int > *indexBuffer ) {
+        // Copy all of the vertex information at once
+        unsigned int firstVertex = vertexBuffer->size();
+        vertexBuffer->insert( vertexBuffer->end(), vertices.begin(), vertices.end() );
+
+        if ( vertices.size() < 3 ) {
+            return;
+        }
+
+        // The polygon is convex, so it is covered by a fan of triangles that
+        // all start at its first corner
+        int numTriangles = vertices.size() - 2;
+        int firstIndex = indexBuffer->size();
+        indexBuffer->resize( firstIndex + numTriangles * 3 );
+
+        unsigned int *indices = &( *indexBuffer )[ firstIndex ];
+
+        for ( int i = 0; i < numTriangles; ++i ) {
+            indices[ i * 3 ] = firstVertex;
+            indices[ i * 3 + 1 ] = firstVertex + i + 1;
+            indices[ i * 3 + 2 ] = firstVertex + i + 2;
         }
     };
 
@@ -58,24 +72,23 @@ namespace D3D {
 
 
 
-        // Copy the final vertex information to vertices
-        vertices.resize( ( face->num_edges - 2 ) * 3 );
-
-        for ( int i = 0; i < face->num_edges - 2; ++i ) {
+        // Copy the final vertex information to vertices, one vertex for each
+        // corner of the polygon
+        vertices.resize( face->num_edges > 0 ? face->num_edges : 0 );
 
-            // The first point of the triangle is always the first point of the polygon
-            vertexCopy( &vertices[ i * 3 ], &vertexArray[ polygonEdges[ 0 ].p1 ] );
-            getTexCoord( &vertices[ i * 3 ], &texInfoArray[ face->texture_info ], texture );
-
-            // The other two vertices are on the polygon
-            vertexCopy( &vertices[ i * 3 + 1 ], &vertexArray[ polygonEdges[ i + 1 ].p1 ] );
-            getTexCoord( &vertices[ i * 3 + 1 ], &texInfoArray[ face->texture_info ], texture );
+        for ( unsigned int i = 0; i < vertices.size(); ++i ) {
+            vertexCopy( &vertices[ i ], &vertexArray[ polygonEdges[ i ].p1 ] );
+            getTexCoord( &vertices[ i ], &texInfoArray[ face->texture_info ], texture );
+        }
 
-            vertexCopy( &vertices[ i * 3 + 2 ], &vertexArray[ polygonEdges[ i + 2 ].p1 ] );
-            getTexCoord( &vertices[ i * 3 + 2 ], &texInfoArray[ face->texture_info ], texture );
+        // The polygon is flat, so the normal of its first three corners is the
+        // normal of every corner
+        if ( vertices.size() >= 3 ) {
+            getNormal( &vertices[ 0 ] );
 
-            // Get the normals for each of the three points of the triangle
-            getNormal( &vertices[ i * 3 ] );
+            for ( unsigned int i = 3; i < vertices.size(); ++i ) {
+                normalCopy( &vertices[ i ], &vertices[ 0 ] );
+            }
         }
 
 
@@ -189,6 +202,18 @@ namespace D3D {
         }
     };
 
+    /**
+     * Sets every one of the face's lightmap texture coordinates to ( u, v ).
+     * This is for faces that don't have a lightmap of their own, so that
+     * the whole face uses a single pixel of a lightmap page.
+     */
+    void Face::setLMTexCoords( float u, float v ) {
+        for ( unsigned int i = 0; i < vertices.size(); ++i ) {
+            vertices[ i ].lmu = u;
+            vertices[ i ].lmv = v;
+        }
+    };
+
     
     /**
      * Texture coordinates in Quake 2 are done where an image goes from
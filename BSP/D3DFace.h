@@ -15,8 +15,10 @@ namespace D3D {
 
     /**
      * Handles triangulation and coordinate generation for a bsp face structure.
-     * After this class triangulates a face, its vertices are appended to a vertex
-     * array, then those vertices are sent to Direct3D.
+     * Each corner of the face's polygon is kept as one vertex. After the face
+     * is loaded, its vertices are appended to a vertex array, along with the
+     * indices of a fan of triangles that covers the polygon, then those
+     * vertices are sent to Direct3D.
      */
     class Face {
         public:
@@ -48,9 +50,11 @@ namespace D3D {
 
 
             /**
-             * appendTo() puts the vertex information onto the end of vertexBuffer.
+             * appendTo() puts the face's vertices onto the end of vertexBuffer,
+             * and the indices of its triangles onto the end of indexBuffer. The
+             * indices are the vertices' positions in vertexBuffer.
              */
-            void appendTo( vector< D3D::Vertex > *vertexBuffer );
+            void appendTo( vector< D3D::Vertex > *vertexBuffer, vector< unsigned int > *indexBuffer );
 
 
             /**
@@ -90,6 +94,13 @@ namespace D3D {
              */
             void shiftLMTexCoords( float u, float v );
 
+            /**
+             * Sets every one of the face's lightmap texture coordinates to ( u, v ).
+             * This is for faces that don't have a lightmap of their own, so that
+             * the whole face uses a single pixel of a lightmap page.
+             */
+            void setLMTexCoords( float u, float v );
+
 
             /**
              * Texture coordinates in Quake 2 are done where an image goes from
@@ -104,7 +115,8 @@ namespace D3D {
 
         private:
 
-            // The vertex information for this face
+            // The vertex information for this face, one vertex for each corner
+            // of the polygon
             vector< D3D::Vertex > vertices;
 
             // The texture for this face
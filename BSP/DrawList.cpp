@@ -0,0 +1,251 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "DrawList.h"
+
+#include <algorithm>
+
+
+/**
+ * Constructor prepares the draw list to be loaded
+ */
+DrawList::DrawList() {
+    faceInfo = NULL;
+    texInfo = NULL;
+    lightMaps = NULL;
+
+    indexBuffer = NULL;
+    indexFormat = D3DFMT_INDEX16;
+};
+
+/**
+ * Destructor makes sure that the index buffer has been released
+ */
+DrawList::~DrawList() {
+    unload();
+};
+
+
+/**
+ * load() works out the sorting key of every face in the map, and creates
+ * the dynamic index buffer that the faces are drawn with. The faceInfo,
+ * texInfo and lightMaps objects must already be loaded, and must stay
+ * loaded for as long as the draw list is used. If device is NULL, the
+ * indices are written into memory instead, so that the list can still
+ * be drawn into a RecordingRenderDevice.
+ * Returns false if the index buffer could not be created.
+ */
+bool DrawList::load( FaceInfo *faceInfo, TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device ) {
+    unload();
+
+    this->faceInfo = faceInfo;
+    this->texInfo = texInfo;
+    this->lightMaps = lightMaps;
+
+    // Work out the key of each face now, so that nothing has to be looked up
+    //  while the faces are being collected
+    faceKeys.resize( faceInfo->getNumFaces() );
+    for ( int i = 0; i < faceInfo->getNumFaces(); ++i ) {
+        int texNum = faceInfo->getTextureNum( i );
+        WALImage *image = texInfo->getTexture( texNum );
+
+        faceKeys[ i ].texture = texInfo->getImageNum( texNum );
+        faceKeys[ i ].lightMapPage = lightMaps->getPageNum( i );
+        faceKeys[ i ].useLightMap = image->usesLightMaps ? 1 : 0;
+
+        // Skybox faces are never drawn, so they are never added to the list
+        faceKeys[ i ].face = image->isSkyBox ? -1 : i;
+    }
+
+    // Each face is drawn at most once, so there are never more indices than
+    //  the faces have all together. 16 bit indices are used if they can reach
+    //  every vertex.
+    int numIndices = faceInfo->getNumIndices();
+    if ( numIndices == 0 ) {
+        return true;
+    }
+
+    indexFormat = ( faceInfo->getNumVertices() > 0xFFFF ) ? D3DFMT_INDEX32 : D3DFMT_INDEX16;
+    int indexSize = ( indexFormat == D3DFMT_INDEX32 ) ? sizeof( unsigned int ) : sizeof( unsigned short );
+
+    if ( device == NULL ) {
+        memoryIndices.resize( numIndices * indexSize );
+        return true;
+    }
+
+    HRESULT rtn = device->CreateIndexBuffer( numIndices * indexSize,
+                                             D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+                                             indexFormat, D3DPOOL_DEFAULT,
+                                             &indexBuffer, NULL );
+    if ( FAILED( rtn ) ) {
+        indexBuffer = NULL;
+        return false;
+    }
+
+    return true;
+};
+
+/**
+ * unload() releases the index buffer and forgets about the map's faces
+ */
+void DrawList::unload() {
+    if ( indexBuffer != NULL ) {
+        indexBuffer->Release();
+        indexBuffer = NULL;
+    }
+
+    faceKeys.resize( 0 );
+    items.resize( 0 );
+    runs.resize( 0 );
+    memoryIndices.resize( 0 );
+
+    faceInfo = NULL;
+    texInfo = NULL;
+    lightMaps = NULL;
+};
+
+
+/**
+ * Orders two DrawItems by their keys. The texture is compared first, since
+ * changing the texture is the most expensive change to make between runs.
+ */
+bool DrawList::compareItems( const DrawItem &a, const DrawItem &b ) {
+    if ( a.texture != b.texture ) {
+        return a.texture < b.texture;
+    }
+    if ( a.lightMapPage != b.lightMapPage ) {
+        return a.lightMapPage < b.lightMapPage;
+    }
+    if ( a.useLightMap != b.useLightMap ) {
+        return a.useLightMap < b.useLightMap;
+    }
+    return a.face < b.face;
+};
+
+
+/**
+ * draw() sorts the faces in the list and draws them with the effect. The
+ * useLightMap parameter is the effect's "useLightMap" setting for faces
+ * whose textures use lightmaps. The vertex buffer and the effect's
+ * matrices must be set up before draw() is called.
+ *
+ * A face that was added more than once is only drawn once.
+ * Returns the number of polygons that were drawn.
+ */
+int DrawList::draw( RenderDevice *device, ID3DXEffect *effect, int useLightMap ) {
+    runs.resize( 0 );
+
+    if ( items.size() == 0 || ( indexBuffer == NULL && memoryIndices.size() == 0 ) ) {
+        return 0;
+    }
+
+    // Sort the faces so that faces drawn with the same textures are next to
+    //  each other, and so that copies of the same face are next to each other.
+    sort( items.begin(), items.end(), compareItems );
+
+    // Fill in the index buffer with each face's vertices, one run at a time.
+    // The whole buffer is rewritten every frame, so its old contents are discarded.
+    void *indexData = NULL;
+    if ( indexBuffer == NULL ) {
+        indexData = &memoryIndices[ 0 ];
+    } else if ( FAILED( indexBuffer->Lock( 0, 0, &indexData, D3DLOCK_DISCARD ) ) ) {
+        return 0;
+    }
+
+    unsigned short *indices16 = ( unsigned short * ) indexData;
+    unsigned int *indices32 = ( unsigned int * ) indexData;
+    int numIndices = 0;
+
+    for ( unsigned int i = 0; i < items.size(); ++i ) {
+        // Skip over copies of a face that has already been added
+        if ( i > 0 && items[ i ].face == items[ i - 1 ].face ) {
+            continue;
+        }
+
+        // Start a new run if this face can't be drawn with the last one
+        if ( runs.size() == 0 || !sameRun( items[ runs.back().item ], items[ i ] ) ) {
+            runs.push_back();
+            runs.back().item = i;
+            runs.back().startIndex = numIndices;
+            runs.back().numIndices = 0;
+            runs.back().minVertex = faceInfo->getFaceStartVertex( items[ i ].face );
+            runs.back().endVertex = runs.back().minVertex;
+        }
+
+        DrawRun &run = runs.back();
+
+        int start = faceInfo->getFaceStartIndex( items[ i ].face );
+        int end = faceInfo->getFaceStartIndex( items[ i ].face + 1 );
+
+        // Copy the face's triangles into the run
+        if ( indexFormat == D3DFMT_INDEX32 ) {
+            for ( int n = start; n < end; ++n ) {
+                indices32[ numIndices++ ] = faceInfo->getIndex( n );
+            }
+        } else {
+            for ( int n = start; n < end; ++n ) {
+                indices16[ numIndices++ ] = ( unsigned short ) faceInfo->getIndex( n );
+            }
+        }
+
+        // The run has to reach all of the face's vertices
+        int firstVertex = faceInfo->getFaceStartVertex( items[ i ].face );
+        int endVertex = faceInfo->getFaceStartVertex( items[ i ].face + 1 );
+
+        run.numIndices += end - start;
+        if ( firstVertex < run.minVertex ) {
+            run.minVertex = firstVertex;
+        }
+        if ( endVertex > run.endVertex ) {
+            run.endVertex = endVertex;
+        }
+    }
+
+    if ( indexBuffer != NULL ) {
+        indexBuffer->Unlock();
+    }
+
+    device->setIndices( indexBuffer );
+
+
+    // Draw each run with the effect. The effect is only started once, and
+    //  only the textures change between runs.
+    UINT Pass, Passes;
+
+    Passes = device->beginEffect( effect );
+    for ( Pass = 0; Pass < Passes; Pass++ ) {
+        device->beginPass( effect, Pass );
+
+        for ( unsigned int r = 0; r < runs.size(); ++r ) {
+            DrawItem &item = items[ runs[ r ].item ];
+
+            // Setup the lightmap and texture for the pixel shader. If the texture
+            //  doesn't use lightmaps (for example, water and lava), then disable lightmaps
+            device->setEffectTexture( effect, "modelTexture", texInfo->getTexture( faceInfo->getTextureNum( item.face ) )->getTexture() );
+            device->setEffectTexture( effect, "lightMap", lightMaps->getPageTexture( item.lightMapPage ) );
+            device->setEffectInt( effect, "useLightMap", item.useLightMap ? useLightMap : 0 );
+
+            // The effect's variables were changed inside of the pass, so they
+            //  have to be sent to the device before drawing
+            device->commitChanges( effect );
+
+            device->drawIndexedPrimitive( D3DPT_TRIANGLELIST, 0,
+                                          runs[ r ].minVertex,
+                                          runs[ r ].endVertex - runs[ r ].minVertex,
+                                          runs[ r ].startIndex,
+                                          runs[ r ].numIndices / 3 );
+        }
+
+        device->endPass( effect );
+    }
+    device->endEffect( effect );
+
+    // Put the lightmap setting back to what it was
+    device->setEffectInt( effect, "useLightMap", useLightMap );
+
+    return numIndices / 3;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,158 @@
+//---------------------------------------------------------------------------
+
+#ifndef DrawListH
+#define DrawListH
+
+#include <vector.h>
+
+#include <DirectX/d3d9.h>
+#include <DirectX/d3dx9.h>
+
+#include "FaceInfo.h"
+#include "TextureInfo.h"
+#include "LightMapInfo.h"
+#include "RenderDevice.h"
+
+using namespace std;
+
+
+/**
+ * The DrawList class collects the faces of the BSP Map that are visible in a
+ * frame, and draws them with as few draw calls as possible.
+ *
+ * Faces are added to the list while the BSP Map is being culled. When the list
+ * is drawn, the faces are sorted by their texture, their lightmap page and
+ * whether or not they use lightmaps. Each run of faces that share all three of
+ * these is drawn with a single indexed draw call, using a dynamic index buffer
+ * that is filled in with the triangles of the faces in that run. This way,
+ * the shader only has to be started once per frame, and the textures only have
+ * to be changed once per run, instead of once per face.
+ */
+class DrawList {
+    public:
+
+        /**
+         * Constructor prepares the draw list to be loaded
+         */
+        DrawList();
+
+        /**
+         * Destructor makes sure that the index buffer has been released
+         */
+        ~DrawList();
+
+        /**
+         * load() works out the sorting key of every face in the map, and creates
+         * the dynamic index buffer that the faces are drawn with. The faceInfo,
+         * texInfo and lightMaps objects must already be loaded, and must stay
+         * loaded for as long as the draw list is used. If device is NULL, the
+         * indices are written into memory instead, so that the list can still
+         * be drawn into a RecordingRenderDevice.
+         * Returns false if the index buffer could not be created.
+         */
+        bool load( FaceInfo *faceInfo, TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device );
+
+        /**
+         * unload() releases the index buffer and forgets about the map's faces
+         */
+        void unload();
+
+        /**
+         * clear() empties the list, so that a new frame can be collected
+         */
+        void clear() {
+            items.resize( 0 );
+        };
+
+        /**
+         * addFace() adds face #faceNum to the list of faces to be drawn. Skybox
+         * faces are never drawn, so they are not added.
+         */
+        void addFace( int faceNum ) {
+            if ( faceKeys[ faceNum ].face >= 0 ) {
+                items.push_back( faceKeys[ faceNum ] );
+            }
+        };
+
+        /**
+         * draw() sorts the faces in the list and draws them with the effect. The
+         * useLightMap parameter is the effect's "useLightMap" setting for faces
+         * whose textures use lightmaps. The vertex buffer and the effect's
+         * matrices must be set up before draw() is called.
+         *
+         * A face that was added more than once is only drawn once.
+         * Returns the number of polygons that were drawn.
+         */
+        int draw( RenderDevice *device, ID3DXEffect *effect, int useLightMap );
+
+        /**
+         * Returns the number of draw calls made by the last call to draw()
+         */
+        int getNumRuns() {
+            return runs.size();
+        };
+
+    private:
+
+        /**
+         * A DrawItem is a face in the list, along with the key that it is sorted
+         * with. The face number is the last part of the key, so that copies of
+         * the same face end up next to each other.
+         */
+        typedef struct {
+            int texture;
+            int lightMapPage;
+            int useLightMap;
+            int face;
+        } DrawItem;
+
+        /**
+         * A DrawRun is a set of faces that are drawn with one draw call. Item
+         * is the first of the run's faces in the sorted list. The run's
+         * indices start at startIndex in the index buffer, and use the
+         * vertices from minVertex up to (but not including) endVertex.
+         */
+        typedef struct {
+            int item;
+            int startIndex;
+            int numIndices;
+            int minVertex;
+            int endVertex;
+        } DrawRun;
+
+        // Orders two DrawItems by their keys
+        static bool compareItems( const DrawItem &a, const DrawItem &b );
+
+        // Returns true if two DrawItems can be drawn in the same draw call
+        static bool sameRun( const DrawItem &a, const DrawItem &b ) {
+            return a.texture == b.texture && a.lightMapPage == b.lightMapPage &&
+                   a.useLightMap == b.useLightMap;
+        };
+
+        // The map objects that the faces are drawn from
+        FaceInfo *faceInfo;
+        TextureInfo *texInfo;
+        LightMapInfo *lightMaps;
+
+        // The key of each face in the map, worked out by load(). Skybox faces
+        //  have a face number of -1.
+        vector< DrawItem > faceKeys;
+
+        // The faces that were added in this frame
+        vector< DrawItem > items;
+
+        // The runs of faces made by the last call to draw()
+        vector< DrawRun > runs;
+
+        // The dynamic index buffer, and the format of its indices. It is big
+        //  enough to draw every face in the map once.
+        LPDIRECT3DINDEXBUFFER9 indexBuffer;
+        D3DFORMAT indexFormat;
+
+        // The indices, when the list was loaded without a device
+        vector< unsigned char > memoryIndices;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -64,7 +64,7 @@ namespace Entity {
         // Limit how far this light extends
         d3dlight->Range = 600.0f * BSP::MAP_SCALE;
     };
-    /**     * Enables this light with DirectX     */    void Light::setEnableState( LPDIRECT3DDEVICE9 device, int lightNum ) {        light->enable( device, lightNum );    };    /**     * Returns the distance from point pos. This is for enabling the closest     * lights to a point.     */    float Light::getDistFromPoint( Point3f pos ) {        // Just use pythagorean theorem for the distance        return sqrt( ( pos.x - light->getLight()->Position.x ) * ( pos.x - light->getLight()->Position.x ) +                     ( pos.y - light->getLight()->Position.y ) * ( pos.y - light->getLight()->Position.y ) +                     ( pos.z - light->getLight()->Position.z ) * ( pos.z - light->getLight()->Position.z ) );    };
+    /**     * Enables this light with DirectX     */    void Light::setEnableState( RenderDevice *device, int lightNum ) {        light->enable( device, lightNum );    };    /**     * Returns the distance from point pos. This is for enabling the closest     * lights to a point.     */    float Light::getDistFromPoint( Point3f pos ) {        // Just use pythagorean theorem for the distance        return sqrt( ( pos.x - light->getLight()->Position.x ) * ( pos.x - light->getLight()->Position.x ) +                     ( pos.y - light->getLight()->Position.y ) * ( pos.y - light->getLight()->Position.y ) +                     ( pos.z - light->getLight()->Position.z ) * ( pos.z - light->getLight()->Position.z ) );    };
 
 
     //==========================================================
@@ -79,16 +79,17 @@ namespace Entity {
 
 
     /**
-     * load() method loads in all entity data from the BSP map file.     */    void Parser::load( BSP::Header *header, FILE *mapFile ) {
+     * load() method loads in all entity data from the BSP map file.
+     * The entity lump is parsed straight out of the mapped file.
+     */
+    void Parser::load( BSPFile *mapFile ) {
 
-        // Allocate memory for the entity lump and then load it in
-        char *entityLump = new char[ header->lump[ BSP_ENTITY_LUMP ].length ];
-        fseek( mapFile, header->lump[ BSP_ENTITY_LUMP ].offset, 0 );
-        fread( entityLump, 1, header->lump[ BSP_ENTITY_LUMP ].length, mapFile );
+        // The entity lump is only read from, so it doesn't need to be copied
+        char *entityLump = ( char * ) mapFile->getLump( BSP_ENTITY_LUMP );
 
         // load in entities until the end of the entity data is reached
         char *entityAt = entityLump;
-        while ( entityAt < entityLump + header->lump[ BSP_ENTITY_LUMP ].length ) {
+        while ( entityAt < entityLump + mapFile->getLumpLength( BSP_ENTITY_LUMP ) ) {
 
             // Create an entity
             entities.push_back( new Entity() );
@@ -109,15 +110,12 @@ namespace Entity {
                 monsters[ monsters.size() - 1 ]->init( entities[ entNum ] );
             }
         }
-
-        // delete the memory allocated for the entity lump.
-        delete[] entityLump;
     };
     /**     * unload() method deletes all entity data that was created by load()     */    void Parser::unload() {        // Delete the entities        for ( unsigned int i = 0; i < entities.size(); ++i ) {            delete entities[ i ];        }        entities.resize( 0 );        for ( unsigned int i = 0; i < monsters.size(); ++i ) {            delete monsters[ i ];        }        monsters.resize( 0 );        // Delete the entity lights        for ( unsigned int i = 0; i < lights.size(); ++i ) {            delete lights[ i ];        }        lights.resize( 0 );    };
 
     /**
-     * enableLights() method enables the eight closest lights     * to parameter pos     */    void Parser::enableLights( LPDIRECT3DDEVICE9 device, Point3f pos ) {
-        // The maximum number of lights to be enabled        const int NUM_LIGHTS = 8;        // The enabled lights        struct {            Light *light;            float dist;        } enabledLights[ NUM_LIGHTS ];        memset( enabledLights, 0, ( sizeof( Light * ) + sizeof( float ) ) * NUM_LIGHTS );        // Set the first light to the first light in the light array        enabledLights[ 0 ].light = lights[ 0 ];        enabledLights[ 0 ].dist = lights[ 0 ]->getDistFromPoint( pos );        // For each light that exists,        for ( unsigned int lightSet = 0; lightSet < lights.size(); ++lightSet ) {            // Go through each of the lights that have already been enabled            for ( int i = 0; i < NUM_LIGHTS; ++i ) {                // If that light has not been set yet, set it to this light                if ( enabledLights[ i ].light == NULL ) {                    enabledLights[ i ].light = lights[ lightSet ];                    enabledLights[ i ].dist = lights[ lightSet ]->getDistFromPoint( pos );                    break;                } else if ( enabledLights[ i ].dist > lights[ lightSet ]->getDistFromPoint( pos ) ) {                    // Or, if this light is closer than the one that has already been set,                    // insert the light in that position in the array.                    for ( int shift = NUM_LIGHTS - 1; shift > i; --shift ) {                        enabledLights[ shift ] = enabledLights[ shift - 1 ];                    }                                        enabledLights[ i ].light = lights[ lightSet ];                    enabledLights[ i ].dist = lights[ lightSet ]->getDistFromPoint( pos );                    break;                }            }        }        // Enable the lights that are closest to Point "pos"        for ( int i = 0; i < NUM_LIGHTS; ++i ) {            enabledLights[ i ].light->setEnableState( device, i );        }    };    /**     * Returns the name of the skybox, found with the first entity.     */    char *Parser::getSkyBoxName() {        return entities[ 0 ]->getValue( "sky" );    };    /**     * Sets the position of the camera to the player's spawn point     */    void Parser::setCameraPos( Camera *camera ) {        Point3f origin;        unsigned int entityNum;        // Go through each entity until one is found that has the "player start"        // classname        for ( entityNum = 0; entityNum < entities.size(); ++entityNum ) {            if ( strcmp( entities[ entityNum ]->getValue( "classname" ), "info_player_start" ) == 0 ) {                break;            }        }        // From the entity we just found, set the camera's location to the origin        // of that entity.        origin = entities[ entityNum ]->getOrigin();        camera->pos->x = -origin.y;        camera->pos->y = -origin.z;        camera->pos->z = origin.x;    };    MonsterInfo monsterInfo[ NUM_MONSTER_TYPES ] = {        {"Q2/models/monsters/infantry", },        {},        {}    };};
+     * enableLights() method enables the eight closest lights     * to parameter pos     */    void Parser::enableLights( RenderDevice *device, Point3f pos ) {
+        // The maximum number of lights to be enabled        const int NUM_LIGHTS = 8;        // The enabled lights        struct {            Light *light;            float dist;        } enabledLights[ NUM_LIGHTS ];        memset( enabledLights, 0, ( sizeof( Light * ) + sizeof( float ) ) * NUM_LIGHTS );        // Set the first light to the first light in the light array        enabledLights[ 0 ].light = lights[ 0 ];        enabledLights[ 0 ].dist = lights[ 0 ]->getDistFromPoint( pos );        // For each light that exists,        for ( unsigned int lightSet = 0; lightSet < lights.size(); ++lightSet ) {            // Go through each of the lights that have already been enabled            for ( int i = 0; i < NUM_LIGHTS; ++i ) {                // If that light has not been set yet, set it to this light                if ( enabledLights[ i ].light == NULL ) {                    enabledLights[ i ].light = lights[ lightSet ];                    enabledLights[ i ].dist = lights[ lightSet ]->getDistFromPoint( pos );                    break;                } else if ( enabledLights[ i ].dist > lights[ lightSet ]->getDistFromPoint( pos ) ) {                    // Or, if this light is closer than the one that has already been set,                    // insert the light in that position in the array.                    for ( int shift = NUM_LIGHTS - 1; shift > i; --shift ) {                        enabledLights[ shift ] = enabledLights[ shift - 1 ];                    }                                        enabledLights[ i ].light = lights[ lightSet ];                    enabledLights[ i ].dist = lights[ lightSet ]->getDistFromPoint( pos );                    break;                }            }        }        // Enable the lights that are closest to Point "pos"        for ( int i = 0; i < NUM_LIGHTS; ++i ) {            enabledLights[ i ].light->setEnableState( device, i );        }    };    /**     * Returns the name of the skybox, found with the first entity.     */    char *Parser::getSkyBoxName() {        return entities[ 0 ]->getValue( "sky" );    };    /**     * Adds the names of the maps that the target_changelevel entities lead to     * onto the end of mapNames. A changelevel's "map" value can start with a     * '*' (the start of a new unit) and end with "$" and the name of a spawn     * point, which are both taken off. Values that name a cinematic or a     * picture instead of a map, and maps that are already in mapNames, are     * left out.     */    void Parser::getChangeLevelMaps( vector< std::string > *mapNames ) {        for ( unsigned int i = 0; i < entities.size(); ++i ) {            char *className = entities[ i ]->getValue( "classname" );            char *value = entities[ i ]->getValue( "map" );            // Only look at changelevels that name a map            if ( className == NULL || value == NULL || strcmp( className, "target_changelevel" ) != 0 ) {                continue;            }            std::string mapName( value[ 0 ] == '*' ? value + 1 : value );            mapName = mapName.substr( 0, mapName.find( '$' ) );            // "victory.pcx" and "end.cin" aren't maps            if ( mapName.empty() || mapName.find( '.' ) != std::string::npos ) {                continue;            }            bool found = false;            for ( unsigned int e = 0; e < mapNames->size() && !found; ++e ) {                found = ( *mapNames )[ e ] == mapName;            }            if ( !found ) {                mapNames->push_back( mapName );            }        }    };    /**     * Sets the position of the camera to the player's spawn point     */    void Parser::setCameraPos( Camera *camera ) {        Point3f origin;        unsigned int entityNum;        // Go through each entity until one is found that has the "player start"        // classname        for ( entityNum = 0; entityNum < entities.size(); ++entityNum ) {            if ( strcmp( entities[ entityNum ]->getValue( "classname" ), "info_player_start" ) == 0 ) {                break;            }        }        // From the entity we just found, set the camera's location to the origin        // of that entity.        origin = entities[ entityNum ]->getOrigin();        camera->pos->x = -origin.y;        camera->pos->y = -origin.z;        camera->pos->z = origin.x;    };    MonsterInfo monsterInfo[ NUM_MONSTER_TYPES ] = {        {"models/monsters/infantry", },        {},        {}    };};
 
 
 //---------------------------------------------------------------------------
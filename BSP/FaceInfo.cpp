@@ -4,27 +4,7 @@
 
 #include "FaceInfo.h"
 
-/**
- * Switches the locations of the vertices in the vertex lump.
- * Quake 2 coordinates: (x, y, z) = Direct3D coordinates: (y, z, -x)
- */
-void FaceInfo::transformVertices() {
-
-    // The pointer to the first vertex
-    Point3f *vertices = vertexLump.getData( 0 );
-
-    // quake coords ( x, y, z ) == D3D coords ( y, z, -x )
-    for ( int i = 0; i < vertexLump.getSize(); ++i ) {
-
-        // set a temporary value
-        Point3f temp = vertices[ i ];
-
-        // Swap the values for that vertex
-        vertices[ i ].x = temp.y;
-        vertices[ i ].y = temp.z;
-        vertices[ i ].z = -temp.x;
-    }
-};
+#include <math.h>
 
 /**
  * Loads in the bsp lumps necessary for the faces of the bsp map
@@ -32,33 +12,66 @@ void FaceInfo::transformVertices() {
  * load() with extra parameters loads in the vertex information, then calls
  * setupFaces().
  */
-void FaceInfo::load( BSP::Header *header, FILE *mapFile ) {
+void FaceInfo::load( BSPFile *mapFile ) {
 
-    // Load in the vertices and transform them to Direct3D coordinates
-    vertexLump.load( header, mapFile );
-    transformVertices();
+    // Load in the vertices. They stay in Quake 2 coordinates inside of the
+    // mapped file, and are transformed as they are copied into the D3DFaces.
+    vertexLump.load( mapFile );
 
     // Load in the Edge Lump
-    edgeLump.load( header, mapFile );
+    edgeLump.load( mapFile );
 
     // Load in the two Face Lumps
-    faceLump.load( header, mapFile );
-    faceEdgeLump.load( header, mapFile );
+    faceLump.load( mapFile );
+    faceEdgeLump.load( mapFile );
 };
 
 /**
- * Alternate loading method that calls load( bsp_header *, FILE * ) and loads
+ * Alternate loading method that calls load( BSPFile * ) and loads
  * in the Faces and Vertex Buffer
  * load() loads in the vertex information.
  * load() with extra parameters loads in the vertex information, then calls
- * setupFaces().
+ * setupFaces(). If cache isn't NULL, the vertices and lightmaps are taken
+ * from the map cache instead, and true is returned. If the cache can't be
+ * used, the faces are set up from the lumps and false is returned.
+ */
+bool FaceInfo::load( BSPFile *mapFile, TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device, MapCache *cache ) {
+    bool cached = loadFaces( mapFile, texInfo, lightMaps, cache );
+
+    // Set up the lightmap pages and Vertex Buffer
+    createBuffers( lightMaps, device );
+    return cached;
+};
+
+/**
+ * loadFaces() loads in the vertex information, and triangulates the faces
+ * and packs their lightmaps (or copies them out of cache). It doesn't use
+ * Direct3D, and returns true if the cache was used.
  */
-void FaceInfo::load( BSP::Header *header, FILE *file, TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device ) {
+bool FaceInfo::loadFaces( BSPFile *mapFile, TextureInfo *texInfo, LightMapInfo *lightMaps, MapCache *cache ) {
     // Load the bsp Lumps
-    load( header, file );
+    load( mapFile );
+
+    // Use the triangulated faces out of the cache, if they're there
+    if ( cache != NULL && loadCache( cache, lightMaps ) ) {
+        return true;
+    }
 
-    // Set up the D3DFaces and Vertex Buffer
-    setupFaces( texInfo, lightMaps, device );
+    // Set up the D3DFaces
+    triangulateFaces( texInfo, lightMaps );
+    return false;
+};
+
+/**
+ * createBuffers() sends the lightmap pages and the vertex buffer to
+ * Direct3D, once the faces have been loaded with loadFaces().
+ */
+void FaceInfo::createBuffers( LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device ) {
+    // Now that every lightmap has been packed, send the lightmap pages to Direct3D
+    lightMaps->createPages( device );
+
+    // Set up Direct3D's vertex Buffer
+    setupVertexBuffer( device );
 };
 
 /**
@@ -66,9 +79,21 @@ void FaceInfo::load( BSP::Header *header, FILE *file, TextureInfo *texInfo, Ligh
  * them in a vertex buffer created with DirectX
  */
 void FaceInfo::setupFaces( TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device ) {
+    triangulateFaces( texInfo, lightMaps );
+    createBuffers( lightMaps, device );
+};
+
+/**
+ * Triangulates the faces that have been loaded in, and packs their
+ * lightmaps into pages
+ */
+void FaceInfo::triangulateFaces( TextureInfo *texInfo, LightMapInfo *lightMaps ) {
 
-    // make sure the vertex buffer is empty
+    // make sure the vertex and index arrays are empty
     vertices.resize( 0 );
+    indices.resize( 0 );
+    startIndices.resize( 0 );
+    startVertices.resize( 0 );
 
     // temporary D3DFace for loading in the faces
     D3D::Face temp;
@@ -76,28 +101,125 @@ void FaceInfo::setupFaces( TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRE
     // Go through each of the bsp faces
     for ( int i = 0; i < faceLump.getSize(); ++i ) {
 
-        // push back the start index for this face
-        startIndices.push_back( vertices.size() );
+        // push back the first index and vertex for this face
+        startIndices.push_back( indices.size() );
+        startVertices.push_back( vertices.size() );
 
         // load in the bsp_face vertex information
         temp.load( vertexLump.getData( 0 ), edgeLump.getData( 0 ),
                    faceEdgeLump.getData( 0 ), faceLump.getData( i ),
                    texInfo->getData( 0 ), texInfo->getTexture( faceLump.getData( i )->texture_info ) );
 
-        lightMaps->loadLightMap( device, faceLump.getData( i ), &temp );
+        // Pack its lightmap into a lightmap page
+        lightMaps->loadLightMap( faceLump.getData( i ), &temp );
 
         temp.transformTexCoords();
 
-        // Attach the vertex information to the end of the array of vertices
-        temp.appendTo( &vertices );
+        // Attach the vertex information to the end of the array of vertices,
+        // and its triangles to the end of the array of indices
+        temp.appendTo( &vertices, &indices );
     }
 
-    // push back the last index for the vertex array
-    startIndices.push_back( vertices.size() );
+    // push back the end of the last face
+    startIndices.push_back( indices.size() );
+    startVertices.push_back( vertices.size() );
+};
 
+/**
+ * Returns true if starts is numStarts numbers that start at 0, go up, and
+ * finish at end. Starts like this split the numbers from 0 up to end into
+ * numStarts - 1 ranges, one after the other.
+ */
+static bool validStarts( int *starts, int numStarts, int end ) {
+    if ( numStarts < 1 || starts[ 0 ] != 0 || starts[ numStarts - 1 ] != end ) {
+        return false;
+    }
 
-    // Set up Direct3D's vertex Buffer
-    setupVertexBuffer( device );
+    for ( int i = 1; i < numStarts; ++i ) {
+        if ( starts[ i ] < starts[ i - 1 ] ) {
+            return false;
+        }
+    }
+
+    return true;
+};
+
+/**
+ * loadCache() copies the vertices, the indices, the first vertex and index
+ * of each face and the lightmap pages out of a map cache. The face lumps
+ * must have been loaded already. Nothing is changed if the cache doesn't
+ * match the faces in the map, and false is returned.
+ */
+bool FaceInfo::loadCache( MapCache *cache, LightMapInfo *lightMaps ) {
+
+    // The vertices must have been written by this version of D3D::Vertex
+    if ( cache->getHeader()->vertexSize != sizeof( D3D::Vertex ) ) {
+        return false;
+    }
+
+    int numVertices = cache->getNumItems( MAP_CACHE_VERTICES, sizeof( D3D::Vertex ) );
+    int numIndices = cache->getNumItems( MAP_CACHE_INDICES, sizeof( unsigned int ) );
+    int numStarts = cache->getNumItems( MAP_CACHE_FACE_STARTS, sizeof( int ) );
+    int numVertexStarts = cache->getNumItems( MAP_CACHE_FACE_VERTEX_STARTS, sizeof( int ) );
+
+    unsigned int *cachedIndices = ( unsigned int * ) cache->getSection( MAP_CACHE_INDICES );
+    int *starts = ( int * ) cache->getSection( MAP_CACHE_FACE_STARTS );
+    int *vertexStarts = ( int * ) cache->getSection( MAP_CACHE_FACE_VERTEX_STARTS );
+
+    // There must be a start for each face, plus the end of the last face
+    if ( numVertices <= 0 || numIndices < 0 ||
+         numStarts != faceLump.getSize() + 1 || numVertexStarts != faceLump.getSize() + 1 ) {
+        return false;
+    }
+
+    // The faces must come one after the other, and cover all of the vertices
+    //  and indices
+    if ( !validStarts( starts, numStarts, numIndices ) || !validStarts( vertexStarts, numVertexStarts, numVertices ) ) {
+        return false;
+    }
+
+    // Each face must be made of whole triangles, that only use its own vertices
+    for ( int f = 0; f < faceLump.getSize(); ++f ) {
+        if ( ( starts[ f + 1 ] - starts[ f ] ) % 3 != 0 ) {
+            return false;
+        }
+
+        for ( int i = starts[ f ]; i < starts[ f + 1 ]; ++i ) {
+            if ( cachedIndices[ i ] < ( unsigned int ) vertexStarts[ f ] || cachedIndices[ i ] >= ( unsigned int ) vertexStarts[ f + 1 ] ) {
+                return false;
+            }
+        }
+    }
+
+    // Use the packed lightmap pages. They are sent straight from the cache to
+    //  Direct3D by createBuffers().
+    if ( !lightMaps->loadCache( cache, faceLump.getSize() ) ) {
+        return false;
+    }
+
+    vertices.resize( numVertices );
+    memcpy( &vertices[ 0 ], cache->getSection( MAP_CACHE_VERTICES ), numVertices * sizeof( D3D::Vertex ) );
+
+    indices.assign( cachedIndices, cachedIndices + numIndices );
+    startIndices.assign( starts, starts + numStarts );
+    startVertices.assign( vertexStarts, vertexStarts + numVertexStarts );
+
+    return true;
+};
+
+/**
+ * saveCache() gives the vertices, the indices, and the first vertex and
+ * index of each face to a map cache, once the faces have been set up.
+ */
+void FaceInfo::saveCache( MapCacheWriter *writer ) {
+    writer->setSection( MAP_CACHE_VERTICES, vertices.empty() ? NULL : &vertices[ 0 ],
+                        vertices.size() * sizeof( D3D::Vertex ) );
+    writer->setSection( MAP_CACHE_INDICES, indices.empty() ? NULL : &indices[ 0 ],
+                        indices.size() * sizeof( unsigned int ) );
+    writer->setSection( MAP_CACHE_FACE_STARTS, startIndices.empty() ? NULL : &startIndices[ 0 ],
+                        startIndices.size() * sizeof( int ) );
+    writer->setSection( MAP_CACHE_FACE_VERTEX_STARTS, startVertices.empty() ? NULL : &startVertices[ 0 ],
+                        startVertices.size() * sizeof( int ) );
 };
 
 /**
@@ -105,6 +227,11 @@ void FaceInfo::setupFaces( TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRE
  */
 void FaceInfo::setupVertexBuffer( LPDIRECT3DDEVICE9 device ) {
 
+    // Use compact vertices if they were asked for, and the device can read them
+    if ( compactVertices && setupCompactVertexBuffer( device ) ) {
+        return;
+    }
+
     // Allocate the vertex buffer
     device->CreateVertexBuffer( sizeof( D3D::Vertex ) * vertices.size(), 0, BSP_FVF, D3DPOOL_MANAGED, &vertexBuffer, NULL );
 
@@ -117,14 +244,88 @@ void FaceInfo::setupVertexBuffer( LPDIRECT3DDEVICE9 device ) {
 };
 
 
+/**
+ * Puts compact versions of the vertices into a Direct3D vertex buffer, and
+ * measures how far off they are. Returns false, without creating anything, if
+ * the device can't read compact vertices.
+ */
+bool FaceInfo::setupCompactVertexBuffer( LPDIRECT3DDEVICE9 device ) {
+
+    // The device must be able to read each of the compact vertex's types
+    D3DCAPS9 caps;
+    if ( vertices.empty() || FAILED( device->GetDeviceCaps( &caps ) ) ||
+         ( caps.DeclTypes & COMPACT_VERTEX_DECL_TYPES ) != COMPACT_VERTEX_DECL_TYPES ) {
+        return false;
+    }
+
+    if ( FAILED( device->CreateVertexDeclaration( COMPACT_VERTEX_ELEMENTS, &vertexDeclaration ) ) ) {
+        vertexDeclaration = NULL;
+        return false;
+    }
+
+    findCompactBounds( &vertices[ 0 ], vertices.size(), &compactBounds );
+    memset( &compactError, 0, sizeof( compactError ) );
+
+    vector< D3D::CompactVertex > compact( vertices.size() );
+    float maxTexCoord = 0.0f;
+    float maxLightMapCoord = 0.0f;
+
+    for ( int f = 0; f + 1 < ( int ) startVertices.size(); ++f ) {
+        int first = startVertices[ f ];
+        int end = startVertices[ f + 1 ];
+
+        if ( first == end ) {
+            continue;
+        }
+
+        // Textures repeat, so moving a face's texture coordinates by a whole
+        //  texture doesn't change how it looks. Moving them as near to 0 as
+        //  possible keeps the half floats as precise as possible.
+        float minU = vertices[ first ].u, minV = vertices[ first ].v;
+        for ( int v = first + 1; v < end; ++v ) {
+            minU = min( minU, vertices[ v ].u );
+            minV = min( minV, vertices[ v ].v );
+        }
+        float shiftU = floor( minU );
+        float shiftV = floor( minV );
+
+        for ( int v = first; v < end; ++v ) {
+            D3D::Vertex shifted = vertices[ v ];
+            shifted.u -= shiftU;
+            shifted.v -= shiftV;
+
+            compactVertex( &shifted, &compactBounds, &compact[ v ] );
+            measureCompactVertex( &shifted, &compact[ v ], &compactBounds, &compactError );
+
+            maxTexCoord = max( maxTexCoord, ( float ) max( fabs( shifted.u ), fabs( shifted.v ) ) );
+            maxLightMapCoord = max( maxLightMapCoord, ( float ) max( fabs( shifted.lmu ), fabs( shifted.lmv ) ) );
+        }
+    }
+
+    getCompactErrorBounds( &compactBounds, maxTexCoord, maxLightMapCoord, &compactErrorBound );
+
+    // The compact vertices are read with the vertex declaration, not an FVF
+    device->CreateVertexBuffer( sizeof( D3D::CompactVertex ) * compact.size(), 0, 0, D3DPOOL_MANAGED, &vertexBuffer, NULL );
+
+    VOID* pVoid;
+    vertexBuffer->Lock( 0, 0, ( void ** ) &pVoid, 0 );
+    memcpy( pVoid, &compact[ 0 ], sizeof( D3D::CompactVertex ) * compact.size() );
+    vertexBuffer->Unlock();
+
+    return true;
+};
+
+
 /**
  * Deletes all memory allocated by load() and setupFaces()
  */
 void FaceInfo::unload() {
 
-    // delete the memory allocated by vertics and startIndices
+    // delete the memory allocated by the vertices, the indices and the starts
     vertices.resize( 0 );
+    indices.resize( 0 );
     startIndices.resize( 0 );
+    startVertices.resize( 0 );
 
     // delete the vertex buffer
     if ( vertexBuffer != NULL ) {
@@ -132,6 +333,12 @@ void FaceInfo::unload() {
         vertexBuffer = NULL;
     }
 
+    // delete the compact vertex declaration
+    if ( vertexDeclaration != NULL ) {
+        vertexDeclaration->Release();
+        vertexDeclaration = NULL;
+    }
+
     // unload each of the lumps
     vertexLump.unload();
     edgeLump.unload();
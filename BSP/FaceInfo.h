@@ -9,6 +9,8 @@
 #include "D3DFace.h"
 #include "TextureInfo.h"
 #include "LightMapInfo.h"
+#include "MapCache.h"
+#include "CompactVertex.h"
 
 
 using namespace std;
@@ -17,6 +19,17 @@ using namespace std;
  * The FaceInfo class handles loading in and processing the vertex data of a BSP
  * Map. The BSP Map renderer can access a Direct3D vertex buffer object, which is
  * the collection of all of the map's vertices.
+ *
+ * Each corner of a face is stored as one vertex, and the face's triangles are
+ * stored as indices into the vertices. Face #f's vertices go from
+ * getFaceStartVertex( f ) up to getFaceStartVertex( f + 1 ), and its indices
+ * go from getFaceStartIndex( f ) up to getFaceStartIndex( f + 1 ). Every index
+ * of a face is one of that face's own vertices.
+ *
+ * If setCompactVertices( true ) is called before the faces are loaded, and the
+ * device can read them, the vertex buffer holds D3D::CompactVertex's instead
+ * of D3D::Vertex's (see CompactVertex.h). The vertices that getVertex() returns
+ * are always full D3D::Vertex's.
  */
 class FaceInfo {
     public:
@@ -26,6 +39,8 @@ class FaceInfo {
          */
         FaceInfo() {
             vertexBuffer = NULL;
+            vertexDeclaration = NULL;
+            compactVertices = false;
         };
 
         /**
@@ -42,6 +57,56 @@ class FaceInfo {
             return vertexBuffer;
         };
 
+        /**
+         * setCompactVertices() chooses whether the vertex buffer should hold
+         * compact vertices. It must be called before the faces are loaded.
+         */
+        void setCompactVertices( bool compact ) {
+            compactVertices = compact;
+        };
+
+        /**
+         * Returns true if the vertex buffer holds compact vertices. This is
+         * only false after setCompactVertices( true ) if the device can't read
+         * compact vertices.
+         */
+        bool hasCompactVertices() {
+            return vertexDeclaration != NULL;
+        };
+
+        /**
+         * Returns the vertex declaration of the compact vertices, or NULL if
+         * the vertex buffer holds full vertices, which use BSP_FVF
+         */
+        LPDIRECT3DVERTEXDECLARATION9 getVertexDeclaration() {
+            return vertexDeclaration;
+        };
+
+        /**
+         * Returns the size of each vertex in the vertex buffer
+         */
+        int getVertexSize() {
+            return hasCompactVertices() ? sizeof( D3D::CompactVertex ) : sizeof( D3D::Vertex );
+        };
+
+        /**
+         * Returns the box that the compact positions are stored in
+         */
+        CompactBounds *getCompactBounds() {
+            return &compactBounds;
+        };
+
+        /**
+         * Returns how far off the compact vertices actually are, and the most
+         * that they could be off by
+         */
+        CompactVertexError *getCompactError() {
+            return &compactError;
+        };
+        CompactVertexError *getCompactErrorBound() {
+            return &compactErrorBound;
+        };
+
         /**
          * returns the number of vertices in the vertex buffer
          */
@@ -50,12 +115,41 @@ class FaceInfo {
         };
 
         /**
-         * Returns the index of the first vertex of a face
+         * Returns vertex #vertexNum of the vertex buffer
+         */
+        D3D::Vertex *getVertex( int vertexNum ) {
+            return &vertices[ vertexNum ];
+        };
+
+        /**
+         * Returns the position of the first index of a face in the index array
          */
         int getFaceStartIndex( int faceNum ) {
             return startIndices[ faceNum ];
         };
 
+        /**
+         * Returns the number of the first vertex of a face
+         */
+        int getFaceStartVertex( int faceNum ) {
+            return startVertices[ faceNum ];
+        };
+
+        /**
+         * Returns the number of indices of all of the faces together. Every
+         * three indices make a triangle.
+         */
+        int getNumIndices() {
+            return indices.size();
+        };
+
+        /**
+         * Returns index #indexNum of the index array
+         */
+        unsigned int getIndex( int indexNum ) {
+            return indices[ indexNum ];
+        };
+
         /**
          * Returns the number of faces in the BSP Map
          */
@@ -73,10 +167,24 @@ class FaceInfo {
         /**
          * load() loads in the vertex information.
          * load() with extra parameters loads in the vertex information, then calls
-         * setupFaces().
+         * setupFaces(). If cache isn't NULL, the vertices and lightmaps are taken
+         * from the map cache instead, and true is returned. If the cache can't be
+         * used, the faces are set up from the lumps and false is returned.
          */
-        void load( BSP::Header *header, FILE *file );
-        void load( BSP::Header *header, FILE *file, TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device );
+        void load( BSPFile *mapFile );
+        bool load( BSPFile *mapFile, TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device, MapCache *cache );
+
+        /**
+         * load() with extra parameters is done in two steps, so that the faces
+         * can be set up on another thread:
+         *  - loadFaces() loads in the vertex information, and triangulates the
+         *    faces and packs their lightmaps (or copies them out of cache). It
+         *    doesn't use Direct3D, and returns true if the cache was used.
+         *  - createBuffers() sends the lightmap pages and the vertex buffer to
+         *    Direct3D.
+         */
+        bool loadFaces( BSPFile *mapFile, TextureInfo *texInfo, LightMapInfo *lightMaps, MapCache *cache );
+        void createBuffers( LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device );
 
         /**
          * Deletes all memory allocated by load() and setupFaces()
@@ -89,24 +197,53 @@ class FaceInfo {
          */
         void setupFaces( TextureInfo *texInfo, LightMapInfo *lightMaps, LPDIRECT3DDEVICE9 device );
 
+        /**
+         * saveCache() gives the vertices, the indices, and the first vertex and
+         * index of each face to a map cache, once the faces have been set up.
+         */
+        void saveCache( MapCacheWriter *writer );
+
 
     private:
-        // Transforms the quake 2 coordinates (z is up-down) to DirectX coordinates (y is up-down)
-        void transformVertices();
+        // Copies the vertices and lightmap pages out of a map cache. Returns
+        // false if the cache doesn't match the faces in the map.
+        bool loadCache( MapCache *cache, LightMapInfo *lightMaps );
+
+        // Triangulates the faces, and packs their lightmaps into pages
+        void triangulateFaces( TextureInfo *texInfo, LightMapInfo *lightMaps );
 
         // Creates DirectX's vertex buffer objects
         void setupVertexBuffer( LPDIRECT3DDEVICE9 device );
 
+        // Creates a vertex buffer of compact vertices. Returns false if the
+        // device can't read them.
+        bool setupCompactVertexBuffer( LPDIRECT3DDEVICE9 device );
+
 
         // The vertices of the faces in the map
         vector< D3D::Vertex > vertices;
 
-        // The index of the first vertex of each face
+        // The indices of every face's triangles, one face after the other
+        vector< unsigned int > indices;
+
+        // The first index, and the first vertex, of each face
         vector< int > startIndices;
+        vector< int > startVertices;
 
         // The Direct3D vertex buffer
         LPDIRECT3DVERTEXBUFFER9 vertexBuffer;
 
+        // Whether compact vertices were asked for, and their declaration if
+        //  the vertex buffer holds them
+        bool compactVertices;
+        LPDIRECT3DVERTEXDECLARATION9 vertexDeclaration;
+
+        // The box around the vertices, and how far off the compact vertices
+        //  are from the full vertices
+        CompactBounds compactBounds;
+        CompactVertexError compactError;
+        CompactVertexError compactErrorBound;
+
         // The lumps associated with the vertex information.
         Lump< BSP::Vertex, BSP_VERTEX_LUMP > vertexLump;
         Lump< BSP::Edge, BSP_EDGE_LUMP > edgeLump;
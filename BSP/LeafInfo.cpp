@@ -4,9 +4,9 @@
 
 #include "LeafInfo.h"
 
-void LeafInfo::load( BSP::Header *header, FILE *mapFile ) {
-    leafLump.load( header, mapFile );
-    leafFaceLump.load( header, mapFile );
+void LeafInfo::load( BSPFile *mapFile ) {
+    leafLump.load( mapFile );
+    leafFaceLump.load( mapFile );
 
     setupLeafFaces();
 };
@@ -20,7 +20,7 @@ class LeafInfo {
             unload();
         };
 
-        void load( BSP::Header *header, FILE *mapFile );
+        void load( BSPFile *mapFile );
         void unload();
 
         int getLeafOfPoint( Point3f pos );
@@ -6,10 +6,17 @@
 
 
 /**
- * Constructor that prepares the lightmap for use. load() must be called
- * before this lightmap can be used to texture an object in Direct3D.
+ * Constructor that makes an empty (black) page that is width by height
+ * pixels. createTexture() must be called before this page can be used
+ * to texture an object in Direct3D.
  */
-LightMap::LightMap() {
+LightMapPage::LightMapPage( int width, int height ) {
+    this->width = width;
+    this->height = height;
+
+    pixels.resize( width * height );
+    memset( &pixels[ 0 ], 0, width * height * sizeof( Pixel ) );
+
     texture = NULL;
 };
 
@@ -18,78 +25,83 @@ LightMap::LightMap() {
  * Destructor that makes sure all memory allocated by this class has been
  * de-allocated.
  */
-LightMap::~LightMap() {
-    if ( texture != NULL ) {
-        texture->Release();
-    }
+LightMapPage::~LightMapPage() {
+    unload();
 };
 
 
 /**
- * load() method loads in a lightmap from pixel buffer "data", using the
- * information found in face. The d3dFace parameter is the face used for
- * triangulating a BSP Face. The d3dFace also keeps track of the texture
- * coordinates used for the lightmap, which is why it is needed to load
- * the lightmap. The "device" parameter is used in making a texture from
- * the lightmap with Direct3D.
+ * copyLightMap() copies a lightmap that is width by height pixels into
+ * the page, with its top-left corner at ( x, y ). The lightmap's pixels
+ * are 3 bytes each (red, green, blue). If data is NULL, then the lightmap
+ * is fully lit (white). The edge pixels are also copied out into the
+ * padding pixels around the lightmap.
  */
-void LightMap::load( char *data, BSP::Face *face, D3D::Face *d3dFace, LPDIRECT3DDEVICE9 device ) {
+void LightMapPage::copyLightMap( unsigned char *data, int width, int height, int x, int y, int padding ) {
 
-    // compute the width and height of this lightmap
-    width = ceil( d3dFace->getMaxU() / 16 ) - floor( d3dFace->getMinU() / 16 ) + 1;
-    height = ceil( d3dFace->getMaxV() / 16 ) - floor( d3dFace->getMinV() / 16 ) + 1;
+    // Go through each pixel of the lightmap and its padding
+    for ( int row = -padding; row < height + padding; ++row ) {
 
-    // The maximum width or height of a lightmap is 16 pixels
-    if ( width > 16 ) {
-        width = 16;
-    }
-    if ( height > 16 ) {
-        height = 16;
-    }
-
-    // Copy the data from the data pointer into a temporary Pixel buffer
-    vector< Pixel > pixels;
-    pixels.resize( width * height );
+        // Padding pixels take the colour of the closest pixel of the lightmap
+        int srcRow = row < 0 ? 0 : ( row >= height ? height - 1 : row );
+        Pixel *dest = &pixels[ ( y + row ) * this->width + x - padding ];
 
-    data += face->lightmap_offset;
+        for ( int column = -padding; column < width + padding; ++column ) {
+            int srcColumn = column < 0 ? 0 : ( column >= width ? width - 1 : column );
 
-    Pixel *copy = ( Pixel * ) data;
+            if ( data == NULL ) {
+                dest->r = dest->g = dest->b = 255;
+            } else {
+                unsigned char *src = data + ( srcRow * width + srcColumn ) * 3;
 
-    for ( int i = 0; i < width * height; ++i ) {
-        pixels[ i ].r = copy->b;
-        pixels[ i ].g = copy->g;
-        pixels[ i ].b = copy->r;
-        pixels[ i ].a = 255;
+                // Direct3D keeps the colours in the opposite order
+                dest->r = src[ 2 ];
+                dest->g = src[ 1 ];
+                dest->b = src[ 0 ];
+            }
+            dest->a = 255;
 
-        data += 3;
-        copy = ( Pixel * ) data;
+            ++dest;
+        }
     }
+};
 
-    // Give DirectX our lightmap information
-    D3DLOCKED_RECT lr;
 
-    device->CreateTexture(width,
-		height, 1, 0,
-		D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture, NULL);
+/**
+ * createTexture() sends the page's pixels to a Direct3D texture. The
+ * pixels are kept until releasePixels() is called, so that they can
+ * still be written to a map cache.
+ */
+void LightMapPage::createTexture( LPDIRECT3DDEVICE9 device ) {
+    createTexture( device, &pixels[ 0 ] );
+};
 
-	texture->LockRect( 0, &lr, NULL, 0 );
+/**
+ * createTexture() with a source parameter sends width * height pixels
+ * from source instead of the page's own pixels.
+ */
+void LightMapPage::createTexture( LPDIRECT3DDEVICE9 device, const Pixel *source ) {
+    unload();
 
-	unsigned char* pRect = ( UCHAR* ) lr.pBits;
+    // Give DirectX our lightmap information
+    D3DLOCKED_RECT lr;
 
-    // copy image to pRect
-    memcpy( pRect, &pixels[ 0 ], width * height * sizeof( Pixel ) );
+    if ( FAILED( device->CreateTexture( width, height, 1, 0,
+                                        D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture, NULL ) ) ) {
+        texture = NULL;
+        return;
+    }
 
-	texture->UnlockRect( 0 );
+    texture->LockRect( 0, &lr, NULL, 0 );
 
-    //d3dFace->divideLMTexCoords( d3dFace->getMaxU() - d3dFace->getMinU(), d3dFace->getMaxV() - d3dFace->getMinV() );
-    //d3dFace->shiftLMTexCoords( -d3dFace->getMinU(), -d3dFace->getMinV() );
+    unsigned char* pRect = ( UCHAR* ) lr.pBits;
 
-    // Top-left corner is at luxel coord: (-8, -8)
-    d3dFace->shiftLMTexCoords( -d3dFace->getMinU() - 8, -d3dFace->getMinV() - 8 );
-    //d3dFace->shiftLMTexCoords( -d3dFace->getMinU() - 7, -d3dFace->getMinV() - 7 );
-    //d3dFace->shiftLMTexCoords( -8, -8 );
-    d3dFace->divideLMTexCoords( d3dFace->getMaxU() - d3dFace->getMinU(), d3dFace->getMaxV() - d3dFace->getMinV() );
+    // copy the page to pRect, one row at a time
+    for ( int row = 0; row < height; ++row ) {
+        memcpy( pRect + row * lr.Pitch, source + row * width, width * sizeof( Pixel ) );
+    }
 
+    texture->UnlockRect( 0 );
 };
 
 // LIGHTMAPINFO METHODS
@@ -98,10 +110,16 @@ void LightMap::load( char *data, BSP::Face *face, D3D::Face *d3dFace, LPDIRECT3D
 /**
  * Constructor initialises the object and prepares it for use.
  */
-LightMapInfo::LightMapInfo() {
+LightMapInfo::LightMapInfo() : packer( LIGHTMAP_PAGE_SIZE, LIGHTMAP_PAGE_SIZE, LIGHTMAP_PADDING ) {
     lightMapData = NULL;
+    lightMapLength = 0;
 
-    lightMapNum = 0;
+    occupancy = 0.0;
+    cachedPixels = NULL;
+
+    whitePage = 0;
+    whiteX = 0;
+    whiteY = 0;
 };
 
 
@@ -110,44 +128,207 @@ LightMapInfo::LightMapInfo() {
  * properly disposed of.
  */
 LightMapInfo::~LightMapInfo() {
-    if ( lightMapData != NULL ) {
-        delete[] lightMapData;
-        lightMapData = NULL;
-    }
-
     unload();
 };
 
 /**
  * load() method prepares the lightmaps so they can be loaded individually
- * with loadLightMap(). It also loads in the lightmap lump of the BSP file
- * so the lightmaps can be loaded easily.
+ * with loadLightMap(). The lightmap lump is used straight out of the mapped
+ * BSP file, so it must stay open until all of the lightmaps have been loaded.
+ */
+void LightMapInfo::load( BSPFile *mapFile ) {
+    unload();
+
+    // Point at the lightmap data in the mapped file
+    lightMapData = ( char * ) mapFile->getLump( BSP_LIGHTMAP_LUMP );
+    lightMapLength = mapFile->getLumpLength( BSP_LIGHTMAP_LUMP );
+
+    // make room for the page number of each face
+    facePages.reserve( mapFile->getLumpLength( BSP_FACE_LUMP ) / sizeof( BSP::Face ) );
+
+    // Every face without a lightmap uses the same white pixel, so that they
+    // don't each take up space on a page
+    packLightMap( 1, 1, &whitePage, &whiteX, &whiteY );
+    pages[ whitePage ]->copyLightMap( NULL, 1, 1, whiteX, whiteY, packer.getPadding() );
+};
+
+/**
+ * loadLightMap() packs the lightmap that belongs to parameter face into a
+ * page. It then modifies the lightmap texture coordinates, sending the
+ * lightmap texture coordinates to parameter d3dFace. The lightmap texture
+ * coordinates of d3dFace must not have been changed yet.
+ *
+ * loadLightMap() has to be called for each face in the face lump, in order.
+ */
+void LightMapInfo::loadLightMap( BSP::Face *face, D3D::Face *d3dFace ) {
+
+    // compute the size of this lightmap. There is one lightmap pixel for every
+    // 16 texture pixels, with a pixel on each edge of the face.
+    float minU = floor( d3dFace->getMinU() / 16 );
+    float minV = floor( d3dFace->getMinV() / 16 );
+    int width = ( int ) ( ceil( d3dFace->getMaxU() / 16 ) - minU ) + 1;
+    int height = ( int ) ( ceil( d3dFace->getMaxV() / 16 ) - minV ) + 1;
+
+    int page, x, y;
+
+    // If the face has no lightmap, or its lightmap isn't inside of the lightmap
+    // lump, or it doesn't fit on a page, then the face is drawn fully lit.
+    if ( face->lightmap_offset < 0 || face->lightmap_offset > lightMapLength ||
+         width * height * 3 > lightMapLength - face->lightmap_offset ||
+         !packLightMap( width, height, &page, &x, &y ) ) {
+
+        facePages.push_back( whitePage );
+
+        d3dFace->setLMTexCoords( ( whiteX + 0.5 ) / packer.getPageWidth(),
+                                 ( whiteY + 0.5 ) / packer.getPageHeight() );
+        return;
+    }
+
+    pages[ page ]->copyLightMap( ( unsigned char * ) lightMapData + face->lightmap_offset,
+                                 width, height, x, y, packer.getPadding() );
+    facePages.push_back( page );
+
+    // Lightmap pixel #0 covers the texture coordinates from minU * 16 - 8 up
+    // to minU * 16 + 8, so its centre lines up with the first texture
+    // coordinate on the face. Move the coordinates to where the lightmap is
+    // on the page, then scale them down to the size of the page.
+    d3dFace->shiftLMTexCoords( ( x - minU ) * 16 + 8, ( y - minV ) * 16 + 8 );
+    d3dFace->divideLMTexCoords( packer.getPageWidth() * 16, packer.getPageHeight() * 16 );
+};
+
+/**
+ * createPages() creates the Direct3D texture of each page, once all of the
+ * lightmaps have been loaded with loadLightMap(), or once the pages have
+ * been loaded with loadCache().
+ */
+void LightMapInfo::createPages( LPDIRECT3DDEVICE9 device ) {
+
+    // Pages from a map cache are sent straight from the cache to Direct3D
+    if ( cachedPixels != NULL ) {
+        int pageSize = packer.getPageWidth() * packer.getPageHeight();
+
+        for ( unsigned int i = 0; i < pages.size(); ++i ) {
+            pages[ i ]->createTexture( device, cachedPixels + i * pageSize );
+        }
+
+        cachedPixels = NULL;
+        return;
+    }
+
+    for ( unsigned int i = 0; i < pages.size(); ++i ) {
+        pages[ i ]->createTexture( device );
+    }
+
+    occupancy = packer.getOccupancy();
+};
+
+
+/**
+ * loadCache() loads the pages and the page of each face out of a map
+ * cache, instead of packing the lightmaps with loadLightMap(). numFaces
+ * is the number of faces in the map. Nothing is changed if the cache's
+ * lightmaps can't be used, and false is returned. The pages' pixels are
+ * sent straight from the cache by createPages(), so the cache must stay
+ * open until then.
  */
-void LightMapInfo::load( BSP::Header *header, FILE *mapFile ) {
-    if ( lightMapData != NULL ) {
-        delete[] lightMapData;
+bool LightMapInfo::loadCache( MapCache *cache, int numFaces ) {
+    MapCacheHeader *header = cache->getHeader();
+
+    // The pages must be the same size as the pages that this build makes
+    if ( header->lightMapPageWidth != packer.getPageWidth() ||
+         header->lightMapPageHeight != packer.getPageHeight() ) {
+        return false;
+    }
+
+    int pageSize = packer.getPageWidth() * packer.getPageHeight();
+    int numPixels = cache->getNumItems( MAP_CACHE_LIGHTMAP_PIXELS, sizeof( Pixel ) );
+    if ( numPixels <= 0 || numPixels % pageSize != 0 ) {
+        return false;
+    }
+    int numPages = numPixels / pageSize;
+
+    // Every face must have a page that exists
+    int *cachedPages = ( int * ) cache->getSection( MAP_CACHE_FACE_PAGES );
+    if ( cache->getNumItems( MAP_CACHE_FACE_PAGES, sizeof( int ) ) != numFaces ) {
+        return false;
+    }
+    for ( int i = 0; i < numFaces; ++i ) {
+        if ( cachedPages[ i ] < 0 || cachedPages[ i ] >= numPages ) {
+            return false;
+        }
+    }
+
+    // The cache can be used, so throw away the white pixel that load() packed
+    unload();
+
+    facePages.resize( numFaces );
+    if ( numFaces > 0 ) {
+        memcpy( &facePages[ 0 ], cachedPages, numFaces * sizeof( int ) );
+    }
+
+    // The pages don't need pixels of their own, since createPages() sends
+    //  each page straight from the cache to Direct3D
+    for ( int i = 0; i < numPages; ++i ) {
+        LightMapPage *page = new LightMapPage( packer.getPageWidth(), packer.getPageHeight() );
+        page->releasePixels();
+
+        pages.push_back( page );
     }
 
-    // Load in the lightmap data, storing it in lightMapData
-    lightMapData = new char[ header->lump[ BSP_LIGHTMAP_LUMP ].length ];
-    fseek( mapFile, header->lump[ BSP_LIGHTMAP_LUMP ].offset, 0 );
-    fread( lightMapData, header->lump[ BSP_LIGHTMAP_LUMP ].length, 1, mapFile );
+    cachedPixels = ( Pixel * ) cache->getSection( MAP_CACHE_LIGHTMAP_PIXELS );
+
+    occupancy = header->lightMapOccupancy;
+
+    return true;
+};
+
+/**
+ * saveCache() gives the pages and the page of each face to a map cache.
+ * It must be called before releasePixels().
+ */
+void LightMapInfo::saveCache( MapCacheWriter *writer ) {
+    int pageSize = packer.getPageWidth() * packer.getPageHeight();
+
+    // Put all of the pages one after the other
+    vector< Pixel > allPixels;
+    allPixels.resize( pages.size() * pageSize );
 
-    // allocate memory for the lightmaps
-    lightMaps.resize( header->lump[ BSP_FACE_LUMP ].length / sizeof( BSP::Face ) );
+    for ( unsigned int i = 0; i < pages.size(); ++i ) {
+        memcpy( &allPixels[ i * pageSize ], pages[ i ]->getPixels(), pageSize * sizeof( Pixel ) );
+    }
 
+    writer->setSection( MAP_CACHE_LIGHTMAP_PIXELS, allPixels.empty() ? NULL : &allPixels[ 0 ],
+                        allPixels.size() * sizeof( Pixel ) );
+    writer->setSection( MAP_CACHE_FACE_PAGES, facePages.empty() ? NULL : &facePages[ 0 ],
+                        facePages.size() * sizeof( int ) );
+    writer->setLightMapPages( packer.getPageWidth(), packer.getPageHeight(), occupancy );
 };
 
 /**
- * loadLightMap() loads in the lightmap that belongs to parameter face.
- * It then modifies the lightmap texture coordinates, sending the lightmap
- * texture coordinates to parameter d3dFace. Parameter device is to help
- * create the Direct3D texture object that is associated with the lightmap.
+ * releasePixels() deletes the pages' pixels, once their textures have
+ * been created and they no longer need to be written to a map cache.
  */
-void LightMapInfo::loadLightMap( LPDIRECT3DDEVICE9 device, BSP::Face *face, D3D::Face *d3dFace ) {
-    // load in a new lightmap
-    lightMaps[ lightMapNum ].load( lightMapData, face, d3dFace, device );
-    lightMapNum++;
+void LightMapInfo::releasePixels() {
+    for ( unsigned int i = 0; i < pages.size(); ++i ) {
+        pages[ i ]->releasePixels();
+    }
+};
+
+/**
+ * Packs a lightmap onto a page, starting new pages when they are needed.
+ * Returns false if the lightmap is too big for a page.
+ */
+bool LightMapInfo::packLightMap( int width, int height, int *page, int *x, int *y ) {
+    if ( !packer.insert( width, height, page, x, y ) ) {
+        return false;
+    }
+
+    // Make the page if the packer had to start a new one
+    while ( ( int ) pages.size() < packer.getNumPages() ) {
+        pages.push_back( new LightMapPage( packer.getPageWidth(), packer.getPageHeight() ) );
+    }
+
+    return true;
 };
 
 /**
@@ -155,14 +336,20 @@ void LightMapInfo::loadLightMap( LPDIRECT3DDEVICE9 device, BSP::Face *face, D3D:
  */
 void LightMapInfo::unload() {
 
-    // Go through each lightmap, deleting each one
-    for ( unsigned int i = 0; i < lightMaps.size(); ++i ) {
-        lightMaps[ i ].unload();
+    // Go through each page, deleting each one
+    for ( unsigned int i = 0; i < pages.size(); ++i ) {
+        delete pages[ i ];
     }
 
-    lightMapNum = 0;
+    pages.resize( 0 );
+    facePages.resize( 0 );
+    packer.reset();
+    occupancy = 0.0;
+    cachedPixels = NULL;
 
-    lightMaps.resize( 0 );
+    // Forget about the lightmap lump
+    lightMapData = NULL;
+    lightMapLength = 0;
 };
 
 //---------------------------------------------------------------------------
@@ -5,6 +5,20 @@
 
 #include "BSPCommon.h"
 #include "D3DFace.h"
+#include "BSPFile.h"
+#include "LightMapPacker.h"
+#include "MapCache.h"
+
+// The size of each lightmap page, in pixels. A Quake 2 lightmap has one
+// pixel for every 16 units of its face, and a face is never more than 256
+// units across, so a lightmap is never more than 17 pixels on a side and
+// many of them fit on one page.
+#define LIGHTMAP_PAGE_SIZE 256
+
+// The number of pixels around each lightmap on a page. The edges of each
+// lightmap are copied into its border, so that texture filtering at the edge
+// of a face never picks up the colour of the lightmap beside it.
+#define LIGHTMAP_PADDING 1
 
 /**
  * Pixel structure is used to copy information from the loaded lightmap to the
@@ -20,52 +34,66 @@ typedef struct {
  * pixel information is stored in a 24 bits per pixel format (8 bits for red,
  * green, and blue). Lightmap colours are combined with the plain texture of a
  * face in the BSP Map to achieve world lighting with the map's textures.
+ *
+ * Each face's lightmap is tiny, so instead of giving each one a texture of its
+ * own, many lightmaps are copied into one large texture called a page. Faces
+ * with lightmaps on the same page can then be drawn together.
  */
-class LightMap {
+class LightMapPage {
     public:
 
         /**
-         * Constructor that prepares the lightmap for use. load() must be called
-         * before this lightmap can be used to texture an object in Direct3D.
+         * Constructor that makes an empty (black) page that is width by height
+         * pixels. createTexture() must be called before this page can be used
+         * to texture an object in Direct3D.
          */
-        LightMap();
+        LightMapPage( int width, int height );
 
         /**
          * Destructor that makes sure all memory allocated by this class has been
          * de-allocated.
          */
-        ~LightMap();
+        ~LightMapPage();
 
         /**
-         * load() method loads in a lightmap from pixel buffer "data", using the
-         * information found in face. The d3dFace parameter is the face used for
-         * triangulating a BSP Face. The d3dFace also keeps track of the texture
-         * coordinates used for the lightmap, which is why it is needed to load
-         * the lightmap. The "device" parameter is used in making a texture from
-         * the lightmap with Direct3D.
+         * copyLightMap() copies a lightmap that is width by height pixels into
+         * the page, with its top-left corner at ( x, y ). The lightmap's pixels
+         * are 3 bytes each (red, green, blue). If data is NULL, then the lightmap
+         * is fully lit (white). The edge pixels are also copied out into the
+         * padding pixels around the lightmap.
          */
-        void load( char *data, BSP::Face *face, D3D::Face *d3dFace, LPDIRECT3DDEVICE9 device );
+        void copyLightMap( unsigned char *data, int width, int height, int x, int y, int padding );
 
+        /**
+         * createTexture() sends the page's pixels to a Direct3D texture. The
+         * pixels are kept until releasePixels() is called, so that they can
+         * still be written to a map cache.
+         * createTexture() with a source parameter sends width * height pixels
+         * from source instead of the page's own pixels.
+         */
+        void createTexture( LPDIRECT3DDEVICE9 device );
+        void createTexture( LPDIRECT3DDEVICE9 device, const Pixel *source );
 
         /**
-         * Returns the Direct3D texture object associated with this lightmap
+         * Returns the page's pixels, or NULL if they have been released
          */
-        LPDIRECT3DTEXTURE9 getTexture() {
-            return texture;
+        const Pixel *getPixels() {
+            return pixels.empty() ? NULL : &pixels[ 0 ];
         };
 
         /**
-         * Returns the width of the lightmap
+         * releasePixels() deletes the page's pixels. Direct3D keeps its own copy
+         * of them in the page's texture.
          */
-        int getWidth() {
-            return width;
+        void releasePixels() {
+            pixels.resize( 0 );
         };
 
         /**
-         * Returns the height of the lightmap
+         * Returns the Direct3D texture object associated with this page
          */
-        int getHeight() {
-            return height;
+        LPDIRECT3DTEXTURE9 getTexture() {
+            return texture;
         };
 
         /**
@@ -80,11 +108,14 @@ class LightMap {
         };
 
     private:
-        // The dimensions of the lightmap
+        // The dimensions of the page
         int width;
         int height;
 
-        // The Direct3D texture object associated with this lightmap
+        // The page's pixels, until they are sent to Direct3D
+        vector< Pixel > pixels;
+
+        // The Direct3D texture object associated with this page
         LPDIRECT3DTEXTURE9 texture;
 
 };
@@ -92,8 +123,10 @@ class LightMap {
 
 /**
  * The LightMapInfo object deals with storing all of the lightmaps from a BSP map.
- * The LightMaps loaded in separately, with each BSP face that the lightmaps are
- * used for (each lightmap is specific to 1 bsp face)
+ * The lightmaps are loaded in separately, with each BSP face that the lightmaps
+ * are used for (each lightmap is specific to 1 bsp face). Each lightmap is
+ * packed into a page, and its face's lightmap texture coordinates are changed
+ * to point at the lightmap's place on that page.
  */
 class LightMapInfo {
     public:
@@ -111,28 +144,79 @@ class LightMapInfo {
 
         /**
          * load() method prepares the lightmaps so they can be loaded individually
-         * with loadLightMap(). It also loads in the lightmap lump of the BSP file
-         * so the lightmaps can be loaded easily.
+         * with loadLightMap(). The lightmap lump is used straight out of the mapped
+         * BSP file, so it must stay open until all of the lightmaps have been loaded.
+         */
+        void load( BSPFile *mapFile );
+
+        /**
+         * loadLightMap() packs the lightmap that belongs to parameter face into a
+         * page. It then modifies the lightmap texture coordinates, sending the
+         * lightmap texture coordinates to parameter d3dFace. The lightmap texture
+         * coordinates of d3dFace must not have been changed yet.
+         *
+         * loadLightMap() has to be called for each face in the face lump, in order.
+         */
+        void loadLightMap( BSP::Face *face, D3D::Face *d3dFace );
+
+        /**
+         * createPages() creates the Direct3D texture of each page, once all of the
+         * lightmaps have been loaded with loadLightMap(), or once the pages have
+         * been loaded with loadCache().
          */
-        void load( BSP::Header *header, FILE *mapFile );
+        void createPages( LPDIRECT3DDEVICE9 device );
 
         /**
-         * loadLightMap() loads in the lightmap that belongs to parameter face.
-         * It then modifies the lightmap texture coordinates, sending the lightmap
-         * texture coordinates to parameter d3dFace. Parameter device is to help
-         * create the Direct3D texture object that is associated with the lightmap.
+         * Returns the number of the lightmap page that face #faceNum's lightmap
+         * is stored in. Faces on the same page can be drawn together.
          */
-        void loadLightMap( LPDIRECT3DDEVICE9 device, BSP::Face *face, D3D::Face *d3dFace );
+        int getPageNum( int faceNum ) {
+            return facePages[ faceNum ];
+        };
 
+        /**
+         * Returns the Direct3D texture object for lightmap page #pageNum
+         */
+        LPDIRECT3DTEXTURE9 getPageTexture( int pageNum ) {
+            return pages[ pageNum ]->getTexture();
+        };
 
         /**
-         * Returns the Direct3D texture object for face #texNum. This is so that
-         * the BSP Map renderer can use the texture for lighting.
+         * Returns the number of lightmap pages
          */
-        LPDIRECT3DTEXTURE9 getTexture( int texNum ) {
-            return lightMaps[ texNum ].getTexture();
+        int getNumPages() {
+            return pages.size();
         };
 
+        /**
+         * Returns how full the lightmap pages are, from 0.0 to 1.0
+         */
+        float getOccupancy() {
+            return occupancy;
+        };
+
+        /**
+         * loadCache() loads the pages and the page of each face out of a map
+         * cache, instead of packing the lightmaps with loadLightMap(). numFaces
+         * is the number of faces in the map. Nothing is changed if the cache's
+         * lightmaps can't be used, and false is returned. The pages' pixels are
+         * sent straight from the cache by createPages(), so the cache must stay
+         * open until then.
+         */
+        bool loadCache( MapCache *cache, int numFaces );
+
+        /**
+         * saveCache() gives the pages and the page of each face to a map cache.
+         * It must be called before releasePixels().
+         */
+        void saveCache( MapCacheWriter *writer );
+
+        /**
+         * releasePixels() deletes the pages' pixels, once their textures have
+         * been created and they no longer need to be written to a map cache.
+         */
+        void releasePixels();
+
         /**
          * unload() method unloads all of the BSP map's lightmaps
          */
@@ -140,17 +224,35 @@ class LightMapInfo {
 
     private:
 
-        // The array of BSP Lightmaps
-        vector< LightMap > lightMaps;
+        // Packs a lightmap onto a page, starting new pages when they are needed.
+        //  Returns false if the lightmap is too big for a page.
+        bool packLightMap( int width, int height, int *page, int *x, int *y );
 
-        // The lightmap data loaded in from the BSP map
-        char *lightMapData;
+        // Decides where on the pages each lightmap goes
+        LightMapPacker packer;
+
+        // The pages that the lightmaps are packed into
+        vector< LightMapPage * > pages;
+
+        // The page of each face's lightmap
+        vector< int > facePages;
 
-        // Which lightmap is to be loaded next by loadLightMap()
-        int lightMapNum;
+        // How full the pages are, from 0.0 to 1.0
+        float occupancy;
+
+        // The pages' pixels inside of the map cache, if they were loaded from one
+        const Pixel *cachedPixels;
+
+        // Where a single white pixel is, for faces that don't have a lightmap
+        int whitePage;
+        int whiteX;
+        int whiteY;
+
+        // The lightmap lump of the BSP map, inside of the mapped file
+        char *lightMapData;
+        int lightMapLength;
 };
 
 
 //---------------------------------------------------------------------------
 #endif
- 
\ No newline at end of file
@@ -0,0 +1,303 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "LightMapPacker.h"
+
+#include <stdlib.h>
+
+
+/**
+ * Constructor prepares a packer for pages that are pageWidth by
+ * pageHeight pixels, with padding pixels around each rectangle.
+ */
+LightMapPacker::LightMapPacker( int pageWidth, int pageHeight, int padding ) {
+    this->pageWidth = pageWidth;
+    this->pageHeight = pageHeight;
+    this->padding = padding;
+};
+
+
+/**
+ * insert() finds a place for a rectangle that is width by height pixels.
+ * The page that the rectangle was put on is returned in page, and the
+ * top-left corner of the rectangle (inside of its padding) is returned
+ * in x and y.
+ * Returns false if the rectangle is too big to fit on a page at all.
+ */
+bool LightMapPacker::insert( int width, int height, int *page, int *x, int *y ) {
+
+    // The rectangle takes up its padding on every side
+    int paddedWidth = width + padding * 2;
+    int paddedHeight = height + padding * 2;
+
+    if ( width <= 0 || height <= 0 || paddedWidth > pageWidth || paddedHeight > pageHeight ) {
+        return false;
+    }
+
+    int node, nodeX, nodeY;
+
+    // Try each of the pages that have already been started, in order
+    for ( int p = 0; p < getNumPages(); ++p ) {
+        if ( findPosition( p, paddedWidth, paddedHeight, &node, &nodeX, &nodeY ) ) {
+            place( p, node, nodeX, nodeY, paddedWidth, paddedHeight );
+            usedArea[ p ] += width * height;
+
+            *page = p;
+            *x = nodeX + padding;
+            *y = nodeY + padding;
+            return true;
+        }
+    }
+
+    // It didn't fit anywhere, so start a new page. The rectangle always fits
+    //  on an empty page.
+    addPage();
+    int p = getNumPages() - 1;
+
+    findPosition( p, paddedWidth, paddedHeight, &node, &nodeX, &nodeY );
+    place( p, node, nodeX, nodeY, paddedWidth, paddedHeight );
+    usedArea[ p ] += width * height;
+
+    *page = p;
+    *x = nodeX + padding;
+    *y = nodeY + padding;
+    return true;
+};
+
+
+/**
+ * reset() removes all of the rectangles and pages
+ */
+void LightMapPacker::reset() {
+    skylines.resize( 0 );
+    usedArea.resize( 0 );
+};
+
+
+/**
+ * Returns how full the pages are, from 0.0 to 1.0. This is the area
+ * covered by rectangles (not counting their padding) divided by the
+ * total area of all of the pages.
+ */
+float LightMapPacker::getOccupancy() {
+    if ( getNumPages() == 0 ) {
+        return 0.0;
+    }
+
+    float totalUsed = 0.0;
+    for ( int p = 0; p < getNumPages(); ++p ) {
+        totalUsed += usedArea[ p ];
+    }
+
+    return totalUsed / ( float( pageWidth ) * float( pageHeight ) * float( getNumPages() ) );
+};
+
+
+/**
+ * Works out where a rectangle would go if it started at skyline node
+ * #node of page #page. The rectangle has to go below every segment that
+ * it covers, so its y is the largest y of those segments.
+ * Returns false if it doesn't fit there.
+ */
+bool LightMapPacker::fit( int page, int node, int width, int height, int *y ) {
+    vector< SkylineNode > &skyline = skylines[ page ];
+
+    // Make sure the rectangle doesn't go off of the right side of the page
+    if ( skyline[ node ].x + width > pageWidth ) {
+        return false;
+    }
+
+    int top = skyline[ node ].y;
+    int widthLeft = width;
+
+    // Go over each segment under the rectangle. The segments cover the whole
+    //  width of the page, so this never runs off the end of the skyline.
+    while ( widthLeft > 0 ) {
+        if ( skyline[ node ].y > top ) {
+            top = skyline[ node ].y;
+        }
+
+        // Make sure the rectangle doesn't go off of the bottom of the page
+        if ( top + height > pageHeight ) {
+            return false;
+        }
+
+        widthLeft -= skyline[ node ].width;
+        ++node;
+    }
+
+    *y = top;
+    return true;
+};
+
+
+/**
+ * Finds the best place on page #page for a rectangle: the place where the
+ * lower edge of the rectangle is the highest up the page. If two places
+ * are just as good, the narrower segment is used, so that wide gaps are
+ * kept for wide rectangles. Returns false if it doesn't fit anywhere.
+ */
+bool LightMapPacker::findPosition( int page, int width, int height, int *node, int *x, int *y ) {
+    vector< SkylineNode > &skyline = skylines[ page ];
+
+    int bestBottom = pageHeight + 1;
+    int bestWidth = pageWidth + 1;
+    int bestNode = -1;
+
+    for ( unsigned int i = 0; i < skyline.size(); ++i ) {
+        int top;
+
+        if ( fit( page, i, width, height, &top ) ) {
+            if ( top + height < bestBottom ||
+                 ( top + height == bestBottom && skyline[ i ].width < bestWidth ) ) {
+                bestBottom = top + height;
+                bestWidth = skyline[ i ].width;
+                bestNode = i;
+
+                *x = skyline[ i ].x;
+                *y = top;
+            }
+        }
+    }
+
+    *node = bestNode;
+    return bestNode >= 0;
+};
+
+
+/**
+ * Puts a rectangle on page #page at skyline node #node, and updates the
+ * skyline to go over it. The segments that the rectangle covers are cut
+ * back or removed, and segments at the same height are joined together.
+ */
+void LightMapPacker::place( int page, int node, int x, int y, int width, int height ) {
+    vector< SkylineNode > &skyline = skylines[ page ];
+
+    // The lower edge of the rectangle becomes a new segment of the skyline
+    SkylineNode newNode;
+    newNode.x = x;
+    newNode.y = y + height;
+    newNode.width = width;
+    skyline.insert( skyline.begin() + node, newNode );
+
+    // Cut the segments after it back, so that they start where it ends
+    for ( unsigned int i = node + 1; i < skyline.size(); ) {
+        int previousEnd = skyline[ i - 1 ].x + skyline[ i - 1 ].width;
+
+        if ( skyline[ i ].x >= previousEnd ) {
+            break;
+        }
+
+        int shrink = previousEnd - skyline[ i ].x;
+        skyline[ i ].x += shrink;
+        skyline[ i ].width -= shrink;
+
+        if ( skyline[ i ].width <= 0 ) {
+            // The segment is covered completely
+            skyline.erase( skyline.begin() + i );
+        } else {
+            break;
+        }
+    }
+
+    // Join together neighbouring segments that are at the same height
+    for ( unsigned int i = 0; i + 1 < skyline.size(); ) {
+        if ( skyline[ i ].y == skyline[ i + 1 ].y ) {
+            skyline[ i ].width += skyline[ i + 1 ].width;
+            skyline.erase( skyline.begin() + i + 1 );
+        } else {
+            ++i;
+        }
+    }
+};
+
+
+/**
+ * Starts a new, empty page. An empty page's skyline is a single segment
+ * along the top edge of the page.
+ */
+void LightMapPacker::addPage() {
+    SkylineNode bottom;
+    bottom.x = 0;
+    bottom.y = 0;
+    bottom.width = pageWidth;
+
+    skylines.push_back();
+    skylines.back().push_back( bottom );
+
+    usedArea.push_back( 0 );
+};
+
+
+/**
+ * testLightMapPacker() packs "numRects" rectangles of random lightmap sizes
+ * (1 to 17 pixels on a side, made from "seed") into 256 by 256 pages with a
+ * 1 pixel border, then checks that every rectangle is on its page and that no
+ * two of them (with their borders) overlap. The results go into "result".
+ */
+void testLightMapPacker( int numRects, unsigned int seed, LightMapPackerTest *result ) {
+    const int PAGE_SIZE = 256;
+    const int PADDING = 1;
+
+    LightMapPacker packer( PAGE_SIZE, PAGE_SIZE, PADDING );
+
+    result->numFailed = 0;
+    result->numOutside = 0;
+    result->numOverlapping = 0;
+
+    // How many times each pixel of each page is covered, by a rectangle or
+    //  its border. A pixel that is covered twice is an overlap.
+    vector< vector< unsigned char > > covered;
+
+    srand( seed );
+
+    for ( int i = 0; i < numRects; ++i ) {
+        int width = 1 + rand() % 17;
+        int height = 1 + rand() % 17;
+        int page, x, y;
+
+        if ( !packer.insert( width, height, &page, &x, &y ) ) {
+            ++result->numFailed;
+            continue;
+        }
+
+        // The rectangle's border has to be on the page too
+        int left = x - PADDING;
+        int top = y - PADDING;
+        int right = x + width + PADDING;
+        int bottom = y + height + PADDING;
+
+        if ( left < 0 || top < 0 || right > PAGE_SIZE || bottom > PAGE_SIZE ) {
+            ++result->numOutside;
+            continue;
+        }
+
+        while ( ( int ) covered.size() <= page ) {
+            covered.push_back();
+            covered.back().resize( PAGE_SIZE * PAGE_SIZE, 0 );
+        }
+
+        bool overlaps = false;
+        for ( int py = top; py < bottom; ++py ) {
+            for ( int px = left; px < right; ++px ) {
+                unsigned char *pixel = &covered[ page ][ py * PAGE_SIZE + px ];
+
+                if ( *pixel != 0 ) {
+                    overlaps = true;
+                }
+                *pixel = 1;
+            }
+        }
+
+        if ( overlaps ) {
+            ++result->numOverlapping;
+        }
+    }
+
+    result->numPages = packer.getNumPages();
+    result->occupancy = packer.getOccupancy();
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------
+
+#ifndef LightMapPackerH
+#define LightMapPackerH
+
+#include <vector.h>
+
+using namespace std;
+
+
+/**
+ * The LightMapPacker places rectangles (the lightmaps of the faces in a BSP Map)
+ * into a set of pages of the same size, so that many lightmaps can share one
+ * texture. It only works out where each rectangle goes - it doesn't know
+ * anything about the pixels or about Direct3D, so it can be used on its own.
+ *
+ * Each page is packed with a "skyline": a list of horizontal segments that
+ * make up the lower edge of everything placed on the page so far (y goes down
+ * the page, like it does in a texture). A new rectangle is put just under the
+ * skyline wherever its lower edge ends up the highest, which fills each page
+ * from the top down without leaving many gaps.
+ * A new page is only started when a rectangle doesn't fit on any of the
+ * pages that already exist.
+ *
+ * Every rectangle is surrounded by a border of "padding" pixels, so that
+ * texture filtering never reads pixels from a neighbouring rectangle.
+ */
+class LightMapPacker {
+    public:
+
+        /**
+         * Constructor prepares a packer for pages that are pageWidth by
+         * pageHeight pixels, with padding pixels around each rectangle.
+         */
+        LightMapPacker( int pageWidth, int pageHeight, int padding );
+
+        /**
+         * insert() finds a place for a rectangle that is width by height pixels.
+         * The page that the rectangle was put on is returned in page, and the
+         * top-left corner of the rectangle (inside of its padding) is returned
+         * in x and y.
+         * Returns false if the rectangle is too big to fit on a page at all.
+         */
+        bool insert( int width, int height, int *page, int *x, int *y );
+
+        /**
+         * reset() removes all of the rectangles and pages
+         */
+        void reset();
+
+        /**
+         * Returns the number of pages that have been started
+         */
+        int getNumPages() {
+            return skylines.size();
+        };
+
+        /**
+         * Return the size of each of the pages
+         */
+        int getPageWidth() {
+            return pageWidth;
+        };
+        int getPageHeight() {
+            return pageHeight;
+        };
+
+        /**
+         * Returns the number of padding pixels around each rectangle
+         */
+        int getPadding() {
+            return padding;
+        };
+
+        /**
+         * Returns the number of pixels on page #page that are covered by
+         * rectangles, not counting their padding.
+         */
+        int getUsedArea( int page ) {
+            return usedArea[ page ];
+        };
+
+        /**
+         * Returns how full the pages are, from 0.0 to 1.0. This is the area
+         * covered by rectangles (not counting their padding) divided by the
+         * total area of all of the pages.
+         */
+        float getOccupancy();
+
+    private:
+
+        /**
+         * A SkylineNode is one segment of a page's skyline. It starts at x,
+         * goes for width pixels, and every pixel above row y is taken.
+         */
+        typedef struct {
+            int x, y, width;
+        } SkylineNode;
+
+        // Works out where a rectangle would go if it started at skyline node
+        //  #node of page #page. Returns false if it doesn't fit there.
+        bool fit( int page, int node, int width, int height, int *y );
+
+        // Finds the best place on page #page for a rectangle. Returns false
+        //  if it doesn't fit anywhere on the page.
+        bool findPosition( int page, int width, int height, int *node, int *x, int *y );
+
+        // Puts a rectangle on page #page at skyline node #node, and updates
+        //  the skyline to go over it
+        void place( int page, int node, int x, int y, int width, int height );
+
+        // Starts a new, empty page
+        void addPage();
+
+        // The size of each page, and the border around each rectangle
+        int pageWidth;
+        int pageHeight;
+        int padding;
+
+        // The skyline of each page
+        vector< vector< SkylineNode > > skylines;
+
+        // The area covered by rectangles on each page
+        vector< int > usedArea;
+};
+
+
+/**
+ * The results of testLightMapPacker()
+ */
+typedef struct {
+    // The number of pages that the rectangles were packed into, and how full
+    //  they are (see LightMapPacker::getOccupancy())
+    int numPages;
+    float occupancy;
+
+    // The number of rectangles that couldn't be placed, that went off of
+    //  their page, or that overlapped another rectangle or its padding. These
+    //  should always be 0.
+    int numFailed;
+    int numOutside;
+    int numOverlapping;
+} LightMapPackerTest;
+
+/**
+ * testLightMapPacker() packs "numRects" rectangles of random lightmap sizes
+ * (1 to 17 pixels on a side, made from "seed") into 256 by 256 pages with a
+ * 1 pixel border, then checks that every rectangle is on its page and that no
+ * two of them (with their borders) overlap. The results go into "result".
+ */
+void testLightMapPacker( int numRects, unsigned int seed, LightMapPackerTest *result );
+
+
+//---------------------------------------------------------------------------
+#endif
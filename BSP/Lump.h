@@ -3,13 +3,14 @@
 #ifndef LumpH
 #define LumpH
 
-#include <stdio.h>
-
 #include "BSPCommon.h"
+#include "BSPFile.h"
 
 /**
- * Holds the data for one BSP lump, and handles loading in the lump.
- * Lump data can be accessed through the use of the getData() method.
+ * Gives typed access to one BSP lump of an open BSPFile. The lump data isn't
+ * copied - the Lump is a bounds-checked view of the lump inside of the mapped
+ * file, so the BSPFile must stay open for as long as the Lump is used. The data
+ * is read-only. Lump data can be accessed through the use of the getData() method.
  *
  * NOTE THAT THIS LUMP CLASS DOES NOT WORK WITH THE ENTITY LUMP, OR ANY
  * OTHER LUMP WITH VARIABLE STORAGE SIZES.
@@ -18,34 +19,35 @@ template< class LumpType, int lumpNum >
 class Lump {
     public:
         Lump() {
-            // Empty constructor
+            data = NULL;
+            size = 0;
         };
 
         ~Lump() {
-            // Empty destructor - the data array automatically de-allocates its
-            //  memory when this object (Lump) is deleted
+            // Empty destructor - the data belongs to the BSPFile that the lump
+            //  was loaded from, so there is nothing to de-allocate
         };
 
         /**
-         * load(): loads in the lump specified by template parameter lumpNum
-         * unload(): Empties the data vector, freeing any memory allocated
-         *          when loading
+         * load(): points this lump at the lump specified by template parameter
+         *          lumpNum in the mapped file
+         * unload(): Forgets the lump's data, so that the BSPFile can be closed
          */
-        void load( BSP::Header *header, FILE *mapFile );
+        void load( BSPFile *mapFile );
         void unload();
 
         /**
-         * Returns the size of the vector of data
+         * Returns the number of elements in the lump
          */
         int getSize() {
-            return data.size();
+            return size;
         };
 
         /**
          * Returns a pointer to the element in the data at element index
          */
         LumpType *getData( unsigned int index ) {
-            if ( index < data.size() ) {
+            if ( index < ( unsigned int ) size ) {
                 return &data[ index ];
             } else {
                 return NULL;
@@ -54,8 +56,11 @@ class Lump {
 
     private:
 
-        // The data array
-        vector< LumpType > data;
+        // The first element of the lump, inside of the mapped file
+        LumpType *data;
+
+        // The number of elements in the lump
+        int size;
 
 };
 
@@ -64,27 +69,25 @@ class Lump {
  *     Lump type is template parameter "LumpType"
  *     Lump number is template parameter "lumpNum"
  *
- *     BSP map file to be read from is parameter mapFile
- *     BSP header is the bsp_header structure at the start of the BSP File
+ *     BSP map file to be read from is parameter mapFile. Its header has
+ *     already been checked, so the lump is known to lie inside of the file.
  */
 template< class LumpType, int lumpNum >
-void Lump< LumpType, lumpNum >::load( BSP::Header *header, FILE *mapFile ) {
-
-    // Resize the data array such that it will fit the lump it needs to load
-    data.resize( header->lump[ lumpNum ].length / sizeof( LumpType ) );
+void Lump< LumpType, lumpNum >::load( BSPFile *mapFile ) {
 
-    // Navigate to the lump in the BSP map
-    fseek( mapFile, header->lump[ lumpNum ].offset, 0 );
+    // Any bytes left over at the end of the lump don't make up a whole element
+    size = mapFile->getLumpLength( lumpNum ) / sizeof( LumpType );
 
-    // Read in the data in the BSP Map
-    fread( &data[ 0 ], sizeof( LumpType ), data.size(), mapFile );
+    // Point at the lump in the mapped file
+    data = ( LumpType * ) mapFile->getLump( lumpNum );
 };
 
 
 template< class LumpType, int lumpNum >
 void Lump< LumpType, lumpNum >::unload() {
-    // Shrink the data array to a size of zero
-    data.resize( 0 );
+    // Forget about the data in the mapped file
+    data = NULL;
+    size = 0;
 };
 
 
@@ -0,0 +1,266 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MapCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/**
+ * Constructor prepares the object so that a cache can be opened.
+ */
+MapCache::MapCache() {
+    // The VirtualFile prepares itself
+};
+
+/**
+ * Destructor makes sure that the cache file has been closed.
+ */
+MapCache::~MapCache() {
+    close();
+};
+
+
+/**
+ * Returns the name of the cache file of the .bsp file bspName
+ */
+std::string MapCache::getCacheName( std::string bspName ) {
+    // Swap the .bsp extension for .mapcache
+    if ( bspName.size() >= 4 && bspName.substr( bspName.size() - 4 ) == ".bsp" ) {
+        bspName = bspName.substr( 0, bspName.size() - 4 );
+    }
+
+    return bspName + ".mapcache";
+};
+
+
+/**
+ * open() maps the cache file fileName into memory and checks that it can
+ * be used with the .bsp file mapFile. Returns false if the file could
+ * not be found, or if it is out of date or damaged.
+ */
+bool MapCache::open( std::string fileName, BSPFile *mapFile ) {
+    close();
+
+    // Every section is copied out of the file from front to back
+    if ( !file.open( fileName ) ) {
+        return false;
+    }
+
+    if ( !validateHeader( mapFile ) ) {
+        close();
+        return false;
+    }
+
+    return true;
+};
+
+/**
+ * close() unmaps the cache file. Any pointers that were handed out by
+ * this object are no longer valid after close() is called.
+ */
+void MapCache::close() {
+    file.close();
+};
+
+
+/**
+ * Returns a pointer to the first byte of section #sectionNum, or NULL
+ * if no file is open. The data is read-only - it must never be written to.
+ */
+unsigned char *MapCache::getSection( int sectionNum ) {
+    if ( !file.isOpen() || sectionNum < 0 || sectionNum >= MAP_CACHE_NUM_SECTIONS ) {
+        return NULL;
+    }
+
+    return file.getData() + getHeader()->section[ sectionNum ].offset;
+};
+
+/**
+ * Returns the length (in bytes) of section #sectionNum
+ */
+int MapCache::getSectionLength( int sectionNum ) {
+    if ( !file.isOpen() || sectionNum < 0 || sectionNum >= MAP_CACHE_NUM_SECTIONS ) {
+        return 0;
+    }
+
+    return getHeader()->section[ sectionNum ].length;
+};
+
+/**
+ * Returns the number of itemSize byte items in section #sectionNum, or
+ * -1 if the section isn't a whole number of items long
+ */
+int MapCache::getNumItems( int sectionNum, int itemSize ) {
+    int length = getSectionLength( sectionNum );
+
+    if ( length % itemSize != 0 ) {
+        return -1;
+    }
+
+    return length / itemSize;
+};
+
+
+/**
+ * Checks the header to make sure that the cache belongs to mapFile, and
+ * that every section lies within the file.
+ */
+bool MapCache::validateHeader( BSPFile *mapFile ) {
+    unsigned int fileSize = file.getSize();
+
+    if ( fileSize < sizeof( MapCacheHeader ) ) {
+        return false;
+    }
+
+    MapCacheHeader *header = getHeader();
+
+    // Check the identifying number and the version of the cache
+    if ( header->magic != MAP_CACHE_MAGIC || header->version != MAP_CACHE_VERSION ) {
+        return false;
+    }
+
+    // Check that the cache was made from this version of the .bsp file
+    FILETIME bspTime = mapFile->getWriteTime();
+    if ( header->bspSize != mapFile->getFileSize() ||
+         header->bspTimeLow != bspTime.dwLowDateTime ||
+         header->bspTimeHigh != bspTime.dwHighDateTime ) {
+        return false;
+    }
+
+    // Check that each section starts and ends inside of the file, and is
+    // lined up so that its contents can be read straight out of the file.
+    for ( int i = 0; i < MAP_CACHE_NUM_SECTIONS; ++i ) {
+        int offset = header->section[ i ].offset;
+        int length = header->section[ i ].length;
+
+        if ( offset < 0 || length < 0 || offset % MAP_CACHE_ALIGNMENT != 0 ) {
+            return false;
+        }
+        if ( ( unsigned int ) offset > fileSize || ( unsigned int ) length > fileSize - offset ) {
+            return false;
+        }
+    }
+
+    return true;
+};
+
+
+// MAPCACHEWRITER METHODS
+
+
+/**
+ * Constructor prepares an empty cache with no sections.
+ */
+MapCacheWriter::MapCacheWriter() {
+    lightMapPageWidth = 0;
+    lightMapPageHeight = 0;
+    lightMapOccupancy = 0.0;
+};
+
+
+/**
+ * setSection() copies length bytes from data into section #sectionNum
+ */
+void MapCacheWriter::setSection( int sectionNum, const void *data, int length ) {
+    sections[ sectionNum ].resize( length );
+
+    if ( length > 0 ) {
+        memcpy( &sections[ sectionNum ][ 0 ], data, length );
+    }
+};
+
+/**
+ * setLightMapPages() records the size of the lightmap pages, and how full
+ * they are
+ */
+void MapCacheWriter::setLightMapPages( int width, int height, float occupancy ) {
+    lightMapPageWidth = width;
+    lightMapPageHeight = height;
+    lightMapOccupancy = occupancy;
+};
+
+
+/**
+ * write() writes the header and every section into the cache file
+ * fileName, stamped with the size and write time of mapFile.
+ * Returns false if the file could not be written.
+ */
+bool MapCacheWriter::write( std::string fileName, BSPFile *mapFile ) {
+    MapCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+
+    header.magic = MAP_CACHE_MAGIC;
+    header.version = MAP_CACHE_VERSION;
+
+    FILETIME bspTime = mapFile->getWriteTime();
+    header.bspSize = mapFile->getFileSize();
+    header.bspTimeLow = bspTime.dwLowDateTime;
+    header.bspTimeHigh = bspTime.dwHighDateTime;
+
+    header.vertexSize = sizeof( D3D::Vertex );
+    header.lightMapPageWidth = lightMapPageWidth;
+    header.lightMapPageHeight = lightMapPageHeight;
+    header.lightMapOccupancy = lightMapOccupancy;
+
+    // Work out where each section goes. The sections come one after the other
+    // after the header, each starting on a multiple of MAP_CACHE_ALIGNMENT.
+    int offset = sizeof( header );
+    for ( int i = 0; i < MAP_CACHE_NUM_SECTIONS; ++i ) {
+        offset = ( offset + MAP_CACHE_ALIGNMENT - 1 ) / MAP_CACHE_ALIGNMENT * MAP_CACHE_ALIGNMENT;
+
+        header.section[ i ].offset = offset;
+        header.section[ i ].length = sections[ i ].size();
+
+        offset += sections[ i ].size();
+    }
+
+    // The cache can't be written into a .pak file, so it goes into the game
+    //  directory
+    std::string path = FileSystem::getGameFiles()->getWritePath( fileName );
+    if ( path.empty() ) {
+        return false;
+    }
+
+    FILE *file = fopen( path.c_str(), "wb" );
+    if ( file == NULL ) {
+        return false;
+    }
+
+    bool written = fwrite( &header, sizeof( header ), 1, file ) == 1;
+
+    // Write each section, with zeros in front of it to line it up
+    const char zeros[ MAP_CACHE_ALIGNMENT ] = { 0 };
+    int position = sizeof( header );
+
+    for ( int i = 0; i < MAP_CACHE_NUM_SECTIONS && written; ++i ) {
+        int padding = header.section[ i ].offset - position;
+        if ( padding > 0 ) {
+            written = fwrite( zeros, padding, 1, file ) == 1;
+        }
+
+        if ( written && sections[ i ].size() > 0 ) {
+            written = fwrite( &sections[ i ][ 0 ], sections[ i ].size(), 1, file ) == 1;
+        }
+
+        position = header.section[ i ].offset + header.section[ i ].length;
+    }
+
+    if ( fclose( file ) != 0 ) {
+        written = false;
+    }
+
+    // Don't leave half of a cache behind
+    if ( !written ) {
+        FileSystem::getGameFiles()->removeFile( fileName );
+    } else {
+        FileSystem::getGameFiles()->addFile( fileName );
+    }
+
+    return written;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
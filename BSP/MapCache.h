@@ -0,0 +1,224 @@
+//---------------------------------------------------------------------------
+
+#ifndef MapCacheH
+#define MapCacheH
+
+#include <vector.h>
+#include <string>
+
+#include "BSPFile.h"
+#include "FileSystem.h"
+
+using namespace std;
+
+
+// The identifying number at the start of every map cache file ("Q2MC")
+#define MAP_CACHE_MAGIC ( ( 'C' << 24 ) + ( 'M' << 16 ) + ( '2' << 8 ) + 'Q' )
+
+// The version number of the map cache format. This must go up whenever the
+// layout of a section, or of anything stored in a section, changes.
+#define MAP_CACHE_VERSION 2
+
+// The sections of a map cache file
+#define MAP_CACHE_VERTICES          0   // D3D::Vertex for every vertex of every face
+#define MAP_CACHE_FACE_STARTS       1   // int: first index of each face, plus the end
+#define MAP_CACHE_FACE_PAGES        2   // int: lightmap page of each face
+#define MAP_CACHE_LIGHTMAP_PIXELS   3   // Pixel: every lightmap page, one after the other
+#define MAP_CACHE_NODES             4   // BSPTree::Node: the flattened BSP tree
+#define MAP_CACHE_CLUSTER_STARTS    5   // int: first entry of each cluster in the cluster
+                                        //  leaves, plus the end
+#define MAP_CACHE_CLUSTER_LEAVES    6   // int: leaf number of each leaf of each cluster
+#define MAP_CACHE_LEAF_FACE_STARTS  7   // int: first face of each cluster leaf, plus the end
+#define MAP_CACHE_LEAF_FACES        8   // BSP::LeafFace: the faces of each cluster leaf
+#define MAP_CACHE_INDICES           9   // unsigned int: the triangles of every face
+#define MAP_CACHE_FACE_VERTEX_STARTS 10 // int: first vertex of each face, plus the end
+
+// The number of sections in a map cache file
+#define MAP_CACHE_NUM_SECTIONS 11
+
+// Each section starts on a multiple of this many bytes
+#define MAP_CACHE_ALIGNMENT 16
+
+
+/**
+ * Where a section is in the map cache file, just like a BSP::Lump
+ */
+typedef struct {
+    int offset;
+    int length;
+} MapCacheSection;
+
+/**
+ * The header at the start of a map cache file. The size and write time of the
+ * .bsp file that the cache was made from are kept, so that a cache is never
+ * used with a different version of its map.
+ */
+typedef struct {
+    int magic;
+    int version;
+
+    // The .bsp file that the cache was made from
+    unsigned int bspSize;
+    unsigned int bspTimeLow;
+    unsigned int bspTimeHigh;
+
+    // The size of a vertex, and of a lightmap page, when the cache was made
+    int vertexSize;
+    int lightMapPageWidth;
+    int lightMapPageHeight;
+
+    // How full the lightmap pages are, from 0.0 to 1.0
+    float lightMapOccupancy;
+
+    MapCacheSection section[ MAP_CACHE_NUM_SECTIONS ];
+} MapCacheHeader;
+
+
+/**
+ * A map cache holds the parts of a BSP map that take a long time to build: the
+ * triangulated vertices of every face, the packed lightmap pages, the flattened
+ * BSP tree and the faces in each cluster. It is kept in a file beside the .bsp
+ * file ("maps/base1.bsp" has the cache "maps/base1.mapcache"). A map that comes
+ * out of a .pak file has its cache written into the game directory instead.
+ *
+ * The first time that a map is loaded, it is built from its .bsp file as usual,
+ * and then written out with a MapCacheWriter. After that, the MapCache maps the
+ * cache file into memory, and the map's objects copy their data straight out
+ * of it instead of building it again.
+ *
+ * The cache is only used if it has the right version, was made from the same
+ * .bsp file (the same size and write time), and every section lies inside of
+ * the file. Each object still checks that its own sections make sense before
+ * it uses them, and builds its data from the .bsp file if they don't.
+ */
+class MapCache {
+    public:
+
+        /**
+         * Constructor prepares the object so that a cache can be opened.
+         */
+        MapCache();
+
+        /**
+         * Destructor makes sure that the cache file has been closed.
+         */
+        ~MapCache();
+
+        /**
+         * Returns the name of the cache file of the .bsp file bspName
+         */
+        static std::string getCacheName( std::string bspName );
+
+        /**
+         * open() maps the cache file fileName into memory and checks that it can
+         * be used with the .bsp file mapFile. Returns false if the file could
+         * not be found, or if it is out of date or damaged.
+         */
+        bool open( std::string fileName, BSPFile *mapFile );
+
+        /**
+         * close() unmaps the cache file. Any pointers that were handed out by
+         * this object are no longer valid after close() is called.
+         */
+        void close();
+
+        /**
+         * Returns true if a cache file is currently open
+         */
+        bool isOpen() {
+            return file.isOpen();
+        };
+
+        /**
+         * Returns the size of the cache file in bytes
+         */
+        unsigned int getFileSize() {
+            return file.getSize();
+        };
+
+        /**
+         * touchPages() reads the whole cache file into the system file cache
+         */
+        void touchPages() {
+            file.touchPages();
+        };
+
+        /**
+         * Returns the header at the start of the cache file
+         */
+        MapCacheHeader *getHeader() {
+            return ( MapCacheHeader * ) file.getData();
+        };
+
+        /**
+         * Returns a pointer to the first byte of section #sectionNum, or NULL
+         * if no file is open. The data is read-only - it must never be written to.
+         */
+        unsigned char *getSection( int sectionNum );
+
+        /**
+         * Returns the length (in bytes) of section #sectionNum
+         */
+        int getSectionLength( int sectionNum );
+
+        /**
+         * Returns the number of itemSize byte items in section #sectionNum, or
+         * -1 if the section isn't a whole number of items long
+         */
+        int getNumItems( int sectionNum, int itemSize );
+
+    private:
+
+        // Checks the header to make sure that the cache belongs to mapFile, and
+        // that every section lies within the file.
+        bool validateHeader( BSPFile *mapFile );
+
+        // The mapped cache file
+        VirtualFile file;
+};
+
+
+/**
+ * The MapCacheWriter collects the sections of a map cache from the map's
+ * objects, and then writes them all out to a cache file.
+ */
+class MapCacheWriter {
+    public:
+
+        /**
+         * Constructor prepares an empty cache with no sections.
+         */
+        MapCacheWriter();
+
+        /**
+         * setSection() copies length bytes from data into section #sectionNum
+         */
+        void setSection( int sectionNum, const void *data, int length );
+
+        /**
+         * setLightMapPages() records the size of the lightmap pages, and how full
+         * they are
+         */
+        void setLightMapPages( int width, int height, float occupancy );
+
+        /**
+         * write() writes the header and every section into the cache file
+         * fileName, stamped with the size and write time of mapFile.
+         * Returns false if the file could not be written.
+         */
+        bool write( std::string fileName, BSPFile *mapFile );
+
+    private:
+
+        // The contents of each section
+        vector< unsigned char > sections[ MAP_CACHE_NUM_SECTIONS ];
+
+        // The lightmap information for the header
+        int lightMapPageWidth;
+        int lightMapPageHeight;
+        float lightMapOccupancy;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,360 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MapPrefetcher.h"
+#include "BSPMap.h"
+#include "UI.h"
+
+#include <stdio.h>
+
+
+// Read ahead up to 64 megabytes unless the user asks for something else
+int MapPrefetcher::budgetMegabytes = 64;
+
+
+/**
+ * Constructor prepares the prefetcher, without reading anything ahead
+ */
+MapPrefetcher::MapPrefetcher() {
+    running = false;
+    usedBytes = 0;
+    console = NULL;
+};
+
+/**
+ * Destructor cancels anything that is being read ahead
+ */
+MapPrefetcher::~MapPrefetcher() {
+    cancel();
+};
+
+
+/**
+ * start() starts reading ahead the maps that are likely to come after
+ * "map", which was loaded from the map called "mapName". Anything that
+ * was being read ahead is cancelled first. Nothing is read ahead if
+ * the budget is 0.
+ */
+void MapPrefetcher::start( string mapName, BSPMap *map, Console *console ) {
+    cancel();
+
+    this->console = console;
+    usedBytes = 0;
+
+    if ( budgetMegabytes <= 0 || map == NULL ) {
+        return;
+    }
+
+    // The maps that the changelevels lead to are the most likely to come
+    //  next, then the next map in the campaign
+    vector< string > names;
+    map->getChangeLevelMaps( &names );
+
+    for ( int i = 0; i + 1 < NUM_MAPS; ++i ) {
+        if ( mapName == BSPMap::ORDERED_MAP_NAMES[ i ] ) {
+            bool found = false;
+            for ( unsigned int e = 0; e < names.size() && !found; ++e ) {
+                found = names[ e ] == BSPMap::ORDERED_MAP_NAMES[ i + 1 ];
+            }
+
+            if ( !found ) {
+                names.push_back( string( BSPMap::ORDERED_MAP_NAMES[ i + 1 ] ) );
+            }
+            break;
+        }
+    }
+
+    for ( unsigned int i = 0; i < names.size() && ( int ) maps.size() < MAX_MAPS; ++i ) {
+        if ( names[ i ] == mapName ) {
+            continue;
+        }
+
+        PrefetchMap *prefetchMap = new PrefetchMap();
+        prefetchMap->prefetcher = this;
+        prefetchMap->name = names[ i ];
+        prefetchMap->texInfo = NULL;
+        prefetchMap->firstPending = 0;
+        prefetchMap->endPending = 0;
+        prefetchMap->nextImage = 0;
+        prefetchMap->numImages = 0;
+        prefetchMap->skipped = false;
+        prefetchMap->imagesSkipped = false;
+        prefetchMap->cached = false;
+        prefetchMap->cacheBuilt = false;
+
+        maps.push_back( prefetchMap );
+    }
+
+    if ( maps.empty() ) {
+        return;
+    }
+
+    // One core is left for drawing the current map
+    int numThreads = TaskGraph::getNumProcessors() - 1;
+    if ( numThreads < 1 ) {
+        numThreads = 1;
+    }
+
+    // The maps are read ahead one after the other, so that the most likely
+    //  maps get the budget first, and so that only one map uses the texture
+    //  cache at a time. A map's cache is built while the next map is read in.
+    graph.clear();
+    vector< int > lastReadTasks;
+
+    for ( unsigned int i = 0; i < maps.size(); ++i ) {
+        int warmTask = graph.addTask( "Read files", warmFilesTask, maps[ i ], false );
+        for ( unsigned int e = 0; e < lastReadTasks.size(); ++e ) {
+            graph.addDependency( warmTask, lastReadTasks[ e ] );
+        }
+
+        int acquireTask = graph.addTask( "Texture names", acquireTexturesTask, maps[ i ], false );
+        graph.addDependency( acquireTask, warmTask );
+
+        int buildTask = graph.addTask( "Build map cache", buildCacheTask, maps[ i ], false );
+
+        lastReadTasks.resize( 0 );
+        for ( int e = 0; e < numThreads; ++e ) {
+            int readTask = graph.addTask( "Read textures", readTexturesTask, maps[ i ], false );
+            graph.addDependency( readTask, acquireTask );
+
+            lastReadTasks.push_back( readTask );
+        }
+
+        for ( unsigned int e = 0; e < lastReadTasks.size(); ++e ) {
+            graph.addDependency( buildTask, lastReadTasks[ e ] );
+        }
+    }
+
+    graph.start( numThreads );
+    running = true;
+
+    string message = "Reading ahead:";
+    for ( unsigned int i = 0; i < maps.size(); ++i ) {
+        message += " " + maps[ i ]->name;
+    }
+    console->printMessage( message, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+};
+
+
+/**
+ * update() is called once a frame. Once every map has been read ahead,
+ * the maps' images are given back to the texture cache (which keeps
+ * them until a map is loaded), and the user is told what was done.
+ */
+void MapPrefetcher::update() {
+
+    // None of the tasks are render tasks, so this only checks whether they
+    //  have all finished
+    if ( !running || !graph.runRenderTasks( 0 ) ) {
+        return;
+    }
+
+    running = false;
+
+    char buf[ 256 ];
+    for ( unsigned int i = 0; i < maps.size(); ++i ) {
+        PrefetchMap *prefetchMap = maps[ i ];
+
+        if ( prefetchMap->skipped ) {
+            sprintf( buf, "  %s: left out, the budget was used up", prefetchMap->name.c_str() );
+        } else {
+            sprintf( buf, "  %s: %d images read in, map cache %s", prefetchMap->name.c_str(), prefetchMap->numImages,
+                     prefetchMap->cached ? "was up to date" :
+                     prefetchMap->cacheBuilt ? "built" : "not built" );
+        }
+        console->printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+    }
+
+    sprintf( buf, "Read ahead %d maps in %u ms, using %.1f of %d MB", maps.size(), graph.getTotalMillis(),
+             usedBytes / ( 1024.0 * 1024.0 ), budgetMegabytes );
+    console->printMessage( buf, D3DXCOLOR( 0.0, 1.0, 0.0, 1.0 ) );
+
+    releaseMaps();
+};
+
+
+/**
+ * cancel() stops reading maps ahead, and returns once the workers have
+ * stopped. What has already been read in is kept.
+ */
+void MapPrefetcher::cancel() {
+    if ( running ) {
+        graph.cancel();
+        running = false;
+    }
+
+    releaseMaps();
+};
+
+
+/**
+ * Reads the map's .bsp file and its map cache into the system file cache
+ */
+void MapPrefetcher::warmFilesTask( void *prefetchMap ) {
+    PrefetchMap *map = ( PrefetchMap * ) prefetchMap;
+    MapPrefetcher *prefetcher = map->prefetcher;
+
+    string fileName = string( "maps/" ) + map->name + string( ".bsp" );
+
+    if ( prefetcher->graph.isCancelled() || prefetcher->isOverBudget() || !map->mapFile.open( fileName ) ) {
+        map->skipped = true;
+        return;
+    }
+
+    map->mapFile.touchPages();
+    prefetcher->addBytes( map->mapFile.getFileSize() );
+
+    MapCache cache;
+    if ( cache.open( MapCache::getCacheName( fileName ), &map->mapFile ) ) {
+        cache.touchPages();
+        prefetcher->addBytes( cache.getFileSize() );
+
+        map->cached = true;
+    }
+};
+
+/**
+ * Acquires the map's textures from the texture cache. Its new images are
+ * left pending for the read tasks.
+ */
+void MapPrefetcher::acquireTexturesTask( void *prefetchMap ) {
+    PrefetchMap *map = ( PrefetchMap * ) prefetchMap;
+    TextureCache *cache = BSPMap::getTextureCache();
+
+    if ( map->skipped ) {
+        return;
+    }
+
+    map->texInfo = new TextureInfo();
+
+    map->firstPending = cache->getNumPending();
+    map->texInfo->acquire( &map->mapFile, cache );
+    map->endPending = cache->getNumPending();
+};
+
+/**
+ * Reads in the map's new images, one at a time, until there are none left
+ * or the budget has been used up. Every read task runs this at the same time.
+ */
+void MapPrefetcher::readTexturesTask( void *prefetchMap ) {
+    PrefetchMap *map = ( PrefetchMap * ) prefetchMap;
+    MapPrefetcher *prefetcher = map->prefetcher;
+    TextureCache *cache = BSPMap::getTextureCache();
+
+    if ( map->skipped ) {
+        return;
+    }
+
+    while ( !prefetcher->graph.isCancelled() ) {
+        int pendingNum = map->firstPending + InterlockedIncrement( &map->nextImage ) - 1;
+        if ( pendingNum >= map->endPending ) {
+            break;
+        }
+
+        if ( prefetcher->isOverBudget() ) {
+            map->imagesSkipped = true;
+            break;
+        }
+
+        cache->readPending( pendingNum );
+
+        WALImage *image = cache->getPendingImage( pendingNum );
+        prefetcher->addBytes( image->getWidth() * image->getHeight() * 4 );
+        InterlockedIncrement( &map->numImages );
+    }
+};
+
+/**
+ * Builds the map's faces, lightmap pages and BSP tree, and writes them to
+ * its map cache, if it didn't already have an up to date one. The faces need
+ * the sizes of every image, so the cache isn't built if some of them weren't
+ * read in.
+ */
+void MapPrefetcher::buildCacheTask( void *prefetchMap ) {
+    PrefetchMap *map = ( PrefetchMap * ) prefetchMap;
+
+    if ( map->skipped || map->cached || map->imagesSkipped || map->prefetcher->graph.isCancelled() ) {
+        return;
+    }
+
+    LightMapInfo lightMaps;
+    FaceInfo faceInfo;
+    BSPTree::Tree bspTree;
+
+    lightMaps.load( &map->mapFile );
+    faceInfo.loadFaces( &map->mapFile, map->texInfo, &lightMaps, NULL );
+    bspTree.load( &map->mapFile, NULL );
+
+    MapCacheWriter writer;
+    faceInfo.saveCache( &writer );
+    lightMaps.saveCache( &writer );
+    bspTree.saveCache( &writer );
+
+    string fileName = string( "maps/" ) + map->name + string( ".bsp" );
+    map->cacheBuilt = writer.write( MapCache::getCacheName( fileName ), &map->mapFile );
+};
+
+
+/**
+ * Returns the budget in bytes. A budget of 2 gigabytes or more can't be
+ * counted in a LONG, so it is as many bytes as a LONG can count.
+ */
+static LONG getBudgetBytes() {
+    if ( MapPrefetcher::budgetMegabytes <= 0 ) {
+        return 0;
+    }
+    if ( MapPrefetcher::budgetMegabytes >= 2048 ) {
+        return 0x7FFFFFFF;
+    }
+
+    return MapPrefetcher::budgetMegabytes * 1024 * 1024;
+};
+
+/**
+ * Returns true if the budget has been used up
+ */
+bool MapPrefetcher::isOverBudget() {
+    return usedBytes >= getBudgetBytes();
+};
+
+/**
+ * Counts "bytes" more towards the budget, up to the whole budget
+ */
+void MapPrefetcher::addBytes( unsigned int bytes ) {
+    LONG budget = getBudgetBytes();
+    LONG used, counted;
+
+    // The bytes are compared with what is left of the budget, instead of
+    //  being added to the total first, so that a very large file can't wrap
+    //  the total around. Other read tasks can count at the same time, so the
+    //  total is only changed if nothing else changed it in between.
+    do {
+        used = usedBytes;
+        if ( used >= budget ) {
+            return;
+        }
+
+        counted = ( bytes > ( unsigned long ) ( budget - used ) ) ? budget : used + ( LONG ) bytes;
+    } while ( InterlockedCompareExchange( &usedBytes, counted, used ) != used );
+};
+
+
+/**
+ * Gives back the maps' textures and closes their files. The images stay in
+ * the texture cache until the next map is loaded.
+ */
+void MapPrefetcher::releaseMaps() {
+    for ( unsigned int i = 0; i < maps.size(); ++i ) {
+        if ( maps[ i ]->texInfo != NULL ) {
+            delete maps[ i ]->texInfo;
+        }
+
+        delete maps[ i ];
+    }
+
+    maps.resize( 0 );
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------
+
+#ifndef MapPrefetcherH
+#define MapPrefetcherH
+
+#include <vector.h>
+#include <string>
+
+#include "BSPFile.h"
+#include "TextureCache.h"
+#include "TextureInfo.h"
+#include "TaskGraph.h"
+
+using namespace std;
+
+class BSPMap;
+class Console;
+
+
+/**
+ * An explanation on prefetching:
+ *      Most of the time that it takes to load a map goes into reading the .bsp
+ *  file and the WAL images off of the disk, decoding the images, and building
+ *  the faces, lightmap pages and BSP tree that go into the map cache. None of
+ *  that needs Direct3D, so it can be done before the map is chosen.
+ *
+ *      While the player is in a map, the MapPrefetcher guesses which maps come
+ *  next: the maps that the map's target_changelevel entities lead to, and then
+ *  the next map in BSPMap::ORDERED_MAP_NAMES. For each of them, in that order,
+ *  it uses worker threads to
+ *   - read the .bsp file, and its map cache, into the system file cache,
+ *   - read in and decode the map's WAL images into the shared texture cache,
+ *   - build the map's cache file, if it doesn't have an up to date one.
+ *  When one of those maps is loaded, it comes out of its map cache, and its
+ *  images are already in the texture cache, so mostly the Direct3D part of
+ *  loading is left.
+ *
+ *      The files and the decoded images count towards a memory budget. Once
+ *  the budget has been used up, the rest is left for the map to load itself.
+ *
+ *      The texture cache can only be used by one thing at a time, so the
+ *  prefetcher must be cancelled before a map is loaded, and the maps that are
+ *  being read ahead take turns with it.
+ */
+class MapPrefetcher {
+    public:
+
+        /**
+         * Constructor prepares the prefetcher, without reading anything ahead
+         */
+        MapPrefetcher();
+
+        /**
+         * Destructor cancels anything that is being read ahead
+         */
+        ~MapPrefetcher();
+
+        /**
+         * start() starts reading ahead the maps that are likely to come after
+         * "map", which was loaded from the map called "mapName". Anything that
+         * was being read ahead is cancelled first. Nothing is read ahead if
+         * the budget is 0.
+         */
+        void start( string mapName, BSPMap *map, Console *console );
+
+        /**
+         * update() is called once a frame. Once every map has been read ahead,
+         * the maps' images are given back to the texture cache (which keeps
+         * them until a map is loaded), and the user is told what was done.
+         */
+        void update();
+
+        /**
+         * cancel() stops reading maps ahead, and returns once the workers have
+         * stopped. What has already been read in is kept.
+         */
+        void cancel();
+
+        /**
+         * Returns true if maps are being read ahead
+         */
+        bool isRunning() {
+            return running;
+        };
+
+        // The most memory that the files and images that are read ahead can
+        //  use, in megabytes. It is kept from one map to the next.
+        static int budgetMegabytes;
+
+        // The most maps that are read ahead at a time
+        static const int MAX_MAPS = 4;
+
+    private:
+
+        /**
+         * A map that is being read ahead, and what has been done with it
+         */
+        typedef struct {
+            MapPrefetcher *prefetcher;
+            string name;
+
+            // The mapped .bsp file, and the map's textures while they are
+            //  being read in
+            BSPFile mapFile;
+            TextureInfo *texInfo;
+
+            // The map's new images are pending images #firstPending up to
+            //  #endPending in the texture cache. nextImage is the next one
+            //  for the read tasks to read.
+            int firstPending;
+            int endPending;
+            volatile LONG nextImage;
+            volatile LONG numImages;
+
+            // Whether the map was left out because the budget had been used
+            //  up, whether some of its images were, and whether it already had
+            //  an up to date map cache, or one was built for it
+            bool skipped;
+            bool imagesSkipped;
+            bool cached;
+            bool cacheBuilt;
+        } PrefetchMap;
+
+        // The tasks that read a map ahead (see start())
+        static void warmFilesTask( void *prefetchMap );
+        static void acquireTexturesTask( void *prefetchMap );
+        static void readTexturesTask( void *prefetchMap );
+        static void buildCacheTask( void *prefetchMap );
+
+        // Returns true if the budget has been used up
+        bool isOverBudget();
+
+        // Counts "bytes" more towards the budget, up to the whole budget
+        void addBytes( unsigned int bytes );
+
+        // Gives back the maps' textures and closes their files
+        void releaseMaps();
+
+        // The maps that are being read ahead
+        vector< PrefetchMap * > maps;
+
+        // The tasks that read the maps ahead
+        TaskGraph graph;
+        bool running;
+
+        // The number of bytes of the budget that have been used
+        volatile LONG usedBytes;
+
+        // The console that the prefetcher reports to
+        Console *console;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,120 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MappedFile.h"
+
+#include <string.h>
+
+
+/**
+ * Constructor prepares the object so that a file can be opened.
+ */
+MappedFile::MappedFile() {
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+    view = NULL;
+    fileSize = 0;
+
+    memset( &writeTime, 0, sizeof( writeTime ) );
+};
+
+/**
+ * Destructor makes sure that the file has been unmapped and closed.
+ */
+MappedFile::~MappedFile() {
+    close();
+};
+
+
+/**
+ * open() maps the file fileName into memory. If sequential is true, then
+ * Windows is told that the file will be read from front to back, so it
+ * reads ahead. Returns false if the file could not be found or mapped,
+ * or if it is empty.
+ */
+bool MappedFile::open( std::string fileName, bool sequential ) {
+
+    // Only one file can be mapped at a time
+    close();
+
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if ( sequential ) {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+
+    file = CreateFile( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, flags, NULL );
+    if ( file == INVALID_HANDLE_VALUE ) {
+        return false;
+    }
+
+    // An empty file can't be mapped
+    fileSize = GetFileSize( file, NULL );
+    if ( fileSize == INVALID_FILE_SIZE || fileSize == 0 ) {
+        close();
+        return false;
+    }
+
+    if ( !GetFileTime( file, NULL, NULL, &writeTime ) ) {
+        memset( &writeTime, 0, sizeof( writeTime ) );
+    }
+
+    // Map the entire file into memory, read-only
+    mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( mapping == NULL ) {
+        close();
+        return false;
+    }
+
+    view = ( unsigned char * ) MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    if ( view == NULL ) {
+        close();
+        return false;
+    }
+
+    return true;
+};
+
+/**
+ * close() unmaps the file. Any pointers into the file are no longer
+ * valid after close() is called.
+ */
+void MappedFile::close() {
+    if ( view != NULL ) {
+        UnmapViewOfFile( view );
+        view = NULL;
+    }
+
+    if ( mapping != NULL ) {
+        CloseHandle( mapping );
+        mapping = NULL;
+    }
+
+    if ( file != INVALID_HANDLE_VALUE ) {
+        CloseHandle( file );
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    fileSize = 0;
+    memset( &writeTime, 0, sizeof( writeTime ) );
+};
+
+/**
+ * touchPages() reads one byte from every page of the file, so that
+ * Windows reads the whole file into the system file cache. Opening
+ * the file again after that doesn't have to wait for the disk.
+ */
+void MappedFile::touchPages() {
+    const unsigned int PAGE_SIZE = 4096;
+
+    // The sum is kept in a volatile, so that the reads can't be left out
+    volatile unsigned char sum = 0;
+
+    for ( unsigned int offset = 0; offset < fileSize && view != NULL; offset += PAGE_SIZE ) {
+        sum += view[ offset ];
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
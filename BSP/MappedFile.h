@@ -0,0 +1,96 @@
+//---------------------------------------------------------------------------
+
+#ifndef MappedFileH
+#define MappedFileH
+
+#include <windows.h>
+#include <string>
+
+
+/**
+ * The MappedFile class maps an entire file into memory, read-only, so that the
+ * file can be used straight out of the system file cache without copying it.
+ * It is what the BSPFile and MapCache classes use to open their files.
+ *
+ * The MappedFile has to stay open for as long as anything is using its data.
+ */
+class MappedFile {
+    public:
+
+        /**
+         * Constructor prepares the object so that a file can be opened.
+         */
+        MappedFile();
+
+        /**
+         * Destructor makes sure that the file has been unmapped and closed.
+         */
+        ~MappedFile();
+
+        /**
+         * open() maps the file fileName into memory. If sequential is true, then
+         * Windows is told that the file will be read from front to back, so it
+         * reads ahead. Returns false if the file could not be found or mapped,
+         * or if it is empty.
+         */
+        bool open( std::string fileName, bool sequential );
+
+        /**
+         * close() unmaps the file. Any pointers into the file are no longer
+         * valid after close() is called.
+         */
+        void close();
+
+        /**
+         * Returns true if a file is currently mapped
+         */
+        bool isOpen() {
+            return view != NULL;
+        };
+
+        /**
+         * Returns the first byte of the mapped file, or NULL if no file is open.
+         * The data is read-only - it must never be written to.
+         */
+        unsigned char *getData() {
+            return view;
+        };
+
+        /**
+         * Returns the size of the file in bytes
+         */
+        unsigned int getSize() {
+            return fileSize;
+        };
+
+        /**
+         * Returns the time that the file was last written to
+         */
+        FILETIME getWriteTime() {
+            return writeTime;
+        };
+
+        /**
+         * touchPages() reads one byte from every page of the file, so that
+         * Windows reads the whole file into the system file cache. Opening
+         * the file again after that doesn't have to wait for the disk.
+         */
+        void touchPages();
+
+    private:
+
+        // The handles to the open file and the file mapping
+        HANDLE file;
+        HANDLE mapping;
+
+        // The mapped view of the entire file
+        unsigned char *view;
+
+        // The size of the file in bytes, and when it was last written to
+        unsigned int fileSize;
+        FILETIME writeTime;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -8,7 +8,7 @@ const float SKYBOX_SIZE = 5000.0 * BSP::MAP_SCALE;
 
 
 /**
- * load() loads in the skybox from the Directory "Q2/env/", and creates
+ * load() loads in the skybox from the Directory "env/", and creates
  * the skybox vertex buffer. After this method is called, the skybox can
  * be rendered to the screen.
  */
@@ -82,25 +82,25 @@ void SkyBox::load( LPDIRECT3DDEVICE9 device, string baseName ) {
  * show() renders the Skybox around the Camera, adding scenery to the outside
  * part of the BSP Map
  */
-void SkyBox::show( LPDIRECT3DDEVICE9 device ) {
+void SkyBox::show( RenderDevice *device ) {
 
     // Disable lighting
-    device->SetRenderState( D3DRS_LIGHTING, FALSE );
+    device->setRenderState( D3DRS_LIGHTING, FALSE );
 
     // setup rendering the skybox
-    device->SetFVF( SKYBOX_FVF );
-    device->SetStreamSource( 0, vBuffer, 0, sizeof( SkyBoxVertex ) );
+    device->setFVF( SKYBOX_FVF );
+    device->setStreamSource( 0, vBuffer, 0, sizeof( SkyBoxVertex ) );
 
-    device->SetSamplerState( 0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP );
-    device->SetSamplerState( 0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP );
+    device->setSamplerState( 0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP );
+    device->setSamplerState( 0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP );
 
 
     // Go through each face of the skybox and render it
     for ( unsigned int c = 0; c < 6; ++c ) {
-        device->SetTexture( 0, sides[ c ].getTexture() );        device->DrawPrimitive( D3DPT_TRIANGLESTRIP,                               c * 4, 2 );    }
+        device->setTexture( 0, sides[ c ].getTexture() );        device->drawPrimitive( D3DPT_TRIANGLESTRIP,                               c * 4, 2 );    }
     // Setup normal rendering
-    device->SetSamplerState( 0, D3DSAMP_ADDRESSU, D3DTADDRESS_WRAP );
-    device->SetSamplerState( 0, D3DSAMP_ADDRESSV, D3DTADDRESS_WRAP );
+    device->setSamplerState( 0, D3DSAMP_ADDRESSU, D3DTADDRESS_WRAP );
+    device->setSamplerState( 0, D3DSAMP_ADDRESSV, D3DTADDRESS_WRAP );
 };
 
 
@@ -5,6 +5,7 @@
 
 #include "Texture.h"
 #include "BSPCommon.h"
+#include "RenderDevice.h"
 #include <DirectX/d3d9.h>
 #include <iostream.h>
 
@@ -31,6 +32,14 @@ typedef struct {
  */
 class SkyBox {
     public:
+        /**
+         * Constructor makes sure that a skybox that was never loaded isn't
+         * released
+         */
+        SkyBox() {
+            vBuffer = NULL;
+        };
+
         /**
          * Destructor makes sure the textures and vertex buffer have been de-allocated.
          */
@@ -39,7 +48,7 @@ class SkyBox {
         };
 
         /**
-         * load() loads in the skybox from the Directory "Q2/env/", and creates
+         * load() loads in the skybox from the Directory "env/", and creates
          * the skybox vertex buffer. After this method is called, the skybox can
          * be rendered to the screen.
          */
@@ -54,7 +63,7 @@ class SkyBox {
          * show() renders the Skybox around the Camera, adding scenery to the outside
          * part of the BSP Map
          */
-        void show( LPDIRECT3DDEVICE9 device );
+        void show( RenderDevice *device );
 
     private:
 
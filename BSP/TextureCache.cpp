@@ -0,0 +1,297 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "TextureCache.h"
+
+#include <string.h>
+
+
+/**
+ * Constructor prepares an empty cache
+ */
+TextureCache::TextureCache() {
+    palette = NULL;
+    numImages = 0;
+
+    resetCounts();
+};
+
+/**
+ * Destructor deletes every image in the cache
+ */
+TextureCache::~TextureCache() {
+    unload();
+};
+
+
+/**
+ * acquire() adds a reference to the image called "name", and returns its
+ * entry number. If the image isn't in the cache, then it is loaded in
+ * from "textures/" and sent to the Direct3D device first.
+ * The entry number stays the same until the image is purged.
+ */
+int TextureCache::acquire( char *name, LPDIRECT3DDEVICE9 device ) {
+    int entryNum = acquire( name );
+
+    // Load the image in straight away, if it is new
+    for ( int i = 0; i < getNumPending(); ++i ) {
+        readPending( i );
+    }
+    createPendingTextures( device );
+
+    return entryNum;
+};
+
+
+/**
+ * acquire() without a device adds a reference to the image called
+ * "name" in the same way, but an image that isn't in the cache is only
+ * added as a pending image. It isn't read in until readPending() is
+ * called for it.
+ */
+int TextureCache::acquire( char *name ) {
+    unsigned int hash = hashName( name );
+
+    // If the image was already loaded, then just add a reference to it
+    int entryNum = find( name, hash );
+    if ( entryNum >= 0 ) {
+        entries[ entryNum ].refCount++;
+        numReused++;
+        return entryNum;
+    }
+
+    // load in the Quake 2 colour palette
+    // WAL textures do not contain definitive colours in RGB format.
+    // Instead, they contain indices into this colour palette, which in turn
+    // has the colours in RGB format.
+    if ( palette == NULL ) {
+        LoadFilePCX( "pics/colormap.pcx", &palette, NULL, NULL, false );
+    }
+
+    // Make an entry for the WAL image, to be read in later. Even if it can't
+    // be loaded, it is kept in the cache, so that the file isn't looked for again.
+    WALImage *image = new WALImage();
+    numLoaded++;
+
+    // Use an entry that was freed by purgeUnused() if there is one
+    if ( freeEntries.size() > 0 ) {
+        entryNum = freeEntries.back();
+        freeEntries.pop_back();
+    } else {
+        entryNum = entries.size();
+        entries.push_back();
+
+        // Make sure the hash table stays at most half full
+        if ( entries.size() * 2 > table.size() ) {
+            entries[ entryNum ].image = NULL;
+            rebuildTable();
+        }
+    }
+
+    entries[ entryNum ].image = image;
+    strncpy( entries[ entryNum ].name, name, WAL_IMAGE_NAME_SIZE );
+    entries[ entryNum ].hash = hash;
+    entries[ entryNum ].refCount = 1;
+    numImages++;
+
+    addToTable( entryNum );
+    pending.push_back( entryNum );
+
+    return entryNum;
+};
+
+
+/**
+ * readPending() reads in pending image #pendingNum, if it hasn't been
+ * read in already. Different pending images can be read on different
+ * threads at the same time, as long as nothing else is done with the
+ * cache until they have been read. An image without a reference isn't
+ * read, since nothing is going to use it.
+ */
+void TextureCache::readPending( int pendingNum ) {
+    CacheEntry &entry = entries[ pending[ pendingNum ] ];
+
+    // Reading ahead can be cancelled (or run out of budget) before it gets
+    //  to an image, which is then left pending without a reference. The map
+    //  that is being loaded doesn't use it, so it is left for purgeUnused().
+    if ( entry.refCount == 0 ) {
+        return;
+    }
+
+    // The image may have been read in ahead of time, while it wasn't used
+    if ( entry.image->getData() != NULL ) {
+        return;
+    }
+
+    // Row 319 of the colour palette holds the colours of the WAL images
+    entry.image->read( entry.name, palette, 319 );
+};
+
+
+/**
+ * createPendingTextures() sends every pending image that has a reference
+ * to the Direct3D device, once they have all been read in. They are then
+ * no longer pending. Images without a reference were only read in ahead of
+ * time, so they stay pending until a map uses them or they are purged.
+ */
+void TextureCache::createPendingTextures( LPDIRECT3DDEVICE9 device ) {
+    unsigned int numLeft = 0;
+
+    for ( unsigned int i = 0; i < pending.size(); ++i ) {
+        if ( entries[ pending[ i ] ].refCount > 0 ) {
+            entries[ pending[ i ] ].image->createTexture( device );
+        } else {
+            pending[ numLeft++ ] = pending[ i ];
+        }
+    }
+
+    pending.resize( numLeft );
+};
+
+
+/**
+ * release() takes away a reference to the image at entry #entryNum. The
+ * image stays in the cache until purgeUnused() is called.
+ */
+void TextureCache::release( int entryNum ) {
+    if ( entries[ entryNum ].refCount > 0 ) {
+        entries[ entryNum ].refCount--;
+    }
+};
+
+
+/**
+ * purgeUnused() deletes every image that doesn't have any references
+ */
+void TextureCache::purgeUnused() {
+    bool purged = false;
+
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        if ( entries[ i ].image != NULL && entries[ i ].refCount == 0 ) {
+            delete entries[ i ].image;
+            entries[ i ].image = NULL;
+
+            freeEntries.push_back( i );
+            numImages--;
+            purged = true;
+        }
+    }
+
+    // The purged images have to be taken out of the hash table, and out of
+    //  the pending images
+    if ( purged ) {
+        rebuildTable();
+
+        unsigned int numLeft = 0;
+        for ( unsigned int i = 0; i < pending.size(); ++i ) {
+            if ( entries[ pending[ i ] ].image != NULL ) {
+                pending[ numLeft++ ] = pending[ i ];
+            }
+        }
+        pending.resize( numLeft );
+    }
+};
+
+
+/**
+ * unload() deletes every image in the cache, whether or not it is still
+ * being used, and the colour palette.
+ */
+void TextureCache::unload() {
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        delete entries[ i ].image;
+    }
+
+    entries.resize( 0 );
+    freeEntries.resize( 0 );
+    pending.resize( 0 );
+    table.resize( 0 );
+    numImages = 0;
+
+    delete[] palette;
+    palette = NULL;
+};
+
+
+/**
+ * Returns the hash of an image name, using the FNV-1a hash. The name ends
+ * at its first null character, or after WAL_IMAGE_NAME_SIZE characters.
+ */
+unsigned int TextureCache::hashName( char *name ) {
+    unsigned int hash = 2166136261u;
+
+    for ( int i = 0; i < WAL_IMAGE_NAME_SIZE && name[ i ] != '\0'; ++i ) {
+        hash ^= ( unsigned char ) name[ i ];
+        hash *= 16777619u;
+    }
+
+    return hash;
+};
+
+
+/**
+ * Returns the entry number of the image called "name", or -1 if the
+ * image isn't in the cache
+ */
+int TextureCache::find( char *name, unsigned int hash ) {
+    if ( table.size() == 0 ) {
+        return -1;
+    }
+
+    unsigned int mask = table.size() - 1;
+
+    // Go through the slots starting at the name's hash, until an empty slot is found
+    for ( unsigned int slot = hash & mask; table[ slot ] >= 0; slot = ( slot + 1 ) & mask ) {
+        CacheEntry &entry = entries[ table[ slot ] ];
+
+        // Only compare the names if their hashes are the same
+        if ( entry.hash == hash &&
+             strncmp( entry.name, name, WAL_IMAGE_NAME_SIZE ) == 0 ) {
+            return table[ slot ];
+        }
+    }
+
+    return -1;
+};
+
+
+/**
+ * Puts entry #entryNum into the first empty slot after its hash
+ */
+void TextureCache::addToTable( int entryNum ) {
+    unsigned int mask = table.size() - 1;
+    unsigned int slot = entries[ entryNum ].hash & mask;
+
+    while ( table[ slot ] >= 0 ) {
+        slot = ( slot + 1 ) & mask;
+    }
+
+    table[ slot ] = entryNum;
+};
+
+
+/**
+ * Makes a new hash table that is big enough for every entry, and puts
+ * every entry with an image into it
+ */
+void TextureCache::rebuildTable() {
+    unsigned int size = 16;
+    while ( size < entries.size() * 2 ) {
+        size *= 2;
+    }
+
+    table.resize( size );
+    for ( unsigned int i = 0; i < size; ++i ) {
+        table[ i ] = -1;
+    }
+
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        if ( entries[ i ].image != NULL ) {
+            addToTable( i );
+        }
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
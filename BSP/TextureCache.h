@@ -0,0 +1,206 @@
+//---------------------------------------------------------------------------
+
+#ifndef TextureCacheH
+#define TextureCacheH
+
+#include <vector.h>
+
+#include "WALImage.h"
+#include "pcx.h"
+
+using namespace std;
+
+
+/**
+ * The TextureCache keeps every WAL image that has been loaded, so that an image
+ * is only ever read from its file and sent to Direct3D once, even when it is used
+ * by many texture info structures, or by many maps.
+ *
+ * Images are found by their name (the 32 character texture_name of a texture
+ * info structure) with a hash table, instead of comparing the name against
+ * every image that has been loaded.
+ *
+ * Each image has a reference count. acquire() adds a reference and release()
+ * takes one away, but an image with no references is NOT deleted right away.
+ * It is kept until purgeUnused() is called, so that when one map is unloaded
+ * and the next map is loaded, the images that both maps use are still there.
+ * Calling purgeUnused() after the new map's textures have been acquired deletes
+ * only the images that the new map doesn't use.
+ *
+ * acquire() without a device doesn't read in the new images straight away.
+ * They are left pending, so that they can be read in on several threads at
+ * once with readPending(), and then sent to Direct3D together with
+ * createPendingTextures().
+ *
+ * An image can also be acquired, read in and released again before any map
+ * uses it, to read it in ahead of time (see MapPrefetcher). It stays pending,
+ * without a Direct3D texture, until a map acquires it or it is purged.
+ */
+class TextureCache {
+    public:
+
+        /**
+         * Constructor prepares an empty cache
+         */
+        TextureCache();
+
+        /**
+         * Destructor deletes every image in the cache
+         */
+        ~TextureCache();
+
+        /**
+         * acquire() adds a reference to the image called "name", and returns its
+         * entry number. If the image isn't in the cache, then it is loaded in
+         * from "textures/" and sent to the Direct3D device first.
+         * The entry number stays the same until the image is purged.
+         */
+        int acquire( char *name, LPDIRECT3DDEVICE9 device );
+
+        /**
+         * acquire() without a device adds a reference to the image called
+         * "name" in the same way, but an image that isn't in the cache is only
+         * added as a pending image. It isn't read in until readPending() is
+         * called for it.
+         */
+        int acquire( char *name );
+
+        /**
+         * Returns the number of images that have been acquired, but not read
+         * in and sent to Direct3D yet
+         */
+        int getNumPending() {
+            return pending.size();
+        };
+
+        /**
+         * readPending() reads in pending image #pendingNum, if it hasn't been
+         * read in already. Different pending images can be read on different
+         * threads at the same time, as long as nothing else is done with the
+         * cache until they have been read. An image without a reference isn't
+         * read, since nothing is going to use it.
+         */
+        void readPending( int pendingNum );
+
+        /**
+         * createPendingTextures() sends every pending image that has a
+         * reference to the Direct3D device, once they have all been read in.
+         * They are then no longer pending. Images without a reference were
+         * only read in ahead of time, so they stay pending until a map uses
+         * them or they are purged.
+         */
+        void createPendingTextures( LPDIRECT3DDEVICE9 device );
+
+        /**
+         * release() takes away a reference to the image at entry #entryNum. The
+         * image stays in the cache until purgeUnused() is called.
+         */
+        void release( int entryNum );
+
+        /**
+         * Returns the image of pending image #pendingNum
+         */
+        WALImage *getPendingImage( int pendingNum ) {
+            return entries[ pending[ pendingNum ] ].image;
+        };
+
+        /**
+         * Returns the image at entry #entryNum
+         */
+        WALImage *getImage( int entryNum ) {
+            return entries[ entryNum ].image;
+        };
+
+        /**
+         * purgeUnused() deletes every image that doesn't have any references
+         */
+        void purgeUnused();
+
+        /**
+         * unload() deletes every image in the cache, whether or not it is still
+         * being used, and the colour palette.
+         */
+        void unload();
+
+        /**
+         * Returns the number of images in the cache
+         */
+        int getNumImages() {
+            return numImages;
+        };
+
+        /**
+         * Return the number of images that acquire() had to load from their files,
+         * and the number that it found already in the cache, since the last call
+         * to resetCounts().
+         */
+        int getNumLoaded() {
+            return numLoaded;
+        };
+        int getNumReused() {
+            return numReused;
+        };
+
+        /**
+         * Sets the counts of loaded and reused images back to 0
+         */
+        void resetCounts() {
+            numLoaded = 0;
+            numReused = 0;
+        };
+
+    private:
+
+        /**
+         * A CacheEntry is one image in the cache, with its name, the hash of its
+         * name and the number of references to it. The name is kept here because
+         * an image that couldn't be loaded doesn't know its own name. Entries
+         * whose image has been purged have a NULL image, and are used again by
+         * the next new image.
+         */
+        typedef struct {
+            WALImage *image;
+            char name[ WAL_IMAGE_NAME_SIZE ];
+            unsigned int hash;
+            int refCount;
+        } CacheEntry;
+
+        // Returns the hash of an image name (at most WAL_IMAGE_NAME_SIZE characters)
+        static unsigned int hashName( char *name );
+
+        // Returns the entry number of the image called "name", or -1 if the
+        //  image isn't in the cache
+        int find( char *name, unsigned int hash );
+
+        // Puts entry #entryNum into the hash table
+        void addToTable( int entryNum );
+
+        // Makes a new hash table that is big enough for every entry, and puts
+        //  every entry with an image into it
+        void rebuildTable();
+
+        // The images, and the entries that are not being used
+        vector< CacheEntry > entries;
+        vector< int > freeEntries;
+        int numImages;
+
+        // The entries whose images haven't been read in and sent to Direct3D
+        vector< int > pending;
+
+        // The hash table. Each slot holds an entry number, or -1 if the slot is
+        //  empty. Its size is always a power of 2, and at least twice the number
+        //  of entries, so a name is usually found in one or two tries.
+        vector< int > table;
+
+        // The colour palette of the WAL images. It is loaded in the first time
+        //  that an image is loaded.
+        unsigned char *palette;
+
+        // The number of images loaded and reused since the last resetCounts()
+        int numLoaded;
+        int numReused;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -6,17 +6,42 @@
 
 
 /**
- * load() method loads in all of the map's textures and registers them
- * all with the Direct3D device parameter.
+ * load() method loads in all of the map's textures through the texture
+ * cache, and registers the new ones with the Direct3D device parameter.
  */
-void TextureInfo::load( BSP::Header *header, FILE *file, LPDIRECT3DDEVICE9 device ) {
+void TextureInfo::load( BSPFile *mapFile, TextureCache *cache, LPDIRECT3DDEVICE9 device ) {
+    acquire( mapFile, cache );
+
+    // read in the images that weren't in the cache
+    for ( int i = 0; i < cache->getNumPending(); ++i ) {
+        cache->readPending( i );
+    }
+
+    createTextures( cache, device );
+};
+
+
+/**
+ * acquire() acquires every texture that the map uses from the cache. The
+ * images that weren't in the cache yet are left pending.
+ */
+void TextureInfo::acquire( BSPFile *mapFile, TextureCache *cache ) {
     // load in the texture info structures
-    texInfoLump.load( header, file );
+    texInfoLump.load( mapFile );
 
-    // load in every texture in the map
+    // acquire every texture in the map
     for ( int i = 0; i < texInfoLump.getSize(); ++i ) {
-        textures.loadNew( texInfoLump.getData( i )->texture_name, device );
+        textures.loadNew( cache, texInfoLump.getData( i )->texture_name );
     }
+};
+
+
+/**
+ * createTextures() sends the pending images to the Direct3D device, and
+ * makes the megatexture.
+ */
+void TextureInfo::createTextures( TextureCache *cache, LPDIRECT3DDEVICE9 device ) {
+    cache->createPendingTextures( device );
 
     textures.loadMegaTexture( device );
 };
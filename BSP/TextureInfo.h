@@ -29,10 +29,22 @@ class TextureInfo {
         };
 
         /**
-         * load() method loads in all of the map's textures and registers them
-         * all with the Direct3D device parameter.
+         * load() method loads in all of the map's textures through the texture
+         * cache, and registers the new ones with the Direct3D device parameter.
          */
-        void load( BSP::Header *header, FILE *file, LPDIRECT3DDEVICE9 device );
+        void load( BSPFile *mapFile, TextureCache *cache, LPDIRECT3DDEVICE9 device );
+
+        /**
+         * load() is done in three steps, so that the images can be read in on
+         * other threads:
+         *  - acquire() acquires every texture that the map uses from the cache.
+         *    The images that weren't in the cache yet are left pending.
+         *  - The cache's readPending() reads in the pending images.
+         *  - createTextures() sends the pending images to the Direct3D device,
+         *    and makes the megatexture.
+         */
+        void acquire( BSPFile *mapFile, TextureCache *cache );
+        void createTextures( TextureCache *cache, LPDIRECT3DDEVICE9 device );
 
         /**
          * unload() deletes any allocated memory
@@ -56,6 +68,14 @@ class TextureInfo {
             return textures.getImage( index );
         };
 
+        /**
+         * Returns the number of the unique image used by texture "index". Two
+         * textures that use the same image have the same image number.
+         */
+        int getImageNum( int index ) {
+            return textures.getImageNum( index );
+        };
+
         LPDIRECT3DTEXTURE9 getMegaTexture() {
             return textures.getMegaTexture();
         };
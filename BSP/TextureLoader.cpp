@@ -8,86 +8,55 @@
 
 
 TextureLoader::TextureLoader() {
-    // load in the Quake 2 colour palette
-    // WAL textures do not contain definitive colours in RGB format.
-    // Instead, they contain indices into this colour palette, which in turn
-    // has the colours in RGB format.
-    LoadFilePCX( "Q2/pics/colormap.pcx", &palette, NULL, NULL, false );
-
+    cache = NULL;
     megaTexture = NULL;
 };
 
 TextureLoader::~TextureLoader() {
-    delete[] palette;
-
-
     unload();
 };
 
 
 /**
- * Loads in the .WAL Image under the directory "Q2/textures/"
- * If the image already exists in the data array, then keep a pointer
- *  to the already-loaded .WAL Image.
- * If the image does not already exist, load it in and store its name
- *  in alphabetically-ordered array of texture names.
+ * Loads in the .WAL Image under the directory "textures/" through
+ *  the texture cache, and adds it to the end of the "textures" array.
+ * If the image was already loaded (by this map or by another map), then
+ *  the cache hands back the image that was already loaded.
+ * The first time this map uses an image, it is also put into the
+ *  loadedImages field, which is an array of the map's unique WALImages.
+ * A new image is left pending in the cache, until the cache reads it in.
  */
-void TextureLoader::loadNew( char *name, LPDIRECT3DDEVICE9 device ) {
+void TextureLoader::loadNew( TextureCache *cache, char *name ) {
+    this->cache = cache;
 
-    // Go through each image, testing to see if the image was already loaded
-    for ( unsigned int imageNum = 0; imageNum < loadedImages.size(); ++imageNum ) {
+    // Find the image by its name, adding it to the cache if it isn't there yet
+    int imageNum = cache->acquire( name );
+    WALImage *image = cache->getImage( imageNum );
 
-        // Compare the WALImages' names. If they are the same,
-        if ( stringCompare( name, loadedImages[ imageNum ]->getName() ) == 0 ) {
-            // make a pointer to it in textures
-            textures.push_back( loadedImages[ imageNum ] );
-            return;
-        }
+    // If this is the first time this map has used the image, remember it
+    if ( imageNum >= ( int ) entryLoaded.size() ) {
+        entryLoaded.resize( imageNum + 1, false );
     }
-
-    // If the image was not loaded previously, then load it in.
-
-    // Load in the WAL image directly
-    WALImage *temp = new WALImage();
-    temp->load( name, palette, 319, device );
-
-    loadedImages.push_back( temp );
-    textures.push_back( temp );
-};
-
-
-
-/**
- * Goes through each character of two 32-character long strings, and if
- * the difference between them is NOT zero, then return the difference.
- * If the strings are equal, then return value is 0
- */
-int TextureLoader::stringCompare( char *a, char *b ) {
-    // Go through 32 characters (size of a WAL Image name)
-    for ( int i = 0; i < WAL_IMAGE_NAME_SIZE; ++i ) {
-
-        // if two characters at the same place are unequal, then return the difference.
-        if ( ( *b ) != ( *a ) ) {
-            return ( *b ) - ( *a );
-        }
-
-        // if not, go to the next character in each string
-        a++;
-        b++;
+    if ( !entryLoaded[ imageNum ] ) {
+        entryLoaded[ imageNum ] = true;
+        loadedImages.push_back( image );
     }
 
-    return 0;
+    textures.push_back( image );
+    imageNums.push_back( imageNum );
 };
 
 
 /**
- * Goes through each of the WAL Images and unloads them all.
+ * Gives each of the WAL Images back to the texture cache. The cache keeps
+ * them until it is told to purge the images that aren't being used.
  */
 void TextureLoader::unload() {
-    for ( unsigned int i = 0; i < loadedImages.size(); ++i ) {
-        delete loadedImages[ i ];
+    for ( unsigned int i = 0; i < imageNums.size(); ++i ) {
+        cache->release( imageNums[ i ] );
     }
     loadedImages.resize( 0 );
+    entryLoaded.resize( 0 );
 
     if ( megaTexture != NULL ) {
         megaTexture->Release();
@@ -95,6 +64,7 @@ void TextureLoader::unload() {
     }
 
     textures.resize( 0 );
+    imageNums.resize( 0 );
 };
 
 //---------------------------------------------------------------------------
@@ -7,7 +7,7 @@
 #include <math.h>
 
 #include "WALImage.h"
-#include "pcx.h"
+#include "TextureCache.h"
 
 using namespace std;
 
@@ -242,35 +242,37 @@ class MegaTexture {
 
 /**
  * Handles all WAL image loading and use to reduce the amount of
- * memory used and loading time
+ * memory used and loading time. The images themselves are kept in a
+ * TextureCache, which can be shared by the TextureLoaders of many maps.
  */
 class TextureLoader {
     public:
         /**
-         * Constructor that loads in the Colour palette for the WAL Images.
+         * Constructor that prepares the loader for use
          */
         TextureLoader();
 
         /**
-         * Destructor that deletes all memory that was loaded, and deletes the
-         * colour palette that the WAL Images used.
+         * Destructor that gives back all of the images that were loaded
          */
         ~TextureLoader();
 
 
         /**
-         * Goes through each of the WAL Images and unloads them all.
+         * Gives each of the WAL Images back to the texture cache.
          */
         void unload();
 
         /**
-         * Loads in the .WAL Image under the directory "Q2/textures/"
-         * If the image already exists in loadedImages, then keep a pointer to it
-         *  in the "texture" field, which is an array
-         * If the image does not already exist, load it in and store it in the
-         *  loadedImages field, which is an array of WALImages
+         * Loads in the .WAL Image under the directory "textures/" through
+         *  the texture cache, and adds it to the end of the "textures" array.
+         * If the image was already loaded (by this map or by another map), then
+         *  the cache hands back the image that was already loaded.
+         * The first time this map uses an image, it is also put into the
+         *  loadedImages field, which is an array of the map's unique WALImages.
+         * A new image is left pending in the cache, until the cache reads it in.
          */
-        void loadNew( char *name, LPDIRECT3DDEVICE9 device );
+        void loadNew( TextureCache *cache, char *name );
 
         /**
          * Returns the .WAL image at index "texNum". Index goes by the first
@@ -280,6 +282,22 @@ class TextureLoader {
             return textures[ texNum ];
         };
 
+        /**
+         * Returns the number of the image used by texture "texNum". Textures
+         *  that share the same image have the same image number, so the image
+         *  number can be used to group together faces with the same texture.
+         */
+        int getImageNum( int texNum ) {
+            return imageNums[ texNum ];
+        };
+
+        /**
+         * Returns the number of unique images that have been loaded
+         */
+        int getNumImages() {
+            return loadedImages.size();
+        };
+
         void loadMegaTexture( LPDIRECT3DDEVICE9 device ) {
             int shortest = 1024;
             int largest = 0;
@@ -328,28 +346,21 @@ class TextureLoader {
 
     private:
 
-        // the color palette used by the PCX images
-        unsigned char *palette;
-
-        /**
-         * Returns a pointer to an already-loaded .WAL image that has the same
-         * file name as parameter "name"
-         */
-        WALImage *getImage( char *name );
-
-        /**
-         * Goes through each character of two 32-character long strings, and if
-         * the difference between them is NOT zero, then return the difference.
-         * If the strings are equal, then return value is 0
-         */
-        int stringCompare( char *a, char *b );
+        // The cache that the images were loaded through
+        TextureCache *cache;
 
         // Vector of non-redundant textures
         vector< WALImage * > loadedImages;
 
-        // Vector of Pointers to the WAL images in sortedImages
+        // Vector of Pointers to the WAL images in loadedImages
         vector< WALImage * > textures;
 
+        // The texture cache entry number of each of the images in textures
+        vector< int > imageNums;
+
+        // Whether or not each texture cache entry is in loadedImages
+        vector< bool > entryLoaded;
+
         LPDIRECT3DTEXTURE9 megaTexture;
 };
 
@@ -5,59 +5,198 @@
 #include "VisibilityInfo.h"
 
 
+// BITVECTOR METHODS
+
 /**
- * load() method loads in the visibility states for the map clusters
+ * The bit positions for each of the patterns in countTrailingZeros()
  */
-void VisibilityInfo::load( BSP::Header *header, FILE *mapFile ) {
+const unsigned char BitVector::bitPositions[ 32 ] = {
+     0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8,
+    31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9
+};
 
-    // Read in the first 4 bytes of the BSP Map. This integer is the number
-    // of clusters that are in the map.
-    fseek( mapFile, header->lump[ BSP_VISIBILITY_LUMP ].offset, 0 );
-    fread( &numClusters, 4, 1, mapFile );
 
-    // Read in the visibility offsets. The number of visiblility offsets is equal
-    // to the number of clusters.
-    visOffsets.resize( numClusters );
-    fseek(  mapFile, header->lump[ BSP_VISIBILITY_LUMP ].offset + 4, 0  );
-    fread( &visOffsets[ 0 ], sizeof( BSP::VisOffset ), numClusters, mapFile );
+/**
+ * This call simply resizes this bit vector, setting all of the values in
+ * it to true.
+ */
+void BitVector::resize( int numBits ) {
+    this->numBits = numBits;
 
+    words.resize( ( numBits + 31 ) / 32 );
+    for ( unsigned int i = 0; i < words.size(); ++i ) {
+        words[ i ] = 0xFFFFFFFF;
+    }
 
-    // Allocate memory for the visibility states and read them in 
-    unsigned char *visData = new unsigned char[ visOffsets[ 0 ].pas - visOffsets[ 0 ].pvs ];
-    fseek( mapFile, header->lump[ BSP_VISIBILITY_LUMP ].offset + visOffsets[ 0 ].pvs, 0 );
-    fread( visData, visOffsets[ 0 ].pas - visOffsets[ 0 ].pvs, 1, mapFile );
+    // Clear the bits past the last cluster, so getNextSet() never finds them
+    if ( numBits % 32 != 0 ) {
+        words[ words.size() - 1 ] = ( 1u << ( numBits % 32 ) ) - 1;
+    }
+};
 
-    // For each cluster,
-    for ( unsigned int i = 0; i < numClusters; ++i ) {
 
-        // Load in the visibility information for that cluster
-        BitVector temp;
-        temp.readFromPtr( visData + ( visOffsets[ i ].pvs - visOffsets[ 0 ].pvs ), numClusters );
+/**
+ * This call reads in and decompresses a bit vector from memory, without
+ * reading past the end pointer. The data is stored in the words array,
+ * usable for PVS culling later.
+ */
+void BitVector::readFromPtr( unsigned char *data, unsigned char *end, int numBits ) {
+    this->numBits = numBits;
 
-        // store the visibility information in the visStates array
-        visStates.push_back( temp );
+    // Start with every cluster invisible
+    words.resize( ( numBits + 31 ) / 32 );
+    for ( unsigned int i = 0; i < words.size(); ++i ) {
+        words[ i ] = 0;
     }
 
-    // De-allocate the memory allocated for the visibility states data
-    delete[] visData;
+    int numBytes = ( numBits + 7 ) / 8;
+
+    for ( int b = 0; b < numBytes && data < end; ++data ) {
+
+        if ( *data == 0 ) {
+            // A byte that is equal to 0 means that the number of bytes of
+            // visibility states that are false is equal to the value
+            // of the next byte. They are already false, so just skip them.
+            if ( ++data >= end ) {
+                break;
+            }
+            b += *data;
+
+        } else {
+            // Each byte holds the visibility states of 8 clusters. Put
+            // them in the right place in their word.
+            words[ b >> 2 ] |= ( unsigned int ) *data << ( ( b & 3 ) * 8 );
+            b++;
+        }
+    }
 
+    // Clear the bits past the last cluster, so getNextSet() never finds them
+    if ( numBits % 32 != 0 ) {
+        words[ words.size() - 1 ] &= ( 1u << ( numBits % 32 ) ) - 1;
+    }
+};
 
-    // The final visibility state is where all values are true. This value is used
-    // when the player is outside of the map.
-    BitVector temp;
-    temp.resize( numClusters );
-    visStates.push_back( temp );
 
+// VISIBILITYINFO METHODS
 
+/**
+ * Constructor prepares the object to be loaded.
+ */
+VisibilityInfo::VisibilityInfo() {
+    numClusters = 0;
+    visLump = NULL;
+    visLength = 0;
+    visOffsets = NULL;
+    useCount = 0;
+
+    for ( int i = 0; i < VIS_CACHE_SIZE; ++i ) {
+        cache[ i ].cluster = -1;
+        cache[ i ].lastUsed = 0;
+    }
 };
 
+
+/**
+ * load() method loads in the visibility information for the map clusters.
+ * Nothing is decompressed until getVisState() is called.
+ */
+void VisibilityInfo::load( BSPFile *mapFile ) {
+
+    // The visibility lump is read straight out of the mapped file
+    visLump = mapFile->getLump( BSP_VISIBILITY_LUMP );
+    visLength = mapFile->getLumpLength( BSP_VISIBILITY_LUMP );
+
+    // The first 4 bytes of the lump are the number of clusters that are in the
+    // map. A map without any visibility information has no clusters.
+    numClusters = 0;
+    if ( visLength >= 4 ) {
+        numClusters = *( unsigned int * ) visLump;
+    }
+
+    // The visibility offsets follow the number of clusters. The number of
+    // visiblility offsets is equal to the number of clusters. If they don't
+    // fit in the lump, then the lump can't be used.
+    if ( numClusters > ( visLength - 4 ) / sizeof( BSP::VisOffset ) ) {
+        numClusters = 0;
+    }
+    visOffsets = ( BSP::VisOffset * ) ( visLump + 4 );
+
+    // Nothing has been decompressed yet
+    useCount = 0;
+    for ( int i = 0; i < VIS_CACHE_SIZE; ++i ) {
+        cache[ i ].cluster = -1;
+        cache[ i ].lastUsed = 0;
+    }
+
+    // The visibility state where all values are true is used when the player
+    // is outside of the map.
+    allVisible.resize( numClusters );
+};
+
+
+/**
+ * Returns the visibility states of the other clusters for the cluster
+ * specified by stateNum. The BitVector stays valid until another
+ * VIS_CACHE_SIZE clusters have been asked for.
+ */
+BitVector *VisibilityInfo::getVisState( int stateNum ) {
+
+    // Make sure the cluster index is within the map. If it isn't, then tell
+    // the application to draw ALL of the clusters in the map.
+    if ( stateNum < 0 || stateNum >= ( int ) numClusters ) {
+        return &allVisible;
+    }
+
+    useCount++;
+
+    // See if the state has already been decompressed. While looking, find the
+    // state that hasn't been used for the longest time, in case it hasn't.
+    int oldest = 0;
+    for ( int i = 0; i < VIS_CACHE_SIZE; ++i ) {
+        if ( cache[ i ].cluster == stateNum ) {
+            cache[ i ].lastUsed = useCount;
+            return &cache[ i ].state;
+        }
+
+        if ( cache[ i ].lastUsed < cache[ oldest ].lastUsed ) {
+            oldest = i;
+        }
+    }
+
+    // Decompress the state over top of the oldest one. A state that starts
+    // outside of the lump has nothing visible.
+    CachedState *entry = &cache[ oldest ];
+
+    if ( visOffsets[ stateNum ].pvs < ( unsigned int ) visLength ) {
+        entry->state.readFromPtr( visLump + visOffsets[ stateNum ].pvs, visLump + visLength, numClusters );
+    } else {
+        entry->state.readFromPtr( visLump, visLump, numClusters );
+    }
+
+    entry->cluster = stateNum;
+    entry->lastUsed = useCount;
+
+    return &entry->state;
+};
+
+
 /**
  * unload() method deletes all memory allocated by load()
  */
 void VisibilityInfo::unload() {
     numClusters = 0;
-    visOffsets.resize( 0 );
-    visStates.resize( 0 );
+    visLump = NULL;
+    visLength = 0;
+    visOffsets = NULL;
+
+    // Throw away the decompressed visibility states
+    for ( int i = 0; i < VIS_CACHE_SIZE; ++i ) {
+        cache[ i ].cluster = -1;
+        cache[ i ].lastUsed = 0;
+        cache[ i ].state.resize( 0 );
+    }
+
+    allVisible.resize( 0 );
 };
 
 
@@ -6,105 +6,131 @@
 
 #include "BSPCommon.h"
 
-#include "Lump.h"
+#include "BSPFile.h"
+
+
+// The number of decoded cluster visibility states that VisibilityInfo keeps
+// around. Only the cluster the camera is in is needed each frame, so this only
+// has to be big enough to hold the clusters around the camera.
+#define VIS_CACHE_SIZE 8
 
 
 /**
  * The BitVector class is made to decompress the data in a bit stream. The
  * bit stream is found in the visibility lump, and is decompressed into an
- * array of boolean values. These boolean values determine whether or not
- * a cluster is to be drawn. There are the same number of bit vectors as there
- * are clusters.
+ * array of bits, packed 32 to a word. These bits determine whether or not
+ * a cluster is to be drawn. Bit #c of word #( c / 32 ) is the visibility
+ * state of cluster #c.
  */
 class BitVector {
     public:
 
-        // Empty constructor and destructor do nothing. Behind the scenes, however,
-        // the destructor deletes the memory allocated in the bits array.
-        BitVector() {};
+        // Constructor makes an empty bit vector. Behind the scenes, the
+        // destructor deletes the memory allocated in the words array.
+        BitVector() {
+            numBits = 0;
+        };
         ~BitVector() {};
 
         /**
          * This call simply resizes this bit vector, setting all of the values in
          * it to true.
          */
-        void resize( int numBits ) {
-            bits.resize( numBits );
-            for ( int i = 0; i < numBits; ++i ) {
-                bits[ i ] = true;
-            }
+        void resize( int numBits );
+
+        /**
+         * This call reads in and decompresses a bit vector from memory, without
+         * reading past the end pointer. The data is stored in the words array,
+         * usable for PVS culling later.
+         */
+        void readFromPtr( unsigned char *data, unsigned char *end, int numBits );
+
+        /**
+         * Returns the visibility state of cluster #bitnum:
+         *  - true if visible
+         *  - false if not visible
+         */
+        bool getData( int bitNum ) {
+            return ( words[ bitNum >> 5 ] >> ( bitNum & 31 ) ) & 1;
         };
 
         /**
-         * This call reads in and decompresses a bit vector from memory.
-         * The data is stored in the bits array, usable for PVS culling later.
+         * Returns the number of the first visible cluster that is numbered
+         * bitNum or higher, or -1 if there are no more visible clusters. Whole
+         * words of invisible clusters are skipped at a time, so all of the
+         * visible clusters can be visited with:
+         *     for ( c = getNextSet( 0 ); c >= 0; c = getNextSet( c + 1 ) )
          */
-        void readFromPtr( unsigned char *data, int numBits ) {
-            int v = 0;
-
-            this->numBits = numBits;
-            //bits.resize( 0 );
-
-            for (int c = 0; c < numBits; v++) {
-
-                if ( data[ v ] == 0 ) {
-                    // A byte that is equal to 0 means that the number of
-                    // visibility states that are false is equal to the value
-                    // of the next byte.
-                    v++;
-                    c += 8 * data[ v ];
-                    for ( int i = 0; i < 8 * data[ v ]; ++i ) {
-                        bits.push_back( false );
-                    }
-
-                } else {
-                    for ( unsigned char bit = 1; bit != 0; bit *= 2, c++ ) {
-                        // Append the value of that bit to the end of
-                        // the "bits" array.
-                        if ( data[ v ] & bit ) {
-                            bits.push_back( true );
-                        } else {
-                            bits.push_back( false );
-                        }
-                    }
+        int getNextSet( int bitNum ) {
+            if ( bitNum >= numBits ) {
+                return -1;
+            }
+
+            // Ignore the bits in the first word that come before bitNum
+            int wordNum = bitNum >> 5;
+            unsigned int word = words[ wordNum ] & ( 0xFFFFFFFF << ( bitNum & 31 ) );
+
+            // Skip over the words that have no visible clusters in them
+            while ( word == 0 ) {
+                if ( ++wordNum >= ( int ) words.size() ) {
+                    return -1;
                 }
+                word = words[ wordNum ];
             }
 
+            return ( wordNum << 5 ) + countTrailingZeros( word );
         };
 
         /**
-         * Returns the visibility state of cluster #bitnum:
-         *  - true if visible
-         *  - false if not visible
+         * Returns the number of clusters in this bit vector
          */
-        bool getData( int bitNum ) {
-            return bits[ bitNum ];
+        int getNumBits() {
+            return numBits;
         };
 
     private:
-        // The visibility state of each cluster
-        vector< bool > bits;
+
+        // Returns the number of the lowest bit that is set in word (word
+        // must not be 0)
+        static int countTrailingZeros( unsigned int word ) {
+            // Isolating the lowest bit and multiplying by a de Bruijn sequence
+            // puts a unique pattern in the top 5 bits for each bit position.
+            return bitPositions[ ( ( word & ( 0 - word ) ) * 0x077CB531 ) >> 27 ];
+        };
+
+        // The bit positions for each of the patterns in countTrailingZeros()
+        static const unsigned char bitPositions[ 32 ];
+
+        // The visibility state of each cluster, 32 clusters to a word
+        vector< unsigned int > words;
 
         int numBits;
 };
 
 /**
- * The VisibilityInfo class loads in the visibility state for each cluster of a
+ * The VisibilityInfo class handles the visibility state for each cluster of a
  * BSP Map. Each cluster has a BitVector, dictating the visibility states of all
  * other clusters.
+ *
+ * The visibility lump is kept compressed (inside of the mapped BSP file), and a
+ * cluster's BitVector is only decompressed once it is asked for. The last few
+ * BitVectors that were decompressed are kept, so walking around inside of the
+ * same few clusters never decompresses anything.
  */
 class VisibilityInfo {
     public:
 
-        // Empty constructor and destructor do nothing (except the destructor
-        // deletes the memory allocated by visOffsets and visStates)
-        VisibilityInfo() {};
+        // Constructor prepares the object to be loaded. The destructor does
+        // nothing (except the destructor deletes the memory allocated by the
+        // decompressed visibility states)
+        VisibilityInfo();
         ~VisibilityInfo() {};
 
         /**
-         * load() method loads in the visibility states for the map clusters
+         * load() method loads in the visibility information for the map clusters.
+         * Nothing is decompressed until getVisState() is called.
          */
-        void load( BSP::Header *header, FILE *mapFile );
+        void load( BSPFile *mapFile );
 
         /**
          * unload() method deletes all memory allocated by load()
@@ -120,27 +146,46 @@ class VisibilityInfo {
 
         /**
          * Returns the visibility states of the other clusters for the cluster
-         * specified by stateNum
+         * specified by stateNum. The BitVector stays valid until another
+         * VIS_CACHE_SIZE clusters have been asked for.
          */
-        BitVector *getVisState( int stateNum ) {
-            // Make sure the cluster index is NOT less than 0. If it is, then tell
-            // the application to draw ALL of the clusters in the map.
-            if ( stateNum < 0 ) {
-                return &visStates[ visStates.size() - 1 ];
-            }
-            return &visStates[ stateNum ];
-        };
+        BitVector *getVisState( int stateNum );
 
     private:
 
+        /**
+         * A decompressed visibility state, and when it was last used
+         */
+        struct CachedState {
+            // The cluster that the state belongs to, or -1 if the entry is empty
+            int cluster;
+
+            // The value of useCount when the state was last asked for
+            unsigned int lastUsed;
+
+            // The decompressed visibility state
+            BitVector state;
+        };
+
         // Number of clusters in the BSP Map
         unsigned int numClusters;
 
-        // The offsets to the bit vectors loaded in by visStates
-        vector< BSP::VisOffset > visOffsets;
+        // The visibility lump, inside of the mapped file
+        unsigned char *visLump;
+        int visLength;
+
+        // The offsets to the compressed bit vectors, inside of the mapped file
+        BSP::VisOffset *visOffsets;
+
+        // The most recently used visibility states
+        CachedState cache[ VIS_CACHE_SIZE ];
+
+        // Counts up every time a visibility state is asked for
+        unsigned int useCount;
 
-        // The visibility states of each cluster
-        vector< BitVector > visStates;
+        // The visibility state where all values are true. This is used when the
+        // player is outside of the map.
+        BitVector allVisible;
 };
 
 
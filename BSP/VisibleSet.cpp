@@ -0,0 +1,183 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "VisibleSet.h"
+
+
+/**
+ * Constructor prepares the object to be loaded
+ */
+VisibleSet::VisibleSet() {
+    tree = NULL;
+    faceInfo = NULL;
+
+    cluster = NO_CLUSTER;
+    numPolygons = 0;
+    numLeafPolygons = 0;
+    frame = 0;
+};
+
+
+/**
+ * load() prepares the set for the map's tree and faces, which must stay
+ * loaded for as long as this object is used
+ */
+void VisibleSet::load( BSPTree::Tree *tree, FaceInfo *faceInfo ) {
+    unload();
+
+    this->tree = tree;
+    this->faceInfo = faceInfo;
+
+    faceFrame.resize( faceInfo->getNumFaces() );
+    for ( unsigned int i = 0; i < faceFrame.size(); ++i ) {
+        faceFrame[ i ] = 0;
+    }
+
+    // The set of every leaf is made once, to count the map's polygons
+    setCluster( -1 );
+    numLeafPolygons = numPolygons;
+};
+
+/**
+ * unload() forgets about the map
+ */
+void VisibleSet::unload() {
+    tree = NULL;
+    faceInfo = NULL;
+
+    cluster = NO_CLUSTER;
+    leaves.resize( 0 );
+    leafBoxes.clear();
+    leafVisible.resize( 0 );
+
+    numPolygons = 0;
+    numLeafPolygons = 0;
+
+    faceFrame.resize( 0 );
+    frame = 0;
+};
+
+
+/**
+ * setCluster() makes the leaves that can be seen from cluster #clusterNum
+ * the set of leaves. If clusterNum is -1, every leaf is in the set.
+ * Nothing is done if the set is already for that cluster.
+ */
+void VisibleSet::setCluster( int clusterNum ) {
+    if ( tree == NULL || clusterNum == cluster ) {
+        return;
+    }
+
+    cluster = clusterNum;
+
+    leaves.resize( 0 );
+    leafBoxes.clear();
+    numPolygons = 0;
+
+    // The faces are stamped while the polygons are counted, so that a face
+    //  in more than one leaf is only counted once
+    nextFrame();
+
+    BitVector *visState = tree->getClusterVisState( clusterNum );
+
+    // Each cluster's leaves, and their faces, are one after the other in the
+    //  tree's cluster arrays
+    for ( int c = visState->getNextSet( 0 ); c >= 0 && c < tree->getNumClusters(); c = visState->getNextSet( c + 1 ) ) {
+        for ( int l = tree->getClusterStart( c ); l < tree->getClusterStart( c + 1 ); ++l ) {
+            int numFaces;
+            BSP::LeafFace *faces = tree->getClusterLeafFaces( l, &numFaces );
+
+            // A leaf without any faces never has anything to draw
+            if ( numFaces == 0 ) {
+                continue;
+            }
+
+            int leafNum = tree->getClusterLeafNum( l );
+            leaves.push_back( leafNum );
+            tree->copyLeafBox( leafNum, &leafBoxes );
+
+            for ( int f = 0; f < numFaces; ++f ) {
+                if ( stampFace( faces[ f ] ) ) {
+                    numPolygons += getFacePolygons( faces[ f ] );
+                }
+            }
+        }
+    }
+
+    leafVisible.resize( leaves.size() );
+};
+
+
+/**
+ * beginFrame() starts a new frame, so that every face can be added
+ * again. It must be called after setCluster().
+ */
+void VisibleSet::beginFrame() {
+    nextFrame();
+};
+
+/**
+ * Starts a new frame number for the face stamps
+ */
+void VisibleSet::nextFrame() {
+    // If the frame number wraps around, the faces' old frame numbers could
+    //  match it again, so they are all cleared.
+    if ( ++frame == 0 ) {
+        for ( unsigned int i = 0; i < faceFrame.size(); ++i ) {
+            faceFrame[ i ] = 0;
+        }
+        frame = 1;
+    }
+};
+
+
+/**
+ * addVisibleFaces() starts a new frame, then adds the faces of each leaf
+ * in the set that is within the camera's frustum to drawList.
+ * Returns the number of polygons that were added.
+ */
+int VisibleSet::addVisibleFaces( Camera *camera, DrawList *drawList ) {
+    beginFrame();
+
+    if ( leaves.empty() ) {
+        return 0;
+    }
+
+    // Cull all of the leaves' boxes at once
+    camera->boxesInFrustum( &leafBoxes, 0, leaves.size(), &leafVisible[ 0 ] );
+
+    int numAdded = 0;
+
+    for ( unsigned int l = 0; l < leaves.size(); ++l ) {
+        if ( leafVisible[ l ] ) {
+            numAdded += addLeafFaces( leaves[ l ], drawList );
+        }
+    }
+
+    return numAdded;
+};
+
+/**
+ * addLeafFaces() adds the faces of leaf #leafNum to drawList, leaving
+ * out the faces that have already been added this frame.
+ * Returns the number of polygons that were added.
+ */
+int VisibleSet::addLeafFaces( int leafNum, DrawList *drawList ) {
+    int numFaces;
+    BSP::LeafFace *faces = tree->getLeafFaces( leafNum, &numFaces );
+
+    int numAdded = 0;
+
+    for ( int f = 0; f < numFaces; ++f ) {
+        if ( stampFace( faces[ f ] ) ) {
+            drawList->addFace( faces[ f ] );
+            numAdded += getFacePolygons( faces[ f ] );
+        }
+    }
+
+    return numAdded;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,141 @@
+//---------------------------------------------------------------------------
+
+#ifndef VisibleSetH
+#define VisibleSetH
+
+#include <vector.h>
+
+#include "BSPCommon.h"
+#include "BSPTree.h"
+#include "FaceInfo.h"
+#include "DrawList.h"
+#include "BoxCull.h"
+#include "Camera.h"
+
+using namespace std;
+
+
+/**
+ * VisibleSet keeps the leaves that can be seen from the cluster that the
+ * camera is in, so that they don't have to be found again every frame.
+ *
+ * When the camera moves into a new cluster, setCluster() goes through the
+ * clusters in its PVS once, and copies each of their leaves (that have faces)
+ * into a list, along with the leaves' bounding boxes. Until the camera leaves
+ * the cluster, each frame only has to frustum cull that list of boxes, which
+ * is done all at once with cullBoxes() (BoxCull.h).
+ *
+ * A face can be in more than one leaf. Each face is stamped with the frame
+ * that it was last added in, so that it is only added to the draw list, and
+ * only counted, once per frame.
+ */
+class VisibleSet {
+    public:
+
+        /**
+         * Constructor prepares the object to be loaded
+         */
+        VisibleSet();
+
+        /**
+         * load() prepares the set for the map's tree and faces, which must stay
+         * loaded for as long as this object is used
+         */
+        void load( BSPTree::Tree *tree, FaceInfo *faceInfo );
+
+        /**
+         * unload() forgets about the map
+         */
+        void unload();
+
+        /**
+         * setCluster() makes the leaves that can be seen from cluster #clusterNum
+         * the set of leaves. If clusterNum is -1, every leaf is in the set.
+         * Nothing is done if the set is already for that cluster.
+         */
+        void setCluster( int clusterNum );
+
+        /**
+         * beginFrame() starts a new frame, so that every face can be added
+         * again. It must be called after setCluster().
+         */
+        void beginFrame();
+
+        /**
+         * addVisibleFaces() starts a new frame, then adds the faces of each leaf
+         * in the set that is within the camera's frustum to drawList.
+         * Returns the number of polygons that were added.
+         */
+        int addVisibleFaces( Camera *camera, DrawList *drawList );
+
+        /**
+         * addLeafFaces() adds the faces of leaf #leafNum to drawList, leaving
+         * out the faces that have already been added this frame.
+         * Returns the number of polygons that were added.
+         */
+        int addLeafFaces( int leafNum, DrawList *drawList );
+
+        /**
+         * Returns the number of polygons in the set's leaves. A polygon that is
+         * in more than one leaf is only counted once.
+         */
+        int getNumPolygons() {
+            return numPolygons;
+        };
+
+        /**
+         * Returns the number of polygons in all of the map's leaves. A polygon
+         * that is in more than one leaf is only counted once.
+         */
+        int getNumLeafPolygons() {
+            return numLeafPolygons;
+        };
+
+    private:
+
+        // Starts a new frame number for the face stamps
+        void nextFrame();
+
+        // Stamps face #faceNum with the current frame. Returns false if it
+        //  was already stamped this frame, or if it isn't one of the map's faces.
+        bool stampFace( int faceNum ) {
+            if ( faceNum >= ( int ) faceFrame.size() || faceFrame[ faceNum ] == frame ) {
+                return false;
+            }
+
+            faceFrame[ faceNum ] = frame;
+            return true;
+        };
+
+        // Returns the number of polygons in face #faceNum
+        int getFacePolygons( int faceNum ) {
+            return ( faceInfo->getFaceStartIndex( faceNum + 1 ) - faceInfo->getFaceStartIndex( faceNum ) ) / 3;
+        };
+
+        // The map's tree and faces
+        BSPTree::Tree *tree;
+        FaceInfo *faceInfo;
+
+        // The cluster that the set was made for. NO_CLUSTER means that the set
+        //  hasn't been made yet.
+        static const int NO_CLUSTER = -2;
+        int cluster;
+
+        // The leaves in the set, their bounding boxes, and whether each one
+        //  was in the frustum this frame
+        vector< int > leaves;
+        BoxArray leafBoxes;
+        vector< unsigned char > leafVisible;
+
+        // The number of polygons in the set, and in the whole map's leaves
+        int numPolygons;
+        int numLeafPolygons;
+
+        // The frame that each face was last added in
+        vector< unsigned int > faceFrame;
+        unsigned int frame;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
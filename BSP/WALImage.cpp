@@ -3,6 +3,8 @@
 #pragma hdrstop
 
 #include "WALImage.h"
+#include "PaletteExpand.h"
+#include "FileSystem.h"
 
 using namespace std;
 
@@ -12,6 +14,7 @@ using namespace std;
  */
 WALImage::WALImage() {
     texture = NULL;
+    data = NULL;
 };
 
 
@@ -67,46 +70,67 @@ bool strContains( char *str, char *substr ) {
  * that loaded image as a texture to Direct3D Device "device".
  */
 bool WALImage::load( char *fName, unsigned char *palette, int rowNum, LPDIRECT3DDEVICE9 device ) {
+    return read( fName, palette, rowNum ) && createTexture( device );
+};
+
+
+/**
+ * read() reads in the WALImage with file name "fName", and expands its
+ * colours with row "rowNum" of colour palette "palette", without sending
+ * it to Direct3D. Different images can be read on different threads.
+ */
+bool WALImage::read( char *fName, unsigned char *palette, int rowNum ) {
 
     // Fing the complete filename of the WAL image by adding the directory and file extension.
-    string fileName = string( "Q2/textures/" ) + string( fName ) + string( ".wal" );
+    string fileName = string( "textures/" ) + string( fName ) + string( ".wal" );
 
     // Determine if the WAL image is a skybox or if it uses lightmaps, based on its
     // file name
     isSkyBox = strContains( fName, "sky" );
     usesLightMaps = !( strContains( fName, "wter" ) || strContains( fName, "lava" ) || strContains( fName, "water" ) || strContains( fName, "sewer" ) );
 
-    // data is the final pixel information to be sent to the Direct3D texture object.
-    // packedData is the data that was found in the WAL file.
-    unsigned char *packedData;
-
-    // Open the WAL file
-    FILE *fh = NULL;
+    // Open the WAL file. It is mapped (or comes out of a mapped .pak file),
+    // so the packed data is read straight out of it.
+    VirtualFile file;
 
-    if ( ( fh = fopen( fileName.c_str(), "rb" ) ) == NULL ) {
+    if ( !file.open( fileName ) || file.getSize() < sizeof( WALHeader ) ) {
         // if the file open failed, return false
         return false;
     }
 
     // read in the WAL header
-    fread( &header, sizeof( WALHeader ), 1, fh );
-
-    // create memory for the data
-    packedData = new unsigned char[ header.width * header.height ];
-    data = new unsigned char[ header.width * header.height * 4 ];
-
-    // Read in the packed data
-    fseek( fh, header.offset[ 0 ], 0 );
-    fread( packedData, header.width * header.height, 1, fh );
-
-    // unpack the packed data, placing the new data into the data array
-    for ( unsigned int i = 0; i < header.width * header.height; ++i ) {
-        data[ i * 4 ] = palette[ packedData[ i ] * 4 + rowNum * 256 * 4 ];
-        data[ i * 4 + 1 ] = palette[ packedData[ i ] * 4 + 1 + rowNum * 256 * 4 ];
-        data[ i * 4 + 2 ] = palette[ packedData[ i ] * 4 + 2 + rowNum * 256 * 4 ];
-        data[ i * 4 + 3 ] = 255;
+    memcpy( &header, file.getData(), sizeof( WALHeader ) );
+
+    // Make sure that the packed data lies inside of the file
+    unsigned int numPixels = header.width * header.height;
+    if ( header.offset[ 0 ] < 0 || ( unsigned int ) header.offset[ 0 ] > file.getSize() ||
+         numPixels > file.getSize() - header.offset[ 0 ] ) {
+        return false;
     }
 
+    // data is the final pixel information to be sent to the Direct3D texture object.
+    data = new unsigned char[ numPixels * 4 ];
+
+    // unpack the packed data, placing the new data into the data array. Row
+    // "rowNum" of the colour palette holds the 256 colours of the indices.
+    unsigned int paletteRow[ 256 ];
+    packPaletteBGRA( palette + rowNum * 256 * 4, paletteRow );
+    expandPalette( file.getData() + header.offset[ 0 ], ( unsigned int * ) data, numPixels, paletteRow );
+
+    return true;
+};
+
+
+/**
+ * createTexture() sends the pixels of an image that has been read in to
+ * a Direct3D texture on Direct3D Device "device"
+ */
+bool WALImage::createTexture( LPDIRECT3DDEVICE9 device ) {
+
+    // An image that couldn't be read in doesn't have any pixels to send
+    if ( data == NULL ) {
+        return false;
+    }
 
     HRESULT rtn;
     D3DLOCKED_RECT lr;
@@ -136,14 +160,6 @@ bool WALImage::load( char *fName, unsigned char *palette, int rowNum, LPDIRECT3D
     // Stop sending texture information to the Direct3D texture object
 	rtn = texture->UnlockRect( 0 );
 
-    // delete the memory allocated to load the WAL Image data
-    delete[] packedData;
-
-    // close the file
-    if ( fh != NULL ) {
-        fclose( fh );
-    }
-
     return true;
 };
 
@@ -83,6 +83,19 @@ class WALImage {
          */
         bool load( char *fName, unsigned char *palette, int rowNum, LPDIRECT3DDEVICE9 device );
 
+        /**
+         * read() reads in the WALImage with file name "fName", and expands its
+         * colours with row "rowNum" of colour palette "palette", without sending
+         * it to Direct3D. Different images can be read on different threads.
+         */
+        bool read( char *fName, unsigned char *palette, int rowNum );
+
+        /**
+         * createTexture() sends the pixels of an image that has been read in to
+         * a Direct3D texture on Direct3D Device "device"
+         */
+        bool createTexture( LPDIRECT3DDEVICE9 device );
+
         /**
          * unload() method de-allocates any memory allocated by "load"
          */
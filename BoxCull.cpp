@@ -0,0 +1,352 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "BoxCull.h"
+#include "Timer.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+
+// Work out whether this compiler can build the SSE version. It is only ever
+// called if the CPU supports it, so the intrinsics are allowed even when the
+// rest of the program is built for an older CPU. C++Builder 6 has no SSE
+// intrinsics, so it only builds the plain loop.
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+    #include <intrin.h>
+    #include <xmmintrin.h>
+    #define BOXCULL_HAS_SSE
+    #define BOXCULL_TARGET_SSE
+
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+    #include <cpuid.h>
+    #include <xmmintrin.h>
+    #define BOXCULL_HAS_SSE
+    #define BOXCULL_TARGET_SSE __attribute__(( target( "sse" ) ))
+#endif
+
+
+/**
+ * add() adds a box to the end of the array
+ */
+void BoxArray::add( float cX, float cY, float cZ, float eX, float eY, float eZ ) {
+    centerX.push_back( cX );
+    centerY.push_back( cY );
+    centerZ.push_back( cZ );
+    extentX.push_back( eX );
+    extentY.push_back( eY );
+    extentZ.push_back( eZ );
+};
+
+/**
+ * clear() removes every box from the array
+ */
+void BoxArray::clear() {
+    centerX.resize( 0 );
+    centerY.resize( 0 );
+    centerZ.resize( 0 );
+    extentX.resize( 0 );
+    extentY.resize( 0 );
+    extentZ.resize( 0 );
+};
+
+
+/**
+ * A frustum plane, with the absolute values of its normal worked out ahead
+ * of time for the effective radius of each box
+ */
+typedef struct {
+    float a, b, c, d;
+    float absA, absB, absC;
+} CullPlane;
+
+/**
+ * Copies the six frustum planes into "cullPlanes"
+ */
+static void preparePlanes( const Plane *planes, CullPlane *cullPlanes ) {
+    for ( int p = 0; p < 6; ++p ) {
+        cullPlanes[ p ].a = planes[ p ].a;
+        cullPlanes[ p ].b = planes[ p ].b;
+        cullPlanes[ p ].c = planes[ p ].c;
+        cullPlanes[ p ].d = planes[ p ].d;
+        cullPlanes[ p ].absA = fabs( planes[ p ].a );
+        cullPlanes[ p ].absB = fabs( planes[ p ].b );
+        cullPlanes[ p ].absC = fabs( planes[ p ].c );
+    }
+};
+
+
+/**
+ * The plain version of cullBoxes(), which works on every CPU. Each box
+ * stops being tested as soon as one plane has it outside.
+ */
+static void cullScalar( const CullPlane *planes, BoxArray *boxes, int first, int count, unsigned char *visible ) {
+    const float *cX = &boxes->centerX[ first ];
+    const float *cY = &boxes->centerY[ first ];
+    const float *cZ = &boxes->centerZ[ first ];
+    const float *eX = &boxes->extentX[ first ];
+    const float *eY = &boxes->extentY[ first ];
+    const float *eZ = &boxes->extentZ[ first ];
+
+    for ( int i = 0; i < count; ++i ) {
+        visible[ i ] = 1;
+
+        for ( int p = 0; p < 6; ++p ) {
+            // Added up in the same order as the SSE version, so that both give
+            // the same answer for a box that just touches a plane
+            float distance = ( planes[ p ].a * cX[ i ] + planes[ p ].b * cY[ i ] ) + ( planes[ p ].c * cZ[ i ] + planes[ p ].d );
+            float radius = ( planes[ p ].absA * eX[ i ] + planes[ p ].absB * eY[ i ] ) + planes[ p ].absC * eZ[ i ];
+
+            if ( distance + radius <= 0.0f ) {
+                visible[ i ] = 0;
+                break;
+            }
+        }
+    }
+};
+
+
+#ifdef BOXCULL_HAS_SSE
+/**
+ * The SSE version of cullBoxes(). 4 boxes are tested against each plane at
+ * once, and a group stops being tested once all 4 of its boxes are outside.
+ */
+BOXCULL_TARGET_SSE
+static void cullSSE( const CullPlane *planes, BoxArray *boxes, int first, int count, unsigned char *visible ) {
+    const float *cX = &boxes->centerX[ first ];
+    const float *cY = &boxes->centerY[ first ];
+    const float *cZ = &boxes->centerZ[ first ];
+    const float *eX = &boxes->extentX[ first ];
+    const float *eY = &boxes->extentY[ first ];
+    const float *eZ = &boxes->extentZ[ first ];
+
+    int i = 0;
+
+    for ( ; i + 4 <= count; i += 4 ) {
+        __m128 centerX = _mm_loadu_ps( cX + i );
+        __m128 centerY = _mm_loadu_ps( cY + i );
+        __m128 centerZ = _mm_loadu_ps( cZ + i );
+        __m128 extentX = _mm_loadu_ps( eX + i );
+        __m128 extentY = _mm_loadu_ps( eY + i );
+        __m128 extentZ = _mm_loadu_ps( eZ + i );
+
+        // One bit for each box that is still inside of every plane so far
+        int inside = 15;
+
+        for ( int p = 0; p < 6 && inside != 0; ++p ) {
+            __m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( centerX, _mm_set1_ps( planes[ p ].a ) ),
+                                                      _mm_mul_ps( centerY, _mm_set1_ps( planes[ p ].b ) ) ),
+                                          _mm_add_ps( _mm_mul_ps( centerZ, _mm_set1_ps( planes[ p ].c ) ),
+                                                      _mm_set1_ps( planes[ p ].d ) ) );
+            __m128 radius = _mm_add_ps( _mm_add_ps( _mm_mul_ps( extentX, _mm_set1_ps( planes[ p ].absA ) ),
+                                                    _mm_mul_ps( extentY, _mm_set1_ps( planes[ p ].absB ) ) ),
+                                        _mm_mul_ps( extentZ, _mm_set1_ps( planes[ p ].absC ) ) );
+
+            inside &= _mm_movemask_ps( _mm_cmpgt_ps( _mm_add_ps( distance, radius ), _mm_setzero_ps() ) );
+        }
+
+        visible[ i ] = inside & 1;
+        visible[ i + 1 ] = ( inside >> 1 ) & 1;
+        visible[ i + 2 ] = ( inside >> 2 ) & 1;
+        visible[ i + 3 ] = ( inside >> 3 ) & 1;
+    }
+
+    // The last few boxes
+    if ( i < count ) {
+        cullScalar( planes, boxes, first + i, count - i, visible + i );
+    }
+};
+#endif
+
+
+/**
+ * Asks the CPU which instruction sets can be used
+ */
+static BoxCullPath detectPath() {
+#if defined( BOXCULL_HAS_SSE )
+    unsigned int edx = 0;
+
+    #if defined( _MSC_VER )
+        int info[ 4 ];
+        __cpuid( info, 0 );
+
+        if ( info[ 0 ] >= 1 ) {
+            __cpuid( info, 1 );
+            edx = info[ 3 ];
+        }
+    #else
+        unsigned int eax, ebx, ecx;
+        if ( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) ) {
+            edx = 0;
+        }
+    #endif
+
+    if ( edx & ( 1 << 25 ) ) {
+        return BOX_CULL_SSE;
+    }
+#endif
+
+    return BOX_CULL_SCALAR;
+};
+
+
+// The path that cullBoxes() uses. It is worked out the first time that it is
+// needed.
+static int boxCullPath = -1;
+
+
+/**
+ * Returns the path that cullBoxes() uses on this CPU
+ */
+BoxCullPath getBoxCullPath() {
+    if ( boxCullPath < 0 ) {
+        boxCullPath = detectPath();
+    }
+
+    return ( BoxCullPath ) boxCullPath;
+};
+
+
+/**
+ * cullBoxesWith() is the same as cullBoxes(), except that it uses the given
+ * path, whether or not the CPU supports it. A path that wasn't compiled in
+ * falls back to the plain version.
+ */
+void cullBoxesWith( BoxCullPath path, const Plane *planes, BoxArray *boxes, int first, int count, unsigned char *visible ) {
+    if ( count <= 0 ) {
+        return;
+    }
+
+    CullPlane cullPlanes[ 6 ];
+    preparePlanes( planes, cullPlanes );
+
+    switch ( path ) {
+#ifdef BOXCULL_HAS_SSE
+        case BOX_CULL_SSE:
+            cullSSE( cullPlanes, boxes, first, count, visible );
+            return;
+#endif
+        default:
+            cullScalar( cullPlanes, boxes, first, count, visible );
+            return;
+    }
+};
+
+/**
+ * cullBoxes() tests "count" boxes, starting at box #first of "boxes", against
+ * the six frustum planes in "planes". visible[ i ] is set to 1 if box
+ * #( first + i ) is at least partly inside of the frustum, or 0 if it isn't.
+ */
+void cullBoxes( const Plane *planes, BoxArray *boxes, int first, int count, unsigned char *visible ) {
+    cullBoxesWith( getBoxCullPath(), planes, boxes, first, count, visible );
+};
+
+
+/**
+ * cullBox() tests box #index of "boxes" against the frustum planes that are
+ * in planeMask (bit p stands for plane #p). It returns -1 if the box is
+ * outside of one of those planes. Otherwise, it returns planeMask without the
+ * planes that the box is entirely in front of.
+ */
+int cullBox( const Plane *planes, BoxArray *boxes, int index, int planeMask ) {
+    float cX = boxes->centerX[ index ];
+    float cY = boxes->centerY[ index ];
+    float cZ = boxes->centerZ[ index ];
+    float eX = boxes->extentX[ index ];
+    float eY = boxes->extentY[ index ];
+    float eZ = boxes->extentZ[ index ];
+
+    for ( int p = 0; p < 6; ++p ) {
+        if ( !( planeMask & ( 1 << p ) ) ) {
+            continue;
+        }
+
+        float distance = ( planes[ p ].a * cX + planes[ p ].b * cY ) + ( planes[ p ].c * cZ + planes[ p ].d );
+        float radius = ( fabs( planes[ p ].a ) * eX + fabs( planes[ p ].b ) * eY ) + fabs( planes[ p ].c ) * eZ;
+
+        // The box is entirely behind the plane
+        if ( distance + radius <= 0.0f ) {
+            return -1;
+        }
+
+        // The box is entirely in front of the plane
+        if ( distance - radius > 0.0f ) {
+            planeMask &= ~( 1 << p );
+        }
+    }
+
+    return planeMask;
+};
+
+
+/**
+ * Returns a random number from min to max
+ */
+static float randomFloat( float min, float max ) {
+    return min + ( max - min ) * ( float ) rand() / ( float ) RAND_MAX;
+};
+
+/**
+ * benchmarkBoxCull() makes "numBoxes" random boxes scattered around a
+ * frustum, then culls all of them "repeats" times with each path, and fills
+ * in "result" with how long each path took.
+ */
+void benchmarkBoxCull( int numBoxes, int repeats, BoxCullBenchmark *result ) {
+
+    // A 90 degree frustum at the origin, looking down the z axis, like the
+    // ones that Frustum::updateFrustum() makes
+    const float s = 0.70710678f;
+    Plane planes[ 6 ] = {
+        {  s,  0.0f, s, 0.0f },     // left
+        { -s,  0.0f, s, 0.0f },     // right
+        { 0.0f, -s,  s, 0.0f },     // top
+        { 0.0f,  s,  s, 0.0f },     // bottom
+        { 0.0f, 0.0f, -1.0f, 100.0f },  // far
+        { 0.0f, 0.0f, 1.0f, -0.1f }     // near
+    };
+
+    // Scatter boxes of leaf-like sizes all around the camera, so that some
+    // are in front of it, some are behind it, and some cross the planes
+    BoxArray boxes;
+    srand( 1 );
+
+    for ( int i = 0; i < numBoxes; ++i ) {
+        boxes.add( randomFloat( -100.0f, 100.0f ), randomFloat( -100.0f, 100.0f ), randomFloat( -100.0f, 100.0f ),
+                   randomFloat( 0.5f, 10.0f ), randomFloat( 0.5f, 10.0f ), randomFloat( 0.5f, 10.0f ) );
+    }
+
+    vector< unsigned char > scalarVisible;
+    vector< unsigned char > sseVisible;
+    scalarVisible.resize( numBoxes );
+    sseVisible.resize( numBoxes );
+
+    Timer timer;
+
+    unsigned int start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        cullBoxesWith( BOX_CULL_SCALAR, planes, &boxes, 0, numBoxes, &scalarVisible[ 0 ] );
+    }
+    result->scalarMillis = timer.getTimeMillis() - start;
+
+    start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        cullBoxesWith( getBoxCullPath(), planes, &boxes, 0, numBoxes, &sseVisible[ 0 ] );
+    }
+    result->sseMillis = timer.getTimeMillis() - start;
+
+    // Both paths must find the same boxes
+    result->numVisible = 0;
+    result->numMismatched = 0;
+
+    for ( int i = 0; i < numBoxes; ++i ) {
+        result->numVisible += scalarVisible[ i ];
+
+        if ( scalarVisible[ i ] != sseVisible[ i ] ) {
+            ++result->numMismatched;
+        }
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
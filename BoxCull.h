@@ -0,0 +1,143 @@
+//---------------------------------------------------------------------------
+
+#ifndef BoxCullH
+#define BoxCullH
+
+#include <vector.h>
+
+#include "frustum.h"
+
+using namespace std;
+
+/**
+ * An explanation on box culling:
+ *      Frustum culling a BSP leaf means checking its bounding box against the
+ *  six planes of the viewing frustum. If the whole box is behind any one of
+ *  the planes, then the leaf can't be seen.
+ *
+ *      For each plane, the corner of the box that is furthest in front of the
+ *  plane is found by taking the box's centre, and adding on the box's extent
+ *  (half of its size) along each axis, in the direction that the plane faces.
+ *  This is the same as moving the centre forward by the box's "effective
+ *  radius" for that plane:
+ *          radius = |a| * extentX + |b| * extentY + |c| * extentZ
+ *  If the centre is more than that far behind the plane, the box is outside.
+ *  This is much tighter than putting a sphere around the box, and it doesn't
+ *  need a square root.
+ *
+ *      The boxes are kept in a BoxArray, which stores each of the six numbers
+ *  of every box in its own array (the centre x's, then the centre y's, and so
+ *  on), so that a group of boxes can be loaded into one SSE register at once.
+ *
+ *      cullBoxes() picks the fastest way to test the boxes that the CPU
+ *  supports, the first time that it is called:
+ *   - SSE tests 4 boxes at once against each plane.
+ *   - Otherwise, a plain loop tests one box at a time.
+ *  The SSE version is only compiled in by compilers that have the intrinsics
+ *  for it (Visual C++ and GCC). C++Builder 6, which Quake2.bpr is built with,
+ *  doesn't have them, so that build always uses the plain loop. Both versions
+ *  give exactly the same results, which benchmarkBoxCull() checks.
+ */
+
+/**
+ * The ways that cullBoxes() can test boxes
+ */
+enum BoxCullPath {
+    BOX_CULL_SCALAR,
+    BOX_CULL_SSE
+};
+
+
+/**
+ * A BoxArray holds a set of axis-aligned boxes, each as a centre and an extent
+ * (half of the box's size along each axis).
+ */
+class BoxArray {
+    public:
+
+        /**
+         * add() adds a box to the end of the array
+         */
+        void add( float centerX, float centerY, float centerZ,
+                  float extentX, float extentY, float extentZ );
+
+        /**
+         * clear() removes every box from the array
+         */
+        void clear();
+
+        /**
+         * Returns the number of boxes in the array
+         */
+        int getSize() {
+            return centerX.size();
+        };
+
+        // The centre and the extent of each box
+        vector< float > centerX;
+        vector< float > centerY;
+        vector< float > centerZ;
+        vector< float > extentX;
+        vector< float > extentY;
+        vector< float > extentZ;
+};
+
+
+/**
+ * cullBoxes() tests "count" boxes, starting at box #first of "boxes", against
+ * the six frustum planes in "planes". visible[ i ] is set to 1 if box
+ * #( first + i ) is at least partly inside of the frustum, or 0 if it isn't.
+ */
+void cullBoxes( const Plane *planes, BoxArray *boxes, int first, int count, unsigned char *visible );
+
+/**
+ * cullBoxesWith() is the same as cullBoxes(), except that it uses the given
+ * path, whether or not the CPU supports it. This is for comparing the paths
+ * against each other.
+ */
+void cullBoxesWith( BoxCullPath path, const Plane *planes, BoxArray *boxes, int first, int count, unsigned char *visible );
+
+/**
+ * Returns the path that cullBoxes() uses on this CPU
+ */
+BoxCullPath getBoxCullPath();
+
+
+// The plane mask that has all six frustum planes in it
+#define BOX_CULL_ALL_PLANES 63
+
+/**
+ * cullBox() tests box #index of "boxes" against the frustum planes that are
+ * in planeMask (bit p stands for plane #p). It returns -1 if the box is
+ * outside of one of those planes. Otherwise, it returns planeMask without the
+ * planes that the box is entirely in front of. Anything inside of the box is
+ * also in front of those planes, so the returned mask is what the contents of
+ * the box need to be tested against.
+ */
+int cullBox( const Plane *planes, BoxArray *boxes, int index, int planeMask );
+
+
+/**
+ * The results of benchmarkBoxCull()
+ */
+typedef struct {
+    // How long each path took, in milliseconds
+    unsigned int scalarMillis;
+    unsigned int sseMillis;
+
+    // How many boxes were found to be visible, and how many boxes the two
+    // paths didn't agree on (this should always be 0)
+    int numVisible;
+    int numMismatched;
+} BoxCullBenchmark;
+
+/**
+ * benchmarkBoxCull() makes "numBoxes" random boxes scattered around a
+ * frustum, then culls all of them "repeats" times with each path, and fills
+ * in "result" with how long each path took.
+ */
+void benchmarkBoxCull( int numBoxes, int repeats, BoxCullBenchmark *result );
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -107,8 +107,38 @@ void Camera::update( float mouseX, float mouseY ) {
  * and rotating around a camera that stays still.
  */
 void Camera::setupTransform( LPDIRECT3DDEVICE9 device ) {
+    D3DXMATRIX view;
+    getViewMatrix( &view );
+
+    // send the viewing transformation to Direct3D
+    device->SetTransform( D3DTS_VIEW, &view );
+
+    // update the frustum object.
+    frustum->updateFrustum( device );
+};
+
+/**
+ * setupTransform() can also set up the viewing transformation on a
+ * RenderDevice, so that the camera works without Direct3D. The projection
+ * must already be set on the device.
+ */
+void Camera::setupTransform( RenderDevice *device ) {
+    D3DXMATRIX view, proj;
+    getViewMatrix( &view );
+
+    device->setTransform( D3DTS_VIEW, &view );
+    device->getTransform( D3DTS_PROJECTION, &proj );
+
+    frustum->updateFrustum( &view, &proj );
+};
+
+/**
+ * Works out the viewing transformation from the camera's position and
+ * rotation
+ */
+void Camera::getViewMatrix( D3DXMATRIX *view ) {
     // The transformation matrices
-    D3DXMATRIX rotX, rotY, trans, eyeTrans;
+    D3DXMATRIX rotX, rotY, trans;
 
     // Rotate the world around the camera
     D3DXMatrixRotationX( &rotX, -D3DXToRadian( pos->ry ) );
@@ -117,11 +147,7 @@ void Camera::setupTransform( LPDIRECT3DDEVICE9 device ) {
     // move the world around the camera
     D3DXMatrixTranslation( &trans, pos->x, pos->y, pos->z );
 
-    // send the viewing transformation to Direct3D
-    device->SetTransform( D3DTS_VIEW, &( trans * rotY * rotX ) );
-
-    // update the frustum object.
-    frustum->updateFrustum( device );
+    *view = trans * rotY * rotX;
 };
 
 //---------------------------------------------------------------------------
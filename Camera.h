@@ -6,6 +6,8 @@
 #include "BSPCommon.h"
 #include "BSPMath.h"
 #include "Frustum.h"
+#include "BoxCull.h"
+#include "RenderDevice.h"
 
 /**
  * The point structure keeps track of the camera's position and rotation.
@@ -39,6 +41,10 @@ class Camera {
         // The BSP Map
         Frustum *frustum;
 
+        // Works out the viewing transformation from the camera's position
+        //  and rotation
+        void getViewMatrix( D3DXMATRIX *view );
+
     public:
         // The Camera's position and orientation
         Point *pos;
@@ -62,6 +68,13 @@ class Camera {
          */
         void setupTransform( LPDIRECT3DDEVICE9 device );
 
+        /**
+         * setupTransform() can also set up the viewing transformation on a
+         * RenderDevice, so that the camera works without Direct3D. The
+         * projection must already be set on the device.
+         */
+        void setupTransform( RenderDevice *device );
+
         /**
          * Moves the camera based on the states of the keys on the keyboard.
          * Holding down:
@@ -81,12 +94,19 @@ class Camera {
         void update( float mouseX, float mouseY );
 
         /**
-         * Tests to see if a BSP Leaf is within the viewing frustum.
-         * Returns true if the leaf is visible,
-         * Returns false if not visible.
+         * Tests to see which of a set of boxes are within the viewing frustum.
+         * visible[ i ] is set to 1 if box #( first + i ) is visible,
+         * or 0 if it is not visible.
+         */
+        void boxesInFrustum( BoxArray *boxes, int first, int count, unsigned char *visible ) {
+            frustum->boxesInFrustum( boxes, first, count, visible );
+        };
+
+        /**
+         * Returns the six planes of the viewing frustum, in Direct3D coordinates
          */
-        bool leafInFrustum( BSP::Leaf *leaf ) {
-            return frustum->leafInFrustum( leaf );
+        const Plane *getFrustumPlanes() {
+            return frustum->getPlanes();
         };
 };
 
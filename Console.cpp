@@ -222,13 +222,50 @@ char *Console::getMapName() {
 };
 
 
+/**
+ * Returns the number after the last console command, or -1 if there
+ * wasn't one. This is called when the COMMAND_PREFETCH or
+ * COMMAND_BENCHANIM value is returned from the previous call to
+ * executeInputCommand().
+ */
+int Console::getCommandNumber() {
+    char *token, *value;
+
+    string tmp = lines[ lines.size() - 1 ]->getText();
+
+    // parse the token and value parts of the command
+    token = strtok( ( char * ) tmp.c_str(), " " );
+    value = strtok( NULL, " " );
+
+    if ( value == NULL || value[ 0 ] < '0' || value[ 0 ] > '9' ) {
+        return -1;
+    }
+
+    return atoi( value );
+};
+
+
 /**
  * executeInputCommand() executes the input string as a command - this is
  * done when the user presses the Enter key.
- * The return value is the type of command that the user input. For now,
- * this can only be a new map, the command to show all maps, or an unknown
- * command, and the engine can respond accordingly. When the "map<mapname>"
- * command is used, the map name can be accessed by calling getMapName().
+ * The return value is the type of command that the user input, so that the
+ * engine can respond accordingly. It is one of:
+ *  - COMMAND_NEWMAP: "map <mapname>", whose map name can be accessed by
+ *    calling getMapName()
+ *  - COMMAND_SHOWMAPS: "showmaps", which prints the names of the maps
+ *  - COMMAND_RECORDFRAME: "recordframe"
+ *  - COMMAND_BENCHCULL: "benchcull"
+ *  - COMMAND_OUTSIDEPVS: "outsidepvs"
+ *  - COMMAND_COMPACTVERTS: "compactverts"
+ *  - COMMAND_PREFETCH: "prefetch <megabytes>", whose number can be
+ *    accessed by calling getCommandNumber()
+ *  - COMMAND_BENCHMD2: "benchmd2"
+ *  - COMMAND_COMPACTMD2: "compactmd2"
+ *  - COMMAND_MD2RENDER: "md2render"
+ *  - COMMAND_BENCHANIM: "benchanim <instances>", whose number can be
+ *    accessed by calling getCommandNumber()
+ *  - COMMAND_BENCHPALETTE: "benchpalette"
+ *  - COMMAND_UNKNOWN: anything else
  */
 int Console::executeInputCommand() {
     lines.push_back( new ConsoleLine( inputLine.c_str(), D3DXCOLOR( 1.0, 0.8, 0.0, 1.0 ), &time ) );
@@ -254,6 +291,47 @@ int Console::executeInputCommand() {
 
         // Return the COMMAND_SHOWMAPS signal
         return COMMAND_SHOWMAPS;
+    } else if ( strcmp( token, "recordframe" ) == 0 ) {
+        // if the command was recordframe, then the engine records the drawing
+        // calls of the next frame
+        return COMMAND_RECORDFRAME;
+    } else if ( strcmp( token, "benchcull" ) == 0 ) {
+        // if the command was benchcull, then the engine times the ways of
+        // frustum culling boxes
+        return COMMAND_BENCHCULL;
+    } else if ( strcmp( token, "outsidepvs" ) == 0 ) {
+        // if the command was outsidepvs, then the engine switches between
+        // drawing every cluster and using the nearest cluster's PVS when the
+        // camera is outside of the map
+        return COMMAND_OUTSIDEPVS;
+    } else if ( strcmp( token, "compactverts" ) == 0 ) {
+        // if the command was compactverts, then the engine switches whether
+        // the next map that is loaded uses compact vertices
+        return COMMAND_COMPACTVERTS;
+    } else if ( strcmp( token, "prefetch" ) == 0 ) {
+        // if the command was prefetch<megabytes>, then the engine changes how
+        // much memory the maps that are read ahead can use
+        return COMMAND_PREFETCH;
+    } else if ( strcmp( token, "benchmd2" ) == 0 ) {
+        // if the command was benchmd2, then the engine times the ways of
+        // blending the frames of an MD2 model
+        return COMMAND_BENCHMD2;
+    } else if ( strcmp( token, "compactmd2" ) == 0 ) {
+        // if the command was compactmd2, then the engine switches whether
+        // MD2 models keep their frames compressed
+        return COMMAND_COMPACTMD2;
+    } else if ( strcmp( token, "md2render" ) == 0 ) {
+        // if the command was md2render, then the engine switches the way
+        // that the monsters' models are drawn
+        return COMMAND_MD2RENDER;
+    } else if ( strcmp( token, "benchanim" ) == 0 ) {
+        // if the command was benchanim<instances>, then the engine times
+        // animating that many instances with each number of threads
+        return COMMAND_BENCHANIM;
+    } else if ( strcmp( token, "benchpalette" ) == 0 ) {
+        // if the command was benchpalette, then the engine times the ways of
+        // expanding palette images, and checks that they match
+        return COMMAND_BENCHPALETTE;
     }
 
 
@@ -74,10 +74,24 @@ class Console {
         /**
          * executeInputCommand() executes the input string as a command - this is
          * done when the user presses the Enter key.
-         * The return value is the type of command that the user input. For now,
-         * this can only be a new map, the command to show all maps, or an unknown
-         * command, and the engine can respond accordingly. When the "map<mapname>"
-         * command is used, the map name can be accessed by calling getMapName().
+         * The return value is the type of command that the user input, so that the
+         * engine can respond accordingly. It is one of:
+         *  - COMMAND_NEWMAP: "map <mapname>", whose map name can be accessed by
+         *    calling getMapName()
+         *  - COMMAND_SHOWMAPS: "showmaps", which prints the names of the maps
+         *  - COMMAND_RECORDFRAME: "recordframe"
+         *  - COMMAND_BENCHCULL: "benchcull"
+         *  - COMMAND_OUTSIDEPVS: "outsidepvs"
+         *  - COMMAND_COMPACTVERTS: "compactverts"
+         *  - COMMAND_PREFETCH: "prefetch <megabytes>", whose number can be
+         *    accessed by calling getCommandNumber()
+         *  - COMMAND_BENCHMD2: "benchmd2"
+         *  - COMMAND_COMPACTMD2: "compactmd2"
+         *  - COMMAND_MD2RENDER: "md2render"
+         *  - COMMAND_BENCHANIM: "benchanim <instances>", whose number can be
+         *    accessed by calling getCommandNumber()
+         *  - COMMAND_BENCHPALETTE: "benchpalette"
+         *  - COMMAND_UNKNOWN: anything else
          */
         int executeInputCommand();
 
@@ -101,6 +115,14 @@ class Console {
          */
         char *getMapName();
 
+        /**
+         * Returns the number after the last console command, or -1 if there
+         * wasn't one. This is called when the COMMAND_PREFETCH or
+         * COMMAND_BENCHANIM value is returned from the previous call to
+         * executeInputCommand().
+         */
+        int getCommandNumber();
+
 
         /**
          * This boolean is set to true if the console receives keyboard input,
@@ -118,6 +140,36 @@ class Console {
         // The command from the user was "showmaps"
         static const int COMMAND_SHOWMAPS = 2;
 
+        // The command from the user was "recordframe"
+        static const int COMMAND_RECORDFRAME = 3;
+
+        // The command from the user was "benchcull"
+        static const int COMMAND_BENCHCULL = 4;
+
+        // The command from the user was "outsidepvs"
+        static const int COMMAND_OUTSIDEPVS = 5;
+
+        // The command from the user was "compactverts"
+        static const int COMMAND_COMPACTVERTS = 6;
+
+        // The command from the user follows "prefetch <megabytes>"
+        static const int COMMAND_PREFETCH = 7;
+
+        // The command from the user was "benchmd2"
+        static const int COMMAND_BENCHMD2 = 8;
+
+        // The command from the user was "compactmd2"
+        static const int COMMAND_COMPACTMD2 = 9;
+
+        // The command from the user was "md2render"
+        static const int COMMAND_MD2RENDER = 10;
+
+        // The command from the user follows "benchanim <instances>"
+        static const int COMMAND_BENCHANIM = 11;
+
+        // The command from the user was "benchpalette"
+        static const int COMMAND_BENCHPALETTE = 12;
+
         // The maximum number of lines the console can contain.
         static const int MAX_CONSOLE_LINES = 40;
 
@@ -0,0 +1,112 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "D3D9RenderDevice.h"
+
+
+/**
+ * The D3D9RenderDevice methods just call the Direct3D device method (or the
+ * effect method) with the same name. The states and primitive types already
+ * have the values of the Direct3D enums, so they are only cast.
+ */
+void D3D9RenderDevice::setFVF( unsigned long fvf ) {
+    device->SetFVF( fvf );
+};
+
+void D3D9RenderDevice::setVertexDeclaration( RenderDeclaration declaration ) {
+    device->SetVertexDeclaration( declaration );
+};
+
+void D3D9RenderDevice::setStreamSource( unsigned int stream, RenderVertexBuffer buffer, unsigned int offset, unsigned int stride ) {
+    device->SetStreamSource( stream, buffer, offset, stride );
+};
+
+void D3D9RenderDevice::setStreamSourceFreq( unsigned int stream, unsigned int setting ) {
+    device->SetStreamSourceFreq( stream, setting );
+};
+
+void D3D9RenderDevice::setIndices( RenderIndexBuffer indices ) {
+    device->SetIndices( indices );
+};
+
+void D3D9RenderDevice::setRenderState( unsigned long state, unsigned long value ) {
+    device->SetRenderState( ( D3DRENDERSTATETYPE ) state, value );
+};
+
+void D3D9RenderDevice::setSamplerState( unsigned long sampler, unsigned long type, unsigned long value ) {
+    device->SetSamplerState( sampler, ( D3DSAMPLERSTATETYPE ) type, value );
+};
+
+void D3D9RenderDevice::setTexture( unsigned long stage, RenderTexture texture ) {
+    device->SetTexture( stage, texture );
+};
+
+void D3D9RenderDevice::setTransform( unsigned long state, const RenderMatrix *matrix ) {
+    device->SetTransform( ( D3DTRANSFORMSTATETYPE ) state, matrix );
+};
+
+void D3D9RenderDevice::getTransform( unsigned long state, RenderMatrix *matrix ) {
+    device->GetTransform( ( D3DTRANSFORMSTATETYPE ) state, matrix );
+};
+
+void D3D9RenderDevice::setLight( unsigned long index, const RenderLight *light ) {
+    device->SetLight( index, light );
+};
+
+void D3D9RenderDevice::lightEnable( unsigned long index, bool enable ) {
+    device->LightEnable( index, enable ? TRUE : FALSE );
+};
+
+
+void D3D9RenderDevice::drawPrimitive( unsigned int type, unsigned int startVertex, unsigned int primitiveCount ) {
+    device->DrawPrimitive( ( D3DPRIMITIVETYPE ) type, startVertex, primitiveCount );
+};
+
+void D3D9RenderDevice::drawIndexedPrimitive( unsigned int type, int baseVertex, unsigned int minVertex,
+                                             unsigned int numVertices, unsigned int startIndex, unsigned int primitiveCount ) {
+    device->DrawIndexedPrimitive( ( D3DPRIMITIVETYPE ) type, baseVertex, minVertex, numVertices, startIndex, primitiveCount );
+};
+
+
+unsigned int D3D9RenderDevice::beginEffect( RenderEffect *effect ) {
+    unsigned int passes = 0;
+    effect->Begin( &passes, 0 );
+
+    return passes;
+};
+
+void D3D9RenderDevice::beginPass( RenderEffect *effect, unsigned int pass ) {
+    effect->BeginPass( pass );
+};
+
+void D3D9RenderDevice::endPass( RenderEffect *effect ) {
+    effect->EndPass();
+};
+
+void D3D9RenderDevice::endEffect( RenderEffect *effect ) {
+    effect->End();
+};
+
+void D3D9RenderDevice::setEffectTexture( RenderEffect *effect, const char *name, RenderTexture texture ) {
+    effect->SetTexture( name, texture );
+};
+
+void D3D9RenderDevice::setEffectInt( RenderEffect *effect, const char *name, int value ) {
+    effect->SetInt( name, value );
+};
+
+void D3D9RenderDevice::setEffectFloat( RenderEffect *effect, const char *name, float value ) {
+    effect->SetFloat( name, value );
+};
+
+void D3D9RenderDevice::setEffectMatrix( RenderEffect *effect, const char *name, const RenderMatrix *matrix ) {
+    effect->SetMatrix( name, matrix );
+};
+
+void D3D9RenderDevice::commitChanges( RenderEffect *effect ) {
+    effect->CommitChanges();
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,76 @@
+//---------------------------------------------------------------------------
+
+#ifndef D3D9RenderDeviceH
+#define D3D9RenderDeviceH
+
+#include <windows.h>
+#include <DirectX/d3d9.h>
+#include <DirectX/d3dx9.h>
+
+#include "RenderDevice.h"
+
+
+/**
+ * The D3D9RenderDevice sends every call straight on to a Direct3D device. This
+ * is the RenderDevice that is used for drawing to the screen.
+ */
+class D3D9RenderDevice : public RenderDevice {
+    public:
+
+        /**
+         * Constructor that sends the calls to parameter device. The device can
+         * also be set later with setDevice().
+         */
+        D3D9RenderDevice( LPDIRECT3DDEVICE9 device = NULL ) {
+            this->device = device;
+        };
+
+        /**
+         * Sets the Direct3D device that the calls are sent to
+         */
+        void setDevice( LPDIRECT3DDEVICE9 device ) {
+            this->device = device;
+        };
+
+        /**
+         * Returns the Direct3D device that the calls are sent to
+         */
+        LPDIRECT3DDEVICE9 getDevice() {
+            return device;
+        };
+
+        void setFVF( unsigned long fvf );
+        void setVertexDeclaration( RenderDeclaration declaration );
+        void setStreamSource( unsigned int stream, RenderVertexBuffer buffer, unsigned int offset, unsigned int stride );
+        void setStreamSourceFreq( unsigned int stream, unsigned int setting );
+        void setIndices( RenderIndexBuffer indices );
+        void setRenderState( unsigned long state, unsigned long value );
+        void setSamplerState( unsigned long sampler, unsigned long type, unsigned long value );
+        void setTexture( unsigned long stage, RenderTexture texture );
+        void setTransform( unsigned long state, const RenderMatrix *matrix );
+        void getTransform( unsigned long state, RenderMatrix *matrix );
+        void setLight( unsigned long index, const RenderLight *light );
+        void lightEnable( unsigned long index, bool enable );
+
+        void drawPrimitive( unsigned int type, unsigned int startVertex, unsigned int primitiveCount );
+        void drawIndexedPrimitive( unsigned int type, int baseVertex, unsigned int minVertex,
+                                   unsigned int numVertices, unsigned int startIndex, unsigned int primitiveCount );
+
+        unsigned int beginEffect( RenderEffect *effect );
+        void beginPass( RenderEffect *effect, unsigned int pass );
+        void endPass( RenderEffect *effect );
+        void endEffect( RenderEffect *effect );
+        void setEffectTexture( RenderEffect *effect, const char *name, RenderTexture texture );
+        void setEffectInt( RenderEffect *effect, const char *name, int value );
+        void setEffectFloat( RenderEffect *effect, const char *name, float value );
+        void setEffectMatrix( RenderEffect *effect, const char *name, const RenderMatrix *matrix );
+        void commitChanges( RenderEffect *effect );
+
+    private:
+        // The Direct3D device that the calls are sent to
+        LPDIRECT3DDEVICE9 device;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
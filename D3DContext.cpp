@@ -49,6 +49,9 @@ void D3DContext::init( HWND hWnd, int width, int height ) {
                       &d3dpp,
                       &device);
 
+    // Send the drawing calls to the new device
+    renderDevice.setDevice( device );
+
     reset();
 
 };
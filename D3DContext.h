@@ -7,6 +7,8 @@
 #include <DirectX/d3d9.h>
 #include <DirectX/d3dx9.h>
 
+#include "D3D9RenderDevice.h"
+
 #pragma hdrstop
 
 
@@ -114,6 +116,15 @@ class D3DContext {
             return device;
         };
 
+        /**
+         * getRenderDevice() gives access to a RenderDevice that sends its calls
+         * to the DirectX device. The map, models and lights draw themselves with
+         * a RenderDevice, so that their drawing calls can also be recorded.
+         */
+        RenderDevice *getRenderDevice() {
+            return &renderDevice;
+        };
+
     private:
         /**
          * reset() simply resets all of DirectX's states and behaviours to the
@@ -137,6 +148,9 @@ class D3DContext {
         // The DirectX device, used for all of the rendering purposes.
         LPDIRECT3DDEVICE9 device;
 
+        // The RenderDevice that sends drawing calls to the DirectX device
+        D3D9RenderDevice renderDevice;
+
 };
 
 //---------------------------------------------------------------------------
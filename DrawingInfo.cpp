@@ -47,13 +47,13 @@ DrawingInfo::~DrawingInfo() {
  * about how the map was rendered so that information can be displayed
  * to the user later with the draw() call.
  */
-void DrawingInfo::drawMap( BSPMap *map ) {
+void DrawingInfo::drawMap( BSPMap *map, RenderDevice *device ) {
 
     // record the time going into renedering the BSP Map.
     unsigned int msStart = time->getTimeMillis();
 
     // Draw the map
-    map->draw( d3d->getDevice(), camera, this );
+    map->draw( device, camera, this );
 
 
     // get the number of milliseconds drawing the map took
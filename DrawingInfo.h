@@ -40,8 +40,9 @@ class DrawingInfo {
          * to the user later with the draw() call.
          *
          * map: The BSP map instance that this call renders
+         * device: The RenderDevice that the map is drawn with
          */
-        void drawMap( BSPMap *map );
+        void drawMap( BSPMap *map, RenderDevice *device );
 
         /**
          * This method takes the data collected earlier by the drawMap() method
@@ -78,7 +79,7 @@ class DrawingInfo {
          */
 
         // The Number of lines in the Drawing info
-        static const int NUM_RENDER_INFO_LINES = 5;
+        static const int NUM_RENDER_INFO_LINES = 6;
 
         // Tells the user that some percentages can exceed 100%
         static const int INFO_NOTE = 0;
@@ -94,6 +95,9 @@ class DrawingInfo {
         //  frames per second.
         static const int INFO_DRAWING_TIME = 4;
 
+        // Whether the camera is inside or outside of the map
+        static const int INFO_CAMERA_MODE = 5;
+
     private:
 
         // A pointer to the application's D3DContext object
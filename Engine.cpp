@@ -3,6 +3,10 @@
 #pragma hdrstop
 
 #include "Engine.h"
+#include "MD2Lerp.h"
+#include "PaletteExpand.h"
+
+#include <stdio.h>
 
 
 
@@ -14,17 +18,19 @@ Engine::Engine() {
     d3d = NULL;
 
     map = NULL;
+    nextMap = NULL;
     camera = NULL;
 
     hInput = NULL;
 
     material = NULL;
-    md2model = NULL;
 
     time = 0;
 
     // Default to NOT draw the sample MD2 Model
     animateModel = false;
+
+    recordFrame = false;
 };
 
 
@@ -33,21 +39,36 @@ Engine::Engine() {
  * releases the DirectX objects associated with the engine.
  */
 Engine::~Engine() {
-    if ( d3d != NULL ) {
-        delete d3d;
-    }
+    // Stop reading maps ahead before the maps and their textures are deleted
+    prefetcher.cancel();
+
     if ( map != NULL ) {
         delete map;
     }
+    if ( nextMap != NULL ) {
+        delete nextMap;
+    }
+
+    // Every map is gone, so the textures that they shared can go too
+    BSPMap::unloadTextureCache();
+
+    // The monsters' models go before the Direct3D device does
+    deleteMonsterInstances();
+    models.unload();
+    md2Renderer.unload();
+
+    // Nothing is reading out of the .pak files any more
+    FileSystem::getGameFiles()->unmountAll();
+
+    if ( d3d != NULL ) {
+        delete d3d;
+    }
     if ( camera != NULL ) {
         delete camera;
     }
     if ( material != NULL ) {
         delete material;
     }
-    if ( md2model != NULL ) {
-        delete md2model;
-    }
 };
 
 
@@ -61,29 +82,40 @@ void Engine::init( HWND hWnd, InputHandler *hInput, int screenWidth, int screenH
     // Set the link to the input handler
     this->hInput = hInput;
 
+    // Mount the game directory and the .pak files in it, so that every file
+    //  after this can be found
+    int numPaks = FileSystem::getGameFiles()->mountGame( "Q2" );
+
     // Create the direct3d context
     d3d = new D3DContext( hWnd, screenWidth, screenHeight );
 
+    // Pick the fastest way that this device can draw the monsters
+    md2Renderer.init( d3d->getDevice(), &md2Animator );
+
 
     // Setup the camera for viewing
     camera = new Camera();
 
-    // Load in a sample .md2 model, and set its animation to
-    //  the "idle" animation.
-    md2model = new MD2Model();
-    md2model->load( "Q2/models/monsters/soldier/", d3d->getDevice() );
-    //md2model->setAnimation( 18, 56 );
-
     // Initialise the Text-based parts of the screen (Console, drawing
     //  information, and map selector)
     console.init( d3d, screenWidth, screenHeight );
     drawInfo.init( d3d, camera, screenWidth, screenHeight );
     mapSelector.init( d3d, screenWidth, screenHeight );
 
+    char message[ 128 ];
+    sprintf( message, "Mounted Q2 with %d .pak files: %d files", numPaks, FileSystem::getGameFiles()->getNumFiles() );
+    console.printMessage( message, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+    // Load in the first map in Quake 2. There is no map to draw while it is
+    //  loading, so it isn't loaded in the background.
+    map = console.loadMap( "base1", camera );
+    mapName = "base1";
 
-    // Create the map object and load it in with the first map in Quake 2
-    map = new BSPMap();
-    switchMap( "base1" );
+    // Start reading ahead the maps that are likely to come next
+    prefetcher.start( mapName, map, &console );
+
+    // Give each of the map's monsters its own animated model
+    createMonsterInstances();
 
     // Initialise the material structure
     initLight();
@@ -139,6 +171,11 @@ void Engine::draw() {
 
     handleInput();
 
+    // Keep loading the next map, if there is one, and reading ahead the maps
+    //  after that
+    updateNextMap();
+    prefetcher.update();
+
     // Clear the screen before drawing
     d3d->clearScreen();
 
@@ -149,14 +186,26 @@ void Engine::draw() {
     camera->setupTransform( d3d->getDevice() );
 
 
-    // If the model is supposed to be animated, then update it.
-    if ( animateModel ) {
-        md2model->update( 0.016 );
+    // If the models are supposed to be animated, then update them. The
+    //  instances are split across the animator's threads.
+    if ( animateModel && !monsterInstances.empty() ) {
+        md2Animator.update( &monsterInstances[ 0 ], monsterInstances.size(), 0.016 );
     }
 
     rt.switchToRT( d3d->getDevice() );
 
 
+    // The world is drawn with the Direct3D context's RenderDevice. If this
+    // frame is to be recorded, then the drawing calls go through the recorder
+    // on their way to the screen.
+    RenderDevice *device = d3d->getRenderDevice();
+    if ( recordFrame ) {
+        recorder.clear();
+        recorder.setTarget( device );
+        device = &recorder;
+    }
+
+
     // Begin drawing the Direct3D scene
     d3d->getDevice()->BeginScene();
 
@@ -165,20 +214,40 @@ void Engine::draw() {
         if ( animateModel ) {
             vector< Entity::Monster * > *monsters = map->getMonsters();
 
-            for ( int i = 0; i < monsters->size(); ++i ) {
-                Point3f monsterOrigin = ( *monsters )[ i ]->getOrigin();
+            if ( md2Renderer.getPath() == MD2_RENDER_EACH ) {
+                // Each monster is lit by the lights around it
+                for ( unsigned int i = 0; i < monsters->size() && i < monsterInstances.size(); ++i ) {
+                    Point3f monsterOrigin = ( *monsters )[ i ]->getOrigin();
+
+                    //map->enableLights( d3d->getDevice(), getPoint( -camera->pos->x, -camera->pos->y, -camera->pos->z ) );
+                    //d3d->setupWorldTransform( -camera->pos->x, -camera->pos->y, -camera->pos->z, -camera->pos->ry, camera->pos->rx - 180, 0.0, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
+                    map->enableLights( device, getPoint( monsterOrigin.y, monsterOrigin.z, -monsterOrigin.x ) );
+                    d3d->setupWorldTransform( monsterOrigin.y, monsterOrigin.z, -monsterOrigin.x, 0, 0, 0, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
+                    monsterInstances[ i ]->render( device );
+                }
+            } else {
+                // The monsters are drawn together, so they share the lights
+                //  around the camera
+                map->enableLights( device, getPoint( -camera->pos->x, -camera->pos->y, -camera->pos->z ) );
+
+                for ( unsigned int i = 0; i < monsters->size() && i < monsterInstances.size(); ++i ) {
+                    Point3f monsterOrigin = ( *monsters )[ i ]->getOrigin();
 
-                //map->enableLights( d3d->getDevice(), getPoint( -camera->pos->x, -camera->pos->y, -camera->pos->z ) );
-                //d3d->setupWorldTransform( -camera->pos->x, -camera->pos->y, -camera->pos->z, -camera->pos->ry, camera->pos->rx - 180, 0.0, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
-                map->enableLights( d3d->getDevice(), getPoint( monsterOrigin.y, monsterOrigin.z, -monsterOrigin.x ) );
-                d3d->setupWorldTransform( monsterOrigin.y, monsterOrigin.z, -monsterOrigin.x, 0, 0, 0, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
-                md2model->render( d3d->getDevice() );
+                    D3DXMATRIX scale, world;
+                    D3DXMatrixScaling( &scale, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
+                    D3DXMatrixTranslation( &world, monsterOrigin.y, monsterOrigin.z, -monsterOrigin.x );
+                    D3DXMatrixMultiply( &world, &scale, &world );
+
+                    md2Renderer.add( monsterInstances[ i ], &world );
+                }
+
+                md2Renderer.render( device );
             }
         }
 
         // Draw the BSP map
         d3d->setupWorldTransform( 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
-        drawInfo.drawMap( map );
+        drawInfo.drawMap( map, device );
 
         // Draw the User interface
         d3d->setupWorldTransform( 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0 );
@@ -188,6 +257,21 @@ void Engine::draw() {
 
     d3d->getDevice()->EndScene();
 
+    // Save the recorded frame, and tell the user what it had in it
+    if ( recordFrame ) {
+        recordFrame = false;
+
+        if ( recorder.write( "frame.txt" ) ) {
+            char buf[ 128 ];
+            sprintf( buf, "Frame recorded to frame.txt: %d draw calls, %d instances, %d polygons, %d state changes.",
+                     recorder.getStats().drawCalls, recorder.getStats().instances,
+                     recorder.getStats().primitives, recorder.getStats().stateChanges );
+            console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+        } else {
+            console.printMessage( "Could not write frame.txt.", D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
+        }
+    }
+
     rt.switchToBB( d3d->getDevice() );
     d3d->clearScreen();
 
@@ -213,6 +297,10 @@ void Engine::draw() {
 
 };
 
+// The most time that each frame spends on the render tasks of the map that is
+//  being loaded, in milliseconds. A single task can take longer.
+const unsigned int MAP_LOAD_MILLIS_PER_FRAME = 4;
+
 // Some key codes for handleInput()
 const int KEY_TILDE = 192;
 const int KEY_SHIFT = 16;
@@ -288,6 +376,161 @@ void Engine::handleInput() {
                         // user that it was invalid.
                         console.printMessage( "Invalid map name.", D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
                     }
+                } else if ( commandType == Console::COMMAND_RECORDFRAME ) {
+
+                    // record the drawing calls of the next frame
+                    recordFrame = true;
+                } else if ( commandType == Console::COMMAND_BENCHCULL ) {
+
+                    // time the ways of frustum culling a large set of made-up leaves
+                    BoxCullBenchmark result;
+                    benchmarkBoxCull( 100000, 100, &result );
+
+                    char buf[ 256 ];
+                    sprintf( buf, "Culled 100000 boxes 100 times: %u ms plain, %u ms %s ( %d visible, %d mismatched )",
+                             result.scalarMillis, result.sseMillis,
+                             getBoxCullPath() == BOX_CULL_SSE ? "SSE" : "plain",
+                             result.numVisible, result.numMismatched );
+                    console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                } else if ( commandType == Console::COMMAND_BENCHPALETTE ) {
+
+                    // time expanding a 1024 by 1024 palette image 100 times with
+                    //  each path, and check each path's pixels against the plain loop
+                    PaletteExpandBenchmark result;
+                    benchmarkPaletteExpand( 1048576, 100, &result );
+
+                    for ( int p = 0; p < NUM_PALETTE_EXPAND_PATHS; ++p ) {
+                        char buf[ 256 ];
+
+                        if ( result.ran[ p ] ) {
+                            sprintf( buf, "Expanded 1048576 pixels 100 times with %s: %u ms ( %d pixels mismatched )",
+                                     getPaletteExpandPathName( ( PaletteExpandPath ) p ), result.millis[ p ],
+                                     result.numMismatched[ p ] );
+                        } else {
+                            sprintf( buf, "%s: not built in, or not supported by this CPU",
+                                     getPaletteExpandPathName( ( PaletteExpandPath ) p ) );
+                        }
+                        console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                    }
+                } else if ( commandType == Console::COMMAND_BENCHMD2 ) {
+
+                    // time the ways of blending two frames of an MD2 model, for
+                    //  models from small to very large. Every size blends the
+                    //  same number of corners in total.
+                    const int NUM_SIZES = 4;
+                    const int sizes[ NUM_SIZES ] = { 512, 2048, 8192, 32768 };
+
+                    for ( int i = 0; i < NUM_SIZES; ++i ) {
+                        MD2LerpBenchmark result;
+                        benchmarkMD2Lerp( sizes[ i ], 8388608 / sizes[ i ], &result );
+
+                        char buf[ 256 ];
+                        sprintf( buf, "Blended %d corners %d times: %u ms old loop, %u ms plain, %u ms %s ( max difference %g )",
+                                 sizes[ i ], 8388608 / sizes[ i ], result.aosMillis, result.scalarMillis, result.sseMillis,
+                                 getMD2LerpPath() == MD2_LERP_SCALAR ? "plain" : "SSE", result.maxDifference );
+                        console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+
+                        sprintf( buf, "  Compressed: %u ms plain, %u ms %s ( max difference %g )",
+                                 result.compressedScalarMillis, result.compressedSSEMillis,
+                                 getMD2LerpPath() == MD2_LERP_SSE2 ? "SSE2" : "plain", result.compressedDifference );
+                        console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                    }
+                } else if ( commandType == Console::COMMAND_COMPACTMD2 ) {
+
+                    // switch whether MD2 models keep their frames compressed,
+                    //  and load the models again so that the change shows
+                    MD2Model::useCompressedFrames = !MD2Model::useCompressedFrames;
+
+                    deleteMonsterInstances();
+                    models.unload();
+                    createMonsterInstances();
+
+                    char buf[ 128 ];
+                    sprintf( buf, "MD2 frames are %s: %d KB", MD2Model::useCompressedFrames ? "compressed" : "not compressed",
+                             models.getFrameBytes() / 1024 );
+                    console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                } else if ( commandType == Console::COMMAND_MD2RENDER ) {
+
+                    // switch to the next way of drawing the monsters, skipping
+                    //  instanced drawing if this device can't do it
+                    MD2RenderPath path = (MD2RenderPath) ( ( md2Renderer.getPath() + 1 ) % NUM_MD2_RENDER_PATHS );
+                    if ( !md2Renderer.setPath( path ) ) {
+                        md2Renderer.setPath( (MD2RenderPath) ( ( path + 1 ) % NUM_MD2_RENDER_PATHS ) );
+                    }
+
+                    char buf[ 128 ];
+                    sprintf( buf, "MD2 models are drawn with %s", MD2Renderer::getPathName( md2Renderer.getPath() ) );
+                    console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                } else if ( commandType == Console::COMMAND_BENCHANIM ) {
+
+                    // time animating and blending many instances of the soldier
+                    //  for 100 frames, without drawing them, with each number
+                    //  of threads up to one for each processor
+                    int numInstances = console.getCommandNumber();
+                    if ( numInstances <= 0 ) {
+                        numInstances = 1000;
+                    }
+
+                    MD2Model *model = models.acquire( "models/monsters/soldier/", d3d->getDevice() );
+                    if ( model != NULL ) {
+                        MD2AnimationBenchmark single;
+
+                        for ( int threads = 0; threads < TaskGraph::getNumProcessors(); ++threads ) {
+                            MD2AnimationBenchmark result;
+                            benchmarkMD2Animation( model, numInstances, 100, threads, &result );
+                            if ( threads == 0 ) {
+                                single = result;
+                            }
+
+                            char buf[ 256 ];
+                            sprintf( buf, "Animated %d instances 100 times on %d cores: %u ms, %.0f instances a second ( %.2fx )",
+                                     numInstances, threads + 1, result.millis, result.instancesPerSecond,
+                                     result.instancesPerSecond / single.instancesPerSecond );
+                            console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                        }
+
+                        models.release( model );
+                    } else {
+                        console.printMessage( "Could not load the soldier's model.", D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
+                    }
+                } else if ( commandType == Console::COMMAND_OUTSIDEPVS ) {
+
+                    // switch how the map is culled when the camera is outside of it
+                    map->outsideUsesNearestCluster = !map->outsideUsesNearestCluster;
+
+                    if ( map->outsideUsesNearestCluster ) {
+                        console.printMessage( "Outside of the map, the nearest cluster's PVS is used", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                    } else {
+                        console.printMessage( "Outside of the map, every cluster is drawn", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                    }
+                } else if ( commandType == Console::COMMAND_COMPACTVERTS ) {
+
+                    // switch whether maps keep their vertices as compact vertices.
+                    // The vertex buffer is only made when a map is loaded.
+                    BSPMap::useCompactVertices = !BSPMap::useCompactVertices;
+
+                    if ( BSPMap::useCompactVertices ) {
+                        console.printMessage( "Compact vertices will be used from the next map that is loaded", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                    } else {
+                        console.printMessage( "Full vertices will be used from the next map that is loaded", D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
+                    }
+                } else if ( commandType == Console::COMMAND_PREFETCH ) {
+
+                    // change how much memory the maps that are read ahead can
+                    // use, and read them ahead again with the new budget
+                    int megabytes = console.getCommandNumber();
+
+                    if ( megabytes >= 0 ) {
+                        MapPrefetcher::budgetMegabytes = megabytes;
+
+                        if ( nextMap == NULL ) {
+                            prefetcher.start( mapName, map, &console );
+                        }
+                    }
+
+                    char buf[ 128 ];
+                    sprintf( buf, "Maps are read ahead with up to %d MB", MapPrefetcher::budgetMegabytes );
+                    console.printMessage( buf, D3DXCOLOR( 1.0, 1.0, 1.0, 1.0 ) );
                 }
             }
         } else if ( mapSelector.hasFocus ) {
@@ -343,15 +586,126 @@ void Engine::handleInput() {
 };
 
 /**
- * Loads in the BSP map with the same name as parameter mapName
+ * Starts loading the BSP map with the same name as parameter mapName in the
+ * background. The current map is still drawn until the new map has finished
+ * loading. If another map was being loaded, it is cancelled.
  */
 void Engine::switchMap( string mapName ) {
-    // unload the current BSP map
-    console.unloadMap( map );
-    delete map;
 
-    // load in the new BSP Map
-    map = console.loadMap( mapName, camera );
+    // If that map is already being loaded, just let it carry on
+    if ( nextMap != NULL && nextMapName == mapName ) {
+        return;
+    }
+
+    // The prefetcher can't use the texture cache while a map is being loaded.
+    //  What it has already read in is kept, so the new map might use it.
+    prefetcher.cancel();
+    cancelNextMap();
+
+    // Start loading the new BSP map. If it isn't there, the current map stays,
+    //  and the maps after it are read ahead again.
+    nextMap = new BSPMap();
+    if ( !nextMap->startLoad( mapName, d3d, &console ) ) {
+        delete nextMap;
+        nextMap = NULL;
+
+        prefetcher.start( this->mapName, map, &console );
+        return;
+    }
+
+    nextMapName = mapName;
+};
+
+/**
+ * Stops loading the map that is being loaded in the background, if there is one
+ */
+void Engine::cancelNextMap() {
+    if ( nextMap == NULL ) {
+        return;
+    }
+
+    nextMap->cancelLoad();
+    delete nextMap;
+    nextMap = NULL;
+
+    console.printMessage( "Stopped loading " + nextMapName, D3DXCOLOR( 1.0, 0.0, 0.0, 1.0 ) );
+};
+
+/**
+ * Runs the render tasks of the map that is being loaded, for a part of the
+ * frame. Once the map has finished loading, it replaces the current map.
+ */
+void Engine::updateNextMap() {
+    if ( nextMap == NULL || !nextMap->updateLoad( MAP_LOAD_MILLIS_PER_FRAME ) ) {
+        return;
+    }
+
+    // Swap in the new map, and move the camera to its starting point
+    BSPMap *oldMap = map;
+    map = nextMap;
+    mapName = nextMapName;
+    nextMap = NULL;
+
+    map->placeCamera( camera );
+
+    // Now that nothing is drawing the old map, it can be deleted
+    if ( oldMap != NULL ) {
+        delete oldMap;
+    }
+
+    // The new map's monsters replace the old map's monsters
+    createMonsterInstances();
+
+    // Start reading ahead the maps that are likely to come after the new one
+    prefetcher.start( mapName, map, &console );
+};
+
+/**
+ * Makes an MD2Instance for every monster in the current map, and deletes the
+ * instances of the map before it
+ */
+void Engine::createMonsterInstances() {
+
+    // The old instances are only let go of once the new ones have been made,
+    //  so that the models that both maps use aren't loaded again
+    vector< MD2Instance * > oldInstances;
+    oldInstances.swap( monsterInstances );
+
+    // Every monster is drawn as a soldier for now
+    vector< Entity::Monster * > *monsters = map->getMonsters();
+
+    for ( unsigned int i = 0; i < monsters->size(); ++i ) {
+        MD2Model *model = models.acquire( "models/monsters/soldier/", d3d->getDevice() );
+        if ( model == NULL ) {
+            break;
+        }
+
+        // Start each monster at a different point of its animation, so that
+        //  they don't all move together
+        MD2Instance *instance = new MD2Instance( model );
+        instance->setFrame( i % model->getNumFrames() );
+
+        monsterInstances.push_back( instance );
+    }
+
+    for ( unsigned int i = 0; i < oldInstances.size(); ++i ) {
+        models.release( oldInstances[ i ]->getModel() );
+        delete oldInstances[ i ];
+    }
+
+    models.purgeUnused();
+};
+
+/**
+ * Deletes every monster's MD2Instance, and releases their models
+ */
+void Engine::deleteMonsterInstances() {
+    for ( unsigned int i = 0; i < monsterInstances.size(); ++i ) {
+        models.release( monsterInstances[ i ]->getModel() );
+        delete monsterInstances[ i ];
+    }
+
+    monsterInstances.clear();
 };
 
 //---------------------------------------------------------------------------
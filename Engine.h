@@ -15,12 +15,19 @@
 #include "Camera.h"
 
 #include "RenderTarget.h"
+#include "RecordingRenderDevice.h"
 
-// Include the header for the sample MD2 Model (for demonstrating the world lights)
+// Include the headers for the MD2 Models of the monsters (for demonstrating
+//  the world lights), and the cache that shares them
 #include "MD2.h"
+#include "MD2Cache.h"
+#include "MD2Renderer.h"
 
-// Include the header for the BSP Map class
+// Include the header for the BSP Map class, the class that reads the next
+//  maps ahead of time, and the file system that the game's files come from
 #include "BSPMap.h"
+#include "MapPrefetcher.h"
+#include "FileSystem.h"
 
 // Include the headers for the Console, MapSelector, and DrawingInfo classes.
 #include "UI.h"
@@ -71,10 +78,36 @@ class Engine {
 
     private:
         /**
-         * Loads in the BSP map with the same name as parameter mapName
+         * Starts loading the BSP map with the same name as parameter mapName in
+         * the background. The current map is still drawn until the new map has
+         * finished loading. If another map was being loaded, it is cancelled.
          */
         void switchMap( string mapName );
 
+        /**
+         * Stops loading the map that is being loaded in the background, if
+         * there is one
+         */
+        void cancelNextMap();
+
+        /**
+         * Runs the render tasks of the map that is being loaded, for a part of
+         * the frame. Once the map has finished loading, it replaces the current
+         * map.
+         */
+        void updateNextMap();
+
+        /**
+         * Makes an MD2Instance for every monster in the current map, and
+         * deletes the instances of the map before it
+         */
+        void createMonsterInstances();
+
+        /**
+         * Deletes every monster's MD2Instance, and releases their models
+         */
+        void deleteMonsterInstances();
+
 
         /**
          * Handles all keyboard and mouse interactions from the user
@@ -90,14 +123,30 @@ class Engine {
         // The DirectX handler object
         D3DContext *d3d;
 
-        // The bsp map object
+        // The bsp map object, and the name of its map
         BSPMap *map;
+        string mapName;
+
+        // The map that is being loaded in the background, and its name. It
+        //  replaces "map" once it has loaded.
+        BSPMap *nextMap;
+        string nextMapName;
+
+        // Reads ahead the maps that are likely to come after the current map
+        MapPrefetcher prefetcher;
 
         // The position of the player
         Camera *camera;
 
-        // A sample model to demonstrate world lighting
-        MD2Model *md2model;
+        // The MD2 models of the monsters, which demonstrate world lighting,
+        //  and an animated instance of a model for each monster in the map
+        MD2Cache models;
+        vector< MD2Instance * > monsterInstances;
+
+        // Moves the monsters' instances on and blends them, on every
+        //  processor, and draws them, together where it can
+        MD2Animator md2Animator;
+        MD2Renderer md2Renderer;
 
         // A link to the input handler instantiated in WinMain.cpp
         InputHandler *hInput;
@@ -109,6 +158,11 @@ class Engine {
         // Boolean for whether or not to draw the sample model
         bool animateModel;
 
+        // Records the drawing calls of a frame when the console's "recordframe"
+        //  command is used. recordFrame is true until that frame has been drawn.
+        RecordingRenderDevice recorder;
+        bool recordFrame;
+
         // The User interface objects, including the console, rendering info,
         //  and the map menu
         Console console;
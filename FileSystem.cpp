@@ -0,0 +1,485 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "FileSystem.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+
+// The file system that the game's files are loaded from
+FileSystem FileSystem::gameFiles;
+
+
+/**
+ * Constructor prepares the object so that a file can be opened.
+ */
+VirtualFile::VirtualFile() {
+    data = NULL;
+    size = 0;
+
+    memset( &writeTime, 0, sizeof( writeTime ) );
+};
+
+/**
+ * Destructor makes sure that the file has been closed.
+ */
+VirtualFile::~VirtualFile() {
+    close();
+};
+
+
+/**
+ * open() finds the file fileName (e.g. "maps/base1.bsp") in the game's
+ * file system, and maps it into memory. Returns false if the file
+ * could not be found or mapped, or if it is empty.
+ */
+bool VirtualFile::open( string fileName ) {
+    return FileSystem::getGameFiles()->open( fileName, this );
+};
+
+/**
+ * close() closes the file. Any pointers into the file are no longer
+ * valid after close() is called.
+ */
+void VirtualFile::close() {
+    looseFile.close();
+
+    data = NULL;
+    size = 0;
+    memset( &writeTime, 0, sizeof( writeTime ) );
+};
+
+/**
+ * touchPages() reads one byte from every page of the file, so that
+ * Windows reads the whole file into the system file cache.
+ */
+void VirtualFile::touchPages() {
+    const unsigned int PAGE_SIZE = 4096;
+
+    // The sum is kept in a volatile, so that the reads can't be left out
+    volatile unsigned char sum = 0;
+
+    for ( unsigned int offset = 0; offset < size && data != NULL; offset += PAGE_SIZE ) {
+        sum += data[ offset ];
+    }
+};
+
+
+/**
+ * Constructor prepares a file system with nothing mounted
+ */
+FileSystem::FileSystem() {
+    InitializeCriticalSection( &lock );
+};
+
+/**
+ * Destructor unmounts everything
+ */
+FileSystem::~FileSystem() {
+    unmountAll();
+
+    DeleteCriticalSection( &lock );
+};
+
+
+/**
+ * mountDirectory() adds every file under the directory dirName to the
+ * file system, below everything that was mounted before it. Returns
+ * false if the directory could not be found.
+ */
+bool FileSystem::mountDirectory( string dirName ) {
+    DWORD attributes = GetFileAttributes( dirName.c_str() );
+    if ( attributes == 0xFFFFFFFF || !( attributes & FILE_ATTRIBUTE_DIRECTORY ) ) {
+        return false;
+    }
+
+    EnterCriticalSection( &lock );
+
+    int mountNum = mounts.size();
+    mounts.push_back();
+    mounts[ mountNum ].name = dirName;
+    mounts[ mountNum ].pak = NULL;
+
+    addDirectory( mountNum, dirName, "" );
+
+    LeaveCriticalSection( &lock );
+
+    return true;
+};
+
+/**
+ * mountPak() maps the .pak file fileName into memory, and adds the
+ * files in its directory to the file system, below everything that
+ * was mounted before it. Returns false if the file could not be
+ * mapped, or isn't a valid .pak file.
+ */
+bool FileSystem::mountPak( string fileName ) {
+    MappedFile *pak = new MappedFile();
+
+    // The files in the .pak file are read in any order
+    if ( !pak->open( fileName, false ) || pak->getSize() < sizeof( PakHeader ) ) {
+        delete pak;
+        return false;
+    }
+
+    // Make sure that the directory lies inside of the file
+    PakHeader *header = ( PakHeader * ) pak->getData();
+    if ( header->magic != PAK_MAGIC ||
+         header->dirOffset < 0 || header->dirLength < 0 ||
+         ( unsigned int ) header->dirOffset > pak->getSize() ||
+         ( unsigned int ) header->dirLength > pak->getSize() - header->dirOffset ) {
+        delete pak;
+        return false;
+    }
+
+    PakDirEntry *dir = ( PakDirEntry * ) ( pak->getData() + header->dirOffset );
+    int numFiles = header->dirLength / sizeof( PakDirEntry );
+
+    EnterCriticalSection( &lock );
+
+    int mountNum = mounts.size();
+    mounts.push_back();
+    mounts[ mountNum ].name = fileName;
+    mounts[ mountNum ].pak = pak;
+
+    for ( int i = 0; i < numFiles; ++i ) {
+
+        // Leave out the files that don't lie inside of the .pak file
+        if ( dir[ i ].offset < 0 || dir[ i ].length < 0 ||
+             ( unsigned int ) dir[ i ].offset > pak->getSize() ||
+             ( unsigned int ) dir[ i ].length > pak->getSize() - dir[ i ].offset ) {
+            continue;
+        }
+
+        // The name doesn't have to end with a null character
+        int nameLength = 0;
+        while ( nameLength < PAK_NAME_SIZE && dir[ i ].name[ nameLength ] != '\0' ) {
+            ++nameLength;
+        }
+
+        string name( dir[ i ].name, nameLength );
+
+        addEntry( normalizeName( name ), mountNum, dir[ i ].offset, dir[ i ].length );
+    }
+
+    LeaveCriticalSection( &lock );
+
+    return true;
+};
+
+/**
+ * mountGame() mounts the game directory dirName, and then the .pak
+ * files in it, from pak9.pak down to pak0.pak, the same order that
+ * Quake 2 uses. Returns the number of .pak files that were mounted.
+ */
+int FileSystem::mountGame( string dirName ) {
+    mountDirectory( dirName );
+
+    int numPaks = 0;
+    char pakName[ 16 ];
+
+    for ( int i = MAX_GAME_PAKS - 1; i >= 0; --i ) {
+        sprintf( pakName, "/pak%d.pak", i );
+
+        if ( mountPak( dirName + pakName ) ) {
+            ++numPaks;
+        }
+    }
+
+    return numPaks;
+};
+
+/**
+ * unmountAll() takes every directory and .pak file out of the file
+ * system. Any files that were opened from the .pak files are no longer
+ * valid after unmountAll() is called.
+ */
+void FileSystem::unmountAll() {
+    EnterCriticalSection( &lock );
+
+    for ( unsigned int i = 0; i < mounts.size(); ++i ) {
+        if ( mounts[ i ].pak != NULL ) {
+            delete mounts[ i ].pak;
+        }
+    }
+
+    mounts.resize( 0 );
+    entries.resize( 0 );
+    table.resize( 0 );
+
+    LeaveCriticalSection( &lock );
+};
+
+
+/**
+ * open() opens the file fileName into "file". Returns false if the
+ * file isn't in the file system, or could not be mapped.
+ */
+bool FileSystem::open( string fileName, VirtualFile *file ) {
+    file->close();
+
+    string name = normalizeName( fileName );
+
+    // Copy what is needed out of the entry, so that the lock isn't held
+    //  while a loose file is opened
+    EnterCriticalSection( &lock );
+
+    int entryNum = find( name, hashName( name ) );
+    Mount mount;
+    unsigned int offset = 0;
+    unsigned int length = 0;
+
+    if ( entryNum >= 0 ) {
+        mount = mounts[ entries[ entryNum ].mountNum ];
+        offset = entries[ entryNum ].offset;
+        length = entries[ entryNum ].length;
+    }
+
+    LeaveCriticalSection( &lock );
+
+    if ( entryNum < 0 ) {
+        return false;
+    }
+
+    if ( mount.pak == NULL ) {
+        if ( !file->looseFile.open( mount.name + "/" + name, true ) ) {
+            return false;
+        }
+
+        file->data = file->looseFile.getData();
+        file->size = file->looseFile.getSize();
+        file->writeTime = file->looseFile.getWriteTime();
+    } else {
+
+        // Like a loose file, an empty file can't be opened
+        if ( length == 0 ) {
+            return false;
+        }
+
+        file->data = mount.pak->getData() + offset;
+        file->size = length;
+        file->writeTime = mount.pak->getWriteTime();
+    }
+
+    return true;
+};
+
+
+/**
+ * getWritePath() returns the path on disk that the file fileName should
+ * be written to, in the first directory that was mounted, and makes the
+ * directories that it goes in. Returns an empty string if no directory
+ * has been mounted.
+ */
+string FileSystem::getWritePath( string fileName ) {
+    string dirName;
+
+    EnterCriticalSection( &lock );
+
+    for ( unsigned int i = 0; i < mounts.size(); ++i ) {
+        if ( mounts[ i ].pak == NULL ) {
+            dirName = mounts[ i ].name;
+            break;
+        }
+    }
+
+    LeaveCriticalSection( &lock );
+
+    if ( dirName.empty() ) {
+        return dirName;
+    }
+
+    // The game's files can all be in .pak files, so the directories that the
+    //  file goes in might not be there yet
+    string name = normalizeName( fileName );
+    for ( string::size_type i = name.find( '/' ); i != string::npos; i = name.find( '/', i + 1 ) ) {
+        CreateDirectory( ( dirName + "/" + name.substr( 0, i ) ).c_str(), NULL );
+    }
+
+    return dirName + "/" + name;
+};
+
+/**
+ * addFile() adds the file fileName, which has just been written to
+ * getWritePath( fileName ), to the file system.
+ */
+void FileSystem::addFile( string fileName ) {
+    EnterCriticalSection( &lock );
+
+    for ( unsigned int i = 0; i < mounts.size(); ++i ) {
+        if ( mounts[ i ].pak == NULL ) {
+            addEntry( normalizeName( fileName ), i, 0, 0 );
+            break;
+        }
+    }
+
+    LeaveCriticalSection( &lock );
+};
+
+/**
+ * removeFile() deletes the file fileName from getWritePath( fileName ). It is
+ * still listed in the file system, but can't be opened until it has been
+ * written and added again. Returns false if there was no file to delete.
+ */
+bool FileSystem::removeFile( string fileName ) {
+    string path = getWritePath( fileName );
+
+    return !path.empty() && remove( path.c_str() ) == 0;
+};
+
+
+/**
+ * Returns fileName in lower case, with '/' between directories
+ */
+string FileSystem::normalizeName( string fileName ) {
+    for ( unsigned int i = 0; i < fileName.size(); ++i ) {
+        if ( fileName[ i ] == '\\' ) {
+            fileName[ i ] = '/';
+        } else {
+            fileName[ i ] = tolower( ( unsigned char ) fileName[ i ] );
+        }
+    }
+
+    return fileName;
+};
+
+/**
+ * Returns the hash of a normalized file name, using the FNV-1a hash
+ */
+unsigned int FileSystem::hashName( const string &name ) {
+    unsigned int hash = 2166136261u;
+
+    for ( unsigned int i = 0; i < name.size(); ++i ) {
+        hash ^= ( unsigned char ) name[ i ];
+        hash *= 16777619u;
+    }
+
+    return hash;
+};
+
+
+/**
+ * Returns the entry number of the file called "name", or -1 if the
+ * file isn't in the file system. The lock must be held.
+ */
+int FileSystem::find( const string &name, unsigned int hash ) {
+    if ( table.size() == 0 ) {
+        return -1;
+    }
+
+    unsigned int mask = table.size() - 1;
+
+    // Go through the slots starting at the name's hash, until an empty slot is found
+    for ( unsigned int slot = hash & mask; table[ slot ] >= 0; slot = ( slot + 1 ) & mask ) {
+        Entry &entry = entries[ table[ slot ] ];
+
+        // Only compare the names if their hashes are the same
+        if ( entry.hash == hash && entry.name == name ) {
+            return table[ slot ];
+        }
+    }
+
+    return -1;
+};
+
+/**
+ * Adds the file "name" from mount #mountNum, unless it is already in
+ * the file system from a mount that comes before it. The lock must
+ * be held.
+ */
+void FileSystem::addEntry( const string &name, int mountNum, unsigned int offset, unsigned int length ) {
+    unsigned int hash = hashName( name );
+    int entryNum = find( name, hash );
+
+    if ( entryNum >= 0 ) {
+        if ( entries[ entryNum ].mountNum <= mountNum ) {
+            return;
+        }
+    } else {
+        entryNum = entries.size();
+        entries.push_back();
+        entries[ entryNum ].name = name;
+        entries[ entryNum ].hash = hash;
+
+        // Make sure the hash table stays at most half full
+        if ( entries.size() * 2 > table.size() ) {
+            rebuildTable();
+        } else {
+            addToTable( entryNum );
+        }
+    }
+
+    entries[ entryNum ].mountNum = mountNum;
+    entries[ entryNum ].offset = offset;
+    entries[ entryNum ].length = length;
+};
+
+/**
+ * Puts entry #entryNum into the first empty slot after its hash
+ */
+void FileSystem::addToTable( int entryNum ) {
+    unsigned int mask = table.size() - 1;
+    unsigned int slot = entries[ entryNum ].hash & mask;
+
+    while ( table[ slot ] >= 0 ) {
+        slot = ( slot + 1 ) & mask;
+    }
+
+    table[ slot ] = entryNum;
+};
+
+/**
+ * Makes a new hash table that is big enough for every entry, and puts
+ * every entry into it
+ */
+void FileSystem::rebuildTable() {
+    unsigned int size = 1024;
+    while ( size < entries.size() * 2 ) {
+        size *= 2;
+    }
+
+    table.resize( size );
+    for ( unsigned int i = 0; i < size; ++i ) {
+        table[ i ] = -1;
+    }
+
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        addToTable( i );
+    }
+};
+
+
+/**
+ * Adds every file under the directory dirName, calling them "prefix"
+ * followed by their path in the directory. The lock must be held.
+ */
+void FileSystem::addDirectory( int mountNum, string dirName, string prefix ) {
+    WIN32_FIND_DATA findData;
+    HANDLE find = FindFirstFile( ( dirName + "/*" ).c_str(), &findData );
+
+    if ( find == INVALID_HANDLE_VALUE ) {
+        return;
+    }
+
+    do {
+        string name = findData.cFileName;
+
+        if ( name == "." || name == ".." ) {
+            continue;
+        }
+
+        if ( findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) {
+            addDirectory( mountNum, dirName + "/" + name, prefix + name + "/" );
+        } else {
+            addEntry( normalizeName( prefix + name ), mountNum, 0, 0 );
+        }
+    } while ( FindNextFile( find, &findData ) );
+
+    FindClose( find );
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
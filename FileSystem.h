@@ -0,0 +1,312 @@
+//---------------------------------------------------------------------------
+
+#ifndef FileSystemH
+#define FileSystemH
+
+#include <windows.h>
+#include <vector.h>
+#include <string>
+
+#include "MappedFile.h"
+
+using namespace std;
+
+
+// The identifying number at the start of every .pak file ("PACK")
+#define PAK_MAGIC ( ( 'K' << 24 ) + ( 'C' << 16 ) + ( 'A' << 8 ) + 'P' )
+
+// The length of a file name in the directory of a .pak file
+#define PAK_NAME_SIZE 56
+
+// The most .pak files that mountGame() looks for (pak0.pak up to pak9.pak)
+#define MAX_GAME_PAKS 10
+
+/**
+ * The header at the start of a .pak file. The directory is an array of
+ * PakDirEntry structures, dirLength bytes long, starting at dirOffset.
+ */
+typedef struct {
+    int magic;
+    int dirOffset;
+    int dirLength;
+} PakHeader;
+
+/**
+ * One file in the directory of a .pak file. The name is relative to the game
+ * directory (e.g. "textures/e1u1/floor1_1.wal"), and the file's bytes are
+ * stored uncompressed, "length" bytes starting at "offset".
+ */
+typedef struct {
+    char name[ PAK_NAME_SIZE ];
+    int offset;
+    int length;
+} PakDirEntry;
+
+
+/**
+ * A VirtualFile is a file that has been opened through the FileSystem. Its
+ * bytes are read-only, and come straight out of a mapped file: either the
+ * loose file itself, or the .pak file that holds it. Nothing is copied.
+ *
+ * The VirtualFile has to stay open for as long as anything is using its data.
+ */
+class VirtualFile {
+    public:
+
+        /**
+         * Constructor prepares the object so that a file can be opened.
+         */
+        VirtualFile();
+
+        /**
+         * Destructor makes sure that the file has been closed.
+         */
+        ~VirtualFile();
+
+        /**
+         * open() finds the file fileName (e.g. "maps/base1.bsp") in the game's
+         * file system, and maps it into memory. Returns false if the file
+         * could not be found or mapped, or if it is empty.
+         */
+        bool open( string fileName );
+
+        /**
+         * close() closes the file. Any pointers into the file are no longer
+         * valid after close() is called.
+         */
+        void close();
+
+        /**
+         * Returns true if a file is currently open
+         */
+        bool isOpen() {
+            return data != NULL;
+        };
+
+        /**
+         * Returns the first byte of the file, or NULL if no file is open.
+         * The data is read-only - it must never be written to.
+         */
+        unsigned char *getData() {
+            return data;
+        };
+
+        /**
+         * Returns the size of the file in bytes
+         */
+        unsigned int getSize() {
+            return size;
+        };
+
+        /**
+         * Returns the time that the file was last written to. A file in a
+         * .pak file has the time that the .pak file was written to.
+         */
+        FILETIME getWriteTime() {
+            return writeTime;
+        };
+
+        /**
+         * touchPages() reads one byte from every page of the file, so that
+         * Windows reads the whole file into the system file cache.
+         */
+        void touchPages();
+
+    private:
+        friend class FileSystem;
+
+        // A loose file is mapped by itself. A file in a .pak file points into
+        //  the .pak file's mapping, which the FileSystem keeps open.
+        MappedFile looseFile;
+
+        // The file's bytes, its size, and when it was last written to
+        unsigned char *data;
+        unsigned int size;
+        FILETIME writeTime;
+};
+
+
+/**
+ * An explanation on the file system:
+ *      Quake 2 keeps its files in .pak archives (pak0.pak holds nearly the
+ *  whole game), and lets loose files in the game directory take the place of
+ *  the ones in the archives. The FileSystem does the same. Directories and
+ *  .pak files are mounted in order, and a file that is in more than one of
+ *  them comes from the one that was mounted first.
+ *
+ *      Every file name is looked up in a hash table, which is built when the
+ *  directories and .pak files are mounted. The table holds every file in
+ *  every mount, so finding a file never touches the disk, and a file that
+ *  doesn't exist is known not to without trying to open it.
+ *
+ *      A .pak file is mapped into memory once, when it is mounted, and the
+ *  files in it are handed out as ranges of that mapping. A loose file is
+ *  mapped when it is opened.
+ *
+ *      File names are relative to the game directory, use '/', and don't
+ *  care about case (like Windows, and like the names in the .pak files).
+ *  Looking files up can be done from any thread.
+ */
+class FileSystem {
+    public:
+
+        /**
+         * Constructor prepares a file system with nothing mounted
+         */
+        FileSystem();
+
+        /**
+         * Destructor unmounts everything
+         */
+        ~FileSystem();
+
+        /**
+         * mountDirectory() adds every file under the directory dirName to the
+         * file system, below everything that was mounted before it. Returns
+         * false if the directory could not be found.
+         */
+        bool mountDirectory( string dirName );
+
+        /**
+         * mountPak() maps the .pak file fileName into memory, and adds the
+         * files in its directory to the file system, below everything that
+         * was mounted before it. Returns false if the file could not be
+         * mapped, or isn't a valid .pak file.
+         */
+        bool mountPak( string fileName );
+
+        /**
+         * mountGame() mounts the game directory dirName, and then the .pak
+         * files in it, from pak9.pak down to pak0.pak, the same order that
+         * Quake 2 uses. Returns the number of .pak files that were mounted.
+         */
+        int mountGame( string dirName );
+
+        /**
+         * unmountAll() takes every directory and .pak file out of the file
+         * system. Any files that were opened from the .pak files are no longer
+         * valid after unmountAll() is called.
+         */
+        void unmountAll();
+
+        /**
+         * open() opens the file fileName into "file". Returns false if the
+         * file isn't in the file system, or could not be mapped.
+         */
+        bool open( string fileName, VirtualFile *file );
+
+        /**
+         * getWritePath() returns the path on disk that the file fileName should
+         * be written to, in the first directory that was mounted, and makes the
+         * directories that it goes in. Returns an empty string if no directory
+         * has been mounted.
+         */
+        string getWritePath( string fileName );
+
+        /**
+         * addFile() adds the file fileName, which has just been written to
+         * getWritePath( fileName ), to the file system.
+         */
+        void addFile( string fileName );
+
+        /**
+         * removeFile() deletes the file fileName from getWritePath( fileName ).
+         * It is still listed in the file system, but can't be opened until it
+         * has been written and added again. Returns false if there was no file
+         * to delete.
+         */
+        bool removeFile( string fileName );
+
+        /**
+         * Returns the number of different files in the file system
+         */
+        int getNumFiles() {
+            return entries.size();
+        };
+
+        /**
+         * Returns the number of directories and .pak files that are mounted
+         */
+        int getNumMounts() {
+            return mounts.size();
+        };
+
+        /**
+         * Returns the file system that the game's files are loaded from
+         */
+        static FileSystem *getGameFiles() {
+            return &gameFiles;
+        };
+
+    private:
+
+        /**
+         * A mounted directory or .pak file. A directory has a NULL pak.
+         */
+        typedef struct {
+            string name;
+            MappedFile *pak;
+        } Mount;
+
+        /**
+         * A file in the file system, with the hash of its name, and the mount
+         * that it comes from. A file in a .pak file is "length" bytes starting
+         * at "offset" in the .pak file.
+         */
+        typedef struct {
+            string name;
+            unsigned int hash;
+            int mountNum;
+            unsigned int offset;
+            unsigned int length;
+        } Entry;
+
+        // Returns fileName in lower case, with '/' between directories
+        static string normalizeName( string fileName );
+
+        // Returns the hash of a normalized file name
+        static unsigned int hashName( const string &name );
+
+        // Returns the entry number of the file called "name", or -1 if the
+        //  file isn't in the file system. The lock must be held.
+        int find( const string &name, unsigned int hash );
+
+        // Adds the file "name" from mount #mountNum, unless it is already in
+        //  the file system from a mount that comes before it. The lock must
+        //  be held.
+        void addEntry( const string &name, int mountNum, unsigned int offset, unsigned int length );
+
+        // Puts entry #entryNum into the hash table
+        void addToTable( int entryNum );
+
+        // Makes a new hash table that is big enough for every entry, and puts
+        //  every entry into it
+        void rebuildTable();
+
+        // Adds every file under the directory dirName, calling them "prefix"
+        //  followed by their path in the directory. The lock must be held.
+        void addDirectory( int mountNum, string dirName, string prefix );
+
+        // The mounted directories and .pak files, in the order that they are
+        //  searched
+        vector< Mount > mounts;
+
+        // The files
+        vector< Entry > entries;
+
+        // The hash table. Each slot holds an entry number, or -1 if the slot is
+        //  empty. Its size is always a power of 2, and at least twice the
+        //  number of entries.
+        vector< int > table;
+
+        // Guards the entries and the table, since maps are loaded (and their
+        //  caches written) on worker threads
+        CRITICAL_SECTION lock;
+
+        // The file system that the game's files are loaded from
+        static FileSystem gameFiles;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
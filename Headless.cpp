@@ -0,0 +1,443 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "Headless.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <vector.h>
+
+#include "LightMapPacker.h"
+#include "BoxCull.h"
+#include "CompactVertex.h"
+#include "MD2Lerp.h"
+#include "MD2Animator.h"
+#include "MD2Cache.h"
+#include "MD2Renderer.h"
+#include "PaletteExpand.h"
+#include "BSPMap.h"
+#include "Camera.h"
+#include "Console.h"
+#include "FileSystem.h"
+#include "RecordingRenderDevice.h"
+#include "Timer.h"
+
+using namespace std;
+
+
+// The file that the results are written to, as well as stdout
+static FILE *resultFile = NULL;
+
+/**
+ * Prints a line of results, the same as printf()
+ */
+static void report( const char *format, ... ) {
+    va_list args;
+
+    va_start( args, format );
+    vprintf( format, args );
+    va_end( args );
+    printf( "\n" );
+
+    if ( resultFile != NULL ) {
+        va_start( args, format );
+        vfprintf( resultFile, format, args );
+        va_end( args );
+        fprintf( resultFile, "\n" );
+    }
+};
+
+/**
+ * Returns argument #i as a number, or "value" if there isn't one
+ */
+static int getNumber( int argc, char **argv, int i, int value ) {
+    if ( i < argc && argv[ i ][ 0 ] >= '0' && argv[ i ][ 0 ] <= '9' ) {
+        return atoi( argv[ i ] );
+    }
+
+    return value;
+};
+
+
+/**
+ * The tests. Each is given the arguments after its name, and returns true if
+ * it passed.
+ */
+
+// Packs random lightmap-sized rectangles, and checks that they don't overlap
+static bool testPackLightMaps( int argc, char **argv ) {
+    int numRects = getNumber( argc, argv, 0, 5000 );
+    int seed = getNumber( argc, argv, 1, 1 );
+
+    LightMapPackerTest result;
+    testLightMapPacker( numRects, seed, &result );
+
+    report( "Packed %d lightmaps into %d pages ( %.1f%% full )", numRects, result.numPages, 100.0 * result.occupancy );
+    report( "  %d not placed, %d off of their page, %d overlapping",
+            result.numFailed, result.numOutside, result.numOverlapping );
+
+    return result.numFailed == 0 && result.numOutside == 0 && result.numOverlapping == 0;
+};
+
+// Times each way of expanding palette images, and checks that every one makes
+//  exactly the same pixels as the plain loop
+static bool testBenchPalette( int argc, char **argv ) {
+    int numPixels = getNumber( argc, argv, 0, 1048576 );
+    int repeats = getNumber( argc, argv, 1, 100 );
+
+    PaletteExpandBenchmark result;
+    benchmarkPaletteExpand( numPixels, repeats, &result );
+
+    bool passed = true;
+    for ( int p = 0; p < NUM_PALETTE_EXPAND_PATHS; ++p ) {
+        const char *name = getPaletteExpandPathName( ( PaletteExpandPath ) p );
+
+        if ( result.ran[ p ] ) {
+            report( "Expanded %d pixels %d times with %s: %u ms ( %d pixels mismatched )",
+                    numPixels, repeats, name, result.millis[ p ], result.numMismatched[ p ] );
+            passed = passed && result.numMismatched[ p ] == 0;
+        } else {
+            report( "%s: not built in, or not supported by this CPU", name );
+        }
+    }
+
+    return passed;
+};
+
+// Times frustum culling random boxes with the plain loop and with the path
+//  that cullBoxes() uses, and checks that both find the same boxes
+static bool testBenchCull( int argc, char **argv ) {
+    int numBoxes = getNumber( argc, argv, 0, 100000 );
+    int repeats = getNumber( argc, argv, 1, 100 );
+
+    BoxCullBenchmark result;
+    benchmarkBoxCull( numBoxes, repeats, &result );
+
+    if ( getBoxCullPath() == BOX_CULL_SSE ) {
+        report( "Culled %d boxes %d times: %u ms plain, %u ms SSE", numBoxes, repeats, result.scalarMillis, result.sseMillis );
+    } else {
+        report( "Culled %d boxes %d times: %u ms plain ( SSE is not built in, or not supported by this CPU )",
+                numBoxes, repeats, result.scalarMillis );
+    }
+    report( "  %d visible, %d mismatched", result.numVisible, result.numMismatched );
+
+    return result.numMismatched == 0;
+};
+
+// Turns random vertices into compact vertices and back, and checks that they
+//  are within the error bounds, and that the axis-aligned normals are exact
+static bool testCompactVerts( int argc, char **argv ) {
+    int numVertices = getNumber( argc, argv, 0, 100000 );
+    int seed = getNumber( argc, argv, 1, 1 );
+
+    CompactVertexTest result;
+    testCompactVertices( numVertices, seed, &result );
+
+    report( "Compacted %d vertices: %d further off than the bounds, %d of the 6 axis normals not exact",
+            numVertices, result.numOverBound, result.numAxisMismatched );
+    report( "  Position off by %g ( bound %g ), normal by %g degrees ( bound %g )",
+            result.maxError.position, result.bound.position, result.maxError.normalDegrees, result.bound.normalDegrees );
+    report( "  Texture coordinates off by %g ( bound %g ), lightmap coordinates by %g ( bound %g )",
+            result.maxError.texCoord, result.bound.texCoord, result.maxError.lightMapCoord, result.bound.lightMapCoord );
+
+    return result.numOverBound == 0 && result.numAxisMismatched == 0;
+};
+
+// Times blending two frames of an MD2 model with the old loop, the plain loop
+//  and the path that lerpKeyFrames() uses, and checks that they all give the
+//  same vertices. The compressed paths are checked against lerpKeyFrames().
+static bool testBenchMD2( int argc, char **argv ) {
+    int numCorners = getNumber( argc, argv, 0, 8192 );
+    int repeats = getNumber( argc, argv, 1, 1024 );
+
+    MD2LerpBenchmark result;
+    benchmarkMD2Lerp( numCorners, repeats, &result );
+
+    if ( getMD2LerpPath() == MD2_LERP_SCALAR ) {
+        report( "Blended %d corners %d times: %u ms old loop, %u ms plain ( SSE is not built in, or not supported by this CPU )",
+                numCorners, repeats, result.aosMillis, result.scalarMillis );
+    } else {
+        report( "Blended %d corners %d times: %u ms old loop, %u ms plain, %u ms SSE",
+                numCorners, repeats, result.aosMillis, result.scalarMillis, result.sseMillis );
+    }
+    report( "  Compressed: %u ms plain, %u ms %s", result.compressedScalarMillis, result.compressedSSEMillis,
+            getMD2LerpPath() == MD2_LERP_SSE2 ? "SSE2" : "plain" );
+    report( "  Max difference from the plain loop: %g, compressed from lerpKeyFrames(): %g",
+            result.maxDifference, result.compressedDifference );
+
+    return result.maxDifference <= MD2_LERP_TOLERANCE && result.compressedDifference <= MD2_LERP_TOLERANCE;
+};
+
+// Loads the soldier without Direct3D, and times animating and blending many
+//  instances of it on 1 core up to every core, the same as the console's
+//  "benchanim"
+static bool testBenchAnim( int argc, char **argv ) {
+    int numInstances = getNumber( argc, argv, 0, 1000 );
+    int numFrames = getNumber( argc, argv, 1, 100 );
+
+    FileSystem::getGameFiles()->mountGame( "Q2" );
+
+    MD2Cache models;
+    MD2Model *model = models.acquire( "models/monsters/soldier/", NULL );
+    if ( model == NULL ) {
+        report( "The soldier's model could not be loaded" );
+
+        FileSystem::getGameFiles()->unmountAll();
+        return false;
+    }
+
+    report( "Loaded the soldier: %d frames, %d triangle corners", model->getNumFrames(), model->getNumCorners() );
+
+    MD2AnimationBenchmark single;
+    bool passed = true;
+
+    for ( int threads = 0; threads < TaskGraph::getNumProcessors(); ++threads ) {
+        MD2AnimationBenchmark result;
+        benchmarkMD2Animation( model, numInstances, numFrames, threads, &result );
+        if ( threads == 0 ) {
+            single = result;
+        }
+
+        report( "Animated %d instances %d times on %d cores: %u ms, %.0f instances a second ( %.2fx )",
+                numInstances, numFrames, threads + 1, result.millis, result.instancesPerSecond,
+                result.instancesPerSecond / single.instancesPerSecond );
+        passed = passed && result.instancesPerSecond > 0.0;
+    }
+
+    models.release( model );
+    models.unload();
+    FileSystem::getGameFiles()->unmountAll();
+
+    return passed;
+};
+
+// Loads the soldier without Direct3D, and draws many instances of it into a
+//  RecordingRenderDevice by themselves and as a CPU batch. Drawn by
+//  themselves, each instance takes one draw call; as a batch, the whole model
+//  takes one draw call (or as few as fit MD2_MAX_BATCH_PRIMITIVES).
+static bool testMD2Draw( int argc, char **argv ) {
+    int numInstances = getNumber( argc, argv, 0, 100 );
+
+    FileSystem::getGameFiles()->mountGame( "Q2" );
+
+    MD2Cache models;
+    MD2Model *model = models.acquire( "models/monsters/soldier/", NULL );
+    if ( model == NULL || model->getNumCorners() <= 0 ) {
+        report( "The soldier's model could not be loaded" );
+
+        models.unload();
+        FileSystem::getGameFiles()->unmountAll();
+        return false;
+    }
+
+    vector< MD2Instance * > instances;
+    instances.resize( numInstances );
+    for ( int i = 0; i < numInstances; ++i ) {
+        instances[ i ] = new MD2Instance( model );
+        instances[ i ]->setFrame( i % model->getNumFrames() );
+    }
+
+    MD2Animator animator;
+    MD2Renderer renderer;
+    renderer.init( NULL, &animator );
+
+    // The number of draw calls that a batch of every instance should take
+    int numTriangles = model->getNumCorners() / 3;
+    int instancesPerDraw = MD2_MAX_BATCH_PRIMITIVES / numTriangles;
+    if ( instancesPerDraw < 1 ) {
+        instancesPerDraw = 1;
+    }
+
+    const MD2RenderPath paths[ 2 ] = { MD2_RENDER_EACH, MD2_RENDER_CPU_BATCH };
+    const int expectedDraws[ 2 ] = { numInstances, ( numInstances + instancesPerDraw - 1 ) / instancesPerDraw };
+
+    RecordingRenderDevice recorder;
+    bool passed = true;
+
+    for ( int p = 0; p < 2; ++p ) {
+        renderer.setPath( paths[ p ] );
+
+        for ( int i = 0; i < numInstances; ++i ) {
+            D3DXMATRIX world;
+            D3DXMatrixTranslation( &world, ( float ) ( i % 32 ) * 64.0f, 0.0f, ( float ) ( i / 32 ) * 64.0f );
+            renderer.add( instances[ i ], &world );
+        }
+
+        recorder.clear();
+        int drawCalls = renderer.render( &recorder );
+        const RenderStats &stats = recorder.getStats();
+
+        report( "Drew %d soldiers with %s: %d draw calls, %d primitives ( expected %d draw calls, %d primitives )",
+                numInstances, MD2Renderer::getPathName( paths[ p ] ), stats.drawCalls, stats.primitives,
+                expectedDraws[ p ], numInstances * numTriangles );
+
+        passed = passed && drawCalls == expectedDraws[ p ] && stats.drawCalls == expectedDraws[ p ] &&
+                 stats.primitives == numInstances * numTriangles;
+    }
+
+    report( "  Instanced drawing needs a Direct3D device, so it isn't checked" );
+
+    for ( int i = 0; i < numInstances; ++i ) {
+        delete instances[ i ];
+    }
+
+    renderer.unload();
+    models.release( model );
+    models.unload();
+    FileSystem::getGameFiles()->unmountAll();
+
+    return passed;
+};
+
+// Loads a map without Direct3D, and draws one frame of it from where the
+//  player starts into a RecordingRenderDevice. The frame's culling and drawing
+//  calls are all run, but nothing is drawn.
+static bool testRecordFrame( int argc, char **argv ) {
+    const char *mapName = argc > 0 ? argv[ 0 ] : "base1";
+
+    int numPaks = FileSystem::getGameFiles()->mountGame( "Q2" );
+    report( "Mounted Q2 with %d .pak files: %d files", numPaks, FileSystem::getGameFiles()->getNumFiles() );
+
+    // The console isn't drawn, it only keeps what the map tells it
+    Console console;
+    Camera camera;
+    BSPMap *map = new BSPMap();
+
+    if ( !map->load( mapName, NULL, &camera, &console ) ) {
+        report( "Map %s could not be loaded", mapName );
+
+        delete map;
+        FileSystem::getGameFiles()->unmountAll();
+        return false;
+    }
+
+    // The same transforms that the Engine draws the map with, on a 4:3 screen
+    RecordingRenderDevice recorder;
+    D3DXMATRIX proj, world;
+
+    D3DXMatrixPerspectiveFovLH( &proj, D3DXToRadian( 80.0f ), 4.0f / 3.0f, 0.001f, 9.0f );
+    D3DXMatrixScaling( &world, BSP::MAP_SCALE, BSP::MAP_SCALE, BSP::MAP_SCALE );
+
+    recorder.setTransform( D3DTS_PROJECTION, &proj );
+    recorder.setTransform( D3DTS_WORLD, &world );
+    camera.setupTransform( &recorder );
+
+    // Only the map's own calls are counted
+    recorder.clear();
+
+    Timer timer;
+    unsigned int start = timer.getTimeMillis();
+
+    map->draw( &recorder, &camera, NULL );
+
+    unsigned int millis = timer.getTimeMillis() - start;
+    const RenderStats &stats = recorder.getStats();
+
+    report( "Drew %s from the player start in %u ms: %d draw calls, %d primitives",
+            mapName, millis, stats.drawCalls, stats.primitives );
+    report( "  %d commands, %d state changes ( %d redundant ), %d texture binds",
+            stats.commands, stats.stateChanges, stats.redundantStates, stats.textureBinds );
+
+    if ( recorder.write( "frame.txt" ) ) {
+        report( "  The frame's calls were written to frame.txt" );
+    }
+
+    bool passed = stats.drawCalls > 0 && stats.primitives > 0;
+
+    delete map;
+    BSPMap::unloadTextureCache();
+    FileSystem::getGameFiles()->unmountAll();
+
+    return passed;
+};
+
+
+/**
+ * A test that can be run, with its name and its arguments
+ */
+typedef struct {
+    const char *name;
+    bool ( *run )( int argc, char **argv );
+    const char *usage;
+} HeadlessTest;
+
+static const HeadlessTest HEADLESS_TESTS[] = {
+    { "packlightmaps", testPackLightMaps, "packlightmaps [rectangles] [seed]" },
+    { "benchpalette", testBenchPalette, "benchpalette [pixels] [repeats]" },
+    { "benchcull", testBenchCull, "benchcull [boxes] [repeats]" },
+    { "compactverts", testCompactVerts, "compactverts [vertices] [seed]" },
+    { "benchmd2", testBenchMD2, "benchmd2 [corners] [repeats]" },
+    { "benchanim", testBenchAnim, "benchanim [instances] [frames]" },
+    { "md2draw", testMD2Draw, "md2draw [instances]" },
+    { "recordframe", testRecordFrame, "recordframe [map]" }
+};
+
+static const int NUM_HEADLESS_TESTS = sizeof( HEADLESS_TESTS ) / sizeof( HEADLESS_TESTS[ 0 ] );
+
+
+/**
+ * isHeadless() returns true if the command line asks for a headless test
+ */
+bool isHeadless( const char *commandLine ) {
+    return commandLine != NULL && strncmp( commandLine, "-headless", 9 ) == 0;
+};
+
+/**
+ * runHeadless() runs the test named on the command line, and returns the exit
+ * code for the application
+ */
+int runHeadless( const char *commandLine ) {
+
+    // Split the command line into words. The first is "-headless".
+    vector< char > line;
+    vector< char * > words;
+
+    line.resize( strlen( commandLine ) + 1 );
+    strcpy( &line[ 0 ], commandLine );
+
+    for ( char *word = strtok( &line[ 0 ], " \t" ); word != NULL; word = strtok( NULL, " \t" ) ) {
+        words.push_back( word );
+    }
+
+    resultFile = fopen( "headless.txt", "w" );
+
+    int argc = words.size() - 2;
+    char **argv = argc > 0 ? &words[ 2 ] : NULL;
+    bool runAll = words.size() >= 2 && strcmp( words[ 1 ], "all" ) == 0;
+    bool found = false;
+    bool passed = true;
+
+    for ( int i = 0; i < NUM_HEADLESS_TESTS; ++i ) {
+        if ( runAll ) {
+            report( "%s:", HEADLESS_TESTS[ i ].name );
+            passed = HEADLESS_TESTS[ i ].run( 0, NULL ) && passed;
+            found = true;
+        } else if ( words.size() >= 2 && strcmp( words[ 1 ], HEADLESS_TESTS[ i ].name ) == 0 ) {
+            passed = HEADLESS_TESTS[ i ].run( argc, argv );
+            found = true;
+        }
+    }
+
+    if ( !found ) {
+        report( "Usage: -headless <test> [arguments], where the test is \"all\" or one of:" );
+        for ( int i = 0; i < NUM_HEADLESS_TESTS; ++i ) {
+            report( "  %s", HEADLESS_TESTS[ i ].usage );
+        }
+        passed = false;
+    } else {
+        report( passed ? "PASSED" : "FAILED" );
+    }
+
+    if ( resultFile != NULL ) {
+        fclose( resultFile );
+        resultFile = NULL;
+    }
+
+    return passed ? 0 : 1;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
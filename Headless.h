@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------
+
+#ifndef HeadlessH
+#define HeadlessH
+
+
+/**
+ * An explanation on running without a window:
+ *      Starting the application with
+ *          Quake2.exe -headless <test> [arguments]
+ *  runs one of the tests or benchmarks below, and then exits. No window or
+ *  Direct3D device is made, so it can be run on a build machine. What the test
+ *  found is printed to stdout and written to headless.txt, and the exit code is
+ *  0 if the test passed or 1 if it failed, so that a build can check it.
+ *  "-headless all" runs every test with its default arguments.
+ *
+ *  The tests:
+ *   - packlightmaps [rectangles] [seed]: packs random lightmap-sized
+ *     rectangles into pages, and checks that none of them overlap
+ *   - benchpalette [pixels] [repeats]: times each way of expanding palette
+ *     images, and checks that they all make the same pixels
+ *   - benchcull [boxes] [repeats]: times frustum culling random boxes with
+ *     the plain loop and with SSE, and checks that both find the same boxes
+ *   - compactverts [vertices] [seed]: turns random vertices into compact
+ *     vertices and back, and checks that they are within their error bounds
+ *     and that the normals along the axes come back exactly
+ *   - benchmd2 [corners] [repeats]: times each way of blending two frames of
+ *     an MD2 model, and checks that they all give the same vertices
+ *   - benchanim [instances] [frames]: loads the soldier without Direct3D, and
+ *     times animating that many of it on 1 core up to every core. Needs the
+ *     Q2 directory.
+ *   - md2draw [instances]: draws that many soldiers into a
+ *     RecordingRenderDevice, each by itself and then as one CPU batch, and
+ *     checks that the batch takes one draw call. Needs the Q2 directory.
+ *   - recordframe [map]: loads a map (base1 if none is given) without
+ *     Direct3D, draws a frame of it into a RecordingRenderDevice, and tells
+ *     how many draw calls and primitives it took. Needs the Q2 directory.
+ */
+
+/**
+ * isHeadless() returns true if the command line asks for a headless test
+ */
+bool isHeadless( const char *commandLine );
+
+/**
+ * runHeadless() runs the test named on the command line, and returns the exit
+ * code for the application
+ */
+int runHeadless( const char *commandLine );
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -20,9 +20,9 @@ namespace D3D {
     /**
      * enable() method tells the Direct3D device to use this light
      */
-    void Light::enable( LPDIRECT3DDEVICE9 device, int lightNum ) {
-        device->SetLight( lightNum, &light );    // send the light struct properties to light #lightNum
-        device->LightEnable( lightNum, TRUE );    // turn on light #lightNum
+    void Light::enable( RenderDevice *device, int lightNum ) {
+        device->setLight( lightNum, &light );    // send the light struct properties to light #lightNum
+        device->lightEnable( lightNum, TRUE );    // turn on light #lightNum
 
         d3dLightNum = lightNum;
     };
@@ -31,15 +31,15 @@ namespace D3D {
      * Sends the light's information to Direct3D, updating any changes
      * the application has made to this light
      */
-    void Light::refresh( LPDIRECT3DDEVICE9 device ) {
-        device->SetLight( d3dLightNum, &light );    // send the light struct properties to light #lightNum
+    void Light::refresh( RenderDevice *device ) {
+        device->setLight( d3dLightNum, &light );    // send the light struct properties to light #lightNum
     };
 
     /**
      * disable() method tells Direct3D to stop using this light
      */
-    void Light::disable( LPDIRECT3DDEVICE9 device ) {
-        device->LightEnable( d3dLightNum, FALSE );
+    void Light::disable( RenderDevice *device ) {
+        device->lightEnable( d3dLightNum, FALSE );
     };
 
     /**
@@ -5,6 +5,8 @@
 
 #include <DirectX/d3d9.h>
 
+#include "RenderDevice.h"
+
 #pragma hdrstop
 
 // The Light class is an object to add abstraction to a Direct3D object, and is
@@ -38,18 +40,18 @@ namespace D3D {
             /**
              * enable() method tells the Direct3D device to use this light
              */
-            void enable( LPDIRECT3DDEVICE9 device, int lightNum );
+            void enable( RenderDevice *device, int lightNum );
 
             /**
              * disable() method tells Direct3D to stop using this light
              */
-            void disable( LPDIRECT3DDEVICE9 device );
+            void disable( RenderDevice *device );
 
             /**
              * Sends the light's information to Direct3D, updating any changes
              * the application has made to this light
              */
-            void refresh( LPDIRECT3DDEVICE9 device );
+            void refresh( RenderDevice *device );
 
             /**
              * Returns a pointer to the Direct3D light object so the programmer can
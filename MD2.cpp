@@ -3,6 +3,11 @@
 #pragma hdrstop
 
 #include "MD2.h"
+#include "FileSystem.h"
+#include "MD2Lerp.h"
+
+#include <string.h>
+#include <limits.h>
 
 
 /**
@@ -19,12 +24,18 @@ Vector3 MD2Model::normals[ 162 ] = {
     #include    "anorms.h"
 };
 
+// Whether models that are loaded from now on keep their frames compressed
+bool MD2Model::useCompressedFrames = false;
+
 
 MD2Model::MD2Model() {
     vertexBuffer = NULL;
     skin = NULL;
-    frameNum = 0;
     normalVertexBuffer = NULL;
+    frameTexture = NULL;
+    cornerBuffer = NULL;
+    cornerIndices = NULL;
+    compressed = useCompressedFrames;
 
 };
 
@@ -37,16 +48,69 @@ MD2Model::~MD2Model() {
 
 
 
+/**
+ * Returns true if "count" items of "size" bytes each take up no more bytes
+ * than an int can count
+ */
+static bool fitsInInt( int count, int size ) {
+    return count >= 0 && count <= INT_MAX / size;
+};
+
+/**
+ * Returns true if "length" bytes starting at "offset" lie inside of a file
+ * that is fileSize bytes long
+ */
+static bool fitsInFile( unsigned int fileSize, int offset, int length ) {
+    return offset >= 0 && length >= 0 && ( unsigned int ) offset <= fileSize &&
+           ( unsigned int ) length <= fileSize - offset;
+};
+
+
+/**
+ * load() reads in the model in the directory "fileName". With a NULL device,
+ * only the frames, triangles and texture coordinates are kept, for blending
+ * on the CPU; no skin or vertex buffer is made.
+ */
 bool MD2Model::load( string fileName, LPDIRECT3DDEVICE9 device ) {
-    FILE *fh = 0;
+    VirtualFile file;
 
-    if ( ( fh = fopen( ( fileName + string( "tris.md2" ) ).c_str(), "rb" ) ) == NULL ) {
+    // The model is read straight out of the mapped file (or .pak file)
+    if ( !file.open( fileName + string( "tris.md2" ) ) || file.getSize() < sizeof( MD2Header ) ) {
         return false;
     }
 
+    unsigned char *data = file.getData();
+
     // Read in the header
-    fseek( fh, 0, 0 );
-    fread( &header, sizeof( MD2Header ), 1, fh );
+    memcpy( &header, data, sizeof( MD2Header ) );
+
+    // Make sure that the file is an MD2 model, and that it has something to
+    //  draw and animate
+    if ( memcmp( header.ident, "IDP2", 4 ) != 0 || header.version != 8 ||
+         header.numFrames <= 0 || header.numTriangles <= 0 ||
+         header.numVertices <= 0 || header.numTextureCoords <= 0 ) {
+        return false;
+    }
+
+    // Make sure that the sizes of the parts can be counted without
+    //  overflowing, and that every part of the model lies inside of the file
+    int frameHeaderSize = sizeof( float ) * 6 + sizeof( char ) * 16;
+    if ( header.numVertices > ( INT_MAX - frameHeaderSize ) / ( int ) sizeof( MD2Vertex ) ) {
+        return false;
+    }
+
+    int frameSize = frameHeaderSize + sizeof( MD2Vertex ) * header.numVertices;
+    if ( !fitsInInt( header.numTriangles, sizeof( Triangle ) ) ||
+         !fitsInInt( header.numTextureCoords, sizeof( TexCoord ) ) ||
+         !fitsInInt( header.numFrames, frameSize ) ) {
+        return false;
+    }
+
+    if ( !fitsInFile( file.getSize(), header.triangleOffset, header.numTriangles * sizeof( Triangle ) ) ||
+         !fitsInFile( file.getSize(), header.texCoordOffset, header.numTextureCoords * sizeof( TexCoord ) ) ||
+         !fitsInFile( file.getSize(), header.frameOffset, header.numFrames * frameSize ) ) {
+        return false;
+    }
 
     // Resize the MD2Frame array
     frames.resize( header.numFrames );
@@ -56,46 +120,52 @@ bool MD2Model::load( string fileName, LPDIRECT3DDEVICE9 device ) {
     }
 
     triangles.resize( header.numTriangles );
-    fseek( fh, header.triangleOffset, 0 );
-    fread( &triangles[ 0 ], header.numTriangles * sizeof( Triangle ), 1, fh );
-
-    texCoords.resize( header.numTextureCoords );
-    fseek( fh, header.texCoordOffset, 0 );
-    fread( &texCoords[ 0 ], header.numTextureCoords * sizeof( TexCoord ), 1, fh );
+    memcpy( &triangles[ 0 ], data + header.triangleOffset, header.numTriangles * sizeof( Triangle ) );
 
-    vector< Skin > skinNames;
-    skinNames.resize( header.numSkins );
-    fseek( fh, header.skinOffset, 0 );
-    fread( &skinNames[ 0 ], header.numSkins * sizeof( Skin ), 1, fh );
+    // Every corner of every triangle has to point at a vertex and a texture
+    //  coordinate that the model has
+    for ( int t = 0; t < header.numTriangles; ++t ) {
+        for ( int j = 0; j < 3; ++j ) {
+            if ( triangles[ t ].vertexIndex[ j ] < 0 || triangles[ t ].vertexIndex[ j ] >= header.numVertices ||
+                 triangles[ t ].texCoordIndex[ j ] < 0 || triangles[ t ].texCoordIndex[ j ] >= header.numTextureCoords ) {
+                return false;
+            }
+        }
+    }
 
+    texCoords.resize( header.numTextureCoords );
+    memcpy( &texCoords[ 0 ], data + header.texCoordOffset, header.numTextureCoords * sizeof( TexCoord ) );
 
+    // Without a device (a headless benchmark) only the frames are kept, for
+    //  blending on the CPU
     skins.resize( 1 );
-    skins[0].loadImage( ( fileName + string( "skin.pcx" ) ).c_str(), device );
+    if ( device != NULL ) {
+        skins[0].loadImage( ( fileName + string( "skin.pcx" ) ).c_str(), device );
+    }
 
     // Read in the frames
-    fseek( fh, header.frameOffset, 0 );
+    unsigned char *frameData = data + header.frameOffset;
 
     for (int i = 0; i < header.numFrames; ++i) {
         MD2Frame* f = &frames[ i ];
 
-        fread( f->scale, sizeof( float ) * 3, 1, fh );
-        fread( f->translate, sizeof( float ) * 3, 1, fh );
-        fread( f->name, sizeof( char ) * 16, 1, fh );
-        fread( &f->MD2verts[0], sizeof( MD2Vertex ) * header.numVertices, 1, fh );
-    }
+        memcpy( f->scale, frameData, sizeof( float ) * 3 );
+        memcpy( f->translate, frameData + sizeof( float ) * 3, sizeof( float ) * 3 );
+        memcpy( f->name, frameData + sizeof( float ) * 6, sizeof( char ) * 16 );
+        memcpy( &f->MD2verts[0], frameData + sizeof( float ) * 6 + sizeof( char ) * 16, sizeof( MD2Vertex ) * header.numVertices );
 
-    generateBuffers( device );
-    reorganizeVertices();
+        // Every vertex's normal has to be in the table of normals
+        for ( int v = 0; v < header.numVertices; ++v ) {
+            if ( f->MD2verts[ v ].lightNormalIndex >= 162 ) {
+                return false;
+            }
+        }
 
-    if ( fh ) {
-        fclose( fh );
+        frameData += frameSize;
     }
 
-    interpolation = 0.0f;
-    frameNum = 0;
-
-    startFrame = 0;
-    endFrame = header.numFrames - 1;
+    generateBuffers( device );
+    reorganizeVertices();
 
     //loadTexture( skinName, device );
 
@@ -103,6 +173,10 @@ bool MD2Model::load( string fileName, LPDIRECT3DDEVICE9 device ) {
 };
 
 void MD2Model::generateBuffers( LPDIRECT3DDEVICE9 device ) {
+    if ( device == NULL ) {
+        return;
+    }
+
     device->CreateVertexBuffer(sizeof(D3DMD2Vertex) * triangles.size() * 3,
                                0,                               MD2FVF,
                                D3DPOOL_MANAGED,
@@ -130,93 +204,113 @@ void MD2Model::unloadTexture( LPDIRECT3DDEVICE9 device ) {
 };
 
 void MD2Model::deleteBuffers( void ) {
-    vertexBuffer->Release();
-};
-
-const float SIZE_SCALE = 1.0f;
-
-void MD2Model::update( float dt ) {
-
-    interpolation += dt * ANIMATION_FPS;
-
-    if ( interpolation > 1.0 ) {
-        frameNum = nextFrame;
-        nextFrame++;
-        interpolation = 0.0f;
+    // A model that failed to load never made its vertex buffer
+    if ( vertexBuffer != NULL ) {
+        vertexBuffer->Release();
+        vertexBuffer = NULL;
     }
 
-
-    //nextFrame = frameNum + 1;
-    if ( nextFrame > endFrame ) {
-        nextFrame = startFrame;
+    if ( frameTexture != NULL ) {
+        frameTexture->Release();
+        frameTexture = NULL;
     }
+    if ( cornerBuffer != NULL ) {
+        cornerBuffer->Release();
+        cornerBuffer = NULL;
+    }
+    if ( cornerIndices != NULL ) {
+        cornerIndices->Release();
+        cornerIndices = NULL;
+    }
+};
 
-    VOID* pVoid;
-
-    vertexBuffer->Lock(0, 0, (void **)&pVoid, 0);    // locks v_buffer, the buffer we made earlier
-
-    D3DMD2Vertex *vCopy = (D3DMD2Vertex *) pVoid;
-
-    for ( unsigned int i = 0; i < triangles.size(); ++i ) {
-        for ( int j = 0; j < 3; ++j ) {
-            float v1, v2;
+int MD2Model::getFrameBytes() {
+    int bytes = 0;
 
-            v1 = frames[frameNum].verts[i * 3 + j].y;
-            v2 = frames[nextFrame].verts[i * 3 + j].y;
-            vCopy[i * 3 + j].x = v1 + interpolation * (v2 - v1);
+    for ( unsigned int f = 0; f < frames.size(); ++f ) {
+        bytes += frames[ f ].MD2verts.size() * sizeof( MD2Vertex );
+        bytes += ( frames[ f ].x.size() + frames[ f ].y.size() + frames[ f ].z.size() ) * sizeof( float );
+        bytes += ( frames[ f ].nx.size() + frames[ f ].ny.size() + frames[ f ].nz.size() ) * sizeof( float );
+    }
 
+    return bytes + cornerVertices.size() * sizeof( short );
+};
 
+const float SIZE_SCALE = 1.0f;
 
-            v1 = frames[frameNum].verts[i * 3 + j].z;
-            v2 = frames[nextFrame].verts[i * 3 + j].z;
-            vCopy[i * 3 + j].y = v1 + interpolation * (v2 - v1);
+/**
+ * Points "keyFrame" at the arrays of frame "frame", for lerpKeyFrames()
+ */
+static void getKeyFrame( MD2Frame *frame, MD2KeyFrame *keyFrame ) {
+    keyFrame->x = &frame->x[ 0 ];
+    keyFrame->y = &frame->y[ 0 ];
+    keyFrame->z = &frame->z[ 0 ];
+    keyFrame->nx = &frame->nx[ 0 ];
+    keyFrame->ny = &frame->ny[ 0 ];
+    keyFrame->nz = &frame->nz[ 0 ];
+};
 
-            v1 = -frames[frameNum].verts[i * 3 + j].x;
-            v2 = -frames[nextFrame].verts[i * 3 + j].x;
-            vCopy[i * 3 + j].z = v1 + interpolation * (v2 - v1);
+/**
+ * Points "compressedFrame" at the vertices of frame "frame", for
+ * lerpCompressedFrames()
+ */
+static void getCompressedFrame( MD2Frame *frame, MD2CompressedFrame *compressedFrame ) {
+    compressedFrame->vertices = &frame->MD2verts[ 0 ];
 
+    for ( int i = 0; i < 3; ++i ) {
+        compressedFrame->scale[ i ] = frame->scale[ i ];
+        compressedFrame->translate[ i ] = frame->translate[ i ];
+    }
+};
 
 
-            v1 = frames[frameNum].normals[i * 3 + j].y;
-            v2 = frames[nextFrame].normals[i * 3 + j].y;
-            vCopy[i * 3 + j].nx = v1 + interpolation * (v2 - v1);
+void MD2Model::blendFrames( int from, int to, float t, D3DMD2Vertex *vertices ) {
 
-            v1 = frames[frameNum].normals[i * 3 + j].z;
-            v2 = frames[nextFrame].normals[i * 3 + j].z;
-            vCopy[i * 3 + j].ny = v1 + interpolation * (v2 - v1);
+    // Blend the two frames straight into "vertices". Their axes were swapped
+    //  around when the model was loaded, unless they were kept compressed, in
+    //  which case they are swapped while they are blended.
+    if ( compressed ) {
+        MD2CompressedFrame fromFrame, toFrame;
+        getCompressedFrame( &frames[ from ], &fromFrame );
+        getCompressedFrame( &frames[ to ], &toFrame );
 
-            v1 = -frames[frameNum].normals[i * 3 + j].x;
-            v2 = -frames[nextFrame].normals[i * 3 + j].x;
-            vCopy[i * 3 + j].nz = v1 + interpolation * (v2 - v1);
+        lerpCompressedFrames( &fromFrame, &toFrame, &cornerVertices[ 0 ], t, cornerVertices.size(), vertices );
+    } else {
+        MD2KeyFrame fromFrame, toFrame;
+        getKeyFrame( &frames[ from ], &fromFrame );
+        getKeyFrame( &frames[ to ], &toFrame );
 
-        }
-        // For the normal of each triangle
-        //getNormal( &vCopy[ i * 3 ] );
+        lerpKeyFrames( &fromFrame, &toFrame, t, triangles.size() * 3, vertices );
     }
-
-    vertexBuffer->Unlock();
 };
 
-void MD2Model::render( LPDIRECT3DDEVICE9 device ) {
+void MD2Model::render( RenderDevice *device, MD2Instance *instance ) {
+    // A model that was loaded without a device has nothing to blend into, but
+    //  its calls can still be recorded
+    if ( vertexBuffer != NULL ) {
+        VOID* pVoid;
 
-    setSkinNum( 0 );
+        vertexBuffer->Lock(0, 0, (void **)&pVoid, 0);    // locks v_buffer, the buffer we made earlier
+        blendFrames( instance->getFrameNum(), instance->getNextFrame(), instance->getInterpolation(), ( D3DMD2Vertex * ) pVoid );
+        vertexBuffer->Unlock();
+    }
 
-    device->SetRenderState( D3DRS_SPECULARENABLE, FALSE );
-    device->SetRenderState( D3DRS_NORMALIZENORMALS, TRUE );
-    device->SetRenderState( D3DRS_LIGHTING, TRUE );
+    device->setRenderState( D3DRS_SPECULARENABLE, FALSE );
+    device->setRenderState( D3DRS_NORMALIZENORMALS, TRUE );
+    device->setRenderState( D3DRS_LIGHTING, TRUE );
 
-    device->SetRenderState( D3DRS_CULLMODE, D3DCULL_CCW );
+    device->setRenderState( D3DRS_CULLMODE, D3DCULL_CCW );
 
-    device->SetFVF( MD2FVF );
+    device->setFVF( MD2FVF );
 
-    device->SetTexture( 0, skins[ skinNum ].getTexture() );
+    device->setTexture( 0, skins[ instance->getSkinNum() ].getTexture() );
 
-    device->SetStreamSource( 0, vertexBuffer, 0, sizeof( D3DMD2Vertex ) );
+    device->setStreamSource( 0, vertexBuffer, 0, sizeof( D3DMD2Vertex ) );
 
-    device->DrawPrimitive( D3DPT_TRIANGLELIST, 0, header.numTriangles );
+    device->drawPrimitive( D3DPT_TRIANGLELIST, 0, header.numTriangles );
 
-    device->SetRenderState( D3DRS_NORMALIZENORMALS, FALSE );
-    device->SetRenderState( D3DRS_LIGHTING, FALSE );
+    device->setRenderState( D3DRS_NORMALIZENORMALS, FALSE );
+    device->setRenderState( D3DRS_LIGHTING, FALSE );
 };
 
 void MD2Model::reorganizeVertices() {
@@ -241,19 +335,45 @@ void MD2Model::reorganizeVertices() {
         }
     }
 
-    for (int f = 0; f < header.numFrames; ++f) {
-        frames[f].verts.resize( triangles.size() * 3 );
-        frames[f].normals.resize( triangles.size() * 3 );
+    // The vertex that each corner points at, for compressed frames and the
+    //  frame texture, and the texture coordinates of each corner
+    cornerVertices.resize( triangles.size() * 3 );
+    cornerTexCoords.resize( triangles.size() * 6 );
+    for (unsigned int i = 0; i < triangles.size(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            cornerVertices[i * 3 + j] = triangles[i].vertexIndex[j];
+            cornerTexCoords[( i * 3 + j ) * 2] = tempVertices[i * 3 + j].u;
+            cornerTexCoords[( i * 3 + j ) * 2 + 1] = tempVertices[i * 3 + j].v;
+        }
+    }
+
+    // Turn each frame's corners into Direct3D's axes ( x, y, z ) -> ( y, z, -x ),
+    //  with each component in its own array. Compressed frames are kept the
+    //  way that they are. Every frame keeps its vertices too, because the
+    //  frame texture is made from them.
+    for (int f = 0; f < header.numFrames && !compressed; ++f) {
+        MD2Frame *frame = &frames[f];
+        unsigned int numCorners = triangles.size() * 3;
+
+        frame->x.resize( numCorners );
+        frame->y.resize( numCorners );
+        frame->z.resize( numCorners );
+        frame->nx.resize( numCorners );
+        frame->ny.resize( numCorners );
+        frame->nz.resize( numCorners );
+
         for (unsigned int i = 0; i < triangles.size(); ++i) {
             for (int j = 0; j < 3; ++j) {
-                //Push back the 3 vertices for this triangle
-                frames[f].verts[i * 3 + j].x = ( float( frames[f].MD2verts[ triangles[i].vertexIndex[j] ].v[0] ) * frames[f].scale[0] + frames[f].translate[0] );
-                frames[f].verts[i * 3 + j].y = ( float( frames[f].MD2verts[ triangles[i].vertexIndex[j] ].v[1] ) * frames[f].scale[1] + frames[f].translate[1] );
-                frames[f].verts[i * 3 + j].z = ( float( frames[f].MD2verts[ triangles[i].vertexIndex[j] ].v[2] ) * frames[f].scale[2] + frames[f].translate[2] );
-
-                frames[f].normals[i * 3 + j].x = normals[ frames[f].MD2verts[triangles[i].vertexIndex[j]].lightNormalIndex ].x;
-                frames[f].normals[i * 3 + j].y = normals[ frames[f].MD2verts[triangles[i].vertexIndex[j]].lightNormalIndex ].y;
-                frames[f].normals[i * 3 + j].z = normals[ frames[f].MD2verts[triangles[i].vertexIndex[j]].lightNormalIndex ].z;
+                MD2Vertex *vertex = &frame->MD2verts[ triangles[i].vertexIndex[j] ];
+                Vector3 *normal = &normals[ vertex->lightNormalIndex ];
+
+                frame->x[i * 3 + j] = float( vertex->v[1] ) * frame->scale[1] + frame->translate[1];
+                frame->y[i * 3 + j] = float( vertex->v[2] ) * frame->scale[2] + frame->translate[2];
+                frame->z[i * 3 + j] = -( float( vertex->v[0] ) * frame->scale[0] + frame->translate[0] );
+
+                frame->nx[i * 3 + j] = normal->y;
+                frame->ny[i * 3 + j] = normal->z;
+                frame->nz[i * 3 + j] = -normal->x;
             }
         }
     }
@@ -261,17 +381,139 @@ void MD2Model::reorganizeVertices() {
 	//Copy the new texture coordinate array over the original
     //m_texCoords = tempTexCoords;
     // Copy in the new vertex information
-    VOID* pVoid;
+    if ( vertexBuffer != NULL ) {
+        VOID* pVoid;
+
+        vertexBuffer->Lock(0, 0, (void **)&pVoid, 0);    // locks v_buffer, the buffer we made earlier
+
+        memcpy( pVoid, &tempVertices[ 0 ], tempVertices.size() * sizeof( D3DMD2Vertex ) );
+
+        vertexBuffer->Unlock();
+    }
+};
+
+bool MD2Model::createInstanceBuffers( LPDIRECT3DDEVICE9 device ) {
+    if ( frameTexture != NULL ) {
+        return true;
+    }
+
+    // Each row of the frame texture is one frame, with two texels for each
+    //  vertex: its position, and then its normal
+    int width = header.numVertices * 2;
+    int height = frames.size();
+
+    D3DCAPS9 caps;
+    if ( FAILED( device->GetDeviceCaps( &caps ) ) || width <= 0 || height <= 0 ||
+         ( DWORD ) width > caps.MaxTextureWidth || ( DWORD ) height > caps.MaxTextureHeight ) {
+        return false;
+    }
+
+    int numCorners = getNumCorners();
+
+    if ( FAILED( device->CreateTexture( width, height, 1, 0, D3DFMT_A32B32G32R32F, D3DPOOL_MANAGED, &frameTexture, NULL ) ) ) {
+        frameTexture = NULL;
+        return false;
+    }
+    if ( FAILED( device->CreateVertexBuffer( sizeof( MD2CornerVertex ) * numCorners, D3DUSAGE_WRITEONLY, 0,
+                                             D3DPOOL_MANAGED, &cornerBuffer, NULL ) ) ||
+         FAILED( device->CreateIndexBuffer( sizeof( short ) * numCorners, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                            D3DPOOL_MANAGED, &cornerIndices, NULL ) ) ) {
+        if ( cornerBuffer != NULL ) {
+            cornerBuffer->Release();
+            cornerBuffer = NULL;
+        }
+        frameTexture->Release();
+        frameTexture = NULL;
+        cornerIndices = NULL;
+        return false;
+    }
+
+    // The positions and normals, in Direct3D's axes
+    D3DLOCKED_RECT rect;
+    frameTexture->LockRect( 0, &rect, NULL, 0 );
+
+    for ( int f = 0; f < height; ++f ) {
+        MD2Frame *frame = &frames[ f ];
+        float *row = ( float * ) ( ( unsigned char * ) rect.pBits + f * rect.Pitch );
+
+        for ( int i = 0; i < header.numVertices; ++i ) {
+            MD2Vertex *vertex = &frame->MD2verts[ i ];
+            Vector3 *normal = &normals[ vertex->lightNormalIndex ];
 
-    vertexBuffer->Lock(0, 0, (void **)&pVoid, 0);    // locks v_buffer, the buffer we made earlier
+            row[ i * 8 ] = float( vertex->v[1] ) * frame->scale[1] + frame->translate[1];
+            row[ i * 8 + 1 ] = float( vertex->v[2] ) * frame->scale[2] + frame->translate[2];
+            row[ i * 8 + 2 ] = -( float( vertex->v[0] ) * frame->scale[0] + frame->translate[0] );
+            row[ i * 8 + 3 ] = 1.0f;
 
-    memcpy( pVoid, &tempVertices[ 0 ], tempVertices.size() * sizeof( D3DMD2Vertex ) );
+            row[ i * 8 + 4 ] = normal->y;
+            row[ i * 8 + 5 ] = normal->z;
+            row[ i * 8 + 6 ] = -normal->x;
+            row[ i * 8 + 7 ] = 0.0f;
+        }
+    }
+
+    frameTexture->UnlockRect( 0 );
+
+    // The corners, drawn in order
+    MD2CornerVertex *corners;
+    cornerBuffer->Lock( 0, 0, ( void ** ) &corners, 0 );
+    for ( int i = 0; i < numCorners; ++i ) {
+        corners[ i ].vertex = cornerVertices[ i ];
+        corners[ i ].u = cornerTexCoords[ i * 2 ];
+        corners[ i ].v = cornerTexCoords[ i * 2 + 1 ];
+    }
+    cornerBuffer->Unlock();
+
+    short *indices;
+    cornerIndices->Lock( 0, 0, ( void ** ) &indices, 0 );
+    for ( int i = 0; i < numCorners; ++i ) {
+        indices[ i ] = ( short ) i;
+    }
+    cornerIndices->Unlock();
+
+    return true;
+};
+
+
+MD2Instance::MD2Instance( MD2Model *model ) {
+    this->model = model;
+    skinNum = 0;
+
+    setAnimation( 0, model->getNumFrames() - 1 );
+};
+
+void MD2Instance::setAnimation( int start, int end ) {
+    startFrame = start;
+    endFrame = end;
+
+    setFrame( start );
+};
+
+void MD2Instance::setFrame( int frame ) {
+    frameNum = frame;
+    nextFrame = frame + 1;
+    interpolation = 0.0f;
 
-    vertexBuffer->Unlock();
+    if ( nextFrame > endFrame ) {
+        nextFrame = startFrame;
+    }
 };
 
-void MD2Model::setSkinNum( int skinN ) {
-    skinNum = skinN;
+void MD2Instance::update( float dt ) {
+
+    interpolation += dt * ANIMATION_FPS;
+
+    if ( interpolation > 1.0 ) {
+        frameNum = nextFrame;
+        nextFrame++;
+        interpolation = 0.0f;
+    }
+
+
+    //nextFrame = frameNum + 1;
+    if ( nextFrame > endFrame ) {
+        nextFrame = startFrame;
+    }
 };
 
 
@@ -18,6 +18,7 @@
 #include <iostream.h>
 
 #include "Texture.h"
+#include "RenderDevice.h"
 
 #define ANIMATION_FPS 8.0f
 
@@ -39,6 +40,14 @@ typedef struct {
     unsigned char lightNormalIndex;
 } MD2Vertex;
 
+// A triangle corner of a model that is drawn with instancing: the number of
+//  the vertex that it points at, and its texture coordinates. Its position
+//  and normal come from the model's frame texture (see MD2Renderer.h).
+typedef struct {
+    float vertex;
+    float u, v;
+} MD2CornerVertex;
+
 typedef struct {
     float x, y, z;
 } Vector3;
@@ -48,8 +57,11 @@ typedef struct {
     float translate[3];
     char name[16];
     vector< MD2Vertex > MD2verts;
-    vector< Vector3 > verts;
-    vector< Vector3 > normals;
+
+    // The position and normal of each triangle corner, in Direct3D's axes,
+    //  with each component in its own array (see MD2Lerp.h)
+    vector< float > x, y, z;
+    vector< float > nx, ny, nz;
 } MD2Frame;
 
 typedef struct {
@@ -103,26 +115,77 @@ class MD2Model {
         MD2Model();
         ~MD2Model();
 
+        /**
+         * load() reads in the model in the directory "fileName". With a NULL
+         * device, only the frames, triangles and texture coordinates are kept,
+         * for blending on the CPU; no skin or vertex buffer is made.
+         */
         bool load( std::string fileName, LPDIRECT3DDEVICE9 device );
         bool loadTexture( std::string fileName, LPDIRECT3DDEVICE9 device );
         void generateBuffers( LPDIRECT3DDEVICE9 device );
 
-        void setAnimation( int start, int end ) {
-            frameNum = start;
-            nextFrame = start + 1;
+        void unload( LPDIRECT3DDEVICE9 device );
+        void unloadTexture( LPDIRECT3DDEVICE9 device );
+        void deleteBuffers( void );
 
-            startFrame = start;
-            endFrame = end;
+        /**
+         * Returns the number of frames of animation that the model has
+         */
+        int getNumFrames() {
+            return frames.size();
         };
 
-        void setSkinNum( int skinN );
+        /**
+         * blendFrames() blends frame #from towards frame #to by "t", and writes
+         * the positions and normals of every triangle corner into "vertices"
+         */
+        void blendFrames( int from, int to, float t, D3DMD2Vertex *vertices );
+
+        /**
+         * render() draws the model the way that "instance" is animated. The
+         * instance's frames are blended into the model's vertex buffer first,
+         * so each instance that is drawn writes the whole buffer again.
+         */
+        void render( RenderDevice *device, MD2Instance *instance );
+
+        /**
+         * createInstanceBuffers() makes what an MD2Renderer needs to draw many
+         * instances of the model with one draw call: a texture that holds the
+         * position and normal of every vertex in every frame, a buffer of the
+         * triangle corners, and an index buffer for them. Returns false if
+         * they could not be made. Does nothing if they have already been made.
+         */
+        bool createInstanceBuffers( LPDIRECT3DDEVICE9 device );
+
+        LPDIRECT3DTEXTURE9 getFrameTexture() {
+            return frameTexture;
+        };
+        LPDIRECT3DVERTEXBUFFER9 getCornerBuffer() {
+            return cornerBuffer;
+        };
+        LPDIRECT3DINDEXBUFFER9 getCornerIndices() {
+            return cornerIndices;
+        };
 
-        void unload( LPDIRECT3DDEVICE9 device );
-        void unloadTexture( LPDIRECT3DDEVICE9 device );
-        void deleteBuffers( void );
+        int getNumVertices() {
+            return header.numVertices;
+        };
 
-        void update( float dt );
-        void render( LPDIRECT3DDEVICE9 device );
+        /**
+         * Returns the number of triangle corners, which is the number of
+         * vertices that blendFrames() writes
+         */
+        int getNumCorners() {
+            return triangles.size() * 3;
+        };
+
+        /**
+         * Returns the texture coordinates of every triangle corner, as pairs
+         * of ( u, v )
+         */
+        const float *getCornerTexCoords() {
+            return &cornerTexCoords[ 0 ];
+        };
 
         LPDIRECT3DVERTEXBUFFER9 normalVertexBuffer;
         void renderNormals( LPDIRECT3DDEVICE9 device );
@@ -130,6 +193,17 @@ class MD2Model {
         vector<Triangle> triangles;
         vector<Texture> skins;
 
+        /**
+         * Returns the number of bytes that the model's frames take up
+         */
+        int getFrameBytes();
+
+        // When this is true, models that are loaded from now on keep their
+        //  frames the way that they are in the .md2 file, 4 bytes for each
+        //  vertex, and turn them into positions and normals while blending
+        //  them (see MD2Lerp.h)
+        static bool useCompressedFrames;
+
     private:
         // Direct3D objects
         LPDIRECT3DVERTEXBUFFER9 vertexBuffer;
@@ -141,13 +215,95 @@ class MD2Model {
 
         vector<TexCoord> texCoords;
 
+        // Whether the frames are kept compressed, and the vertex that each
+        //  triangle corner points at
+        bool compressed;
+        vector<short> cornerVertices;
+
+        // The texture coordinates of each triangle corner
+        vector<float> cornerTexCoords;
+
+        // What createInstanceBuffers() makes, or NULL
+        LPDIRECT3DTEXTURE9 frameTexture;
+        LPDIRECT3DVERTEXBUFFER9 cornerBuffer;
+        LPDIRECT3DINDEXBUFFER9 cornerIndices;
+
         void reorganizeVertices();
         static Vector3 normals[162];
+};
+
+
+/**
+ * An MD2Instance is one animated copy of an MD2Model, such as one monster.
+ * Every instance of a model shares the model's frames, triangles, skins and
+ * vertex buffer, and only keeps how far through its animation it is, so that
+ * a model can have hundreds of instances that each animate by themselves.
+ */
+class MD2Instance {
+    public:
+
+        /**
+         * Constructor makes an instance of "model" that plays every frame of
+         * the model, starting at the first one. The model must stay loaded
+         * for as long as the instance is used.
+         */
+        MD2Instance( MD2Model *model );
+
+        /**
+         * setAnimation() makes the instance play frames #start up to #end, over
+         * and over, starting at frame #start
+         */
+        void setAnimation( int start, int end );
+
+        /**
+         * setFrame() jumps to frame #frame of the animation, so that instances
+         * that play the same animation don't all move together
+         */
+        void setFrame( int frame );
+
+        void setSkinNum( int skinN ) {
+            skinNum = skinN;
+        };
+
+        /**
+         * update() moves the animation on by dt seconds
+         */
+        void update( float dt );
+
+        /**
+         * render() draws the instance with its model
+         */
+        void render( RenderDevice *device ) {
+            model->render( device, this );
+        };
+
+        MD2Model *getModel() {
+            return model;
+        };
+
+        // The frame that is being blended from, the frame that is being
+        //  blended towards, and how far between them the animation is (0 to 1)
+        int getFrameNum() {
+            return frameNum;
+        };
+        int getNextFrame() {
+            return nextFrame;
+        };
+        float getInterpolation() {
+            return interpolation;
+        };
+
+        int getSkinNum() {
+            return skinNum;
+        };
+
+    private:
+        MD2Model *model;
 
-        int skinNum;
-        int frameNum;
-        int nextFrame;
-        int startFrame, endFrame;
+        short frameNum;
+        short nextFrame;
+        short startFrame, endFrame;
+        short skinNum;
 
         float interpolation;
 };
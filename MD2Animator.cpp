@@ -0,0 +1,225 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MD2Animator.h"
+#include "MD2Lerp.h"
+#include "Timer.h"
+
+
+/**
+ * Constructor prepares an animator that uses one worker for each processor,
+ * other than the one that the render thread uses
+ */
+MD2Animator::MD2Animator() {
+    numThreads = TaskGraph::getNumProcessors() - 1;
+
+    graph.setKeepWorkers( true );
+};
+
+/**
+ * setNumThreads() changes the number of workers. With 0 workers, everything
+ * is done on the calling thread.
+ */
+void MD2Animator::setNumThreads( int numThreads ) {
+    this->numThreads = numThreads > 0 ? numThreads : 0;
+};
+
+
+/**
+ * update() moves each of the "numInstances" instances on by "dt" seconds
+ */
+void MD2Animator::update( MD2Instance **instances, int numInstances, float dt ) {
+    int numSlices = splitSlices( numInstances, MD2_MIN_UPDATE_SLICE );
+
+    for ( int i = 0; i < numSlices; ++i ) {
+        slices[ i ].instances = instances;
+        slices[ i ].dt = dt;
+    }
+
+    runSlices( updateSlice, numSlices );
+};
+
+/**
+ * blend() blends the frames of each instance of "model", moves them into the
+ * world with the instance's world matrix, and writes them into "output".
+ * Instance #n is written at output + n * the number of corners in the model,
+ * so output has to have room for every instance.
+ */
+void MD2Animator::blend( MD2Model *model, const MD2PlacedInstance *instances, int numInstances, D3DMD2Vertex *output ) {
+    int numCorners = model->getNumCorners();
+    if ( numCorners <= 0 ) {
+        return;
+    }
+
+    // The tables that blending uses are filled in the first time that the
+    //  path is asked for, which has to happen before the workers blend
+    getMD2LerpPath();
+
+    int minInstances = MD2_MIN_BLEND_SLICE / numCorners;
+    int numSlices = splitSlices( numInstances, minInstances > 1 ? minInstances : 1 );
+
+    for ( int i = 0; i < numSlices; ++i ) {
+        slices[ i ].model = model;
+        slices[ i ].placed = instances;
+        slices[ i ].output = output;
+    }
+
+    runSlices( blendSlice, numSlices );
+};
+
+
+/**
+ * Moves the instances of one slice on
+ */
+void MD2Animator::updateSlice( void *data ) {
+    Slice *slice = ( Slice * ) data;
+
+    for ( int n = slice->first; n < slice->first + slice->count; ++n ) {
+        slice->instances[ n ]->update( slice->dt );
+    }
+};
+
+/**
+ * Blends the instances of one slice into their part of the output
+ */
+void MD2Animator::blendSlice( void *data ) {
+    Slice *slice = ( Slice * ) data;
+
+    MD2Model *model = slice->model;
+    int numCorners = model->getNumCorners();
+    const float *texCoords = model->getCornerTexCoords();
+
+    slice->blended.resize( numCorners );
+
+    for ( int n = slice->first; n < slice->first + slice->count; ++n ) {
+        MD2Instance *instance = slice->placed[ n ].instance;
+        const D3DXMATRIX &m = slice->placed[ n ].world;
+
+        model->blendFrames( instance->getFrameNum(), instance->getNextFrame(), instance->getInterpolation(), &slice->blended[ 0 ] );
+
+        // The output is usually a vertex buffer, which is only ever written
+        //  to, so each corner is worked out from the blended copy
+        D3DMD2Vertex *out = slice->output + n * numCorners;
+        for ( int i = 0; i < numCorners; ++i ) {
+            const D3DMD2Vertex *in = &slice->blended[ i ];
+
+            out[ i ].x = in->x * m._11 + in->y * m._21 + in->z * m._31 + m._41;
+            out[ i ].y = in->x * m._12 + in->y * m._22 + in->z * m._32 + m._42;
+            out[ i ].z = in->x * m._13 + in->y * m._23 + in->z * m._33 + m._43;
+
+            out[ i ].nx = in->nx * m._11 + in->ny * m._21 + in->nz * m._31;
+            out[ i ].ny = in->nx * m._12 + in->ny * m._22 + in->nz * m._32;
+            out[ i ].nz = in->nx * m._13 + in->ny * m._23 + in->nz * m._33;
+
+            out[ i ].u = texCoords[ i * 2 ];
+            out[ i ].v = texCoords[ i * 2 + 1 ];
+        }
+    }
+};
+
+
+/**
+ * Splits "count" items into one slice for each thread, but none smaller than
+ * minPerSlice. Returns the number of slices, whose first and count have been
+ * filled in.
+ */
+int MD2Animator::splitSlices( int count, int minPerSlice ) {
+    if ( count <= 0 ) {
+        return 0;
+    }
+
+    int numSlices = numThreads + 1;
+    if ( numSlices > count / minPerSlice ) {
+        numSlices = count / minPerSlice;
+    }
+    if ( numSlices < 1 ) {
+        numSlices = 1;
+    }
+
+    if ( ( int ) slices.size() < numSlices ) {
+        slices.resize( numSlices );
+    }
+
+    // The first few slices get one more item each, if they don't split evenly
+    int first = 0;
+    for ( int i = 0; i < numSlices; ++i ) {
+        slices[ i ].first = first;
+        slices[ i ].count = count / numSlices + ( i < count % numSlices ? 1 : 0 );
+
+        first += slices[ i ].count;
+    }
+
+    return numSlices;
+};
+
+/**
+ * Runs "function" on the first numSlices slices, and returns once they have
+ * all finished. The first slice is run on this thread.
+ */
+void MD2Animator::runSlices( TaskGraph::TaskFunction function, int numSlices ) {
+    if ( numSlices <= 0 ) {
+        return;
+    }
+
+    // One slice isn't worth waking the workers for
+    if ( numSlices == 1 ) {
+        function( &slices[ 0 ] );
+        return;
+    }
+
+    graph.clear();
+    for ( int i = 0; i < numSlices; ++i ) {
+        graph.addTask( "Animate instances", function, &slices[ i ], i == 0 );
+    }
+
+    graph.run( numThreads );
+};
+
+
+/**
+ * benchmarkMD2Animation() animates "numInstances" instances of "model" over
+ * "numFrames" frames with "numThreads" workers, blending every instance into
+ * memory each frame the same as a CPU batch does, but without drawing
+ * anything. The time that it took is put into "result".
+ */
+void benchmarkMD2Animation( MD2Model *model, int numInstances, int numFrames, int numThreads, MD2AnimationBenchmark *result ) {
+    vector< MD2Instance * > instances;
+    vector< MD2PlacedInstance > placed;
+    vector< D3DMD2Vertex > output;
+
+    instances.resize( numInstances );
+    placed.resize( numInstances );
+    output.resize( numInstances * model->getNumCorners() );
+
+    // Spread the instances out over a grid, each one at a different frame
+    for ( int i = 0; i < numInstances; ++i ) {
+        instances[ i ] = new MD2Instance( model );
+        instances[ i ]->setFrame( i % model->getNumFrames() );
+
+        placed[ i ].instance = instances[ i ];
+        D3DXMatrixTranslation( &placed[ i ].world, ( float ) ( i % 32 ) * 64.0f, 0.0f, ( float ) ( i / 32 ) * 64.0f );
+    }
+
+    MD2Animator animator;
+    animator.setNumThreads( numThreads );
+
+    Timer timer;
+    unsigned int start = timer.getTimeMillis();
+
+    for ( int frame = 0; frame < numFrames && numInstances > 0; ++frame ) {
+        animator.update( &instances[ 0 ], numInstances, 0.016f );
+        animator.blend( model, &placed[ 0 ], numInstances, &output[ 0 ] );
+    }
+
+    result->millis = timer.getTimeMillis() - start;
+    result->instancesPerSecond = ( double ) numInstances * numFrames * 1000.0 /
+                                 ( result->millis > 0 ? result->millis : 1 );
+
+    for ( int i = 0; i < numInstances; ++i ) {
+        delete instances[ i ];
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
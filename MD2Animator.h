@@ -0,0 +1,142 @@
+//---------------------------------------------------------------------------
+
+#ifndef MD2AnimatorH
+#define MD2AnimatorH
+
+#include <vector.h>
+
+#include "MD2.h"
+#include "TaskGraph.h"
+
+using namespace std;
+
+
+/**
+ * An explanation on animating many MD2 instances:
+ *      Every frame, each monster's place in its animation is moved on, and the
+ *  monsters that are drawn together have their frames blended into one vertex
+ *  buffer (see MD2Renderer). Both of these are done on the render thread right
+ *  before the scene is drawn, and take longer the more monsters there are.
+ *
+ *      The MD2Animator splits the instances into one slice for each worker of
+ *  a TaskGraph, plus one for the render thread. Each slice is worked on by
+ *  itself: update() moves the instances in it on, and blend() blends them into
+ *  their own part of the output (instance #n is written at n times the
+ *  model's number of corners), so the slices never touch the same memory. Both
+ *  return once every slice is done, so the output is ready to be drawn.
+ *
+ *      The graph keeps its workers between frames. Small jobs aren't split,
+ *  since starting a task costs more than updating a few instances.
+ */
+
+/**
+ * An instance, with the world matrix that it is moved into when it is blended
+ */
+typedef struct {
+    MD2Instance *instance;
+    D3DXMATRIX world;
+} MD2PlacedInstance;
+
+/**
+ * The results of benchmarkMD2Animation()
+ */
+typedef struct {
+    // How long animating every instance over every frame took
+    unsigned int millis;
+
+    // How many instances were animated each second
+    double instancesPerSecond;
+} MD2AnimationBenchmark;
+
+// The fewest instances that update() gives a slice of their own
+#define MD2_MIN_UPDATE_SLICE 1024
+
+// The fewest triangle corners that blend() gives a slice of their own
+#define MD2_MIN_BLEND_SLICE 4096
+
+
+class MD2Animator {
+    public:
+
+        /**
+         * Constructor prepares an animator that uses one worker for each
+         * processor, other than the one that the render thread uses
+         */
+        MD2Animator();
+
+        /**
+         * setNumThreads() changes the number of workers. With 0 workers,
+         * everything is done on the calling thread.
+         */
+        void setNumThreads( int numThreads );
+
+        int getNumThreads() {
+            return numThreads;
+        };
+
+        /**
+         * update() moves each of the "numInstances" instances on by "dt"
+         * seconds
+         */
+        void update( MD2Instance **instances, int numInstances, float dt );
+
+        /**
+         * blend() blends the frames of each instance of "model", moves them into
+         * the world with the instance's world matrix, and writes them into
+         * "output". Instance #n is written at output + n * the number of
+         * corners in the model, so output has to have room for every instance.
+         */
+        void blend( MD2Model *model, const MD2PlacedInstance *instances, int numInstances, D3DMD2Vertex *output );
+
+    private:
+
+        /**
+         * A part of the instances that one task works on, with everything
+         * that it needs
+         */
+        typedef struct {
+            MD2Model *model;
+            MD2Instance **instances;
+            const MD2PlacedInstance *placed;
+            int first;
+            int count;
+            float dt;
+            D3DMD2Vertex *output;
+
+            // The blended corners of one instance, before they are moved into
+            //  the world and written out. Each slice has its own.
+            vector< D3DMD2Vertex > blended;
+        } Slice;
+
+        // The tasks that each slice is run with
+        static void updateSlice( void *data );
+        static void blendSlice( void *data );
+
+        // Splits "count" items into one slice for each thread, but none
+        //  smaller than minPerSlice. Returns the number of slices, whose first
+        //  and count have been filled in.
+        int splitSlices( int count, int minPerSlice );
+
+        // Runs "function" on the first numSlices slices, and returns once
+        //  they have all finished. The first slice is run on this thread.
+        void runSlices( TaskGraph::TaskFunction function, int numSlices );
+
+        // The number of workers, and the graph that they run the slices in
+        int numThreads;
+        TaskGraph graph;
+
+        vector< Slice > slices;
+};
+
+
+/**
+ * benchmarkMD2Animation() animates "numInstances" instances of "model" over
+ * "numFrames" frames with "numThreads" workers, blending every instance into
+ * memory each frame the same as a CPU batch does, but without drawing
+ * anything. The time that it took is put into "result".
+ */
+void benchmarkMD2Animation( MD2Model *model, int numInstances, int numFrames, int numThreads, MD2AnimationBenchmark *result );
+
+
+//---------------------------------------------------------------------------
+#endif
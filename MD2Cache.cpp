@@ -0,0 +1,112 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MD2Cache.h"
+
+
+/**
+ * Constructor prepares an empty cache
+ */
+MD2Cache::MD2Cache() {
+};
+
+/**
+ * Destructor deletes every model in the cache
+ */
+MD2Cache::~MD2Cache() {
+    unload();
+};
+
+
+/**
+ * acquire() adds a reference to the model in the directory dirName, and
+ * returns it. If the model isn't in the cache, then it is loaded in and
+ * sent to the Direct3D device first. With a NULL device, the model can only
+ * be blended on the CPU (see MD2Model::load()). Returns NULL if the model
+ * could not be loaded.
+ */
+MD2Model *MD2Cache::acquire( string dirName, LPDIRECT3DDEVICE9 device ) {
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        if ( entries[ i ].dirName == dirName ) {
+            ++entries[ i ].refCount;
+            return entries[ i ].model;
+        }
+    }
+
+    // The model hasn't been loaded yet
+    MD2Model *model = new MD2Model();
+    if ( !model->load( dirName, device ) ) {
+        delete model;
+        return NULL;
+    }
+
+    CacheEntry entry;
+    entry.dirName = dirName;
+    entry.model = model;
+    entry.refCount = 1;
+    entries.push_back( entry );
+
+    return model;
+};
+
+/**
+ * release() takes away a reference to "model". The model stays in the cache
+ * until purgeUnused() is called.
+ */
+void MD2Cache::release( MD2Model *model ) {
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        if ( entries[ i ].model == model ) {
+            if ( entries[ i ].refCount > 0 ) {
+                --entries[ i ].refCount;
+            }
+            return;
+        }
+    }
+};
+
+/**
+ * purgeUnused() deletes every model that doesn't have any references
+ */
+void MD2Cache::purgeUnused() {
+    unsigned int kept = 0;
+
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        if ( entries[ i ].refCount > 0 ) {
+            entries[ kept++ ] = entries[ i ];
+        } else {
+            delete entries[ i ].model;
+        }
+    }
+
+    entries.resize( kept );
+};
+
+/**
+ * unload() deletes every model in the cache, whether or not it is still being
+ * used
+ */
+void MD2Cache::unload() {
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        delete entries[ i ].model;
+    }
+
+    entries.clear();
+};
+
+/**
+ * Returns the number of bytes that the frames of every model in the cache
+ * take up
+ */
+int MD2Cache::getFrameBytes() {
+    int bytes = 0;
+
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        bytes += entries[ i ].model->getFrameBytes();
+    }
+
+    return bytes;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,98 @@
+//---------------------------------------------------------------------------
+
+#ifndef MD2CacheH
+#define MD2CacheH
+
+#include <vector.h>
+#include <string>
+
+#include "MD2.h"
+
+using namespace std;
+
+
+/**
+ * The MD2Cache keeps every MD2 model that has been loaded, so that a model's
+ * tris.md2 is only ever read and sent to Direct3D once, however many monsters
+ * use it. Each monster gets an MD2Instance of the shared model instead.
+ *
+ * Models are found by the directory that they were loaded from (e.g.
+ * "models/monsters/soldier/"). A game only has a few dozen kinds of model, so
+ * they are simply searched in order.
+ *
+ * Each model has a reference count, the same as the images in a TextureCache.
+ * acquire() adds a reference and release() takes one away, but a model with no
+ * references is kept until purgeUnused() is called, so that the models that
+ * both the old and the new map use are still there when the map changes.
+ */
+class MD2Cache {
+    public:
+
+        /**
+         * Constructor prepares an empty cache
+         */
+        MD2Cache();
+
+        /**
+         * Destructor deletes every model in the cache
+         */
+        ~MD2Cache();
+
+        /**
+         * acquire() adds a reference to the model in the directory dirName, and
+         * returns it. If the model isn't in the cache, then it is loaded in and
+         * sent to the Direct3D device first. With a NULL device, the model can
+         * only be blended on the CPU (see MD2Model::load()). Returns NULL if
+         * the model could not be loaded.
+         */
+        MD2Model *acquire( string dirName, LPDIRECT3DDEVICE9 device );
+
+        /**
+         * release() takes away a reference to "model". The model stays in the
+         * cache until purgeUnused() is called.
+         */
+        void release( MD2Model *model );
+
+        /**
+         * purgeUnused() deletes every model that doesn't have any references
+         */
+        void purgeUnused();
+
+        /**
+         * unload() deletes every model in the cache, whether or not it is still
+         * being used
+         */
+        void unload();
+
+        /**
+         * Returns the number of models in the cache
+         */
+        int getNumModels() {
+            return entries.size();
+        };
+
+        /**
+         * Returns the number of bytes that the frames of every model in the
+         * cache take up
+         */
+        int getFrameBytes();
+
+    private:
+
+        /**
+         * A CacheEntry is one model in the cache, with the directory that it
+         * was loaded from and the number of references to it
+         */
+        typedef struct {
+            string dirName;
+            MD2Model *model;
+            int refCount;
+        } CacheEntry;
+
+        // The models
+        vector< CacheEntry > entries;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,586 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MD2Lerp.h"
+#include "Timer.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+
+// Work out whether this compiler can build the SSE versions. Each version is
+// only ever called if the CPU supports it, so the intrinsics are allowed even
+// when the rest of the program is built for an older CPU.
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+    #include <intrin.h>
+    #include <emmintrin.h>
+    #define MD2LERP_HAS_SSE
+    #define MD2LERP_TARGET_SSE
+    #define MD2LERP_TARGET_SSE2
+
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+    #include <cpuid.h>
+    #include <emmintrin.h>
+    #define MD2LERP_HAS_SSE
+    #define MD2LERP_TARGET_SSE __attribute__(( target( "sse" ) ))
+    #define MD2LERP_TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+#endif
+
+
+// The normals that the lightNormalIndex of an MD2Vertex picks from
+static const float anorms[ 162 ][ 3 ] = {
+    #include "anorms.h"
+};
+
+// The same normals in Direct3D's axes, with one array for each axis. An
+// index past the end of anorms gets no normal, so that the loops never have
+// to check the index. They are filled in by getMD2LerpPath().
+static float normalX[ 256 ];
+static float normalY[ 256 ];
+static float normalZ[ 256 ];
+
+
+/**
+ * The plain version of lerpKeyFrames(), which works on every CPU. It blends
+ * corners #first up to #( count - 1 ).
+ */
+static void lerpScalar( const MD2KeyFrame *from, const MD2KeyFrame *to, float t, int first, int count, D3DMD2Vertex *vertices ) {
+    for ( int i = first; i < count; ++i ) {
+        vertices[ i ].x = from->x[ i ] + t * ( to->x[ i ] - from->x[ i ] );
+        vertices[ i ].y = from->y[ i ] + t * ( to->y[ i ] - from->y[ i ] );
+        vertices[ i ].z = from->z[ i ] + t * ( to->z[ i ] - from->z[ i ] );
+
+        vertices[ i ].nx = from->nx[ i ] + t * ( to->nx[ i ] - from->nx[ i ] );
+        vertices[ i ].ny = from->ny[ i ] + t * ( to->ny[ i ] - from->ny[ i ] );
+        vertices[ i ].nz = from->nz[ i ] + t * ( to->nz[ i ] - from->nz[ i ] );
+    }
+};
+
+
+/**
+ * The plain version of lerpCompressedFrames(), which works on every CPU. It
+ * blends corners #first up to #( count - 1 ).
+ */
+static void lerpCompressedScalar( const MD2CompressedFrame *from, const MD2CompressedFrame *to, const short *corners,
+                                  float t, int first, int count, D3DMD2Vertex *vertices ) {
+    for ( int i = first; i < count; ++i ) {
+        const MD2Vertex *a = &from->vertices[ corners[ i ] ];
+        const MD2Vertex *b = &to->vertices[ corners[ i ] ];
+
+        // Turn both vertices' bytes into positions, in Direct3D's axes
+        float ax = float( a->v[ 1 ] ) * from->scale[ 1 ] + from->translate[ 1 ];
+        float ay = float( a->v[ 2 ] ) * from->scale[ 2 ] + from->translate[ 2 ];
+        float az = -( float( a->v[ 0 ] ) * from->scale[ 0 ] + from->translate[ 0 ] );
+
+        float bx = float( b->v[ 1 ] ) * to->scale[ 1 ] + to->translate[ 1 ];
+        float by = float( b->v[ 2 ] ) * to->scale[ 2 ] + to->translate[ 2 ];
+        float bz = -( float( b->v[ 0 ] ) * to->scale[ 0 ] + to->translate[ 0 ] );
+
+        vertices[ i ].x = ax + t * ( bx - ax );
+        vertices[ i ].y = ay + t * ( by - ay );
+        vertices[ i ].z = az + t * ( bz - az );
+
+        int na = a->lightNormalIndex;
+        int nb = b->lightNormalIndex;
+
+        vertices[ i ].nx = normalX[ na ] + t * ( normalX[ nb ] - normalX[ na ] );
+        vertices[ i ].ny = normalY[ na ] + t * ( normalY[ nb ] - normalY[ na ] );
+        vertices[ i ].nz = normalZ[ na ] + t * ( normalZ[ nb ] - normalZ[ na ] );
+    }
+};
+
+
+#ifdef MD2LERP_HAS_SSE
+/**
+ * Blends 4 of the numbers in "from" towards the same 4 numbers in "to"
+ */
+MD2LERP_TARGET_SSE
+static inline __m128 lerp4( const float *from, const float *to, __m128 t ) {
+    __m128 a = _mm_loadu_ps( from );
+    __m128 b = _mm_loadu_ps( to );
+
+    return _mm_add_ps( a, _mm_mul_ps( t, _mm_sub_ps( b, a ) ) );
+};
+
+/**
+ * Turns 4 blended corners around into 4 vertices, starting at "vertices".
+ * The texture coordinates are stepped over, so only 6 of the 8 numbers in
+ * each vertex are stored.
+ */
+MD2LERP_TARGET_SSE
+static inline void storeVertices4( D3DMD2Vertex *vertices, __m128 x, __m128 y, __m128 z,
+                                   __m128 nx, __m128 ny, __m128 nz ) {
+
+    // Each register now holds ( x, y, z, nx ) of one vertex
+    _MM_TRANSPOSE4_PS( x, y, z, nx );
+
+    _mm_storeu_ps( &vertices[ 0 ].x, x );
+    _mm_storeu_ps( &vertices[ 1 ].x, y );
+    _mm_storeu_ps( &vertices[ 2 ].x, z );
+    _mm_storeu_ps( &vertices[ 3 ].x, nx );
+
+    // The rest of the normals go in pairs of ( ny, nz )
+    __m128 low = _mm_unpacklo_ps( ny, nz );
+    __m128 high = _mm_unpackhi_ps( ny, nz );
+
+    _mm_storel_pi( ( __m64 * ) &vertices[ 0 ].ny, low );
+    _mm_storeh_pi( ( __m64 * ) &vertices[ 1 ].ny, low );
+    _mm_storel_pi( ( __m64 * ) &vertices[ 2 ].ny, high );
+    _mm_storeh_pi( ( __m64 * ) &vertices[ 3 ].ny, high );
+};
+
+/**
+ * The SSE version of lerpKeyFrames(). 4 corners are blended at once, and then
+ * turned around into 4 vertices.
+ */
+MD2LERP_TARGET_SSE
+static void lerpSSE( const MD2KeyFrame *from, const MD2KeyFrame *to, float t, int count, D3DMD2Vertex *vertices ) {
+    __m128 blend = _mm_set1_ps( t );
+
+    int i;
+    for ( i = 0; i + 4 <= count; i += 4 ) {
+        storeVertices4( vertices + i,
+                        lerp4( from->x + i, to->x + i, blend ),
+                        lerp4( from->y + i, to->y + i, blend ),
+                        lerp4( from->z + i, to->z + i, blend ),
+                        lerp4( from->nx + i, to->nx + i, blend ),
+                        lerp4( from->ny + i, to->ny + i, blend ),
+                        lerp4( from->nz + i, to->nz + i, blend ) );
+    }
+
+    // The last few corners
+    lerpScalar( from, to, t, i, count, vertices );
+};
+
+
+/**
+ * Turns 4 compressed vertices (packed into one register, 4 bytes each) into
+ * positions in Direct3D's axes, the same way as lerpCompressedScalar()
+ */
+MD2LERP_TARGET_SSE2
+static inline void decodePositions4( __m128i packed, const MD2CompressedFrame *frame, __m128 *x, __m128 *y, __m128 *z ) {
+    __m128i byteMask = _mm_set1_epi32( 0xFF );
+
+    // Pick byte v[ 0 ], v[ 1 ] and v[ 2 ] out of each vertex
+    __m128 v0 = _mm_cvtepi32_ps( _mm_and_si128( packed, byteMask ) );
+    __m128 v1 = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( packed, 8 ), byteMask ) );
+    __m128 v2 = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( packed, 16 ), byteMask ) );
+
+    *x = _mm_add_ps( _mm_mul_ps( v1, _mm_set1_ps( frame->scale[ 1 ] ) ), _mm_set1_ps( frame->translate[ 1 ] ) );
+    *y = _mm_add_ps( _mm_mul_ps( v2, _mm_set1_ps( frame->scale[ 2 ] ) ), _mm_set1_ps( frame->translate[ 2 ] ) );
+
+    // Flipping the sign bit is exactly the same as negating
+    *z = _mm_add_ps( _mm_mul_ps( v0, _mm_set1_ps( frame->scale[ 0 ] ) ), _mm_set1_ps( frame->translate[ 0 ] ) );
+    *z = _mm_xor_ps( *z, _mm_set1_ps( -0.0f ) );
+};
+
+/**
+ * The SSE2 version of lerpCompressedFrames(). Each vertex is 4 bytes, so the
+ * vertices of 4 corners are loaded into one register, turned into numbers
+ * 4 at a time, and blended. The normals are still looked up one at a time.
+ */
+MD2LERP_TARGET_SSE2
+static void lerpCompressedSSE2( const MD2CompressedFrame *from, const MD2CompressedFrame *to, const short *corners,
+                                float t, int count, D3DMD2Vertex *vertices ) {
+    __m128 blend = _mm_set1_ps( t );
+
+    const int *packedFrom = ( const int * ) from->vertices;
+    const int *packedTo = ( const int * ) to->vertices;
+
+    int i;
+    for ( i = 0; i + 4 <= count; i += 4 ) {
+        int c0 = corners[ i ];
+        int c1 = corners[ i + 1 ];
+        int c2 = corners[ i + 2 ];
+        int c3 = corners[ i + 3 ];
+
+        __m128 ax, ay, az, bx, by, bz;
+        decodePositions4( _mm_set_epi32( packedFrom[ c3 ], packedFrom[ c2 ], packedFrom[ c1 ], packedFrom[ c0 ] ), from, &ax, &ay, &az );
+        decodePositions4( _mm_set_epi32( packedTo[ c3 ], packedTo[ c2 ], packedTo[ c1 ], packedTo[ c0 ] ), to, &bx, &by, &bz );
+
+        int na0 = from->vertices[ c0 ].lightNormalIndex;
+        int na1 = from->vertices[ c1 ].lightNormalIndex;
+        int na2 = from->vertices[ c2 ].lightNormalIndex;
+        int na3 = from->vertices[ c3 ].lightNormalIndex;
+        int nb0 = to->vertices[ c0 ].lightNormalIndex;
+        int nb1 = to->vertices[ c1 ].lightNormalIndex;
+        int nb2 = to->vertices[ c2 ].lightNormalIndex;
+        int nb3 = to->vertices[ c3 ].lightNormalIndex;
+
+        __m128 anx = _mm_set_ps( normalX[ na3 ], normalX[ na2 ], normalX[ na1 ], normalX[ na0 ] );
+        __m128 any = _mm_set_ps( normalY[ na3 ], normalY[ na2 ], normalY[ na1 ], normalY[ na0 ] );
+        __m128 anz = _mm_set_ps( normalZ[ na3 ], normalZ[ na2 ], normalZ[ na1 ], normalZ[ na0 ] );
+        __m128 bnx = _mm_set_ps( normalX[ nb3 ], normalX[ nb2 ], normalX[ nb1 ], normalX[ nb0 ] );
+        __m128 bny = _mm_set_ps( normalY[ nb3 ], normalY[ nb2 ], normalY[ nb1 ], normalY[ nb0 ] );
+        __m128 bnz = _mm_set_ps( normalZ[ nb3 ], normalZ[ nb2 ], normalZ[ nb1 ], normalZ[ nb0 ] );
+
+        storeVertices4( vertices + i,
+                        _mm_add_ps( ax, _mm_mul_ps( blend, _mm_sub_ps( bx, ax ) ) ),
+                        _mm_add_ps( ay, _mm_mul_ps( blend, _mm_sub_ps( by, ay ) ) ),
+                        _mm_add_ps( az, _mm_mul_ps( blend, _mm_sub_ps( bz, az ) ) ),
+                        _mm_add_ps( anx, _mm_mul_ps( blend, _mm_sub_ps( bnx, anx ) ) ),
+                        _mm_add_ps( any, _mm_mul_ps( blend, _mm_sub_ps( bny, any ) ) ),
+                        _mm_add_ps( anz, _mm_mul_ps( blend, _mm_sub_ps( bnz, anz ) ) ) );
+    }
+
+    // The last few corners
+    lerpCompressedScalar( from, to, corners, t, i, count, vertices );
+};
+#endif
+
+
+/**
+ * Asks the CPU which instruction sets can be used
+ */
+static MD2LerpPath detectPath() {
+#if defined( MD2LERP_HAS_SSE )
+    unsigned int edx = 0;
+
+    #if defined( _MSC_VER )
+        int info[ 4 ];
+        __cpuid( info, 0 );
+
+        if ( info[ 0 ] >= 1 ) {
+            __cpuid( info, 1 );
+            edx = info[ 3 ];
+        }
+    #else
+        unsigned int eax, ebx, ecx;
+        if ( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) ) {
+            edx = 0;
+        }
+    #endif
+
+    if ( edx & ( 1 << 26 ) ) {
+        return MD2_LERP_SSE2;
+    }
+
+    if ( edx & ( 1 << 25 ) ) {
+        return MD2_LERP_SSE;
+    }
+#endif
+
+    return MD2_LERP_SCALAR;
+};
+
+
+/**
+ * Fills in the tables of normals in Direct3D's axes
+ */
+static void prepareNormals() {
+    for ( int i = 0; i < 162; ++i ) {
+        normalX[ i ] = anorms[ i ][ 1 ];
+        normalY[ i ] = anorms[ i ][ 2 ];
+        normalZ[ i ] = -anorms[ i ][ 0 ];
+    }
+};
+
+
+// The path that lerpKeyFrames() and lerpCompressedFrames() use. It is worked
+// out the first time that it is needed.
+static int md2LerpPath = -1;
+
+
+/**
+ * Returns the path that lerpKeyFrames() and lerpCompressedFrames() use on
+ * this CPU
+ */
+MD2LerpPath getMD2LerpPath() {
+    if ( md2LerpPath < 0 ) {
+        prepareNormals();
+        md2LerpPath = detectPath();
+    }
+
+    return ( MD2LerpPath ) md2LerpPath;
+};
+
+
+/**
+ * lerpKeyFramesWith() is the same as lerpKeyFrames(), except that it uses the
+ * given path, whether or not the CPU supports it. A path that wasn't compiled
+ * in falls back to the plain version.
+ */
+void lerpKeyFramesWith( MD2LerpPath path, const MD2KeyFrame *from, const MD2KeyFrame *to, float t, int count, D3DMD2Vertex *vertices ) {
+    if ( count <= 0 ) {
+        return;
+    }
+
+    switch ( path ) {
+#ifdef MD2LERP_HAS_SSE
+        case MD2_LERP_SSE:
+        case MD2_LERP_SSE2:
+            lerpSSE( from, to, t, count, vertices );
+            return;
+#endif
+        default:
+            lerpScalar( from, to, t, 0, count, vertices );
+            return;
+    }
+};
+
+/**
+ * lerpKeyFrames() blends "count" corners of frame "from" towards frame "to"
+ * by "t", and writes the positions and normals into vertices[ 0 ] up to
+ * vertices[ count - 1 ].
+ */
+void lerpKeyFrames( const MD2KeyFrame *from, const MD2KeyFrame *to, float t, int count, D3DMD2Vertex *vertices ) {
+    lerpKeyFramesWith( getMD2LerpPath(), from, to, t, count, vertices );
+};
+
+
+/**
+ * lerpCompressedFramesWith() is the same as lerpCompressedFrames(), except
+ * that it uses the given path, whether or not the CPU supports it. A path
+ * that wasn't compiled in, or that can't blend compressed frames, falls back
+ * to the plain version.
+ */
+void lerpCompressedFramesWith( MD2LerpPath path, const MD2CompressedFrame *from, const MD2CompressedFrame *to,
+                               const short *corners, float t, int count, D3DMD2Vertex *vertices ) {
+    if ( count <= 0 ) {
+        return;
+    }
+
+    // Make sure that the tables of normals have been filled in
+    getMD2LerpPath();
+
+    switch ( path ) {
+#ifdef MD2LERP_HAS_SSE
+        case MD2_LERP_SSE2:
+            lerpCompressedSSE2( from, to, corners, t, count, vertices );
+            return;
+#endif
+        default:
+            lerpCompressedScalar( from, to, corners, t, 0, count, vertices );
+            return;
+    }
+};
+
+/**
+ * lerpCompressedFrames() is the same as lerpKeyFrames(), for compressed
+ * frames. Corner #i is vertex #corners[ i ] of each frame.
+ */
+void lerpCompressedFrames( const MD2CompressedFrame *from, const MD2CompressedFrame *to, const short *corners,
+                           float t, int count, D3DMD2Vertex *vertices ) {
+    lerpCompressedFramesWith( getMD2LerpPath(), from, to, corners, t, count, vertices );
+};
+
+
+/**
+ * The loop that MD2Model::update() used to blend its frames with, with a
+ * Vector3 for each corner in Quake 2's axes, for benchmarkMD2Lerp() to
+ * compare against
+ */
+static void lerpAoS( const Vector3 *fromVerts, const Vector3 *fromNormals,
+                     const Vector3 *toVerts, const Vector3 *toNormals,
+                     float t, int count, D3DMD2Vertex *vertices ) {
+    for ( int i = 0; i < count; ++i ) {
+        float v1, v2;
+
+        v1 = fromVerts[ i ].y;
+        v2 = toVerts[ i ].y;
+        vertices[ i ].x = v1 + t * ( v2 - v1 );
+
+        v1 = fromVerts[ i ].z;
+        v2 = toVerts[ i ].z;
+        vertices[ i ].y = v1 + t * ( v2 - v1 );
+
+        v1 = -fromVerts[ i ].x;
+        v2 = -toVerts[ i ].x;
+        vertices[ i ].z = v1 + t * ( v2 - v1 );
+
+        v1 = fromNormals[ i ].y;
+        v2 = toNormals[ i ].y;
+        vertices[ i ].nx = v1 + t * ( v2 - v1 );
+
+        v1 = fromNormals[ i ].z;
+        v2 = toNormals[ i ].z;
+        vertices[ i ].ny = v1 + t * ( v2 - v1 );
+
+        v1 = -fromNormals[ i ].x;
+        v2 = -toNormals[ i ].x;
+        vertices[ i ].nz = v1 + t * ( v2 - v1 );
+    }
+};
+
+
+/**
+ * Returns a random number from min to max
+ */
+static float randomFloat( float min, float max ) {
+    return min + ( max - min ) * ( float ) rand() / ( float ) RAND_MAX;
+};
+
+/**
+ * Returns the largest difference between the positions and normals of
+ * "count" vertices in "a" and "b"
+ */
+static float maxVertexDifference( const D3DMD2Vertex *a, const D3DMD2Vertex *b, int count ) {
+    float maxDifference = 0.0f;
+
+    for ( int i = 0; i < count; ++i ) {
+        float differences[ 6 ] = {
+            fabs( a[ i ].x - b[ i ].x ), fabs( a[ i ].y - b[ i ].y ), fabs( a[ i ].z - b[ i ].z ),
+            fabs( a[ i ].nx - b[ i ].nx ), fabs( a[ i ].ny - b[ i ].ny ), fabs( a[ i ].nz - b[ i ].nz )
+        };
+
+        for ( int e = 0; e < 6; ++e ) {
+            if ( differences[ e ] > maxDifference ) {
+                maxDifference = differences[ e ];
+            }
+        }
+    }
+
+    return maxDifference;
+};
+
+/**
+ * benchmarkMD2Lerp() makes two random frames with "numVertices" corners (and
+ * half as many vertices), then blends them "repeats" times with each way, and
+ * fills in "result" with how long each way took.
+ */
+void benchmarkMD2Lerp( int numVertices, int repeats, MD2LerpBenchmark *result ) {
+    int numUnique = numVertices / 2;
+    if ( numUnique < 1 ) {
+        numUnique = 1;
+    }
+
+    // Two compressed frames, and the vertex that each corner points at
+    vector< MD2Vertex > packed[ 2 ];
+    MD2CompressedFrame compressed[ 2 ];
+    vector< short > corners;
+
+    // The same frames turned into corners in Quake 2's axes, the way that
+    // they were kept before, and split up and turned into Direct3D's axes
+    vector< Vector3 > verts[ 2 ];
+    vector< Vector3 > normals[ 2 ];
+    vector< float > components[ 2 ][ 6 ];
+    MD2KeyFrame frames[ 2 ];
+
+    srand( 1 );
+
+    corners.resize( numVertices );
+    for ( int i = 0; i < numVertices; ++i ) {
+        corners[ i ] = ( short ) ( rand() % numUnique );
+    }
+
+    // Make sure that the tables of normals have been filled in
+    getMD2LerpPath();
+
+    for ( int f = 0; f < 2; ++f ) {
+        packed[ f ].resize( numUnique );
+
+        for ( int i = 0; i < numUnique; ++i ) {
+            for ( int e = 0; e < 3; ++e ) {
+                packed[ f ][ i ].v[ e ] = ( unsigned char ) ( rand() % 256 );
+            }
+            packed[ f ][ i ].lightNormalIndex = ( unsigned char ) ( rand() % 162 );
+        }
+
+        compressed[ f ].vertices = &packed[ f ][ 0 ];
+        for ( int e = 0; e < 3; ++e ) {
+            compressed[ f ].scale[ e ] = randomFloat( 0.1f, 0.3f );
+            compressed[ f ].translate[ e ] = randomFloat( -30.0f, 0.0f );
+        }
+
+        verts[ f ].resize( numVertices );
+        normals[ f ].resize( numVertices );
+
+        for ( int c = 0; c < 6; ++c ) {
+            components[ f ][ c ].resize( numVertices );
+        }
+
+        for ( int i = 0; i < numVertices; ++i ) {
+            const MD2Vertex *vertex = &packed[ f ][ corners[ i ] ];
+
+            verts[ f ][ i ].x = float( vertex->v[ 0 ] ) * compressed[ f ].scale[ 0 ] + compressed[ f ].translate[ 0 ];
+            verts[ f ][ i ].y = float( vertex->v[ 1 ] ) * compressed[ f ].scale[ 1 ] + compressed[ f ].translate[ 1 ];
+            verts[ f ][ i ].z = float( vertex->v[ 2 ] ) * compressed[ f ].scale[ 2 ] + compressed[ f ].translate[ 2 ];
+            normals[ f ][ i ].x = anorms[ vertex->lightNormalIndex ][ 0 ];
+            normals[ f ][ i ].y = anorms[ vertex->lightNormalIndex ][ 1 ];
+            normals[ f ][ i ].z = anorms[ vertex->lightNormalIndex ][ 2 ];
+
+            components[ f ][ 0 ][ i ] = verts[ f ][ i ].y;
+            components[ f ][ 1 ][ i ] = verts[ f ][ i ].z;
+            components[ f ][ 2 ][ i ] = -verts[ f ][ i ].x;
+            components[ f ][ 3 ][ i ] = normals[ f ][ i ].y;
+            components[ f ][ 4 ][ i ] = normals[ f ][ i ].z;
+            components[ f ][ 5 ][ i ] = -normals[ f ][ i ].x;
+        }
+
+        frames[ f ].x = &components[ f ][ 0 ][ 0 ];
+        frames[ f ].y = &components[ f ][ 1 ][ 0 ];
+        frames[ f ].z = &components[ f ][ 2 ][ 0 ];
+        frames[ f ].nx = &components[ f ][ 3 ][ 0 ];
+        frames[ f ].ny = &components[ f ][ 4 ][ 0 ];
+        frames[ f ].nz = &components[ f ][ 5 ][ 0 ];
+    }
+
+    vector< D3DMD2Vertex > aosVertices;
+    vector< D3DMD2Vertex > scalarVertices;
+    vector< D3DMD2Vertex > pathVertices;
+    vector< D3DMD2Vertex > compressedScalarVertices;
+    vector< D3DMD2Vertex > compressedPathVertices;
+    aosVertices.resize( numVertices );
+    scalarVertices.resize( numVertices );
+    pathVertices.resize( numVertices );
+    compressedScalarVertices.resize( numVertices );
+    compressedPathVertices.resize( numVertices );
+
+    // Each repeat blends by a different amount, like a model that is playing
+    // its animation
+    Timer timer;
+
+    unsigned int start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        lerpAoS( &verts[ 0 ][ 0 ], &normals[ 0 ][ 0 ], &verts[ 1 ][ 0 ], &normals[ 1 ][ 0 ],
+                 ( float ) r / repeats, numVertices, &aosVertices[ 0 ] );
+    }
+    result->aosMillis = timer.getTimeMillis() - start;
+
+    start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        lerpKeyFramesWith( MD2_LERP_SCALAR, &frames[ 0 ], &frames[ 1 ], ( float ) r / repeats, numVertices, &scalarVertices[ 0 ] );
+    }
+    result->scalarMillis = timer.getTimeMillis() - start;
+
+    start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        lerpKeyFramesWith( getMD2LerpPath(), &frames[ 0 ], &frames[ 1 ], ( float ) r / repeats, numVertices, &pathVertices[ 0 ] );
+    }
+    result->sseMillis = timer.getTimeMillis() - start;
+
+    start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        lerpCompressedFramesWith( MD2_LERP_SCALAR, &compressed[ 0 ], &compressed[ 1 ], &corners[ 0 ],
+                                  ( float ) r / repeats, numVertices, &compressedScalarVertices[ 0 ] );
+    }
+    result->compressedScalarMillis = timer.getTimeMillis() - start;
+
+    start = timer.getTimeMillis();
+    for ( int r = 0; r < repeats; ++r ) {
+        lerpCompressedFramesWith( getMD2LerpPath(), &compressed[ 0 ], &compressed[ 1 ], &corners[ 0 ],
+                                  ( float ) r / repeats, numVertices, &compressedPathVertices[ 0 ] );
+    }
+    result->compressedSSEMillis = timer.getTimeMillis() - start;
+
+    // Every way must give the same vertices. The last repeat of each way
+    //  blended by the same amount, so their vertices can be compared.
+    float aosDifference = maxVertexDifference( &scalarVertices[ 0 ], &aosVertices[ 0 ], numVertices );
+    float pathDifference = maxVertexDifference( &scalarVertices[ 0 ], &pathVertices[ 0 ], numVertices );
+    result->maxDifference = aosDifference > pathDifference ? aosDifference : pathDifference;
+
+    // The compressed paths are checked against what lerpKeyFrames() itself
+    //  gives for the same frames
+    vector< D3DMD2Vertex > keyFrameVertices;
+    keyFrameVertices.resize( numVertices );
+    lerpKeyFrames( &frames[ 0 ], &frames[ 1 ], repeats > 0 ? ( float ) ( repeats - 1 ) / repeats : 0.0f,
+                   numVertices, &keyFrameVertices[ 0 ] );
+
+    float scalarDifference = maxVertexDifference( &keyFrameVertices[ 0 ], &compressedScalarVertices[ 0 ], numVertices );
+    float sse2Difference = maxVertexDifference( &keyFrameVertices[ 0 ], &compressedPathVertices[ 0 ], numVertices );
+    result->compressedDifference = scalarDifference > sse2Difference ? scalarDifference : sse2Difference;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------
+
+#ifndef MD2LerpH
+#define MD2LerpH
+
+#include "MD2.h"
+
+/**
+ * An explanation on keyframe interpolation:
+ *      An MD2 model is animated by blending two of its frames together. Every
+ *  triangle corner's position and normal in the first frame is moved part of
+ *  the way ("t", from 0 to 1) towards the same corner in the second frame:
+ *          v = v1 + t * ( v2 - v1 )
+ *  and the results are written into the model's vertex buffer.
+ *
+ *      Quake 2's axes are not Direct3D's, so each position and normal has its
+ *  axes swapped around ( x, y, z ) -> ( y, z, -x ). That is done once, when
+ *  the model is loaded, instead of every time that a frame is drawn.
+ *
+ *      Each frame keeps each of the six numbers of every corner in its own
+ *  array (an MD2KeyFrame), so that 4 corners can be loaded into one SSE
+ *  register at once, the same way as a BoxArray.
+ *
+ *      Those arrays take 24 bytes for every corner of every frame, many times
+ *  the size of the frames in the .md2 file, which keep 4 bytes for each vertex
+ *  (each corner only points at a vertex): one byte for each axis, which is
+ *  scaled and moved by the frame's scale and translate, and the number of a
+ *  normal in the table in anorms.h. A model can keep its frames like that
+ *  instead (an MD2CompressedFrame), and lerpCompressedFrames() turns both
+ *  frames back into positions and normals while it blends them.
+ *
+ *      lerpKeyFrames() and lerpCompressedFrames() pick the fastest way to
+ *  blend the frames that the CPU supports, the first time that they are
+ *  called:
+ *   - SSE blends 4 corners at once, and turns them into 4 vertices. The
+ *     compressed frames need SSE2, to turn the bytes into numbers 4 at a time.
+ *   - Otherwise, a plain loop blends one corner at a time.
+ *  The SSE versions are only compiled in by compilers that have the intrinsics
+ *  for them (Visual C++ and GCC). C++Builder 6, which Quake2.bpr is built with,
+ *  doesn't have them, so that build always uses the plain loop. Only the
+ *  positions and normals of the vertices are written; their texture
+ *  coordinates are left alone.
+ */
+
+/**
+ * The ways that lerpKeyFrames() can blend frames
+ */
+enum MD2LerpPath {
+    MD2_LERP_SCALAR,
+    MD2_LERP_SSE,
+    MD2_LERP_SSE2
+};
+
+
+/**
+ * A frame of an MD2 model, as one array for each component of the positions
+ * and normals of its triangle corners, in Direct3D's axes
+ */
+typedef struct {
+    const float *x;
+    const float *y;
+    const float *z;
+    const float *nx;
+    const float *ny;
+    const float *nz;
+} MD2KeyFrame;
+
+/**
+ * A frame of an MD2 model, the way that it is stored in the .md2 file: the
+ * frame's vertices, and the scale and translate that turn their bytes into
+ * positions (in Quake 2's axes)
+ */
+typedef struct {
+    const MD2Vertex *vertices;
+    float scale[ 3 ];
+    float translate[ 3 ];
+} MD2CompressedFrame;
+
+
+/**
+ * lerpKeyFrames() blends "count" corners of frame "from" towards frame "to"
+ * by "t", and writes the positions and normals into vertices[ 0 ] up to
+ * vertices[ count - 1 ].
+ */
+void lerpKeyFrames( const MD2KeyFrame *from, const MD2KeyFrame *to, float t, int count, D3DMD2Vertex *vertices );
+
+/**
+ * lerpKeyFramesWith() is the same as lerpKeyFrames(), except that it uses the
+ * given path, whether or not the CPU supports it. This is for comparing the
+ * paths against each other.
+ */
+void lerpKeyFramesWith( MD2LerpPath path, const MD2KeyFrame *from, const MD2KeyFrame *to, float t, int count, D3DMD2Vertex *vertices );
+
+/**
+ * lerpCompressedFrames() is the same as lerpKeyFrames(), for compressed
+ * frames. Corner #i is vertex #corners[ i ] of each frame.
+ */
+void lerpCompressedFrames( const MD2CompressedFrame *from, const MD2CompressedFrame *to, const short *corners,
+                           float t, int count, D3DMD2Vertex *vertices );
+
+/**
+ * lerpCompressedFramesWith() is the same as lerpCompressedFrames(), except
+ * that it uses the given path, whether or not the CPU supports it
+ */
+void lerpCompressedFramesWith( MD2LerpPath path, const MD2CompressedFrame *from, const MD2CompressedFrame *to,
+                               const short *corners, float t, int count, D3DMD2Vertex *vertices );
+
+/**
+ * Returns the path that lerpKeyFrames() and lerpCompressedFrames() use on
+ * this CPU
+ */
+MD2LerpPath getMD2LerpPath();
+
+
+/**
+ * The results of benchmarkMD2Lerp()
+ */
+typedef struct {
+    // How long each way of blending took, in milliseconds. aosMillis is the
+    // loop that MD2Model::update() used before the frames were split up: one
+    // Vector3 per corner, with the axes swapped while blending.
+    unsigned int aosMillis;
+    unsigned int scalarMillis;
+    unsigned int sseMillis;
+
+    // How long blending the same frames took when they were compressed, with
+    // the plain loop and with the chosen path
+    unsigned int compressedScalarMillis;
+    unsigned int compressedSSEMillis;
+
+    // The largest difference between the vertices from the plain path and
+    // the vertices from the old loop and the chosen path (this should be 0, or
+    // very close to it)
+    float maxDifference;
+
+    // The largest difference between the vertices that lerpKeyFrames() gave
+    // and the vertices from both compressed paths, which decode the same
+    // frames from their bytes
+    float compressedDifference;
+} MD2LerpBenchmark;
+
+// The largest difference that benchmarkMD2Lerp() can find between two ways of
+// blending before they are said not to match
+const float MD2_LERP_TOLERANCE = 0.0001f;
+
+/**
+ * benchmarkMD2Lerp() makes two random frames with "numVertices" corners (and
+ * half as many vertices), then blends them "repeats" times with each way, and
+ * fills in "result" with how long each way took.
+ */
+void benchmarkMD2Lerp( int numVertices, int repeats, MD2LerpBenchmark *result );
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,387 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "MD2Renderer.h"
+
+#include <string.h>
+
+
+/**
+ * The layout of the instanced vertices: the triangle corners in stream 0
+ * (MD2CornerVertex), and the instances in stream 1 (MD2InstanceData)
+ */
+static const D3DVERTEXELEMENT9 MD2_INSTANCE_ELEMENTS[] = {
+    { 0, 0,  D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
+    { 1, 0,  D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+    { 1, 16, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 2 },
+    { 1, 32, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 3 },
+    { 1, 48, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 4 },
+    { 1, 64, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 5 },
+    D3DDECL_END()
+};
+
+
+/**
+ * Returns true if the device can run vertex shader 3.0, and read floating
+ * point textures in the vertex shader
+ */
+static bool canReadVertexTextures( LPDIRECT3DDEVICE9 device ) {
+    D3DCAPS9 caps;
+    if ( FAILED( device->GetDeviceCaps( &caps ) ) || caps.VertexShaderVersion < D3DVS_VERSION( 3, 0 ) ) {
+        return false;
+    }
+
+    LPDIRECT3D9 d3d;
+    D3DDISPLAYMODE mode;
+    if ( FAILED( device->GetDirect3D( &d3d ) ) ) {
+        return false;
+    }
+
+    HRESULT result = device->GetDisplayMode( 0, &mode );
+    if ( SUCCEEDED( result ) ) {
+        result = d3d->CheckDeviceFormat( caps.AdapterOrdinal, caps.DeviceType, mode.Format,
+                                         D3DUSAGE_QUERY_VERTEXTEXTURE, D3DRTYPE_TEXTURE, D3DFMT_A32B32G32R32F );
+    }
+
+    d3d->Release();
+    return SUCCEEDED( result );
+};
+
+
+/**
+ * Constructor prepares a renderer that draws each instance by itself.
+ * init() has to be called before anything is drawn.
+ */
+MD2Renderer::MD2Renderer() {
+    device = NULL;
+    animator = NULL;
+    path = MD2_RENDER_EACH;
+    declaration = NULL;
+
+    batchBuffer = NULL;
+    batchCapacity = 0;
+    instanceBuffer = NULL;
+    instanceCapacity = 0;
+};
+
+/**
+ * Destructor releases the buffers and the effect
+ */
+MD2Renderer::~MD2Renderer() {
+    unload();
+};
+
+
+/**
+ * init() makes the effect and the vertex declaration for instanced drawing, if
+ * the device can draw that way. Instances are drawn by themselves until
+ * setPath() is called. CPU batches are blended with "animator". With a NULL
+ * device, CPU batches are blended into memory and their calls made without a
+ * vertex buffer, so that they can be recorded by a RecordingRenderDevice.
+ */
+void MD2Renderer::init( LPDIRECT3DDEVICE9 device, MD2Animator *animator ) {
+    this->device = device;
+    this->animator = animator;
+
+    if ( device != NULL && canReadVertexTextures( device ) ) {
+        instanceShader.createEffect( device, "transform.fx", "MD2Instanced" );
+
+        // Without the effect, there is nothing to draw the instances with, so
+        //  the declaration is left NULL
+        if ( instanceShader.getEffect() != NULL ) {
+            if ( FAILED( device->CreateVertexDeclaration( MD2_INSTANCE_ELEMENTS, &declaration ) ) ) {
+                declaration = NULL;
+            }
+        }
+    }
+
+    // The batched paths light every instance of a model the same way, so
+    //  they are only used when they are asked for
+    path = MD2_RENDER_EACH;
+};
+
+/**
+ * unload() releases everything that the renderer made
+ */
+void MD2Renderer::unload() {
+    if ( declaration != NULL ) {
+        declaration->Release();
+        declaration = NULL;
+    }
+    if ( batchBuffer != NULL ) {
+        batchBuffer->Release();
+        batchBuffer = NULL;
+    }
+    if ( instanceBuffer != NULL ) {
+        instanceBuffer->Release();
+        instanceBuffer = NULL;
+    }
+
+    batchCapacity = 0;
+    instanceCapacity = 0;
+    memoryVertices.clear();
+    batches.clear();
+};
+
+
+/**
+ * setPath() changes the way that instances are drawn. Returns false, without
+ * changing it, if the device can't draw that way.
+ */
+bool MD2Renderer::setPath( MD2RenderPath path ) {
+    if ( path == MD2_RENDER_INSTANCED && !canInstance() ) {
+        return false;
+    }
+
+    this->path = path;
+    return true;
+};
+
+/**
+ * Returns the name of a path, for the console
+ */
+const char *MD2Renderer::getPathName( MD2RenderPath path ) {
+    switch ( path ) {
+        case MD2_RENDER_EACH:
+            return "one draw call for each instance";
+        case MD2_RENDER_CPU_BATCH:
+            return "one CPU batch for each model";
+        case MD2_RENDER_INSTANCED:
+            return "one instanced draw call for each model";
+        default:
+            return "unknown";
+    }
+};
+
+
+/**
+ * add() queues "instance" to be drawn with the world matrix "world" by the
+ * next call to render()
+ */
+void MD2Renderer::add( MD2Instance *instance, const D3DXMATRIX *world ) {
+    MD2PlacedInstance queued;
+    queued.instance = instance;
+    queued.world = *world;
+
+    // There are only a few models, so the batches are searched in order
+    for ( unsigned int i = 0; i < batches.size(); ++i ) {
+        if ( batches[ i ].model == instance->getModel() && batches[ i ].skinNum == instance->getSkinNum() ) {
+            batches[ i ].instances.push_back( queued );
+            return;
+        }
+    }
+
+    batches.push_back();
+    batches.back().model = instance->getModel();
+    batches.back().skinNum = instance->getSkinNum();
+    batches.back().instances.push_back( queued );
+};
+
+/**
+ * render() draws every queued instance, and empties the queue. Returns the
+ * number of draw calls that it made.
+ */
+int MD2Renderer::render( RenderDevice *device ) {
+    int drawCalls = 0;
+
+    for ( unsigned int i = 0; i < batches.size(); ++i ) {
+        if ( path == MD2_RENDER_INSTANCED ) {
+            drawCalls += renderInstanced( device, &batches[ i ] );
+        } else if ( path == MD2_RENDER_CPU_BATCH ) {
+            drawCalls += renderCPUBatch( device, &batches[ i ] );
+        } else {
+            drawCalls += renderEach( device, &batches[ i ] );
+        }
+    }
+
+    batches.clear();
+    return drawCalls;
+};
+
+
+/**
+ * Draws each instance by itself, with its own world matrix
+ */
+int MD2Renderer::renderEach( RenderDevice *device, Batch *batch ) {
+    for ( unsigned int i = 0; i < batch->instances.size(); ++i ) {
+        device->setTransform( D3DTS_WORLD, &batch->instances[ i ].world );
+        batch->instances[ i ].instance->render( device );
+    }
+
+    return batch->instances.size();
+};
+
+/**
+ * Blends every instance into the batch buffer, moved into the world, and
+ * draws them with as few draw calls as possible
+ */
+int MD2Renderer::renderCPUBatch( RenderDevice *device, Batch *batch ) {
+    MD2Model *model = batch->model;
+    int numCorners = model->getNumCorners();
+    int numInstances = batch->instances.size();
+
+    if ( numCorners <= 0 ||
+         ( this->device != NULL &&
+           !reserve( &batchBuffer, &batchCapacity, sizeof( D3DMD2Vertex ) * numCorners * numInstances ) ) ) {
+        return renderEach( device, batch );
+    }
+
+    // Each instance is blended into its own part of the buffer, on as many
+    //  threads as the animator has. They have all finished before it is
+    //  unlocked and drawn.
+    if ( this->device == NULL ) {
+        memoryVertices.resize( numCorners * numInstances );
+        animator->blend( model, &batch->instances[ 0 ], numInstances, &memoryVertices[ 0 ] );
+    } else {
+        D3DMD2Vertex *vertices;
+        batchBuffer->Lock( 0, sizeof( D3DMD2Vertex ) * numCorners * numInstances, ( void ** ) &vertices, D3DLOCK_DISCARD );
+        animator->blend( model, &batch->instances[ 0 ], numInstances, vertices );
+        batchBuffer->Unlock();
+    }
+
+
+    // The vertices are already in the world. The normals were scaled along
+    //  with the positions, so Direct3D has to normalize them again.
+    D3DXMATRIX identity;
+    D3DXMatrixIdentity( &identity );
+    device->setTransform( D3DTS_WORLD, &identity );
+
+    device->setRenderState( D3DRS_SPECULARENABLE, FALSE );
+    device->setRenderState( D3DRS_NORMALIZENORMALS, TRUE );
+    device->setRenderState( D3DRS_LIGHTING, TRUE );
+    device->setRenderState( D3DRS_CULLMODE, D3DCULL_CCW );
+
+    device->setFVF( MD2FVF );
+    device->setTexture( 0, model->skins[ batch->skinNum ].getTexture() );
+    device->setStreamSource( 0, batchBuffer, 0, sizeof( D3DMD2Vertex ) );
+
+    // Whole instances are drawn together, as many as fit into one draw call
+    int numTriangles = numCorners / 3;
+    int instancesPerDraw = MD2_MAX_BATCH_PRIMITIVES / numTriangles;
+    if ( instancesPerDraw < 1 ) {
+        instancesPerDraw = 1;
+    }
+
+    int drawCalls = 0;
+    for ( int n = 0; n < numInstances; n += instancesPerDraw ) {
+        int count = numInstances - n;
+        if ( count > instancesPerDraw ) {
+            count = instancesPerDraw;
+        }
+
+        device->drawPrimitive( D3DPT_TRIANGLELIST, n * numCorners, count * numTriangles );
+        ++drawCalls;
+    }
+
+    device->setRenderState( D3DRS_NORMALIZENORMALS, FALSE );
+    device->setRenderState( D3DRS_LIGHTING, FALSE );
+
+    return drawCalls;
+};
+
+/**
+ * Draws every instance with one instanced draw call, blending them in the
+ * vertex shader
+ */
+int MD2Renderer::renderInstanced( RenderDevice *device, Batch *batch ) {
+    MD2Model *model = batch->model;
+    int numCorners = model->getNumCorners();
+    int numInstances = batch->instances.size();
+
+    if ( numCorners <= 0 || !model->createInstanceBuffers( this->device ) ||
+         !reserve( &instanceBuffer, &instanceCapacity, sizeof( MD2InstanceData ) * numInstances ) ) {
+        return renderCPUBatch( device, batch );
+    }
+
+    // Each instance's world matrix, and where it is in its animation
+    MD2InstanceData *data;
+    instanceBuffer->Lock( 0, sizeof( MD2InstanceData ) * numInstances, ( void ** ) &data, D3DLOCK_DISCARD );
+
+    for ( int n = 0; n < numInstances; ++n ) {
+        MD2Instance *instance = batch->instances[ n ].instance;
+
+        memcpy( data[ n ].world, batch->instances[ n ].world.m, sizeof( data[ n ].world ) );
+        data[ n ].fromFrame = ( float ) instance->getFrameNum();
+        data[ n ].toFrame = ( float ) instance->getNextFrame();
+        data[ n ].blend = instance->getInterpolation();
+        data[ n ].unused = 0.0f;
+    }
+
+    instanceBuffer->Unlock();
+
+
+    ID3DXEffect *effect = instanceShader.getEffect();
+
+    D3DXMATRIX view;
+    D3DXMATRIX proj;
+    device->getTransform( D3DTS_VIEW, &view );
+    device->getTransform( D3DTS_PROJECTION, &proj );
+
+    device->setEffectMatrix( effect, "view", &view );
+    device->setEffectMatrix( effect, "proj", &proj );
+    device->setEffectTexture( effect, "md2Frames", model->getFrameTexture() );
+    device->setEffectFloat( effect, "md2FramesWidth", ( float ) ( model->getNumVertices() * 2 ) );
+    device->setEffectFloat( effect, "md2FramesHeight", ( float ) model->getNumFrames() );
+    device->setEffectTexture( effect, "modelTexture", model->skins[ batch->skinNum ].getTexture() );
+
+    device->setRenderState( D3DRS_CULLMODE, D3DCULL_CCW );
+
+    // Stream 0 is drawn once for each instance, and stream 1 moves on by one
+    //  instance each time
+    device->setVertexDeclaration( declaration );
+    device->setStreamSource( 0, model->getCornerBuffer(), 0, sizeof( MD2CornerVertex ) );
+    device->setStreamSourceFreq( 0, D3DSTREAMSOURCE_INDEXEDDATA | numInstances );
+    device->setStreamSource( 1, instanceBuffer, 0, sizeof( MD2InstanceData ) );
+    device->setStreamSourceFreq( 1, D3DSTREAMSOURCE_INSTANCEDATA | 1 );
+    device->setIndices( model->getCornerIndices() );
+
+    UINT Pass, Passes;
+
+    Passes = device->beginEffect( effect );
+    for ( Pass = 0; Pass < Passes; Pass++ ) {
+        device->beginPass( effect, Pass );
+        device->drawIndexedPrimitive( D3DPT_TRIANGLELIST, 0, 0, numCorners, 0, numCorners / 3 );
+        device->endPass( effect );
+    }
+    device->endEffect( effect );
+
+    // Put the streams back, so that the next things drawn aren't instanced
+    device->setStreamSourceFreq( 0, 1 );
+    device->setStreamSourceFreq( 1, 1 );
+    device->setStreamSource( 1, NULL, 0, 0 );
+
+    return Passes;
+};
+
+
+/**
+ * Makes sure that the dynamic vertex buffer "buffer" can hold at least "size"
+ * bytes. Returns false if it could not be made.
+ */
+bool MD2Renderer::reserve( LPDIRECT3DVERTEXBUFFER9 *buffer, unsigned int *capacity, unsigned int size ) {
+    if ( *buffer != NULL && *capacity >= size ) {
+        return true;
+    }
+
+    if ( *buffer != NULL ) {
+        ( *buffer )->Release();
+        *buffer = NULL;
+    }
+
+    // Grow to twice the size that is needed, so that a few more instances
+    //  next frame don't make a new buffer again
+    *capacity = size * 2;
+
+    if ( FAILED( device->CreateVertexBuffer( *capacity, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 0,
+                                             D3DPOOL_DEFAULT, buffer, NULL ) ) ) {
+        *buffer = NULL;
+        *capacity = 0;
+        return false;
+    }
+
+    return true;
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
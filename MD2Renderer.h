@@ -0,0 +1,187 @@
+//---------------------------------------------------------------------------
+
+#ifndef MD2RendererH
+#define MD2RendererH
+
+#include <vector.h>
+
+#include "MD2.h"
+#include "MD2Animator.h"
+#include "Shader.h"
+
+using namespace std;
+
+
+/**
+ * An explanation on drawing many MD2 instances:
+ *      MD2Instance::render() blends the instance's frames into its model's
+ *  vertex buffer and then draws it, so a hundred monsters fill the same buffer
+ *  a hundred times and make a hundred draw calls. The MD2Renderer collects the
+ *  instances that are drawn in a frame, groups them by model and skin, and
+ *  draws each group in one of these ways:
+ *   - MD2_RENDER_EACH draws each instance by itself, the same as before.
+ *   - MD2_RENDER_CPU_BATCH blends every instance of the group on the CPU into
+ *     one dynamic vertex buffer, already moved into the world, and draws them
+ *     all with one draw call. The blending is split across threads by an
+ *     MD2Animator.
+ *   - MD2_RENDER_INSTANCED draws the group with one instanced draw call, and
+ *     the vertex shader does the blending ("MD2Instanced" in transform.fx).
+ *     Stream 0 holds the model's triangle corners, and stream 1 holds each
+ *     instance's world matrix, its two frames and how far between them it is.
+ *
+ *      Direct3D 9 can't point a stream at a different frame for each instance,
+ *  so the instanced path reads both frames from a texture instead. Each row of
+ *  the model's frame texture is one frame, with the position and normal of
+ *  every vertex (see MD2Model::createInstanceBuffers()). That needs vertex
+ *  shader 3.0 and floating point vertex textures; without them, the CPU batch
+ *  is used instead.
+ *
+ *      A group is drawn with one set of lights. CPU batches use the fixed
+ *  function lights that are enabled when render() is called, and instanced
+ *  groups are lit from the camera. Only an instance that is drawn by itself
+ *  can be lit by the lights around it, so MD2_RENDER_EACH is used until
+ *  setPath() picks one of the others.
+ */
+
+/**
+ * The ways that an MD2Renderer can draw the instances
+ */
+enum MD2RenderPath {
+    MD2_RENDER_EACH,
+    MD2_RENDER_CPU_BATCH,
+    MD2_RENDER_INSTANCED,
+    NUM_MD2_RENDER_PATHS
+};
+
+/**
+ * What stream 1 holds for each instance that is drawn with
+ * MD2_RENDER_INSTANCED. The layout matches MD2_INSTANCE_ELEMENTS.
+ */
+typedef struct {
+    float world[ 4 ][ 4 ];
+
+    float fromFrame;
+    float toFrame;
+    float blend;
+    float unused;
+} MD2InstanceData;
+
+// The most triangles that a CPU batch draws with one draw call, which is the
+//  most that every Direct3D 9 device can draw at once
+#define MD2_MAX_BATCH_PRIMITIVES 65535
+
+
+class MD2Renderer {
+    public:
+
+        /**
+         * Constructor prepares a renderer that draws each instance by itself.
+         * init() has to be called before anything is drawn.
+         */
+        MD2Renderer();
+
+        /**
+         * Destructor releases the buffers and the effect
+         */
+        ~MD2Renderer();
+
+        /**
+         * init() makes the effect and the vertex declaration for instanced
+         * drawing, if the device can draw that way. Instances are drawn by
+         * themselves until setPath() is called. CPU batches are blended with
+         * "animator". With a NULL device, CPU batches are blended into memory
+         * and their calls made without a vertex buffer, so that they can be
+         * recorded by a RecordingRenderDevice.
+         */
+        void init( LPDIRECT3DDEVICE9 device, MD2Animator *animator );
+
+        /**
+         * unload() releases everything that the renderer made
+         */
+        void unload();
+
+        /**
+         * Returns true if the device can draw with MD2_RENDER_INSTANCED
+         */
+        bool canInstance() {
+            return declaration != NULL;
+        };
+
+        MD2RenderPath getPath() {
+            return path;
+        };
+
+        /**
+         * setPath() changes the way that instances are drawn. Returns false,
+         * without changing it, if the device can't draw that way.
+         */
+        bool setPath( MD2RenderPath path );
+
+        /**
+         * Returns the name of a path, for the console
+         */
+        static const char *getPathName( MD2RenderPath path );
+
+        /**
+         * add() queues "instance" to be drawn with the world matrix "world" by
+         * the next call to render()
+         */
+        void add( MD2Instance *instance, const D3DXMATRIX *world );
+
+        /**
+         * render() draws every queued instance, and empties the queue. Returns
+         * the number of draw calls that it made.
+         */
+        int render( RenderDevice *device );
+
+    private:
+
+        /**
+         * The instances of one model that use the same skin, which are drawn
+         * together
+         */
+        typedef struct {
+            MD2Model *model;
+            int skinNum;
+            vector< MD2PlacedInstance > instances;
+        } Batch;
+
+        // Draw every instance in "batch" one of the three ways. Each returns
+        //  the number of draw calls that it made.
+        int renderEach( RenderDevice *device, Batch *batch );
+        int renderCPUBatch( RenderDevice *device, Batch *batch );
+        int renderInstanced( RenderDevice *device, Batch *batch );
+
+        // Makes sure that the dynamic vertex buffer "buffer" can hold at least
+        //  "size" bytes. Returns false if it could not be made.
+        bool reserve( LPDIRECT3DVERTEXBUFFER9 *buffer, unsigned int *capacity, unsigned int size );
+
+        // The Direct3D device that the buffers are made with, and the animator
+        //  that CPU batches are blended with
+        LPDIRECT3DDEVICE9 device;
+        MD2Animator *animator;
+
+        MD2RenderPath path;
+
+        // The queued instances, grouped by model and skin
+        vector< Batch > batches;
+
+        // The effect and vertex declaration for instanced drawing. The
+        //  declaration is NULL if the device can't draw that way.
+        D3D::Shader instanceShader;
+        LPDIRECT3DVERTEXDECLARATION9 declaration;
+
+        // The dynamic buffers that CPU batches and the instance data are
+        //  written into, and their sizes in bytes
+        LPDIRECT3DVERTEXBUFFER9 batchBuffer;
+        unsigned int batchCapacity;
+        LPDIRECT3DVERTEXBUFFER9 instanceBuffer;
+        unsigned int instanceCapacity;
+
+        // The blended CPU batch, when the renderer has no device
+        vector< D3DMD2Vertex > memoryVertices;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
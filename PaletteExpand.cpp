@@ -0,0 +1,352 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "PaletteExpand.h"
+#include "Timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector.h>
+
+using namespace std;
+
+
+// Work out which of the faster versions this compiler can build. Each version
+// is only ever called if the CPU supports it, so the intrinsics are allowed even
+// when the rest of the program is built for an older CPU. C++Builder 6 has no
+// SSE2 or AVX2 intrinsics, so it only builds the plain version.
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+    #include <intrin.h>
+    #include <emmintrin.h>
+    #define PALETTE_HAS_SSE2
+    #define PALETTE_TARGET_SSE2
+
+    // The AVX2 intrinsics first came with Visual C++ 2012
+    #if _MSC_VER >= 1700
+        #include <immintrin.h>
+        #define PALETTE_HAS_AVX2
+        #define PALETTE_TARGET_AVX2
+    #endif
+
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+    #include <cpuid.h>
+    #include <immintrin.h>
+    #define PALETTE_HAS_SSE2
+    #define PALETTE_HAS_AVX2
+    #define PALETTE_TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+    #define PALETTE_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+
+
+/**
+ * The plain version of expandPalette(), which works on every CPU. It does
+ * 4 pixels per iteration so that the loop itself costs less.
+ */
+static void expandScalar( const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette ) {
+    int i = 0;
+
+    for ( ; i + 4 <= count; i += 4 ) {
+        pixels[ i ] = palette[ indices[ i ] ];
+        pixels[ i + 1 ] = palette[ indices[ i + 1 ] ];
+        pixels[ i + 2 ] = palette[ indices[ i + 2 ] ];
+        pixels[ i + 3 ] = palette[ indices[ i + 3 ] ];
+    }
+
+    // The last few pixels
+    for ( ; i < count; ++i ) {
+        pixels[ i ] = palette[ indices[ i ] ];
+    }
+};
+
+
+#ifdef PALETTE_HAS_SSE2
+/**
+ * The SSE2 version of expandPalette(). SSE2 can't look up a table, so each
+ * colour is still looked up by itself, but 4 colours are stored at once.
+ */
+PALETTE_TARGET_SSE2
+static void expandSSE2( const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette ) {
+    int i = 0;
+
+    for ( ; i + 4 <= count; i += 4 ) {
+        __m128i colours = _mm_set_epi32( palette[ indices[ i + 3 ] ], palette[ indices[ i + 2 ] ],
+                                         palette[ indices[ i + 1 ] ], palette[ indices[ i ] ] );
+        _mm_storeu_si128( ( __m128i * ) ( pixels + i ), colours );
+    }
+
+    expandScalar( indices + i, pixels + i, count - i, palette );
+};
+#endif
+
+
+#ifdef PALETTE_HAS_AVX2
+/**
+ * The AVX2 version of expandPalette(). 8 indices are widened to 32 bits, and
+ * a gather instruction looks up all 8 colours at once.
+ */
+PALETTE_TARGET_AVX2
+static void expandAVX2( const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette ) {
+    int i = 0;
+
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m256i index = _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i * ) ( indices + i ) ) );
+        __m256i colours = _mm256_i32gather_epi32( ( const int * ) palette, index, 4 );
+        _mm256_storeu_si256( ( __m256i * ) ( pixels + i ), colours );
+    }
+
+    expandScalar( indices + i, pixels + i, count - i, palette );
+};
+#endif
+
+
+/**
+ * Asks the CPU (and the operating system) which instruction sets can be used.
+ * AVX2 also needs the operating system to save the AVX registers when it
+ * switches between threads, which is checked with xgetbv.
+ */
+static PaletteExpandPath detectPath() {
+#if defined( PALETTE_HAS_SSE2 )
+    unsigned int regs1[ 4 ] = { 0, 0, 0, 0 };
+    unsigned int regs7[ 4 ] = { 0, 0, 0, 0 };
+    unsigned int maxLeaf = 0;
+    unsigned int xcr0 = 0;
+
+    #if defined( _MSC_VER )
+        int info[ 4 ];
+        __cpuid( info, 0 );
+        maxLeaf = info[ 0 ];
+
+        __cpuid( info, 1 );
+        for ( int i = 0; i < 4; ++i ) {
+            regs1[ i ] = info[ i ];
+        }
+
+        if ( maxLeaf >= 7 ) {
+            __cpuidex( info, 7, 0 );
+            for ( int i = 0; i < 4; ++i ) {
+                regs7[ i ] = info[ i ];
+            }
+        }
+
+        #if defined( PALETTE_HAS_AVX2 )
+        if ( regs1[ 2 ] & ( 1 << 27 ) ) {
+            xcr0 = ( unsigned int ) _xgetbv( 0 );
+        }
+        #endif
+    #else
+        unsigned int unused;
+        maxLeaf = __get_cpuid_max( 0, NULL );
+
+        if ( maxLeaf >= 1 ) {
+            __cpuid( 1, regs1[ 0 ], regs1[ 1 ], regs1[ 2 ], regs1[ 3 ] );
+        }
+        if ( maxLeaf >= 7 ) {
+            __cpuid_count( 7, 0, regs7[ 0 ], regs7[ 1 ], regs7[ 2 ], regs7[ 3 ] );
+        }
+
+        if ( regs1[ 2 ] & ( 1 << 27 ) ) {
+            __asm__ ( "xgetbv" : "=a" ( xcr0 ), "=d" ( unused ) : "c" ( 0 ) );
+        }
+    #endif
+
+    // AVX2: the CPU has AVX and AVX2, and the OS saves the SSE and AVX registers
+    #if defined( PALETTE_HAS_AVX2 )
+    bool osSavesAVX = ( regs1[ 2 ] & ( 1 << 27 ) ) && ( xcr0 & 6 ) == 6;
+    if ( osSavesAVX && ( regs1[ 2 ] & ( 1 << 28 ) ) && ( regs7[ 1 ] & ( 1 << 5 ) ) ) {
+        return PALETTE_EXPAND_AVX2;
+    }
+    #endif
+
+    if ( regs1[ 3 ] & ( 1 << 26 ) ) {
+        return PALETTE_EXPAND_SSE2;
+    }
+#endif
+
+    return PALETTE_EXPAND_SCALAR;
+};
+
+
+// The path that expandPalette() uses. It is worked out the first time that
+// it is needed. Working it out twice at once is harmless, since both
+// threads would get the same answer.
+static int palettePath = -1;
+
+
+/**
+ * Returns the path that expandPalette() uses on this CPU
+ */
+PaletteExpandPath getPaletteExpandPath() {
+    if ( palettePath < 0 ) {
+        palettePath = detectPath();
+    }
+
+    return ( PaletteExpandPath ) palettePath;
+};
+
+
+/**
+ * expandPaletteWith() is the same as expandPalette(), except that it uses the
+ * given path, whether or not the CPU supports it. A path that wasn't compiled
+ * in falls back to the plain version.
+ */
+void expandPaletteWith( PaletteExpandPath path, const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette ) {
+    switch ( path ) {
+#ifdef PALETTE_HAS_AVX2
+        case PALETTE_EXPAND_AVX2:
+            expandAVX2( indices, pixels, count, palette );
+            return;
+#endif
+#ifdef PALETTE_HAS_SSE2
+        case PALETTE_EXPAND_SSE2:
+            expandSSE2( indices, pixels, count, palette );
+            return;
+#endif
+        default:
+            expandScalar( indices, pixels, count, palette );
+            return;
+    }
+};
+
+
+/**
+ * expandPalette() swaps each of the "count" palette indices in "indices" for
+ * its colour in "palette" (256 packed colours), and stores the colours in
+ * "pixels".
+ */
+void expandPalette( const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette ) {
+    expandPaletteWith( getPaletteExpandPath(), indices, pixels, count, palette );
+};
+
+
+/**
+ * packPaletteRGB() packs 256 colours that are 3 bytes each (red, green, blue),
+ * like the palette at the end of a .pcx file, into "palette". Every colour is
+ * made fully opaque.
+ */
+void packPaletteRGB( const unsigned char *colours, unsigned int *palette ) {
+    for ( int i = 0; i < 256; ++i ) {
+        palette[ i ] = ( unsigned int ) colours[ i * 3 + 2 ] |
+                       ( ( unsigned int ) colours[ i * 3 + 1 ] << 8 ) |
+                       ( ( unsigned int ) colours[ i * 3 ] << 16 ) |
+                       0xFF000000u;
+    }
+};
+
+/**
+ * packPaletteBGRA() packs 256 colours that are 4 bytes each (blue, green, red,
+ * alpha), like a row of pixels loaded by LoadFilePCX(), into "palette". Every
+ * colour is made fully opaque.
+ */
+void packPaletteBGRA( const unsigned char *colours, unsigned int *palette ) {
+    for ( int i = 0; i < 256; ++i ) {
+        palette[ i ] = ( unsigned int ) colours[ i * 4 ] |
+                       ( ( unsigned int ) colours[ i * 4 + 1 ] << 8 ) |
+                       ( ( unsigned int ) colours[ i * 4 + 2 ] << 16 ) |
+                       0xFF000000u;
+    }
+};
+
+
+/**
+ * Returns the name of a path, for printing
+ */
+const char *getPaletteExpandPathName( PaletteExpandPath path ) {
+    switch ( path ) {
+        case PALETTE_EXPAND_SCALAR:
+            return "plain";
+        case PALETTE_EXPAND_SSE2:
+            return "SSE2";
+        case PALETTE_EXPAND_AVX2:
+            return "AVX2";
+        default:
+            return "unknown";
+    }
+};
+
+/**
+ * Returns the number of pixels in "a" and "b" that aren't the same, byte
+ * for byte
+ */
+static int countMismatched( const unsigned int *a, const unsigned int *b, int count ) {
+    int mismatched = 0;
+
+    for ( int i = 0; i < count; ++i ) {
+        if ( memcmp( &a[ i ], &b[ i ], sizeof( unsigned int ) ) != 0 ) {
+            ++mismatched;
+        }
+    }
+
+    return mismatched;
+};
+
+/**
+ * benchmarkPaletteExpand() expands "numPixels" random indices "repeats" times
+ * with each path that this CPU can run, and compares every pixel that each
+ * path makes with the plain loop's, for the whole image and for every count
+ * from 0 to 64 pixels (so that the leftover pixels at the end are checked
+ * too). The results go into "result".
+ */
+void benchmarkPaletteExpand( int numPixels, int repeats, PaletteExpandBenchmark *result ) {
+
+    // A random palette, and a random image. The images are made a little
+    //  bigger than they need to be, so that the short counts fit too.
+    unsigned int palette[ 256 ];
+    vector< unsigned char > indices;
+    vector< unsigned int > scalarPixels;
+    vector< unsigned int > pathPixels;
+
+    int size = numPixels > 64 ? numPixels : 64;
+    indices.resize( size );
+    scalarPixels.resize( size );
+    pathPixels.resize( size );
+
+    srand( 1 );
+    for ( int i = 0; i < 256; ++i ) {
+        palette[ i ] = ( ( unsigned int ) rand() << 16 ) ^ ( unsigned int ) rand();
+    }
+    for ( int i = 0; i < size; ++i ) {
+        indices[ i ] = ( unsigned char ) ( rand() & 255 );
+    }
+
+    expandPaletteWith( PALETTE_EXPAND_SCALAR, &indices[ 0 ], &scalarPixels[ 0 ], numPixels, palette );
+
+    Timer timer;
+
+    for ( int p = 0; p < NUM_PALETTE_EXPAND_PATHS; ++p ) {
+        PaletteExpandPath path = ( PaletteExpandPath ) p;
+
+        // A CPU that can run one path can run the ones before it too
+        result->ran[ p ] = path <= getPaletteExpandPath();
+        result->millis[ p ] = 0;
+        result->numMismatched[ p ] = 0;
+
+        if ( !result->ran[ p ] ) {
+            continue;
+        }
+
+        unsigned int start = timer.getTimeMillis();
+        for ( int r = 0; r < repeats; ++r ) {
+            expandPaletteWith( path, &indices[ 0 ], &pathPixels[ 0 ], numPixels, palette );
+        }
+        result->millis[ p ] = timer.getTimeMillis() - start;
+
+        result->numMismatched[ p ] = countMismatched( &scalarPixels[ 0 ], &pathPixels[ 0 ], numPixels );
+
+        // The short counts, starting at an odd place so that nothing is lined up
+        for ( int count = 0; count <= 64 && count < size; ++count ) {
+            int first = ( size - count ) > 3 ? 3 : 0;
+
+            expandPaletteWith( PALETTE_EXPAND_SCALAR, &indices[ first ], &scalarPixels[ 0 ], count, palette );
+            expandPaletteWith( path, &indices[ first ], &pathPixels[ 0 ], count, palette );
+
+            result->numMismatched[ p ] += countMismatched( &scalarPixels[ 0 ], &pathPixels[ 0 ], count );
+        }
+
+        // Put the whole image back for the next path
+        expandPaletteWith( PALETTE_EXPAND_SCALAR, &indices[ 0 ], &scalarPixels[ 0 ], numPixels, palette );
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,105 @@
+//---------------------------------------------------------------------------
+
+#ifndef PaletteExpandH
+#define PaletteExpandH
+
+/**
+ * An explanation on palette expansion:
+ *      The images in Quake 2 (.wal textures and .pcx skins and skies) don't
+ *  store a colour for each pixel. Instead, each pixel is a single byte, which
+ *  is an index into a "palette" of 256 colours. Before an image can be sent to
+ *  Direct3D, each index has to be swapped for the colour that it stands for.
+ *
+ *      The palette is kept as 256 packed 32-bit colours, in the same byte order
+ *  as a D3DFMT_A8R8G8B8 texture (blue, green, red, alpha), so expanding an
+ *  image is one table lookup and one 32-bit store for each pixel.
+ *
+ *      expandPalette() picks the fastest way to do this that the CPU supports,
+ *  the first time that it is called:
+ *   - AVX2 looks up 8 pixels at once with a "gather" instruction.
+ *   - SSE2 looks up 4 pixels one at a time, and stores them all at once.
+ *   - Otherwise, a plain loop does 4 pixels per iteration.
+ *  The SSE2 and AVX2 versions are only compiled in by compilers that have the
+ *  intrinsics for them (Visual C++ and GCC). C++Builder 6, which Quake2.bpr
+ *  is built with, has neither, so that build always uses the plain loop.
+ *  Every version gives exactly the same pixels, which benchmarkPaletteExpand()
+ *  checks.
+ */
+
+/**
+ * The ways that expandPalette() can expand pixels
+ */
+enum PaletteExpandPath {
+    PALETTE_EXPAND_SCALAR,
+    PALETTE_EXPAND_SSE2,
+    PALETTE_EXPAND_AVX2,
+    NUM_PALETTE_EXPAND_PATHS
+};
+
+/**
+ * expandPalette() swaps each of the "count" palette indices in "indices" for
+ * its colour in "palette" (256 packed colours), and stores the colours in
+ * "pixels".
+ */
+void expandPalette( const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette );
+
+/**
+ * expandPaletteWith() is the same as expandPalette(), except that it uses the
+ * given path, whether or not the CPU supports it. This is for comparing the
+ * paths against each other.
+ */
+void expandPaletteWith( PaletteExpandPath path, const unsigned char *indices, unsigned int *pixels, int count, const unsigned int *palette );
+
+/**
+ * Returns the path that expandPalette() uses on this CPU
+ */
+PaletteExpandPath getPaletteExpandPath();
+
+/**
+ * packPaletteRGB() packs 256 colours that are 3 bytes each (red, green, blue),
+ * like the palette at the end of a .pcx file, into "palette". Every colour is
+ * made fully opaque.
+ */
+void packPaletteRGB( const unsigned char *colours, unsigned int *palette );
+
+/**
+ * packPaletteBGRA() packs 256 colours that are 4 bytes each (blue, green, red,
+ * alpha), like a row of pixels loaded by LoadFilePCX(), into "palette". Every
+ * colour is made fully opaque.
+ */
+void packPaletteBGRA( const unsigned char *colours, unsigned int *palette );
+
+
+/**
+ * The results of benchmarkPaletteExpand(), for each path
+ */
+typedef struct {
+    // Whether the path was run. It isn't if it wasn't compiled in, or if
+    //  the CPU doesn't support it.
+    bool ran[ NUM_PALETTE_EXPAND_PATHS ];
+
+    // How long the path took, in milliseconds
+    unsigned int millis[ NUM_PALETTE_EXPAND_PATHS ];
+
+    // How many pixels the path made that weren't exactly the same as the
+    //  plain loop's (this should always be 0)
+    int numMismatched[ NUM_PALETTE_EXPAND_PATHS ];
+} PaletteExpandBenchmark;
+
+/**
+ * benchmarkPaletteExpand() expands "numPixels" random indices "repeats" times
+ * with each path that this CPU can run, and compares every pixel that each
+ * path makes with the plain loop's, for the whole image and for every count
+ * from 0 to 64 pixels (so that the leftover pixels at the end are checked
+ * too). The results go into "result".
+ */
+void benchmarkPaletteExpand( int numPixels, int repeats, PaletteExpandBenchmark *result );
+
+/**
+ * Returns the name of a path, for printing
+ */
+const char *getPaletteExpandPathName( PaletteExpandPath path );
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,568 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "RecordingRenderDevice.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/**
+ * The names of the command types, for write()
+ */
+const char *RecordingRenderDevice::COMMAND_NAMES[ NUM_COMMAND_TYPES ] = {
+    "SetFVF",
+    "SetVertexDeclaration",
+    "SetStreamSource",
+    "SetIndices",
+    "SetRenderState",
+    "SetSamplerState",
+    "SetTexture",
+    "SetTransform",
+    "SetLight",
+    "LightEnable",
+    "DrawPrimitive",
+    "DrawIndexedPrimitive",
+    "BeginEffect",
+    "BeginPass",
+    "EndPass",
+    "EndEffect",
+    "SetEffectTexture",
+    "SetEffectInt",
+    "SetEffectFloat",
+    "SetEffectMatrix",
+    "CommitChanges",
+    "SetStreamSourceFreq"
+};
+
+/**
+ * The kinds of the arguments of each command type. These must match the
+ * arguments that each method adds to the command.
+ */
+const char *RecordingRenderDevice::COMMAND_FORMATS[ NUM_COMMAND_TYPES ] = {
+    "u",            // SetFVF: fvf
+    "p",            // SetVertexDeclaration: declaration
+    "upuu",         // SetStreamSource: stream, buffer, offset, stride
+    "p",            // SetIndices: buffer
+    "uu",           // SetRenderState: state, value
+    "uuu",          // SetSamplerState: sampler, type, value
+    "up",           // SetTexture: stage, texture
+    "um",           // SetTransform: state, matrix
+    "uuffffffff",   // SetLight: index, type, position, diffuse colour, range
+    "uu",           // LightEnable: index, enable
+    "uuu",          // DrawPrimitive: type, start vertex, primitives
+    "uiuuuu",       // DrawIndexedPrimitive: type, base vertex, min vertex,
+                    //  vertices, start index, primitives
+    "p",            // BeginEffect: effect
+    "pu",           // BeginPass: effect, pass
+    "p",            // EndPass: effect
+    "p",            // EndEffect: effect
+    "pnp",          // SetEffectTexture: effect, name, texture
+    "pni",          // SetEffectInt: effect, name, value
+    "pnf",          // SetEffectFloat: effect, name, value
+    "pnm",          // SetEffectMatrix: effect, name, matrix
+    "p",            // CommitChanges: effect
+    "uu"            // SetStreamSourceFreq: stream, setting
+};
+
+
+/**
+ * Constructor that makes an empty recording. If target is not NULL,
+ * then each call is also sent on to target.
+ */
+RecordingRenderDevice::RecordingRenderDevice( RenderDevice *target ) {
+    this->target = target;
+
+    setRenderMatrixIdentity( &world );
+    setRenderMatrixIdentity( &view );
+    setRenderMatrixIdentity( &projection );
+
+    clear();
+};
+
+
+/**
+ * clear() throws away the recorded commands and counts, so that a new
+ * frame can be recorded. The remembered states are forgotten too.
+ */
+void RecordingRenderDevice::clear() {
+    words.resize( 0 );
+    pointers.resize( 0 );
+
+    memset( &stats, 0, sizeof( stats ) );
+    numInstances = 1;
+
+    for ( int i = 0; i < RECORD_NUM_RENDER_STATES; ++i ) {
+        renderStateSet[ i ] = false;
+    }
+    for ( int i = 0; i < RECORD_NUM_TEXTURE_STAGES; ++i ) {
+        textureSet[ i ] = false;
+    }
+};
+
+
+/**
+ * Starts a new command of the given type. The number of words in its arguments
+ * is worked out from the command's format.
+ */
+void RecordingRenderDevice::begin( int type ) {
+    int numArgs = 0;
+    for ( const char *c = COMMAND_FORMATS[ type ]; *c != '\0'; ++c ) {
+        numArgs += ( *c == 'm' ) ? 16 : 1;
+    }
+
+    words.push_back( type | ( numArgs << 8 ) );
+    stats.commands++;
+};
+
+/**
+ * Adds a float argument, keeping its exact bits
+ */
+void RecordingRenderDevice::addFloat( float value ) {
+    unsigned int bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    words.push_back( bits );
+};
+
+/**
+ * Adds a pointer argument. The pointer goes into the list of pointers, and the
+ * argument is its place in that list.
+ */
+void RecordingRenderDevice::addPointer( const void *pointer ) {
+    words.push_back( pointers.size() );
+    pointers.push_back( pointer );
+};
+
+/**
+ * Adds the 16 numbers of a matrix as arguments
+ */
+void RecordingRenderDevice::addMatrix( const RenderMatrix *matrix ) {
+    for ( int i = 0; i < 16; ++i ) {
+        addFloat( matrix->m[ i / 4 ][ i % 4 ] );
+    }
+};
+
+
+/**
+ * write() writes the recorded commands into a text file, one command on
+ * each line, followed by the counts. Each texture, buffer and effect is
+ * written as a number ("#1", "#2", ...) in the order that it was first
+ * used, so recordings from different runs can be compared.
+ * Returns false if the file could not be opened.
+ */
+bool RecordingRenderDevice::write( const char *fileName ) {
+    FILE *file = fopen( fileName, "w" );
+    if ( file == NULL ) {
+        return false;
+    }
+
+    // The textures, buffers and effects in the order that they were first used
+    vector< const void * > used;
+
+    unsigned int w = 0;
+    while ( w < words.size() ) {
+        int type = words[ w ] & 0xFF;
+        int numArgs = ( words[ w ] >> 8 ) & 0xFF;
+        unsigned int next = w + 1 + numArgs;
+        ++w;
+
+        fprintf( file, "%s", COMMAND_NAMES[ type ] );
+
+        for ( const char *c = COMMAND_FORMATS[ type ]; *c != '\0'; ++c ) {
+            if ( *c == 'u' ) {
+                fprintf( file, " %u", words[ w++ ] );
+            } else if ( *c == 'i' ) {
+                fprintf( file, " %d", ( int ) words[ w++ ] );
+            } else if ( *c == 'f' ) {
+                float value;
+                memcpy( &value, &words[ w++ ], sizeof( value ) );
+                fprintf( file, " %g", value );
+            } else if ( *c == 'm' ) {
+                fprintf( file, " [" );
+                for ( int i = 0; i < 16; ++i ) {
+                    float value;
+                    memcpy( &value, &words[ w++ ], sizeof( value ) );
+                    fprintf( file, i == 0 ? "%g" : " %g", value );
+                }
+                fprintf( file, "]" );
+            } else if ( *c == 'n' ) {
+                fprintf( file, " \"%s\"", ( const char * ) pointers[ words[ w++ ] ] );
+            } else if ( *c == 'p' ) {
+                const void *pointer = pointers[ words[ w++ ] ];
+
+                if ( pointer == NULL ) {
+                    fprintf( file, " NULL" );
+                } else {
+                    // Give the pointer the next number if it hasn't been seen yet
+                    unsigned int id = 0;
+                    while ( id < used.size() && used[ id ] != pointer ) {
+                        ++id;
+                    }
+                    if ( id == used.size() ) {
+                        used.push_back( pointer );
+                    }
+
+                    fprintf( file, " #%u", id + 1 );
+                }
+            }
+        }
+
+        fprintf( file, "\n" );
+        w = next;
+    }
+
+    fprintf( file, "\n" );
+    fprintf( file, "commands %d\n", stats.commands );
+    fprintf( file, "words %d\n", ( int ) words.size() );
+    fprintf( file, "draw calls %d\n", stats.drawCalls );
+    fprintf( file, "primitives %d\n", stats.primitives );
+    fprintf( file, "instances %d\n", stats.instances );
+    fprintf( file, "state changes %d\n", stats.stateChanges );
+    fprintf( file, "redundant states %d\n", stats.redundantStates );
+    fprintf( file, "texture binds %d\n", stats.textureBinds );
+    fprintf( file, "effect passes %d\n", stats.effectPasses );
+    fprintf( file, "resources %d\n", ( int ) used.size() );
+
+    fclose( file );
+    return true;
+};
+
+
+void RecordingRenderDevice::setFVF( unsigned long fvf ) {
+    begin( CMD_SET_FVF );
+    add( fvf );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setFVF( fvf );
+    }
+};
+
+void RecordingRenderDevice::setVertexDeclaration( RenderDeclaration declaration ) {
+    begin( CMD_SET_VERTEX_DECLARATION );
+    addPointer( declaration );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setVertexDeclaration( declaration );
+    }
+};
+
+void RecordingRenderDevice::setStreamSource( unsigned int stream, RenderVertexBuffer buffer, unsigned int offset, unsigned int stride ) {
+    begin( CMD_SET_STREAM_SOURCE );
+    add( stream );
+    addPointer( buffer );
+    add( offset );
+    add( stride );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setStreamSource( stream, buffer, offset, stride );
+    }
+};
+
+/**
+ * An indexed-data frequency on stream 0 makes each draw call draw that many
+ * instances, until the frequency is set back to 1
+ */
+void RecordingRenderDevice::setStreamSourceFreq( unsigned int stream, unsigned int setting ) {
+    begin( CMD_SET_STREAM_SOURCE_FREQ );
+    add( stream );
+    add( setting );
+    stats.stateChanges++;
+
+    if ( stream == 0 ) {
+        if ( setting & RENDER_STREAM_INDEXED_DATA ) {
+            numInstances = setting & ~RENDER_STREAM_INDEXED_DATA;
+        } else {
+            numInstances = 1;
+        }
+    }
+
+    if ( target != NULL ) {
+        target->setStreamSourceFreq( stream, setting );
+    }
+};
+
+void RecordingRenderDevice::setIndices( RenderIndexBuffer indices ) {
+    begin( CMD_SET_INDICES );
+    addPointer( indices );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setIndices( indices );
+    }
+};
+
+/**
+ * A render state that is set to the value that it already has is counted as
+ * redundant
+ */
+void RecordingRenderDevice::setRenderState( unsigned long state, unsigned long value ) {
+    begin( CMD_SET_RENDER_STATE );
+    add( state );
+    add( value );
+    stats.stateChanges++;
+
+    if ( ( unsigned int ) state < RECORD_NUM_RENDER_STATES ) {
+        if ( renderStateSet[ state ] && renderStates[ state ] == value ) {
+            stats.redundantStates++;
+        }
+        renderStates[ state ] = value;
+        renderStateSet[ state ] = true;
+    }
+
+    if ( target != NULL ) {
+        target->setRenderState( state, value );
+    }
+};
+
+void RecordingRenderDevice::setSamplerState( unsigned long sampler, unsigned long type, unsigned long value ) {
+    begin( CMD_SET_SAMPLER_STATE );
+    add( sampler );
+    add( type );
+    add( value );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setSamplerState( sampler, type, value );
+    }
+};
+
+/**
+ * Binding the texture that is already in a stage is counted as redundant
+ */
+void RecordingRenderDevice::setTexture( unsigned long stage, RenderTexture texture ) {
+    begin( CMD_SET_TEXTURE );
+    add( stage );
+    addPointer( texture );
+    stats.textureBinds++;
+
+    if ( stage < RECORD_NUM_TEXTURE_STAGES ) {
+        if ( textureSet[ stage ] && textures[ stage ] == texture ) {
+            stats.redundantStates++;
+        }
+        textures[ stage ] = texture;
+        textureSet[ stage ] = true;
+    }
+
+    if ( target != NULL ) {
+        target->setTexture( stage, texture );
+    }
+};
+
+/**
+ * The world, view and projection transforms are also kept, so that
+ * getTransform() works without a target
+ */
+void RecordingRenderDevice::setTransform( unsigned long state, const RenderMatrix *matrix ) {
+    begin( CMD_SET_TRANSFORM );
+    add( state );
+    addMatrix( matrix );
+    stats.stateChanges++;
+
+    if ( state == RENDER_TRANSFORM_WORLD ) {
+        world = *matrix;
+    } else if ( state == RENDER_TRANSFORM_VIEW ) {
+        view = *matrix;
+    } else if ( state == RENDER_TRANSFORM_PROJECTION ) {
+        projection = *matrix;
+    }
+
+    if ( target != NULL ) {
+        target->setTransform( state, matrix );
+    }
+};
+
+/**
+ * getTransform() isn't recorded, since it doesn't change anything. The
+ * transform comes from the target if there is one, because the transforms
+ * may have been set before recording started.
+ */
+void RecordingRenderDevice::getTransform( unsigned long state, RenderMatrix *matrix ) {
+    if ( target != NULL ) {
+        target->getTransform( state, matrix );
+    } else if ( state == RENDER_TRANSFORM_WORLD ) {
+        *matrix = world;
+    } else if ( state == RENDER_TRANSFORM_VIEW ) {
+        *matrix = view;
+    } else if ( state == RENDER_TRANSFORM_PROJECTION ) {
+        *matrix = projection;
+    } else {
+        setRenderMatrixIdentity( matrix );
+    }
+};
+
+void RecordingRenderDevice::setLight( unsigned long index, const RenderLight *light ) {
+    begin( CMD_SET_LIGHT );
+    add( index );
+    add( light->Type );
+    addFloat( light->Position.x );
+    addFloat( light->Position.y );
+    addFloat( light->Position.z );
+    addFloat( light->Diffuse.r );
+    addFloat( light->Diffuse.g );
+    addFloat( light->Diffuse.b );
+    addFloat( light->Diffuse.a );
+    addFloat( light->Range );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setLight( index, light );
+    }
+};
+
+void RecordingRenderDevice::lightEnable( unsigned long index, bool enable ) {
+    begin( CMD_LIGHT_ENABLE );
+    add( index );
+    add( enable ? 1 : 0 );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->lightEnable( index, enable );
+    }
+};
+
+
+void RecordingRenderDevice::drawPrimitive( unsigned int type, unsigned int startVertex, unsigned int primitiveCount ) {
+    begin( CMD_DRAW_PRIMITIVE );
+    add( type );
+    add( startVertex );
+    add( primitiveCount );
+    stats.drawCalls++;
+    stats.primitives += primitiveCount;
+    stats.instances++;
+
+    if ( target != NULL ) {
+        target->drawPrimitive( type, startVertex, primitiveCount );
+    }
+};
+
+void RecordingRenderDevice::drawIndexedPrimitive( unsigned int type, int baseVertex, unsigned int minVertex,
+                                                  unsigned int numVertices, unsigned int startIndex, unsigned int primitiveCount ) {
+    begin( CMD_DRAW_INDEXED_PRIMITIVE );
+    add( type );
+    add( ( unsigned int ) baseVertex );
+    add( minVertex );
+    add( numVertices );
+    add( startIndex );
+    add( primitiveCount );
+    stats.drawCalls++;
+    stats.primitives += primitiveCount * numInstances;
+    stats.instances += numInstances;
+
+    if ( target != NULL ) {
+        target->drawIndexedPrimitive( type, baseVertex, minVertex, numVertices, startIndex, primitiveCount );
+    }
+};
+
+
+/**
+ * Without a target, every effect is treated as having one pass, so that
+ * whatever is drawn inside of the passes is still recorded once
+ */
+unsigned int RecordingRenderDevice::beginEffect( RenderEffect *effect ) {
+    begin( CMD_BEGIN_EFFECT );
+    addPointer( effect );
+
+    if ( target != NULL ) {
+        return target->beginEffect( effect );
+    }
+
+    return 1;
+};
+
+void RecordingRenderDevice::beginPass( RenderEffect *effect, unsigned int pass ) {
+    begin( CMD_BEGIN_PASS );
+    addPointer( effect );
+    add( pass );
+    stats.effectPasses++;
+
+    if ( target != NULL ) {
+        target->beginPass( effect, pass );
+    }
+};
+
+void RecordingRenderDevice::endPass( RenderEffect *effect ) {
+    begin( CMD_END_PASS );
+    addPointer( effect );
+
+    if ( target != NULL ) {
+        target->endPass( effect );
+    }
+};
+
+void RecordingRenderDevice::endEffect( RenderEffect *effect ) {
+    begin( CMD_END_EFFECT );
+    addPointer( effect );
+
+    if ( target != NULL ) {
+        target->endEffect( effect );
+    }
+};
+
+/**
+ * The effect variable names are kept as pointers, so they must be names that
+ * stay around until the recording is written (string constants).
+ */
+void RecordingRenderDevice::setEffectTexture( RenderEffect *effect, const char *name, RenderTexture texture ) {
+    begin( CMD_SET_EFFECT_TEXTURE );
+    addPointer( effect );
+    addPointer( name );
+    addPointer( texture );
+    stats.textureBinds++;
+
+    if ( target != NULL ) {
+        target->setEffectTexture( effect, name, texture );
+    }
+};
+
+void RecordingRenderDevice::setEffectInt( RenderEffect *effect, const char *name, int value ) {
+    begin( CMD_SET_EFFECT_INT );
+    addPointer( effect );
+    addPointer( name );
+    add( ( unsigned int ) value );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setEffectInt( effect, name, value );
+    }
+};
+
+void RecordingRenderDevice::setEffectFloat( RenderEffect *effect, const char *name, float value ) {
+    begin( CMD_SET_EFFECT_FLOAT );
+    addPointer( effect );
+    addPointer( name );
+    addFloat( value );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setEffectFloat( effect, name, value );
+    }
+};
+
+void RecordingRenderDevice::setEffectMatrix( RenderEffect *effect, const char *name, const RenderMatrix *matrix ) {
+    begin( CMD_SET_EFFECT_MATRIX );
+    addPointer( effect );
+    addPointer( name );
+    addMatrix( matrix );
+    stats.stateChanges++;
+
+    if ( target != NULL ) {
+        target->setEffectMatrix( effect, name, matrix );
+    }
+};
+
+void RecordingRenderDevice::commitChanges( RenderEffect *effect ) {
+    begin( CMD_COMMIT_CHANGES );
+    addPointer( effect );
+
+    if ( target != NULL ) {
+        target->commitChanges( effect );
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
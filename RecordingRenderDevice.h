@@ -0,0 +1,220 @@
+//---------------------------------------------------------------------------
+
+#ifndef RecordingRenderDeviceH
+#define RecordingRenderDeviceH
+
+#include <vector.h>
+
+#include "RenderDevice.h"
+
+using namespace std;
+
+
+/**
+ * The number of render states and texture stages that the RecordingRenderDevice
+ * remembers, so that it can tell when a state is set to the value it already had
+ */
+#define RECORD_NUM_RENDER_STATES 256
+#define RECORD_NUM_TEXTURE_STAGES 8
+
+
+/**
+ * RenderStats are the counts that a RecordingRenderDevice keeps while it records
+ */
+typedef struct {
+    // The number of calls that were recorded
+    int commands;
+
+    // The number of draw calls, and the number of primitives that they drew.
+    //  An instanced draw call counts its primitives once for each instance.
+    int drawCalls;
+    int primitives;
+
+    // The number of instances that the draw calls drew. A draw call that
+    //  isn't instanced draws one.
+    int instances;
+
+    // The number of states that were set (including FVFs, buffers, transforms,
+    //  and lights), and how many of those set a render state to the value that
+    //  it already had
+    int stateChanges;
+    int redundantStates;
+
+    // The number of textures that were bound, to a stage or to an effect
+    int textureBinds;
+
+    // The number of effect passes that were started
+    int effectPasses;
+} RenderStats;
+
+
+/**
+ * The RecordingRenderDevice writes each call made to it into a compact list of
+ * commands, and counts the draw calls, primitives and state changes.
+ *
+ * If it is given another RenderDevice (the "target"), then each call is also
+ * sent on to the target, so that a frame can be recorded while it is still
+ * drawn to the screen. Without a target, nothing is drawn at all, and the
+ * device only records, so the drawing code can be run without a graphics card.
+ *
+ * Each command is a word with its type in the low 8 bits and the number of
+ * words after it in the next 8 bits, followed by its arguments. Textures,
+ * buffers, effects and effect variable names are kept in a separate list of
+ * pointers, and the arguments hold their place in that list. The pointers are
+ * only turned into numbers when the commands are written out with write(), so
+ * that recording stays fast, and so that two recordings of the same frame
+ * give the same file.
+ */
+class RecordingRenderDevice : public RenderDevice {
+    public:
+
+        /**
+         * Constructor that makes an empty recording. If target is not NULL,
+         * then each call is also sent on to target.
+         */
+        RecordingRenderDevice( RenderDevice *target = NULL );
+
+        /**
+         * Sets the RenderDevice that the calls are sent on to. It can be NULL.
+         */
+        void setTarget( RenderDevice *target ) {
+            this->target = target;
+        };
+
+        /**
+         * clear() throws away the recorded commands and counts, so that a new
+         * frame can be recorded. The remembered states are forgotten too.
+         */
+        void clear();
+
+        /**
+         * Returns the counts for everything recorded since the last clear()
+         */
+        const RenderStats &getStats() {
+            return stats;
+        };
+
+        /**
+         * Returns the number of words in the recorded commands
+         */
+        int getNumWords() {
+            return words.size();
+        };
+
+        /**
+         * write() writes the recorded commands into a text file, one command on
+         * each line, followed by the counts. Each texture, buffer and effect is
+         * written as a number ("#1", "#2", ...) in the order that it was first
+         * used, so recordings from different runs can be compared.
+         * Returns false if the file could not be opened.
+         */
+        bool write( const char *fileName );
+
+        void setFVF( unsigned long fvf );
+        void setVertexDeclaration( RenderDeclaration declaration );
+        void setStreamSource( unsigned int stream, RenderVertexBuffer buffer, unsigned int offset, unsigned int stride );
+        void setStreamSourceFreq( unsigned int stream, unsigned int setting );
+        void setIndices( RenderIndexBuffer indices );
+        void setRenderState( unsigned long state, unsigned long value );
+        void setSamplerState( unsigned long sampler, unsigned long type, unsigned long value );
+        void setTexture( unsigned long stage, RenderTexture texture );
+        void setTransform( unsigned long state, const RenderMatrix *matrix );
+        void getTransform( unsigned long state, RenderMatrix *matrix );
+        void setLight( unsigned long index, const RenderLight *light );
+        void lightEnable( unsigned long index, bool enable );
+
+        void drawPrimitive( unsigned int type, unsigned int startVertex, unsigned int primitiveCount );
+        void drawIndexedPrimitive( unsigned int type, int baseVertex, unsigned int minVertex,
+                                   unsigned int numVertices, unsigned int startIndex, unsigned int primitiveCount );
+
+        unsigned int beginEffect( RenderEffect *effect );
+        void beginPass( RenderEffect *effect, unsigned int pass );
+        void endPass( RenderEffect *effect );
+        void endEffect( RenderEffect *effect );
+        void setEffectTexture( RenderEffect *effect, const char *name, RenderTexture texture );
+        void setEffectInt( RenderEffect *effect, const char *name, int value );
+        void setEffectFloat( RenderEffect *effect, const char *name, float value );
+        void setEffectMatrix( RenderEffect *effect, const char *name, const RenderMatrix *matrix );
+        void commitChanges( RenderEffect *effect );
+
+    private:
+
+        /**
+         * The types of command that can be recorded
+         */
+        enum CommandType {
+            CMD_SET_FVF,
+            CMD_SET_VERTEX_DECLARATION,
+            CMD_SET_STREAM_SOURCE,
+            CMD_SET_INDICES,
+            CMD_SET_RENDER_STATE,
+            CMD_SET_SAMPLER_STATE,
+            CMD_SET_TEXTURE,
+            CMD_SET_TRANSFORM,
+            CMD_SET_LIGHT,
+            CMD_LIGHT_ENABLE,
+            CMD_DRAW_PRIMITIVE,
+            CMD_DRAW_INDEXED_PRIMITIVE,
+            CMD_BEGIN_EFFECT,
+            CMD_BEGIN_PASS,
+            CMD_END_PASS,
+            CMD_END_EFFECT,
+            CMD_SET_EFFECT_TEXTURE,
+            CMD_SET_EFFECT_INT,
+            CMD_SET_EFFECT_FLOAT,
+            CMD_SET_EFFECT_MATRIX,
+            CMD_COMMIT_CHANGES,
+            CMD_SET_STREAM_SOURCE_FREQ,
+            NUM_COMMAND_TYPES
+        };
+
+        // The names of the command types, and the kinds of their arguments,
+        //  for write(). Each letter of a format is one argument: 'u' is an
+        //  unsigned number, 'i' a signed number, 'f' a float, 'p' a texture,
+        //  buffer, effect or vertex declaration, 'n' an effect variable name,
+        //  and 'm' a matrix.
+        static const char *COMMAND_NAMES[ NUM_COMMAND_TYPES ];
+        static const char *COMMAND_FORMATS[ NUM_COMMAND_TYPES ];
+
+        // Starts a new command of the given type
+        void begin( int type );
+
+        // Add an argument to the command that was just started
+        void add( unsigned int value ) {
+            words.push_back( value );
+        };
+        void addFloat( float value );
+        void addPointer( const void *pointer );
+        void addMatrix( const RenderMatrix *matrix );
+
+        // The RenderDevice that calls are sent on to, or NULL
+        RenderDevice *target;
+
+        // The recorded commands, and the pointers that they use
+        vector< unsigned int > words;
+        vector< const void * > pointers;
+
+        // The counts since the last clear()
+        RenderStats stats;
+
+        // The last value of each render state and the texture in each stage,
+        //  for finding redundant state changes
+        unsigned long renderStates[ RECORD_NUM_RENDER_STATES ];
+        bool renderStateSet[ RECORD_NUM_RENDER_STATES ];
+        RenderTexture textures[ RECORD_NUM_TEXTURE_STAGES ];
+        bool textureSet[ RECORD_NUM_TEXTURE_STAGES ];
+
+        // The number of instances that each draw call draws, from the frequency
+        //  of stream 0
+        unsigned int numInstances;
+
+        // The world, view and projection transforms, for getTransform() when
+        //  there is no target
+        RenderMatrix world;
+        RenderMatrix view;
+        RenderMatrix projection;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
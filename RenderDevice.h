@@ -0,0 +1,79 @@
+//---------------------------------------------------------------------------
+
+#ifndef RenderDeviceH
+#define RenderDeviceH
+
+#include "RenderTypes.h"
+
+
+/**
+ * The RenderDevice is the set of calls that the application makes to draw a
+ * frame: setting states, binding textures and buffers, running effects, and
+ * drawing primitives. The map, the skybox, the models and the lights draw
+ * themselves through a RenderDevice, instead of calling the Direct3D device
+ * straight away.
+ *
+ * There are two kinds of RenderDevice:
+ *  - D3D9RenderDevice sends each call on to a Direct3D device.
+ *  - RecordingRenderDevice writes each call into a list of commands, so that
+ *    a frame can be counted, saved to a file, and compared with another frame,
+ *    without needing a graphics card.
+ *
+ * Making textures and buffers is not part of the RenderDevice. They are still
+ * made with the Direct3D device when things are loaded, and a RenderDevice only
+ * uses them. So that a RenderDevice can be used without Direct3D, it is called
+ * with the types in RenderTypes.h.
+ */
+class RenderDevice {
+    public:
+
+        /**
+         * Destructor is virtual, so that any kind of RenderDevice can be deleted
+         */
+        virtual ~RenderDevice() {};
+
+
+        /**
+         * The fixed function states. Each of these is the same as the Direct3D
+         * device method with the same name.
+         */
+        virtual void setFVF( unsigned long fvf ) = 0;
+        virtual void setVertexDeclaration( RenderDeclaration declaration ) = 0;
+        virtual void setStreamSource( unsigned int stream, RenderVertexBuffer buffer, unsigned int offset, unsigned int stride ) = 0;
+        virtual void setStreamSourceFreq( unsigned int stream, unsigned int setting ) = 0;
+        virtual void setIndices( RenderIndexBuffer indices ) = 0;
+        virtual void setRenderState( unsigned long state, unsigned long value ) = 0;
+        virtual void setSamplerState( unsigned long sampler, unsigned long type, unsigned long value ) = 0;
+        virtual void setTexture( unsigned long stage, RenderTexture texture ) = 0;
+        virtual void setTransform( unsigned long state, const RenderMatrix *matrix ) = 0;
+        virtual void getTransform( unsigned long state, RenderMatrix *matrix ) = 0;
+        virtual void setLight( unsigned long index, const RenderLight *light ) = 0;
+        virtual void lightEnable( unsigned long index, bool enable ) = 0;
+
+        /**
+         * The drawing calls. These are the same as DrawPrimitive() and
+         * DrawIndexedPrimitive() on the Direct3D device.
+         */
+        virtual void drawPrimitive( unsigned int type, unsigned int startVertex, unsigned int primitiveCount ) = 0;
+        virtual void drawIndexedPrimitive( unsigned int type, int baseVertex, unsigned int minVertex,
+                                           unsigned int numVertices, unsigned int startIndex, unsigned int primitiveCount ) = 0;
+
+        /**
+         * The effect calls. beginEffect() starts the effect and returns the number
+         * of passes that it has. The others are the same as the RenderEffect method
+         * with the same name.
+         */
+        virtual unsigned int beginEffect( RenderEffect *effect ) = 0;
+        virtual void beginPass( RenderEffect *effect, unsigned int pass ) = 0;
+        virtual void endPass( RenderEffect *effect ) = 0;
+        virtual void endEffect( RenderEffect *effect ) = 0;
+        virtual void setEffectTexture( RenderEffect *effect, const char *name, RenderTexture texture ) = 0;
+        virtual void setEffectInt( RenderEffect *effect, const char *name, int value ) = 0;
+        virtual void setEffectFloat( RenderEffect *effect, const char *name, float value ) = 0;
+        virtual void setEffectMatrix( RenderEffect *effect, const char *name, const RenderMatrix *matrix ) = 0;
+        virtual void commitChanges( RenderEffect *effect ) = 0;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
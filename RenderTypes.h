@@ -0,0 +1,94 @@
+//---------------------------------------------------------------------------
+
+#ifndef RenderTypesH
+#define RenderTypesH
+
+#include <stddef.h>
+
+
+/**
+ * The types that a RenderDevice is called with. The RenderDevice doesn't need
+ * the Direct3D headers, so that it (and the RecordingRenderDevice) can be
+ * built and run on a machine without the DirectX SDK:
+ *  - Textures, buffers, vertex declarations and effects are only handles that
+ *    are passed along, so their interfaces are just declared here. They are the
+ *    same types that Direct3D uses, so nothing has to be cast.
+ *  - States, transforms and primitive types are numbers, with the same values
+ *    as the Direct3D enums (D3DRS_CULLMODE, D3DTS_VIEW, D3DPT_TRIANGLELIST...).
+ *  - Matrices and lights are D3DXMATRIX and D3DLIGHT9 when the Direct3D headers
+ *    are there. Otherwise they are structures laid out the same way, with only
+ *    the members that the RenderDevices use.
+ */
+
+struct IDirect3DBaseTexture9;
+struct IDirect3DVertexBuffer9;
+struct IDirect3DIndexBuffer9;
+struct IDirect3DVertexDeclaration9;
+struct ID3DXEffect;
+
+typedef IDirect3DBaseTexture9 *RenderTexture;
+typedef IDirect3DVertexBuffer9 *RenderVertexBuffer;
+typedef IDirect3DIndexBuffer9 *RenderIndexBuffer;
+typedef IDirect3DVertexDeclaration9 *RenderDeclaration;
+typedef ID3DXEffect RenderEffect;
+
+#if defined( _WIN32 )
+    #include <windows.h>
+    #include <DirectX/d3d9.h>
+    #include <DirectX/d3dx9.h>
+
+    typedef D3DXMATRIX RenderMatrix;
+    typedef D3DLIGHT9 RenderLight;
+#else
+    typedef struct {
+        float m[ 4 ][ 4 ];
+    } RenderMatrix;
+
+    typedef struct {
+        float r, g, b, a;
+    } RenderColor;
+
+    typedef struct {
+        float x, y, z;
+    } RenderVector;
+
+    typedef struct {
+        unsigned int Type;
+        RenderColor Diffuse;
+        RenderColor Specular;
+        RenderColor Ambient;
+        RenderVector Position;
+        RenderVector Direction;
+        float Range;
+        float Falloff;
+        float Attenuation0;
+        float Attenuation1;
+        float Attenuation2;
+        float Theta;
+        float Phi;
+    } RenderLight;
+#endif
+
+
+// The transforms that the RecordingRenderDevice keeps (D3DTS_WORLD, D3DTS_VIEW
+//  and D3DTS_PROJECTION)
+#define RENDER_TRANSFORM_WORLD 256
+#define RENDER_TRANSFORM_VIEW 2
+#define RENDER_TRANSFORM_PROJECTION 3
+
+// The stream frequency flag for instanced drawing (D3DSTREAMSOURCE_INDEXEDDATA)
+#define RENDER_STREAM_INDEXED_DATA ( 1u << 30 )
+
+
+/**
+ * Sets a matrix to the identity matrix
+ */
+inline void setRenderMatrixIdentity( RenderMatrix *matrix ) {
+    for ( int i = 0; i < 16; ++i ) {
+        matrix->m[ i / 4 ][ i % 4 ] = ( i / 4 == i % 4 ) ? 1.0f : 0.0f;
+    }
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,334 @@
+//---------------------------------------------------------------------------
+
+#pragma hdrstop
+
+#include "TaskGraph.h"
+#include "Timer.h"
+
+#include <process.h>
+
+
+/**
+ * Constructor makes an empty graph
+ */
+TaskGraph::TaskGraph() {
+    numFinished = 0;
+    stopping = false;
+    serial = false;
+    running = false;
+    keepWorkers = false;
+    runStart = 0;
+    totalMillis = 0;
+
+    InitializeCriticalSection( &lock );
+    workerSemaphore = CreateSemaphore( NULL, 0, 0x7FFFFFFF, NULL );
+    renderEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+};
+
+/**
+ * Destructor stops the workers, and makes sure that the threads' objects
+ * have been closed
+ */
+TaskGraph::~TaskGraph() {
+    stopWorkers();
+
+    CloseHandle( workerSemaphore );
+    CloseHandle( renderEvent );
+    DeleteCriticalSection( &lock );
+};
+
+
+/**
+ * addTask() adds a task called "name" to the graph, which calls
+ * function( data ). If onRenderThread is true, the task is only run on
+ * the thread that calls run(). Returns the task's number.
+ */
+int TaskGraph::addTask( const char *name, TaskFunction function, void *data, bool onRenderThread ) {
+    int taskNum = tasks.size();
+    tasks.push_back();
+
+    Task &task = tasks[ taskNum ];
+    task.name = name;
+    task.function = function;
+    task.data = data;
+    task.onRenderThread = onRenderThread;
+    task.numDependencies = 0;
+    task.numWaiting = 0;
+    task.startMillis = 0;
+    task.millis = 0;
+
+    return taskNum;
+};
+
+/**
+ * addDependency() makes task #taskNum wait until task #dependsOn has
+ * finished before it starts. Tasks must only depend on tasks that
+ * were added before them, so that the graph can't have a loop.
+ */
+void TaskGraph::addDependency( int taskNum, int dependsOn ) {
+    if ( dependsOn < 0 || dependsOn >= taskNum || taskNum >= ( int ) tasks.size() ) {
+        return;
+    }
+
+    tasks[ dependsOn ].dependents.push_back( taskNum );
+    tasks[ taskNum ].numDependencies++;
+};
+
+/**
+ * clear() takes every task out of the graph
+ */
+void TaskGraph::clear() {
+    tasks.resize( 0 );
+    workerReady.resize( 0 );
+    renderReady.resize( 0 );
+    totalMillis = 0;
+};
+
+
+/**
+ * Returns the number of processors that the computer has
+ */
+int TaskGraph::getNumProcessors() {
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+
+    return info.dwNumberOfProcessors > 0 ? ( int ) info.dwNumberOfProcessors : 1;
+};
+
+
+/**
+ * run() runs every task, on "numThreads" worker threads as well as the
+ * calling thread, and returns once they have all finished. If
+ * numThreads is 0, every task is run on the calling thread, one after
+ * the other.
+ */
+void TaskGraph::run( int numThreads ) {
+    start( numThreads );
+
+    // Run the render tasks as they become ready. The event is set whenever a
+    //  task finishes, so nothing is missed between running the ready tasks
+    //  and waiting.
+    while ( !runRenderTasks( INFINITE ) ) {
+        wait();
+    }
+};
+
+
+/**
+ * start() starts the workers on the tasks that don't depend on anything, and
+ * returns straight away. The render tasks are run by calling runRenderTasks()
+ * until it returns true.
+ */
+void TaskGraph::start( int numThreads ) {
+    Timer timer;
+    runStart = timer.getTimeMillis();
+
+    // Workers that were kept from the last run are used again, unless a
+    //  different number of them is wanted
+    if ( threads.size() != ( unsigned int ) numThreads ) {
+        stopWorkers();
+    }
+
+    numFinished = 0;
+    stopping = false;
+    workerReady.resize( 0 );
+    renderReady.resize( 0 );
+
+    // Take away any counts that a cancelled run left in the semaphore
+    while ( WaitForSingleObject( workerSemaphore, 0 ) == WAIT_OBJECT_0 ) {
+    }
+
+    running = true;
+
+    // Start the workers. They wait until there is a task for them.
+    for ( int i = threads.size(); i < numThreads; ++i ) {
+        unsigned int threadId;
+        HANDLE thread = ( HANDLE ) _beginthreadex( NULL, 0, workerMain, this, 0, &threadId );
+
+        if ( thread != NULL ) {
+            threads.push_back( thread );
+        }
+    }
+
+    // If there aren't any workers, everything is run on this thread
+    serial = threads.empty();
+
+    // Start with the tasks that don't depend on anything
+    EnterCriticalSection( &lock );
+    for ( unsigned int i = 0; i < tasks.size(); ++i ) {
+        tasks[ i ].numWaiting = tasks[ i ].numDependencies;
+
+        if ( tasks[ i ].numWaiting == 0 ) {
+            makeReady( i );
+        }
+    }
+    LeaveCriticalSection( &lock );
+};
+
+/**
+ * runRenderTasks() runs the render tasks that are ready on the calling
+ * thread, until there are none left or maxMillis have gone by. A task that
+ * has been started is always finished, so this can take longer than
+ * maxMillis. Returns true once every task in the graph has finished.
+ */
+bool TaskGraph::runRenderTasks( unsigned int maxMillis ) {
+    Timer timer;
+    unsigned int callStart = timer.getTimeMillis();
+
+    for ( ;; ) {
+        int taskNum = -1;
+        bool finished;
+
+        EnterCriticalSection( &lock );
+        finished = numFinished == ( int ) tasks.size();
+        if ( !finished && !renderReady.empty() ) {
+            taskNum = renderReady.front();
+            renderReady.erase( renderReady.begin() );
+        }
+        LeaveCriticalSection( &lock );
+
+        if ( finished ) {
+            if ( running ) {
+                if ( !keepWorkers ) {
+                    stopWorkers();
+                }
+                running = false;
+                totalMillis = timer.getTimeMillis() - runStart;
+            }
+            return true;
+        }
+
+        if ( taskNum < 0 ) {
+            return false;
+        }
+
+        runTask( taskNum );
+
+        if ( maxMillis != INFINITE && timer.getTimeMillis() - callStart >= maxMillis ) {
+            return false;
+        }
+    }
+};
+
+/**
+ * wait() waits until a task finishes, or a render task becomes ready
+ */
+void TaskGraph::wait() {
+    WaitForSingleObject( renderEvent, INFINITE );
+};
+
+/**
+ * cancel() stops the graph, and returns once the workers have stopped. The
+ * tasks that are running are finished, but no other tasks are started.
+ */
+void TaskGraph::cancel() {
+    stopWorkers();
+    running = false;
+};
+
+/**
+ * Returns true if cancel() has been called. A long task can check this to
+ * stop early.
+ */
+bool TaskGraph::isCancelled() {
+    return stopping;
+};
+
+
+/**
+ * Tells the workers to stop, and waits for them
+ */
+void TaskGraph::stopWorkers() {
+    EnterCriticalSection( &lock );
+    stopping = true;
+    LeaveCriticalSection( &lock );
+
+    if ( !threads.empty() ) {
+        ReleaseSemaphore( workerSemaphore, threads.size(), NULL );
+    }
+
+    for ( unsigned int i = 0; i < threads.size(); ++i ) {
+        WaitForSingleObject( threads[ i ], INFINITE );
+        CloseHandle( threads[ i ] );
+    }
+
+    threads.resize( 0 );
+};
+
+
+/**
+ * The function that each worker thread starts in
+ */
+unsigned int __stdcall TaskGraph::workerMain( void *graph ) {
+    ( ( TaskGraph * ) graph )->workerLoop();
+    return 0;
+};
+
+/**
+ * Runs tasks from the worker queue until the graph is finished
+ */
+void TaskGraph::workerLoop() {
+    for ( ;; ) {
+        WaitForSingleObject( workerSemaphore, INFINITE );
+
+        EnterCriticalSection( &lock );
+        if ( stopping ) {
+            LeaveCriticalSection( &lock );
+            return;
+        }
+
+        int taskNum = workerReady.front();
+        workerReady.erase( workerReady.begin() );
+        LeaveCriticalSection( &lock );
+
+        runTask( taskNum );
+    }
+};
+
+/**
+ * Calls a task's function and times it, then starts the tasks that were
+ * waiting for it
+ */
+void TaskGraph::runTask( int taskNum ) {
+    Timer timer;
+
+    unsigned int start = timer.getTimeMillis();
+    tasks[ taskNum ].function( tasks[ taskNum ].data );
+    unsigned int end = timer.getTimeMillis();
+
+    EnterCriticalSection( &lock );
+
+    tasks[ taskNum ].startMillis = start - runStart;
+    tasks[ taskNum ].millis = end - start;
+
+    vector< int > &dependents = tasks[ taskNum ].dependents;
+    for ( unsigned int i = 0; i < dependents.size(); ++i ) {
+        if ( --tasks[ dependents[ i ] ].numWaiting == 0 ) {
+            makeReady( dependents[ i ] );
+        }
+    }
+
+    ++numFinished;
+
+    LeaveCriticalSection( &lock );
+
+    // Wake up the calling thread, so that it can see if everything is done
+    SetEvent( renderEvent );
+};
+
+/**
+ * Puts task #taskNum into the queue of the threads that can run it. The lock
+ * must be held.
+ */
+void TaskGraph::makeReady( int taskNum ) {
+    if ( serial || tasks[ taskNum ].onRenderThread ) {
+        renderReady.push_back( taskNum );
+        SetEvent( renderEvent );
+    } else {
+        workerReady.push_back( taskNum );
+        ReleaseSemaphore( workerSemaphore, 1, NULL );
+    }
+};
+
+//---------------------------------------------------------------------------
+#pragma package(smart_init)
@@ -0,0 +1,241 @@
+//---------------------------------------------------------------------------
+
+#ifndef TaskGraphH
+#define TaskGraphH
+
+#include <windows.h>
+#include <vector.h>
+
+using namespace std;
+
+/**
+ * An explanation on the task graph:
+ *      A job like loading a map is made of steps that mostly don't need each
+ *  other. A TaskGraph holds each step as a task, along with the tasks that it
+ *  depends on. run() starts every task as soon as all of the tasks that it
+ *  depends on have finished, so tasks that don't depend on each other run at
+ *  the same time, on a pool of worker threads.
+ *
+ *      Direct3D can only be used from the thread that made the device, so a
+ *  task can be marked as a render task. Render tasks are only run on the
+ *  thread that called run(), which runs each of them as soon as it is ready,
+ *  alongside the workers, and waits for the workers in between. A task that
+ *  the calling thread would do anyway can be made a render task, so that it
+ *  is done there instead of by a worker (MD2Animator does this with its
+ *  first slice). With no workers, the calling thread runs every task.
+ *  A graph that is run over and over can keep its workers between runs.
+ *
+ *      The time that each task took is kept, so that the slow steps of a job
+ *  can be found.
+ */
+class TaskGraph {
+    public:
+
+        /**
+         * A task is a function that is called with the data that it was added
+         * with
+         */
+        typedef void ( *TaskFunction )( void *data );
+
+        /**
+         * Constructor makes an empty graph
+         */
+        TaskGraph();
+
+        /**
+         * Destructor stops the workers, and makes sure that the threads'
+         * objects have been closed
+         */
+        ~TaskGraph();
+
+        /**
+         * addTask() adds a task called "name" to the graph, which calls
+         * function( data ). If onRenderThread is true, the task is only run on
+         * the thread that calls run(). Returns the task's number.
+         */
+        int addTask( const char *name, TaskFunction function, void *data, bool onRenderThread );
+
+        /**
+         * addDependency() makes task #taskNum wait until task #dependsOn has
+         * finished before it starts. Tasks must only depend on tasks that
+         * were added before them, so that the graph can't have a loop.
+         */
+        void addDependency( int taskNum, int dependsOn );
+
+        /**
+         * run() runs every task, on "numThreads" worker threads as well as the
+         * calling thread, and returns once they have all finished. If
+         * numThreads is 0, every task is run on the calling thread, one after
+         * the other.
+         */
+        void run( int numThreads );
+
+        /**
+         * start() starts the workers on the tasks that don't depend on
+         * anything, and returns straight away. The render tasks are run by
+         * calling runRenderTasks() until it returns true.
+         */
+        void start( int numThreads );
+
+        /**
+         * runRenderTasks() runs the render tasks that are ready on the calling
+         * thread, until there are none left or maxMillis have gone by. A task
+         * that has been started is always finished, so this can take longer
+         * than maxMillis. Returns true once every task in the graph has
+         * finished.
+         */
+        bool runRenderTasks( unsigned int maxMillis );
+
+        /**
+         * wait() waits until a task finishes, or a render task becomes ready
+         */
+        void wait();
+
+        /**
+         * cancel() stops the graph, and returns once the workers have stopped.
+         * The tasks that are running are finished, but no other tasks are
+         * started.
+         */
+        void cancel();
+
+        /**
+         * Returns true if cancel() has been called. A long task can check this
+         * to stop early.
+         */
+        bool isCancelled();
+
+        /**
+         * clear() takes every task out of the graph
+         */
+        void clear();
+
+        /**
+         * setKeepWorkers() chooses whether the worker threads are kept,
+         * waiting, after run() has finished. A graph that is run every frame
+         * keeps them, so that threads aren't made and closed each time.
+         * They are still stopped by cancel() and by the destructor.
+         */
+        void setKeepWorkers( bool keep ) {
+            keepWorkers = keep;
+        };
+
+        /**
+         * Returns the number of tasks in the graph
+         */
+        int getNumTasks() {
+            return tasks.size();
+        };
+
+        /**
+         * Returns the name of task #taskNum
+         */
+        const char *getTaskName( int taskNum ) {
+            return tasks[ taskNum ].name;
+        };
+
+        /**
+         * Return when task #taskNum started, in milliseconds after run() was
+         * called, and how long it took
+         */
+        unsigned int getTaskStart( int taskNum ) {
+            return tasks[ taskNum ].startMillis;
+        };
+        unsigned int getTaskMillis( int taskNum ) {
+            return tasks[ taskNum ].millis;
+        };
+
+        /**
+         * Returns how long the last call to run() took, in milliseconds
+         */
+        unsigned int getTotalMillis() {
+            return totalMillis;
+        };
+
+        /**
+         * Returns the number of processors that the computer has
+         */
+        static int getNumProcessors();
+
+    private:
+
+        /**
+         * A task, with the tasks that are waiting for it to finish
+         */
+        typedef struct {
+            const char *name;
+            TaskFunction function;
+            void *data;
+            bool onRenderThread;
+
+            // The tasks that depend on this task, and the number of tasks
+            //  that this task is still waiting for
+            vector< int > dependents;
+            int numDependencies;
+            int numWaiting;
+
+            // When the task started, after run() was called, and how long it took
+            unsigned int startMillis;
+            unsigned int millis;
+        } Task;
+
+        // The function that each worker thread starts in
+        static unsigned int __stdcall workerMain( void *graph );
+
+        // Runs tasks from the worker queue until the graph is finished
+        void workerLoop();
+
+        // Calls a task's function and times it, then starts the tasks that
+        //  were waiting for it
+        void runTask( int taskNum );
+
+        // Puts task #taskNum into the queue of the threads that can run it.
+        //  The lock must be held.
+        void makeReady( int taskNum );
+
+        // Tells the workers to stop, and waits for them
+        void stopWorkers();
+
+        // The tasks
+        vector< Task > tasks;
+
+        // The tasks that can be started, for the workers and for the thread
+        //  that called run()
+        vector< int > workerReady;
+        vector< int > renderReady;
+
+        // The number of tasks that have finished, and whether the workers
+        //  should stop
+        int numFinished;
+        bool stopping;
+
+        // Whether every task is to be run on the calling thread
+        bool serial;
+
+        // Whether the graph has been started, and hasn't finished or been
+        //  cancelled yet
+        bool running;
+
+        // Whether the workers are kept after the graph has finished
+        bool keepWorkers;
+
+        // The worker threads
+        vector< HANDLE > threads;
+
+        // Guards the queues and the counts
+        CRITICAL_SECTION lock;
+
+        // Counts the tasks in workerReady, plus one for each worker when they
+        //  are told to stop
+        HANDLE workerSemaphore;
+
+        // Set whenever a task finishes, or a render task becomes ready
+        HANDLE renderEvent;
+
+        // When run() was called, and how long it took
+        unsigned int runStart;
+        unsigned int totalMillis;
+};
+
+
+//---------------------------------------------------------------------------
+#endif
@@ -18,6 +18,7 @@ int SCREEN_HEIGHT = 0;
 
 
 #include "BaseGame.h"
+#include "Headless.h"
 
 
 //---------------------------------------------------------------------------
@@ -51,6 +52,12 @@ BaseGame *game;
 WINAPI WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow )
 {
 
+    // "-headless <test>" runs a test or benchmark without making a window
+    //  (see Headless.h)
+    if ( isHeadless( lpCmdLine ) ) {
+        return runHeadless( lpCmdLine );
+    }
+
     // Load in the Screen's width and height from the config file
     FILE *configFile = fopen( "config.txt", "r" );
     char buf[ 10 ];
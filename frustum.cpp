@@ -1,5 +1,6 @@
 #include <math>
 #include "frustum.h"
+#include "BoxCull.h"
 
 /**
  * Sets the length of the line segment from (0, 0, 0) to (a, b, c) to 1.0
@@ -17,33 +18,14 @@ Plane Frustum::extractPlane( float a, float b, float c, float d )
 	return p;
 }
 
-bool Frustum::leafInFrustum( BSP::Leaf *leaf )
+/**
+ * boxesInFrustum() tests "count" boxes, starting at box #first of "boxes",
+ * against the viewing frustum. visible[ i ] is set to 1 if box #( first + i )
+ * is at least partly inside of the frustum, or 0 if it isn't.
+ */
+void Frustum::boxesInFrustum( BoxArray *boxes, int first, int count, unsigned char *visible )
 {
-    // Get the middle point of the bsp leaf's bounding box
-    Point3f middle = getPoint( ( leaf->bbox_min.y + leaf->bbox_max.y ) / 2.0 * BSP::MAP_SCALE,
-                               ( leaf->bbox_min.z + leaf->bbox_max.z ) / 2.0 * BSP::MAP_SCALE,
-                               -( leaf->bbox_min.x + leaf->bbox_max.x ) / 2.0 * BSP::MAP_SCALE );
-
-
-    // Find the distance from the middle point to the corner of the leaf's bounding box.
-    float distToCorner = sqrt( ( leaf->bbox_max.x - leaf->bbox_min.x ) * ( leaf->bbox_max.x - leaf->bbox_min.x ) +
-                               ( leaf->bbox_max.y - leaf->bbox_min.y ) * ( leaf->bbox_max.y - leaf->bbox_min.y ) +
-                               ( leaf->bbox_max.z - leaf->bbox_min.z ) * ( leaf->bbox_max.z - leaf->bbox_min.z ) ) / 2.0 * BSP::MAP_SCALE;
-
-    // If the leaf counts as being outside of one of the planes defining
-    // the viewing frustum, the leaf is not visible. Otherwise, the leaf
-    // is visible.
-	for ( int p = 0; p < 6; p++ )
-    {
-		if ( ( m_planes[ p ].a * middle.x +
-               m_planes[ p ].b * middle.y +
-               m_planes[ p ].c * middle.z +
-               m_planes[ p ].d + distToCorner) <= 0 )
-        {
-			return false;
-        }
-    }
-	return true;
+    cullBoxes( m_planes, boxes, first, count, visible );
 }
 
 
@@ -52,15 +34,26 @@ void Frustum::updateFrustum( LPDIRECT3DDEVICE9 device )
 
     // Direct3D's view and projection matrices
     D3DXMATRIX view, proj;
-	D3DXMATRIX mvp;
 
     // Get the view and projection matrices
     device->GetTransform( D3DTS_VIEW, &view );
     device->GetTransform( D3DTS_PROJECTION, &proj );
 
+    updateFrustum( &view, &proj );
+}
+
+
+/**
+ * updateFrustum() can also be given the view and projection matrices straight
+ * away, for when there is no Direct3D device
+ */
+void Frustum::updateFrustum( const D3DXMATRIX *view, const D3DXMATRIX *proj )
+{
+	D3DXMATRIX mvp;
+
     // multiply the view and projection matrices together to extract the planes
     // of the viewing frustum.
-    mvp = view * proj;
+    mvp = ( *view ) * ( *proj );
 
 
 	/* Extract the RIGHT plane */
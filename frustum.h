@@ -22,6 +22,8 @@ struct Plane {
 	float a, b, c, d;
 };
 
+class BoxArray;
+
 
 /**
  * The Frustum object, associated with a camera object, provides an easy way to
@@ -39,11 +41,26 @@ class Frustum {
         void updateFrustum( LPDIRECT3DDEVICE9 device );
 
         /**
-         * leafInFrustum() tests to see if parameter leaf is visible with the
-         * viewing frustum. If it is, this method returns true. If it is not,
-         * then this method returns false.
+         * updateFrustum() can also be given the view and projection matrices
+         * straight away, for when there is no Direct3D device
+         */
+        void updateFrustum( const D3DXMATRIX *view, const D3DXMATRIX *proj );
+
+        /**
+         * boxesInFrustum() tests "count" boxes, starting at box #first of
+         * "boxes", against the viewing frustum. visible[ i ] is set to 1 if
+         * box #( first + i ) is at least partly inside of the frustum, or 0 if
+         * it isn't. See BoxCull.h.
          */
-        bool leafInFrustum( BSP::Leaf *leaf );
+        void boxesInFrustum( BoxArray *boxes, int first, int count, unsigned char *visible );
+
+        /**
+         * Returns the six planes of the viewing frustum. The inside of the
+         * frustum is in front of each plane.
+         */
+        const Plane *getPlanes() {
+            return m_planes;
+        };
 
     private:
 
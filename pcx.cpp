@@ -6,6 +6,8 @@
  * image data in parameter pixels, recording the width and height to the addresses
  * width and height. The rest of the image loading is handled in Texture.h and
  * Texture.cpp.
+ * The file is found through the FileSystem, by its name in the game directory
+ * (e.g. "pics/colormap.pcx").
  */
 
 //
@@ -15,8 +17,10 @@
 //
 
 
-#include	<fstream>
+#include	<string.h>
 #include	"pcx.h"
+#include	"PaletteExpand.h"
+#include	"FileSystem.h"
 
 
 
@@ -42,41 +46,37 @@
 
 int LoadFilePCX( const char *filename, unsigned char **pixels, int *width, int *height, bool flipvert )
 {
-	std::ifstream		file;			// fichier
+	VirtualFile			file;			// fichier
+	PCXHEADER			pcxHeader;		// copie du header PCX
 	PCXHEADER			*header;		// header PCX
-	RGBTriple			*palette;		// palette
+	unsigned int		palette[ 256 ];	// palette (couleurs 32 bits)
 	unsigned char		*data;			// donnes images RLE
 	unsigned char		*ptr;			// pointeur donnes pixels
 	unsigned char		c;				// variable temporaire
-	char				*buffer;		// buffer stockant l'intgralit du fichier
+	char				*buffer;		// l'intgralit du fichier
 	int					idx = 0;		// variable temporaire
 	int					numRepeat;		// variable temporaire
-	int					i, j;			// variable temporaire
+	int					j;				// variable temporaire
 
 
 
 	/////////////////////////////////////////////////////
-	// lit l'intgralit du fichier dans le buffer
+	// The file is found through the FileSystem, and read straight out of its
+	// mapping (which is read-only) instead of being copied into a buffer
 
-	file.open( filename, std::ios::in | std::ios::binary );
-
-	if( file.fail() )
+	if( !file.open( filename ) || file.getSize() < sizeof( PCXHEADER ) + 769 )
 		return 0;
 
-	file.seekg( 0, std::ios::end );
-	long flen = file.tellg();
-	file.seekg( 0, std::ios::beg );
-
-	buffer = new char[ flen + 1 ];
-	file.read( buffer, flen );
+	long flen = file.getSize();
+	buffer = (char *)file.getData();
 	char *pBuff = buffer;
 
-	file.close();
-
 	/////////////////////////////////////////////////////
 
-	// on lit le header
-	header = (PCXHEADER *)pBuff;
+	// on lit le header. The width and height are changed below, so the
+	// header is copied out of the file first.
+	memcpy( &pcxHeader, pBuff, sizeof( PCXHEADER ) );
+	header = &pcxHeader;
 
 	// vrification de l'authenticit du PCX
 	if( (header->manufacturer	!= 10)	||
@@ -84,7 +84,6 @@ int LoadFilePCX( const char *filename, unsigned char **pixels, int *width, int *
 		(header->encoding		!= 1)	||
 		(header->bitsPerPixel	!= 8) )
 	{
-		delete [] buffer;
 		return 0;
 	}
 
@@ -92,6 +91,9 @@ int LoadFilePCX( const char *filename, unsigned char **pixels, int *width, int *
 	header->width	= header->width	 - header->x + 1;
 	header->height	= header->height - header->y + 1;
 
+	if( (header->width == 0) || (header->height == 0) )
+		return 0;
+
 
 	if( width )
 		*width = header->width;
@@ -101,7 +103,6 @@ int LoadFilePCX( const char *filename, unsigned char **pixels, int *width, int *
 
 	if( !pixels )
 	{
-		delete [] buffer;
 		return (-1);
 	}
 
@@ -110,16 +111,35 @@ int LoadFilePCX( const char *filename, unsigned char **pixels, int *width, int *
 	data = new unsigned char[ header->width * header->height * 3 ];
 	pBuff = (char *)&buffer[ 128 ];
 
-	// dcode l'image compresse (RLE)
+	// dcode l'image compresse (RLE). Les donnes s'arrtent o la
+	// palette commence ; une image qui n'est pas complte avant est refuse.
+	char *end = &buffer[ flen - 769 ];
+
 	while( idx < (header->width * header->height) )
 	{
+		if( pBuff >= end )
+		{
+			delete [] data;
+			return 0;
+		}
+
 		if( (c = *(pBuff++)) > 0xbf )
 		{
+			if( pBuff >= end )
+			{
+				delete [] data;
+				return 0;
+			}
+
 			numRepeat = 0x3f & c;
 			c = *(pBuff++);
 
-			for( i = 0; i < numRepeat; i++ )
-				data[ idx++ ] = c;
+			// une rptition ne dpasse jamais la fin de l'image
+			if( numRepeat > (header->width * header->height) - idx )
+				numRepeat = (header->width * header->height) - idx;
+
+			memset( &data[ idx ], c, numRepeat );
+			idx += numRepeat;
 		}
 		else
 			data[ idx++ ] = c;
@@ -131,39 +151,30 @@ int LoadFilePCX( const char *filename, unsigned char **pixels, int *width, int *
 	// on vrifie la palette ; le premier char doit tre gal  12
 	if( *(pBuff++) != 12 )
 	{
-		delete [] buffer;
 		delete [] data;
 		return 0;
 	}
 
-	// on lit la palette
-	palette = (RGBTriple *)pBuff;
+	// on lit la palette, et on la convertit en couleurs 32 bits (bgra)
+	packPaletteRGB( (unsigned char *)pBuff, palette );
 
 	// allocatation mmoire pour les donnes pixels 32 bits
 	*pixels = new unsigned char[ header->width * header->height * 4 ];
-	ptr = &(*pixels)[0];
 
-	// conversion pixel index couleur bgr en pixel rgba 32 bits
+	// conversion pixel index couleur en pixel rgba 32 bits, une ligne  la fois
 	for( j = header->height - 1; j >= 0; j-- )
 	{
 		if( flipvert )
 			ptr = &(*pixels)[ j * header->width * 4 ];
+		else
+			ptr = &(*pixels)[ (header->height - 1 - j) * header->width * 4 ];
 
-		for( i = 0; i < header->width; i++, ptr += 4 )
-		{
-			int color = data[ j * header->width + i ];
-
-			ptr[ 0 ] = ( unsigned char ) palette[ color ].rgbBlue;	// b->r
-			ptr[ 1 ] = ( unsigned char ) palette[ color ].rgbGreen;	// g->g
-			ptr[ 2 ] = ( unsigned char ) palette[ color ].rgbRed; 	// r->b
-			ptr[ 3 ] = ( unsigned char ) 255;					    // alpha
-		}
+		expandPalette( &data[ j * header->width ], (unsigned int *)ptr, header->width, palette );
 	}
 
 
 	// dsallocation mmoire tampon
 	delete [] data;
-	delete [] buffer;
     
 	// succs
 	return 1;
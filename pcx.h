@@ -6,6 +6,8 @@
  * image data in parameter pixels, recording the width and height to the addresses
  * width and height. The rest of the image loading is handled in Texture.h and
  * Texture.cpp.
+ * The file is found through the FileSystem, by its name in the game directory
+ * (e.g. "pics/colormap.pcx").
  */
 
 //
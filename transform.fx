@@ -17,6 +17,20 @@ float camPosZ;
 
 float vsTest;
 
+// The box that compact vertex positions are stored in (see CompactVertex.h)
+float compactOriginX;
+float compactOriginY;
+float compactOriginZ;
+float compactExtentX;
+float compactExtentY;
+float compactExtentZ;
+
+// The positions and normals of every vertex in every frame of an MD2 model,
+// and the size of that texture (see MD2Renderer.h)
+texture md2Frames;
+float md2FramesWidth;
+float md2FramesHeight;
+
 // Integer to control whether or not to use lightmaps.
 // This may be used to temporarily turn off light maps to render parts of the
 // map that do not use lightmaps (for example, the water in the map)
@@ -51,6 +65,17 @@ sampler2D screenSampler = sampler_state
     AddressV = wrap;
 };
 
+// The frames are read by the vertex shader, one texel at a time
+sampler2D md2FrameSampler = sampler_state
+{
+    Texture = ( md2Frames );
+    MIPFILTER = NONE;
+    MAGFILTER = POINT;
+    MINFILTER = POINT;
+    AddressU = clamp;
+    AddressV = clamp;
+};
+
 sampler2D normalMapSampler = sampler_state
 {
     Texture = ( normalMap );
@@ -228,6 +253,123 @@ vsOut vs( in vsIn In ) {
 };
 
 
+// A compact map vertex. Direct3D has already turned the position into -1 to 1,
+// and the normal's codes into 0 to 1.
+struct vsCompactIn {
+    float4 pos : POSITION;
+    float4 normal : NORMAL;
+    float2 baseTexCoord : TEXCOORD0;
+    float2 lightMapCoord : TEXCOORD1;
+};
+
+/**
+ * Turns an octahedral normal back into a direction. Codes 0 to 254 stand for
+ * -1 to 1, the same as decodeOctahedral() in CompactVertex.cpp.
+ */
+float3 decodeOctahedral( float2 code ) {
+    float2 uv = code * ( 255.0 / 127.0 ) - 1.0;
+    float3 n = float3( uv.x, uv.y, 1.0 - abs( uv.x ) - abs( uv.y ) );
+
+    // Points on the lower half of the octahedron were folded out over the
+    //  corners of the square
+    if ( n.z < 0.0 ) {
+        n.xy = ( 1.0 - abs( n.yx ) ) * ( n.xy >= 0.0 ? 1.0 : -1.0 );
+    }
+
+    return normalize( n );
+};
+
+/**
+ * Expands a compact vertex into a full vertex, and then transforms it the same
+ * way as vs()
+ */
+vsOut vsCompact( in vsCompactIn In ) {
+    vsIn full;
+
+    full.pos = float4( compactOriginX + In.pos.x * compactExtentX,
+                       compactOriginY + In.pos.y * compactExtentY,
+                       compactOriginZ + In.pos.z * compactExtentZ, 1.0 );
+    full.normal = float4( decodeOctahedral( In.normal.xy ), 0.0 );
+    full.baseTexCoord = In.baseTexCoord;
+    full.lightMapCoord = In.lightMapCoord;
+
+    return vs( full );
+};
+
+
+// A triangle corner of an instanced MD2 model, and the instance that it is
+// being drawn for. Each instance has its world matrix, and the two frames
+// that it is blending between, and how far between them it is.
+struct vsMD2In {
+    float3 corner : TEXCOORD0;      // vertex number, u, v
+    float4 world0 : TEXCOORD1;
+    float4 world1 : TEXCOORD2;
+    float4 world2 : TEXCOORD3;
+    float4 world3 : TEXCOORD4;
+    float4 frames : TEXCOORD5;      // from frame, to frame, blend
+};
+
+struct vsMD2Out {
+    float4 pos : POSITION;
+    float2 baseTexCoord : TEXCOORD0;
+    float3 normal : TEXCOORD1;
+    float3 viewPos : TEXCOORD2;
+};
+
+/**
+ * Reads texel #texel of frame #frame from the frame texture
+ */
+float4 md2Fetch( float texel, float frame ) {
+    return tex2Dlod( md2FrameSampler, float4( ( texel + 0.5 ) / md2FramesWidth, ( frame + 0.5 ) / md2FramesHeight, 0.0, 0.0 ) );
+};
+
+/**
+ * Blends the corner's vertex between the instance's two frames, the same
+ * way as lerpKeyFrames() in MD2Lerp.cpp, and then moves it into the world
+ * with the instance's matrix
+ */
+vsMD2Out vsMD2Instanced( in vsMD2In In ) {
+    vsMD2Out Out;
+
+    float4 fromPos = md2Fetch( In.corner.x * 2.0, In.frames.x );
+    float4 toPos = md2Fetch( In.corner.x * 2.0, In.frames.y );
+    float4 fromNormal = md2Fetch( In.corner.x * 2.0 + 1.0, In.frames.x );
+    float4 toNormal = md2Fetch( In.corner.x * 2.0 + 1.0, In.frames.y );
+
+    float4 pos = float4( lerp( fromPos.xyz, toPos.xyz, In.frames.z ), 1.0 );
+    float3 normal = lerp( fromNormal.xyz, toNormal.xyz, In.frames.z );
+
+    float4x4 instanceWorld = float4x4( In.world0, In.world1, In.world2, In.world3 );
+    float4x4 worldView = mul( instanceWorld, view );
+
+    float4 viewPos = mul( pos, worldView );
+
+    Out.pos = mul( viewPos, proj );
+    Out.baseTexCoord = In.corner.yz;
+    Out.normal = mul( normal, ( float3x3 ) worldView );
+    Out.viewPos = viewPos.xyz;
+
+    return Out;
+};
+
+// vsMD2Out, without the position that the pixel shader can't read
+struct psMD2In {
+    float2 baseTexCoord : TEXCOORD0;
+    float3 normal : TEXCOORD1;
+    float3 viewPos : TEXCOORD2;
+};
+
+/**
+ * The instanced models are lit by a light at the camera, since one draw call
+ * can't use the lights that are near to each instance
+ */
+float4 psMD2( in psMD2In In ) : COLOR {
+    float light = 0.35 + 0.65 * saturate( dot( normalize( In.normal ), -normalize( In.viewPos ) ) );
+
+    return tex2D( modelTextureSampler, In.baseTexCoord ) * light;
+};
+
+
 struct bbIn {
     float2 tex : TEXCOORD0;
 };
@@ -281,6 +423,31 @@ technique MapShader
     }
 }
 
+/**
+ * "MapShaderCompact" is the same as "MapShader", for a map whose vertex buffer
+ * holds compact vertices
+ */
+technique MapShaderCompact
+{
+    pass p0
+    {
+        vertexshader = compile vs_3_0 vsCompact();
+        pixelshader = compile ps_3_0 ps();
+    }
+}
+
+/**
+ * "MD2Instanced" draws every instance of an MD2 model with one draw call
+ */
+technique MD2Instanced
+{
+    pass p0
+    {
+        vertexshader = compile vs_3_0 vsMD2Instanced();
+        pixelshader = compile ps_3_0 psMD2();
+    }
+}
+
 technique BBShader
 {
     pass p0